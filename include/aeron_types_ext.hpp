@@ -0,0 +1,273 @@
+#pragma once
+#include "aeron_types.hpp"
+
+// Message types that are local to got-infra and not (yet) part of got-base/aeron_types.hpp.
+// msgType values start at 200 so they do not collide with the ones defined in got-base.
+
+// ---------------------------------------------------------------------------------
+// Snapshot requests on AERON_SS
+// ---------------------------------------------------------------------------------
+#define DEPTH_SNAPSHOT_REQUEST_MULTI        200
+#define MAX_SNAPSHOT_REQUEST_INSTRUMENTS    64
+
+// Asks for depth snapshots for several instruments in one go, msgLength only covers
+// the instrument_ids actually used (num_instruments of them)
+struct DepthSnapshotRequestMulti {
+    MessageHeader   msg_header;
+    uint16_t        num_instruments;
+    uint32_t        instrument_ids[MAX_SNAPSHOT_REQUEST_INSTRUMENTS];
+};
+
+// ---------------------------------------------------------------------------------
+// Conflated market data (svc_md_conflator)
+// ---------------------------------------------------------------------------------
+// Stream the conflated market data is published on, next to AERON_IO/AERON_SS/AERON_OE
+#define AERON_CF                            1010
+
+#define CONFLATED_INTERVAL                  201
+
+// Flags on ConflatedInterval
+#define CONFLATED_HAS_TOB                   1
+#define CONFLATED_HAS_PL                    2
+#define CONFLATED_HAS_TRADES                4
+#define CONFLATED_BOOK_RESET                8
+
+// Sent in front of the conflated messages for an instrument for one interval. The messages
+// that follow (num_messages of them) are, in order: InstrumentClearBook (if BOOK_RESET),
+// PLUpdates with the net level changes, the latest ToBUpdate and one aggregated Trade per side.
+//  - stream_seq increments by one for every ConflatedInterval on the stream, a gap means
+//    the consumer lost data and should resnapshot
+//  - interval_seq increments by one for every interval published for this instrument
+//  - interval_number is interval_end / interval length, so a consumer can tell how many
+//    intervals had no change for the instrument
+struct ConflatedInterval {
+    MessageHeader   msg_header;
+    uint64_t        stream_seq;
+    uint64_t        interval_seq;
+    uint64_t        interval_number;
+    uint64_t        interval_start;
+    uint64_t        interval_end;
+    uint64_t        start_seq_number;
+    uint64_t        end_seq_number;
+    uint32_t        instrument_id;
+    uint8_t         exchange_id;
+    uint8_t         flags;
+    uint16_t        num_messages;
+    uint32_t        num_source_messages;
+};
+
+// ---------------------------------------------------------------------------------
+// Runtime subscription control for the market data services
+// ---------------------------------------------------------------------------------
+// Stream the control messages are sent on
+#define AERON_MC                            1011
+
+#define SUBSCRIPTION_CONTROL                202
+#define MAX_SUBSCRIPTION_CONTROL_INSTRUMENTS 64
+
+// Actions on SubscriptionControl
+#define SUBSCRIPTION_ADD                    1
+#define SUBSCRIPTION_DROP                   2
+
+// Adds or drops streams for a set of instruments without restarting the service.
+//  - stream_mask has a bit per CaptureStreamKind (1 << CAPTURE_STREAM_DEPTH etc), 0 means all
+//  - every service applies it to the instruments it is responsible for (exchange and -r range)
+//    and ignores the rest, so the same message can go to all of them
+//  - msgLength only covers the instrument_ids actually used (num_instruments of them)
+struct SubscriptionControl {
+    MessageHeader   msg_header;
+    uint8_t         action;
+    uint8_t         reserved;
+    uint16_t        stream_mask;
+    uint16_t        num_instruments;
+    uint32_t        instrument_ids[MAX_SUBSCRIPTION_CONTROL_INSTRUMENTS];
+};
+
+// ---------------------------------------------------------------------------------
+// Market data sharding (svc_md_coordinator and svc_md_binance -S), all on AERON_MC
+// ---------------------------------------------------------------------------------
+#define SHARD_REGISTER                      203
+#define SHARD_STATUS                        204
+#define SHARD_ASSIGNMENT                    205
+#define SHARD_HANDOVER                      206
+#define MAX_SHARD_STATUS_INSTRUMENTS        128
+#define MAX_SHARD_ASSIGNMENT_INSTRUMENTS    64
+
+// Per instrument state a shard reports
+#define SHARD_INSTRUMENT_STANDBY            1   // subscribed, book not in sync yet, not publishing
+#define SHARD_INSTRUMENT_READY              2   // subscribed and in sync, not publishing
+#define SHARD_INSTRUMENT_ACTIVE             3   // publishing
+#define SHARD_INSTRUMENT_RELEASING          4   // handing over, no longer publishing
+
+// Actions on ShardAssignment
+#define SHARD_ASSIGN_STANDBY                1   // subscribe and sync up but do not publish yet
+#define SHARD_ASSIGN_ACTIVE                 2   // subscribe and publish straight away (no previous owner)
+#define SHARD_ASSIGN_RELEASE                3   // stop publishing, send ShardHandover to to_shard_id and drop
+#define SHARD_ASSIGN_DROP                   4   // drop without handing over (cancelled standby)
+
+// Sent by a shard when it starts
+struct ShardRegister {
+    MessageHeader   msg_header;
+    uint32_t        shard_id;
+    uint32_t        pid;
+    uint64_t        timestamp;
+};
+
+struct shard_instrument_status {
+    uint32_t        instrument_id;
+    uint8_t         state;
+    uint8_t         reserved[3];
+    float           message_rate;       // websocket messages per second over all its streams
+};
+
+// Sent by every shard once a second, split in num_parts messages when it has many instruments.
+// Doubles as the heartbeat - a shard that has not reported for a while is taken out.
+struct ShardStatus {
+    MessageHeader   msg_header;
+    uint32_t        shard_id;
+    uint16_t        num_instruments;
+    uint16_t        part;
+    uint16_t        num_parts;
+    uint16_t        reserved;
+    uint64_t        timestamp;
+    shard_instrument_status instruments[MAX_SHARD_STATUS_INSTRUMENTS];
+};
+
+// Coordinator to a shard, msgLength only covers the instrument_ids actually used
+struct ShardAssignment {
+    MessageHeader   msg_header;
+    uint32_t        shard_id;
+    uint32_t        to_shard_id;        // only for SHARD_ASSIGN_RELEASE
+    uint8_t         action;
+    uint8_t         reserved;
+    uint16_t        num_instruments;
+    uint32_t        instrument_ids[MAX_SHARD_ASSIGNMENT_INSTRUMENTS];
+};
+
+// Releasing shard to the shard taking over. The new owner only publishes depth updates
+// ending after last_end_seq_number and other messages after last_exchange_timestamp,
+// so consumers see neither a gap nor a duplicate in the depth stream.
+struct ShardHandover {
+    MessageHeader   msg_header;
+    uint32_t        instrument_id;
+    uint32_t        from_shard_id;
+    uint32_t        to_shard_id;
+    uint32_t        reserved;
+    uint64_t        last_end_seq_number;
+    uint64_t        last_exchange_timestamp;
+};
+
+// ---------------------------------------------------------------------------------
+// Consolidated top of book over venues (svc_md_consolidator), on AERON_IO
+// ---------------------------------------------------------------------------------
+#define CONSOLIDATED_TOB                    207
+
+// Flags on ConsolidatedToB
+#define CONSOLIDATED_CROSSED                1   // best bid on one venue is at or above the best ask on another
+
+// Best bid and offer for an asset pair over all venues listing it (spot and futures with the
+// same base and quote asset in RefDB). Sent whenever the best price, its quantity or the venue
+// holding it changes on either side.
+//  - quantities are the best venue's own, in its units (contracts on coin futures)
+//  - a side without any venue quoting it has price, qty and instrument_id 0
+//  - sequence_nr increments by one for every message for the pair
+struct ConsolidatedToB {
+    MessageHeader   msg_header;
+    uint64_t        receive_timestamp;      // of the venue update that caused the change
+    uint64_t        exchange_timestamp;
+    uint64_t        sending_timestamp;
+    uint64_t        sequence_nr;
+    uint32_t        base_asset_id;
+    uint32_t        quote_asset_id;
+    double          bid_price;
+    double          bid_qty;
+    double          ask_price;
+    double          ask_qty;
+    uint32_t        bid_instrument_id;
+    uint32_t        ask_instrument_id;
+    uint8_t         bid_exchange_id;
+    uint8_t         ask_exchange_id;
+    uint8_t         num_bid_venues;
+    uint8_t         num_ask_venues;
+    uint8_t         flags;
+};
+
+// ---------------------------------------------------------------------------------
+// Order book signals (svc_md_binance -G), SignalBlock on AERON_IO
+// ---------------------------------------------------------------------------------
+// signal_block_data_type of the blocks, num_of_signal_update_items SignalBlockItem follow
+#define SIGNAL_BLOCK_MICROSTRUCTURE         200
+
+// signal_id of the items, parameter says what the signal was computed over
+#define MS_SIGNAL_MICROPRICE                1   // touch prices weighted by the opposite touch quantity
+#define MS_SIGNAL_IMBALANCE                 2   // (bid qty - ask qty) / (bid qty + ask qty) over the top parameter levels
+#define MS_SIGNAL_DEPTH_WEIGHTED_MID        3   // mid of the volume weighted bid and ask prices over the top parameter levels
+#define MS_SIGNAL_BID_DEPTH_WITHIN          4   // bid quantity within parameter basis points of the touch
+#define MS_SIGNAL_ASK_DEPTH_WITHIN          5   // ask quantity within parameter basis points of the touch
+#define MS_SIGNAL_COUNT                     5
+
+struct SignalBlockItem {
+    double          value;
+    uint16_t        signal_id;
+    uint16_t        parameter;
+    uint32_t        reserved;
+};
+
+// ---------------------------------------------------------------------------------
+// Exchange rate limit state of the trade adapters, on AERON_IO
+// ---------------------------------------------------------------------------------
+#define RATE_LIMIT_STATUS                   208
+
+// limit_type on RateLimitStatus
+#define RATE_LIMIT_WEIGHT                   1   // request weight (X-MBX-USED-WEIGHT-*)
+#define RATE_LIMIT_ORDERS                   2   // order count (X-MBX-ORDER-COUNT-*)
+
+// level on RateLimitStatus
+#define RATE_LIMIT_LEVEL_NORMAL             0
+#define RATE_LIMIT_LEVEL_WARNING            1   // a budget is past its warning fraction, everything still goes out
+#define RATE_LIMIT_LEVEL_THROTTLED          2   // new orders are held back, reduce-only orders and cancels still go out
+#define RATE_LIMIT_LEVEL_BLOCKED            3   // exchange answered 429/418, nothing goes out until retry_after
+
+// Sent by a trade adapter whenever the level for an exchange changes. used/limit/interval_ns
+// are for the budget closest to its limit, num_held is how many times a request was held
+// back since the previous status (a held request counts again every time it is retried).
+struct RateLimitStatus {
+    MessageHeader   msg_header;
+    uint64_t        timestamp;
+    uint64_t        retry_after;            // epoch ns, only when BLOCKED
+    uint64_t        interval_ns;
+    uint32_t        used;
+    uint32_t        limit;
+    uint32_t        num_held;
+    uint8_t         exchange_id;
+    uint8_t         level;
+    uint8_t         limit_type;
+};
+
+// ---------------------------------------------------------------------------------
+// Tick to trade tracing, optional trailer on Signal, SendOrder, RequestAck and Fill
+// ---------------------------------------------------------------------------------
+#define TRACE_CONTEXT_MAGIC                 0x54524345  // "TRCE"
+
+// Points a traced message passes, stamps[] holds the epoch ns it got there (0 if it didn't)
+#define TRACE_POINT_DECODE_PUBLISH          0   // market data service published the message that started it
+#define TRACE_POINT_STRATEGY_SEND           1   // strategy sent the order
+#define TRACE_POINT_ADAPTER_RECEIVE         2   // trade adapter took the order off the bus
+#define TRACE_POINT_ADAPTER_SEND            3   // trade adapter handed the order to the exchange connection
+#define TRACE_POINT_EXCHANGE_ACK            4   // exchange ack reached the trade adapter
+#define TRACE_POINT_FILL_RECEIVE            5   // latest fill reached the trade adapter from the user stream
+#define TRACE_NUM_POINTS                    6
+
+// Appended after the fixed part of a message, msgLength covers it. A receiver only looks for it
+// when msgLength is at least the size of the message plus the trailer and the magic matches, so
+// services that don't know about it read the message as before. Each hop copies it onto the
+// message it sends on and stamps its own point, the origin never changes.
+//  - trace_id is unique per market data message that started a trace
+//  - origin_receive_timestamp is when the WSock read the frame off the market data websocket
+struct TraceContext {
+    uint32_t        magic;
+    uint32_t        origin_instrument_id;
+    uint64_t        trace_id;
+    uint64_t        origin_receive_timestamp;
+    uint64_t        stamps[TRACE_NUM_POINTS];
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "aeron_types.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#define ARRAY_BOOK_DEFAULT_TICKS    4096    // ticks kept per side, rounded up to a power of two
+#define ARRAY_BOOK_MIN_TICKS        256
+#define ARRAY_BOOK_MAX_DECIMALS     12
+
+struct ladder_level {
+    double price;                   // as received, so snapshots round trip exactly
+    double qty;
+    uint64_t timestamp;             // exchange time of the last change
+};
+
+// One side of the book: a window of capacity consecutive ticks [low_tick, low_tick + capacity).
+// A tick lives in slot tick & (capacity - 1), so moving the window never moves any levels, only
+// the slots of the ticks that leave it are cleared. One bit per slot says if it holds a level,
+// finding the next best level scans 64 ticks per word.
+struct ladder_side {
+    std::vector<ladder_level> levels;
+    std::vector<uint64_t> occupied;
+    int64_t low_tick;
+    int64_t best_tick;
+    uint32_t num_levels;
+};
+
+// Price level book on flat tick indexed arrays, an alternative to MergedOrderbook for the hot
+// path of every depth update. Same calls as MergedOrderbook, except that get_x_price_levels
+// fills a flat array instead of handing out a std::map.
+//
+// Each side keeps max_ticks ticks from a little beyond its touch (margin) into the book. When
+// the touch moves outside that the window is re-centred, levels further from the touch than
+// the window are dropped (pruned) - size max_ticks to the depth consumers actually look at.
+// Without a tick size the book works with the finest decimal step seen in the prices.
+class ArrayOrderbook {
+    private:
+        ladder_side bids;
+        ladder_side asks;
+        uint32_t capacity;
+        uint64_t slot_mask;
+        int64_t margin;
+
+        double tick_size;
+        double inverse_tick;
+        bool fixed_tick;
+
+        // Header of the last depth update, used for the snapshot messages
+        uint32_t instrument_id = 0;
+        uint8_t exchange_id = 0;
+        uint64_t last_receive_timestamp = 0;
+        uint64_t last_exchange_timestamp = 0;
+        uint64_t last_end_seq_number = 0;
+        bool has_updates = false;
+
+        uint64_t num_pruned = 0;
+        uint64_t num_recentres = 0;
+
+        void init_side(ladder_side &side);
+        void clear_side(ladder_side &side);
+        void shift_window(ladder_side &side, int64_t new_low_tick);
+        int64_t find_below(ladder_side &side, int64_t tick);
+        int64_t find_above(ladder_side &side, int64_t tick);
+        void set_level(ladder_side &side, bool is_bid, double price, double qty, uint64_t timestamp);
+        void delete_level(ladder_side &side, bool is_bid, double price);
+        void remove_through(ladder_side &side, bool is_bid, int64_t tick);
+        void refine_tick(double price);
+        int64_t to_tick(double price);
+
+        inline bool is_occupied(ladder_side &side, int64_t tick) {
+            uint64_t slot = tick & slot_mask;
+            return((side.occupied[slot >> 6] >> (slot & 63)) & 1);
+        }
+
+    public:
+        ArrayOrderbook(double _tick_size = 0.0, uint32_t max_ticks = ARRAY_BOOK_DEFAULT_TICKS);
+        void process_update(PLUpdates *pl_update);
+        void process_update(ToBUpdate *tob_update);
+        void clear_orderbook();
+        double get_touch_price_bid();
+        double get_touch_price_ask();
+        double get_touch_qty_bid();
+        double get_touch_qty_ask();
+        bool is_book_crossed();
+        int get_x_price_levels(uint8_t side, int x, PriceLevelDetails *levels);
+        int build_snapshot_from_current_book(char *snap_buffer);
+        uint32_t get_num_levels(uint8_t side);
+        uint64_t get_num_pruned();
+        uint64_t get_num_recentres();
+};
@@ -16,6 +16,10 @@
 #include "sl.hpp"
 #include "logger.hpp"
 #include <random>
+#include "order_request_builder.hpp"
+#include "order_table.hpp"
+#include "risk_engine.hpp"
+#include "trace_context.hpp"
 #include "wolfssl/wolfcrypt/hmac.h"
 // #include <openssl/hmac.h>
 
@@ -53,7 +57,6 @@ class BaseTradeAdapter {
 
     // These are used for web initiated orders or auto close orders (liquidation)
     uint64_t wash_book_order_id = 0;
-    std::unordered_map<std::string, uint64_t> washbook_external_to_internal_order_id;
 
   protected:
     std::atomic<bool> got_hb = false;
@@ -65,13 +68,22 @@ class BaseTradeAdapter {
     SL lock;
     void send_any_io_message(char *message_ptr, int length);
 
-    // Moving these over from aeron_oe to track internally instead
-    std::unordered_map<uint64_t, struct SendOrder *> internal_order_id_to_order;
-    std::unordered_map<std::string, struct SendOrder *> external_order_id_to_order;
-    std::unordered_map<std::string, struct SendOrder *> exchange_order_id_to_order;
+    // Sends the message with the trace trailer after it
+    template<typename T>
+    void send_traced_io_message(T *message, TraceContext *trace) {
+        traced_message<T> traced;
+        traced.message = *message;
+        send_any_io_message((char *) &traced, attach_trace(&traced, trace));
+    }
 
-    std::unordered_map<uint64_t, std::string> internal_order_id_to_external_order_id;
-    std::unordered_map<std::string, uint64_t> external_order_id_to_internal_order_id;
+    // Every order sent or seen, by internal/external/exchange order id - done orders are retired into its history
+    OrderTable *order_table;
+
+    // Pre-trade checks, limits compiled from strategy/instrument info and the risk_* config
+    RiskEngine *risk_engine;
+
+    // Tick to trade hops of traced orders, in shared memory for latency_reader
+    TraceRecorder *trace_recorder;
 
     /////////////////////////////
     // LogWorker and Logger - worker runs a thread and writes to a unified output
@@ -104,7 +116,8 @@ class BaseTradeAdapter {
 
     // Aeron message senders - moved from aeron_oe so we can keep internal structures within the process
     void send_internal_order_ack( char *external_order_id,
-                            struct SendOrder *send_order);
+                            struct SendOrder *send_order,
+                            TraceContext *trace = nullptr);
 
     void send_internal_order_reject(  struct SendOrder *send_order,
                                 std::string reject_message,
@@ -117,6 +130,8 @@ class BaseTradeAdapter {
                                 uint8_t reject_reason);
 
     void send_exchange_order_ack(char *external_order_id);
+    // Ack already built from the exchange message, the order details are filled in here
+    void send_exchange_order_ack(RequestAck *r);
     void send_exchange_order_reject(  char *external_order_id, 
                                 std::string reject_reason_string, 
                                 uint8_t reject_reason);
@@ -134,6 +149,8 @@ class BaseTradeAdapter {
                     double leaves_qty,
                     bool is_buy, 
                     std::string exchange_trade_id);
+    // Fill already built from the exchange message, the order details are filled in here
+    void send_fill(Fill *f);
 
     /////////////////////////////
     // Setters for the private base class variables
@@ -172,13 +189,17 @@ class BaseTradeAdapter {
     // Riskcheck methods
     /////////////////////////////
     bool order_pass_riskcheck(struct SendOrder *order_to_send, std::string &reject_message, uint8_t &reject_reason);
+    // Reads the risk_* config into the risk engine - after load_config
+    void load_risk_limits();
+    // Retires the order and takes it off the open orders of its strategy
+    void retire_order(char *external_order_id);
+    void retire_order(uint64_t exchange_order_id);
 
     /////////////////////////////
     // Helper methods
     /////////////////////////////
     // Creates signature
     std::string hmacHex(std::string key, std::string msg);
-    int hmacHex(std::string key, std::string msg, char *output_string);
 
     // Gets current ts in nanoseconds
     static uint64_t get_current_ts(); // nanoseconds
@@ -207,8 +228,8 @@ class BaseTradeAdapter {
     /////////////////////////////
     // Washbook order_id management
     /////////////////////////////
-    // This gets next order id - also adds the external order_id to the lookup map
-    uint64_t get_next_washbook_internal_order_id(std::string external_order_id, uint8_t exchange_id);
+    // This gets next order id - the order goes in the order table with it
+    uint64_t get_next_washbook_internal_order_id(uint8_t exchange_id);
     // looks up the internal order id from the external
     uint64_t get_internalid_from_external_map(std::string external_id);
 };
\ No newline at end of file
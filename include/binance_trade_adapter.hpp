@@ -4,7 +4,58 @@
 #include <csignal>
 #include "base_trade_adapter.hpp"
 #include "wsock.hpp"
+#include "order_gateway.hpp"
+#include "order_request_builder.hpp"
+#include "execution_report_decoder.hpp"
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define WS_API_MAX_MESSAGE_LENGTH 1024
+// Twice the recvWindow, the exchange would have rejected it by then had it got there
+#define WS_API_REQUEST_TIMEOUT_NS 10000000000L
+#define WS_API_MAX_RATE_LIMITS 4
+// Also twice the recvWindow - an order the exchange doesn't know about by then was never placed
+#define ORDER_STATUS_QUERY_DELAY_NS 10000000000L
+#define ORDER_STATUS_RETRY_NS 1000000000L
+#define ORDER_STATUS_MAX_QUERIES 30
+// Codes Binance sends when it doesn't know itself whether the request was executed
+#define BINANCE_CODE_UNKNOWN_RESPONSE -1006
+#define BINANCE_CODE_BACKEND_TIMEOUT -1007
+#define BINANCE_CODE_NO_SUCH_ORDER -2013
+// Order table slots copied out at a time when it is checked against the open orders on the exchange
+#define OPEN_ORDERS_SCAN_SLOTS 256
+
+// Order entry request sent on the websocket API, kept until the response with its id comes back
+struct ws_api_request {
+    uint8_t request_type;           // GATEWAY_NEW_ORDER or GATEWAY_CANCEL_ORDER
+    uint8_t exchange_id;
+    uint64_t internal_order_id;
+    char external_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    CancelOrder cancel_request;
+    uint64_t receive_ts;
+    uint64_t send_ts;
+};
+
+// New order or cancel that went out without us finding out what happened to it - resolved from
+// the status of the order on the exchange, the order that is to be cancelled for a cancel
+struct order_status_query {
+    uint8_t request_type;           // GATEWAY_NEW_ORDER or GATEWAY_CANCEL_ORDER
+    uint8_t exchange_id;
+    uint32_t instrument_id;
+    char external_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    CancelOrder cancel_request;
+    uint64_t query_ts;              // not asked before this
+    uint32_t num_queries;
+};
+
+// Websocket API params are built as the query string to sign and the json to send at the same time
+struct ws_api_params {
+    char query[WS_API_MAX_MESSAGE_LENGTH];
+    int query_length = 0;
+    char json[WS_API_MAX_MESSAGE_LENGTH];
+    int json_length = 0;
+};
 
 
 class BinanceTradeAdapter : public BaseTradeAdapter {
@@ -14,6 +65,8 @@ class BinanceTradeAdapter : public BaseTradeAdapter {
     // API KEY and SECRET to the exchange accounts (same for all three excahgnes)
     std::string API_KEY;
     std::string SECRET_KEY;
+    // CA bundle to trust instead of the system one (tls_ca_file) - for pointing the adapter at a local simulator
+    std::string tls_ca_file;
 
     // This map is for all websocket listenkeys
     struct user_websocket_info {
@@ -23,22 +76,47 @@ class BinanceTradeAdapter : public BaseTradeAdapter {
       std::string rest_endpoint_margin_v2;
       std::string ws_endpoint;
       std::string exchange_name;
+      uint8_t gateway_endpoint;
+      bool use_ws_api = false;
+      // Futures orders/cancels queued together go out in batchOrders requests (batch_orders)
+      bool batch_orders = false;
+      // Weight and order count budgets, shared by REST and the websocket API
+      RateLimitScheduler *rate_limits = nullptr;
     };
     std::unordered_map<uint8_t, user_websocket_info*> listenkey_map;
 
     // Generic for risk management
     CURL *curl;
 
-    CURL *new_order_curl;
-    struct curl_slist *new_order_chunk = NULL;
-    std::string new_order_response;
+    // New orders and cancels go out through the gateway, responses are parsed on its thread
+    OrderGateway *order_gateway;
+    Logger *gateway_logger;
+    simdjson::dom::parser gateway_parser;
+
+    // Signed order/cancel requests from per instrument templates, the key pads are hashed once
+    OrderRequestBuilder *order_builder;
+    // Signs the batches, on the gateway thread
+    OrderRequestBuilder *batch_builder = nullptr;
 
-    CURL *cancel_curl;
-    struct curl_slist *cancel_chunk = NULL;
-    std::string cancel_response;
+    // executionReport / ORDER_TRADE_UPDATE from the user streams, symbols and assets added with the instruments
+    ExecutionReportDecoder *execution_decoder;
 
     WSock *user_websockets;
 
+    // Order entry over the websocket API - for the exchanges that have it selected in the config
+    WSock *ws_api_sockets = nullptr;
+    simdjson::dom::parser ws_api_parser;
+    SL ws_api_lock;
+    std::unordered_map<uint64_t, ws_api_request> ws_api_pending;
+    uint64_t ws_api_request_id = 0;
+
+    // Orders and cancels with an unknown outcome, queried on the refresh thread
+    SL status_query_lock;
+    std::vector<order_status_query> status_queries;
+    simdjson::dom::parser status_parser;
+    // Open here but not on the exchange at the last check, by client order id (refresh thread)
+    std::unordered_set<std::string> missing_open_orders;
+
     simdjson::dom::parser parser;
 
     struct timespec t;
@@ -49,11 +127,39 @@ class BinanceTradeAdapter : public BaseTradeAdapter {
 
     pthread_t user_websocket_thread_handle;
 
+    void set_tls_ca_file(CURL *handle);
     std::string get_listen_key(std::string rest_endpoint, uint8_t exchange_id);
     void add_user_websocket(Logger *logger, uint8_t exchange_id, std::string ex_name);
     void load_all_open_orders(Logger *logger, uint8_t exchange_id);
     void user_websocket_loop_thread(Logger *logger);
     void listenkey_refresh_thread(Logger *logger);
+    order_template *get_order_template(uint32_t instrument_id, uint8_t exchange_id);
+    void send_new_order_rest(struct SendOrder *s, char *ext_order_id, uint64_t current_ts);
+    void send_cancel_rest(struct CancelOrder *c, std::string &cancel_external_order_id, uint64_t current_ts);
+    void process_gateway_response(gateway_context *context);
+    void process_gateway_batch_response(gateway_context *context);
+    void query_batch_status(gateway_context *context, int first);
+    void add_batching(uint8_t exchange_id, std::string ex_name);
+    int build_batch_request(gateway_request *requests, int num_requests, char *body);
+    void add_ws_api_param(ws_api_params &params, const char *name, const char *value, bool quoted = true);
+    bool send_ws_api_request(ws_api_request &request, const char *method, ws_api_params &params);
+    void expire_ws_api_requests(uint64_t current_ts, Logger *log);
+    void queue_status_query(uint8_t request_type, char *external_order_id, struct CancelOrder *cancel_request, uint64_t send_ts, Logger *log);
+    void run_status_queries(CURL *handle, uint64_t current_ts, Logger *log);
+    bool query_order_status(CURL *handle, order_status_query &query, Logger *log);
+    void resolve_order_status(order_status_query &query, simdjson::dom::element &status_json, Logger *log);
+    static bool is_unknown_outcome(int64_t code);
+    bool fetch_open_orders(CURL *handle, uint8_t exchange_id, std::unordered_set<std::string> &open_orders, Logger *log);
+    void reconcile_open_orders(CURL *handle, Logger *log);
+    bool send_new_order_ws_api(struct SendOrder *s, char *ext_order_id, uint64_t current_ts);
+    bool send_cancel_ws_api(struct CancelOrder *c, std::string &cancel_external_order_id, uint64_t current_ts);
+    void add_ws_api_socket(uint8_t exchange_id, std::string ex_name);
+    void add_rate_limits(uint8_t exchange_id, std::string ex_name);
+    void publish_rate_limit_status(RateLimitStatus *status);
+    void expire_held_order(gateway_request *request);
+    void process_ws_api_rate_limits(simdjson::dom::element &exchange_json_message, ws_api_request &request, Logger *wslogger);
+    void ws_api_loop_thread(Logger *wslogger);
+    void send_request_reject(uint8_t request_type, char *external_order_id, struct CancelOrder *cancel_request, std::string reject_message, Logger *log);
     fragment_handler_t aeron_msg_handler();
 
   public:
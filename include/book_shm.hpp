@@ -0,0 +1,149 @@
+#pragma once
+
+#include "aeron_types.hpp"
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Order books in shared memory
+//
+// The market data process publishes the top depth levels of every instrument it maintains a
+// book for, so local consumers read current books straight from memory instead of rebuilding
+// them from AERON_IO after a snapshot round trip on AERON_SS.
+//
+// Region layout: book_shm_header, then max_instruments slots of slot_size bytes. A slot is a
+// book_shm_slot followed by depth bids and depth asks (book_shm_level, best first). Slots are
+// handed out in order and published by bumping num_slots_used, like the latency region.
+//
+// Every slot is a seqlock: the single writer makes sequence odd, writes, and makes it even
+// again. A reader copies the slot and retries if sequence was odd or changed meanwhile, so
+// reads are consistent and never block the writer.
+//
+// A new writer never resizes a region in place - readers still mapping it would fault. It marks
+// the old region retired, unlinks it and creates a fresh one under the same name, so readers
+// that see retired set reopen the name to pick up the new region.
+
+#define BOOK_SHM_PREFIX             "/got_books_"
+#define BOOK_SHM_MAGIC              "GOTBOOK2"
+#define BOOK_SHM_VERSION            2
+#define BOOK_SHM_DEFAULT_DEPTH      10
+#define BOOK_SHM_MAX_DEPTH          50
+#define BOOK_SHM_DEFAULT_INSTRUMENTS 4096
+#define BOOK_SHM_ALIGNMENT          64
+
+struct book_shm_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t max_instruments;
+    uint32_t depth;
+    uint32_t slot_size;
+    std::atomic<uint32_t> num_slots_used;
+    uint32_t writer_pid;
+    std::atomic<uint32_t> retired;      // 1 once the writer is gone or replaced, reopen the name
+    uint64_t start_timestamp;
+    char process_name[64];
+};
+
+struct book_shm_level {
+    double price;
+    double qty;
+};
+
+struct book_shm_slot {
+    std::atomic<uint64_t> sequence;     // odd while the writer is in the slot
+    uint32_t instrument_id;
+    uint8_t exchange_id;
+    uint8_t valid;                      // 0 from a book clear until the book is rebuilt
+    uint16_t num_bids;
+    uint16_t num_asks;
+    uint16_t reserved[3];
+    uint64_t exchange_timestamp;
+    uint64_t receive_timestamp;
+    uint64_t publish_timestamp;
+    uint64_t end_seq_number;
+    uint64_t update_count;
+};
+
+// A consistent copy of one slot
+struct book_shm_view {
+    uint64_t sequence;
+    uint32_t instrument_id;
+    uint8_t exchange_id;
+    uint8_t valid;
+    uint16_t num_bids;
+    uint16_t num_asks;
+    uint64_t exchange_timestamp;
+    uint64_t receive_timestamp;
+    uint64_t publish_timestamp;
+    uint64_t end_seq_number;
+    uint64_t update_count;
+    book_shm_level bids[BOOK_SHM_MAX_DEPTH];
+    book_shm_level asks[BOOK_SHM_MAX_DEPTH];
+};
+
+// Fills levels (best first) with up to depth levels of one side of the book the update was
+// applied to, returns how many it filled
+typedef std::function<int(uint8_t side, int depth, PriceLevelDetails *levels)> book_level_source;
+
+// Creates the region and publishes the top levels of every instrument after every update. The
+// writer keeps no books itself, the levels come from the book the caller already maintains
+// (WSock's) through the level source. Single writer - the thread that processes the depth stream.
+class BookShmWriter {
+    private:
+        std::string shm_name;
+        uint64_t region_size = 0;
+        ino_t region_inode = 0;
+        book_shm_header *header = nullptr;
+        char *slots = nullptr;
+        uint32_t depth;
+        std::unordered_map<uint32_t, book_shm_slot*> instruments;
+        book_level_source level_source;
+        PriceLevelDetails bid_buffer[BOOK_SHM_MAX_DEPTH];
+        PriceLevelDetails ask_buffer[BOOK_SHM_MAX_DEPTH];
+
+        void retire_region(std::string name);
+        book_shm_slot *get_slot(uint32_t instrument_id, uint8_t exchange_id);
+        void publish(book_shm_slot *slot, PLUpdates *pl_update, int num_bids, int num_asks);
+        uint64_t get_current_ts();
+
+    public:
+        BookShmWriter(std::string name, uint32_t _depth = BOOK_SHM_DEFAULT_DEPTH, uint32_t max_instruments = BOOK_SHM_DEFAULT_INSTRUMENTS);
+        ~BookShmWriter();
+        void set_level_source(book_level_source _level_source);
+        void process_update(PLUpdates *pl_update);
+        void clear_book(uint32_t instrument_id, uint8_t exchange_id);
+        std::string get_shm_name();
+};
+
+// Maps a region read only and reads books from it without locking
+class BookShmReader {
+    private:
+        uint64_t region_size = 0;
+        book_shm_header *header = nullptr;
+        char *slots = nullptr;
+        uint32_t num_slots_known = 0;
+        std::unordered_map<uint32_t, book_shm_slot*> slot_map;
+
+        book_shm_slot *find_slot(uint32_t instrument_id);
+
+    public:
+        BookShmReader(std::string name);
+        ~BookShmReader();
+        bool is_open();
+        bool is_retired();
+        book_shm_header *get_header();
+        std::vector<uint32_t> get_instrument_ids();
+        uint64_t get_sequence(uint32_t instrument_id);
+        bool read_book(uint32_t instrument_id, book_shm_view *view);
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// Binary raw capture format
+//
+// A capture is a series of fixed size segment files named <base>.0000, <base>.0001, ...
+// Every segment starts with a capture_segment_header followed by frames. Each frame is a
+// capture_frame_header followed by the raw payload (the websocket message as received),
+// padded so the next frame starts on an 8 byte boundary. Segments are preallocated and
+// zero filled, so a frame with length 0 (or data_end in the header) marks the end of data.
+//
+// A compressed capture (<base>.capz) holds the same frames grouped into blocks. Every block
+// is an independent gzip member, so the file as a whole is still a valid gzip file. The
+// blocks are listed in <base>.capz.idx as capture_block_index_entry records in the order
+// they were written, which lets a reader go straight to the block covering a timestamp.
+
+#define CAPTURE_MAGIC               "GOTCAP01"
+#define CAPTURE_VERSION             1
+#define CAPTURE_FRAME_ALIGNMENT     8
+#define CAPTURE_DEFAULT_SEGMENT_MB  16
+#define CAPTURE_INDEX_SUFFIX        ".idx"
+#define CAPTURE_BLOCK_SIZE          256*1024
+#define CAPTURE_BLOCK_MAX_AGE_NS    1000000000L
+
+enum CaptureStreamKind {
+    CAPTURE_STREAM_UNKNOWN      = 0,
+    CAPTURE_STREAM_DEPTH        = 1,
+    CAPTURE_STREAM_TRADE        = 2,
+    CAPTURE_STREAM_BOOK_TICKER  = 3,
+    CAPTURE_STREAM_MARK_PRICE   = 4,
+    CAPTURE_STREAM_FORCE_ORDER  = 5,
+    CAPTURE_STREAM_SNAPSHOT     = 6
+};
+
+struct capture_segment_header {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    header_size;
+    uint64_t    segment_size;
+    uint64_t    data_end;           // offset of the first byte after the last complete frame
+    uint64_t    created_timestamp;
+    uint32_t    segment_number;
+    uint32_t    instrument_id;      // 0 if the segment holds several instruments
+    char        reserved[16];
+};
+
+struct capture_frame_header {
+    uint32_t    length;             // payload length, excluding this header and padding
+    uint32_t    instrument_id;
+    uint64_t    receive_timestamp;
+    uint8_t     stream_kind;
+    uint8_t     flags;
+    uint16_t    reserved;
+    uint32_t    reserved2;
+};
+
+struct capture_block_index_entry {
+    uint64_t    file_offset;        // offset of the gzip member in the .capz file
+    uint32_t    compressed_length;
+    uint32_t    uncompressed_length;
+    uint64_t    first_timestamp;    // receive timestamp of the first and last frame in the block
+    uint64_t    last_timestamp;
+    uint32_t    num_frames;
+    uint32_t    instrument_id;
+};
+
+// Size a frame occupies in the segment including header and padding
+inline uint64_t capture_frame_size(uint32_t payload_length) {
+    uint64_t size = sizeof(capture_frame_header) + payload_length;
+    return((size + CAPTURE_FRAME_ALIGNMENT - 1) & ~((uint64_t) CAPTURE_FRAME_ALIGNMENT - 1));
+}
+
+// Segment file name for a capture base name
+inline std::string capture_segment_filename(const std::string &base_filename, uint32_t segment_number) {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), ".%04u", segment_number);
+    return(base_filename + suffix);
+}
+
+// Works out the stream kind from the websocket URI we subscribed to
+inline uint8_t capture_stream_kind_from_uri(std::string_view uri) {
+    if(uri.find("@depth") != uri.npos)
+        return(CAPTURE_STREAM_DEPTH);
+    if(uri.find("@trade") != uri.npos)
+        return(CAPTURE_STREAM_TRADE);
+    if(uri.find("@bookTicker") != uri.npos)
+        return(CAPTURE_STREAM_BOOK_TICKER);
+    if(uri.find("@markPrice") != uri.npos)
+        return(CAPTURE_STREAM_MARK_PRICE);
+    if(uri.find("@forceOrder") != uri.npos)
+        return(CAPTURE_STREAM_FORCE_ORDER);
+    return(CAPTURE_STREAM_UNKNOWN);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstring>
+
+// Internal projects
+#include "aeron_types.hpp"
+#include "logger.hpp"
+
+// Initial capacity of a per instrument buffer, grows if needed and keeps the capacity for the next resync
+#define DIFF_REPLAY_INITIAL_SIZE 256*1024
+// Upper bound per instrument - if we hit this the oldest diffs are thrown away and the snapshot will not bridge
+#define DIFF_REPLAY_MAX_SIZE 16*1024*1024
+
+// Stored in front of every buffered PLUpdates message
+struct buffered_diff_header {
+    uint64_t previous_end_seq_no;
+    uint32_t length;
+};
+
+struct replay_state {
+    std::vector<char> buffer;
+    uint32_t used;
+    uint32_t read_offset;
+    uint64_t num_buffered;
+};
+
+// Holds depth diffs for an instrument while its REST snapshot is in flight and replays
+// them on top of the snapshot following the Binance local orderbook sync rules
+class DiffReplayBuffer {
+    private:
+        Logger *logger = nullptr;
+        std::unordered_map<uint32_t, replay_state*> instrument_state;
+
+        uint64_t num_snapshots_bridged = 0;
+        uint64_t num_snapshots_stale = 0;
+        uint64_t num_diffs_discarded = 0;
+        uint64_t num_diffs_replayed = 0;
+        uint64_t num_resyncs_saved = 0;
+
+        replay_state *get_state(uint32_t instrument_id);
+
+    public:
+        DiffReplayBuffer(Logger *_logger);
+
+        void add_update(uint32_t instrument_id, PLUpdates *pl_update, uint64_t previous_end_seq_no);
+        bool can_bridge(uint32_t instrument_id, uint64_t last_update_id);
+        bool replay(uint32_t instrument_id, uint64_t last_update_id, std::function<void(PLUpdates*)> apply_update);
+        void clear(uint32_t instrument_id);
+
+        uint64_t get_resyncs_saved();
+        std::string get_stats();
+};
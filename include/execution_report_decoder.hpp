@@ -0,0 +1,133 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <atomic>
+
+// Internal projects
+#include "aeron_types.hpp"
+#include "sl.hpp"
+
+#define EXEC_REPORT_MAX_SYMBOL          24
+// Has to be a power of two, and at least twice the symbols/assets it holds
+#define EXEC_REPORT_INTERN_CAPACITY     8192
+#define EXEC_REPORT_NOT_FOUND           0
+#define EXEC_REPORT_MAX_EXCHANGES       256
+
+enum exec_report_event {
+  EXEC_EVENT_NONE,
+  EXEC_EVENT_EXECUTION_REPORT,      // spot
+  EXEC_EVENT_ORDER_TRADE_UPDATE     // futures
+};
+
+enum exec_report_order_type {
+  EXEC_ORDER_TYPE_OTHER,
+  EXEC_ORDER_TYPE_LIMIT,
+  EXEC_ORDER_TYPE_MARKET,
+  EXEC_ORDER_TYPE_LIMIT_MAKER,
+  EXEC_ORDER_TYPE_LIQUIDATION
+};
+
+enum exec_report_status {
+  EXEC_STATUS_OTHER,
+  EXEC_STATUS_NEW,
+  EXEC_STATUS_PARTIALLY_FILLED,
+  EXEC_STATUS_FILLED,
+  EXEC_STATUS_CANCELED,
+  EXEC_STATUS_EXPIRED,
+  EXEC_STATUS_REJECTED
+};
+
+enum exec_report_exec_type {
+  EXEC_EXEC_OTHER,
+  EXEC_EXEC_NEW,
+  EXEC_EXEC_TRADE,
+  EXEC_EXEC_CANCELED,
+  EXEC_EXEC_EXPIRED,
+  EXEC_EXEC_REJECTED
+};
+
+// The fields of an executionReport or ORDER_TRADE_UPDATE the trade adapter acts on, strings are
+// zero terminated and cut to fit
+struct execution_report {
+    uint8_t event;                                          // exec_report_event
+    uint8_t order_type;                                     // exec_report_order_type
+    uint8_t status;                                         // exec_report_status (X)
+    uint8_t exec_type;                                      // exec_report_exec_type (x)
+    bool is_buy;
+    uint32_t instrument_id;                                 // EXEC_REPORT_NOT_FOUND for symbols not added
+    uint32_t commission_asset_id;                           // EXEC_REPORT_NOT_FOUND without commission
+    uint64_t exchange_order_id;
+    int64_t trade_id;                                       // -1 when not a trade
+    uint64_t event_time;                                    // epoch ms
+    uint64_t transaction_time;                              // epoch ms
+    double price;                                           // 0 for market orders
+    double orig_qty;
+    double cum_qty;
+    double last_qty;
+    double last_price;
+    double commission;
+    char symbol[EXEC_REPORT_MAX_SYMBOL];
+    char client_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    char orig_client_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH]; // spot cancels only (C)
+};
+
+struct intern_entry {
+    char key[EXEC_REPORT_MAX_SYMBOL];                       // zero padded, compared over the full width
+    uint32_t value;
+};
+
+// Symbol (or asset code) to id, open addressing with linear probing over an array allocated up front.
+// Written from the aeron thread when instruments come in and read from the user stream thread, so it
+// takes the lock.
+class InternTable {
+    private:
+        SL intern_lock;
+        intern_entry *entries;
+        uint32_t num_entries = 0;
+        bool lower_case;
+
+        static uint64_t key_hash(const char *key);
+        uint32_t find_slot(const char *key);
+        bool make_key(const char *key, size_t length, char *padded_key);
+
+    public:
+        // Asset codes are matched without case, Binance sends them upper case and refdata has them lower
+        InternTable(bool _lower_case = false);
+        bool add(const char *key, size_t length, uint32_t value);
+        uint32_t get(const char *key, size_t length);
+};
+
+// Single pass decoder for the user data stream order events. Goes over the message once, picks the
+// fields by key straight into an execution_report, maps the enum-like strings through fixed tables and
+// the symbol/commission asset through intern tables - nothing is allocated and nothing is parsed twice.
+// Anything else that comes on the stream (account updates, listenKeyExpired..) returns false.
+// Symbols are per exchange as spot and futures share names (BTCUSDT) but not instrument ids.
+class ExecutionReportDecoder {
+    private:
+        SL add_lock;
+        std::atomic<InternTable*> symbols[EXEC_REPORT_MAX_EXCHANGES] = {};
+        InternTable assets{true};
+
+        static bool skip_value(const char *&ptr, const char *end);
+        static bool read_string(const char *&ptr, const char *end, const char *&value, size_t &length);
+        static double read_decimal(const char *value, size_t length);
+        static int64_t read_integer(const char *value, size_t length);
+        static void copy_string(char *target, size_t target_size, const char *value, size_t length);
+        bool decode_object(const char *&ptr, const char *end, InternTable *exchange_symbols, execution_report *report, bool nested);
+
+    public:
+        // From the instrument info, the tables of an exchange are made on its first symbol
+        void add_symbol(uint8_t exchange_id, const char *symbol, uint32_t instrument_id);
+        void add_asset(const char *asset_code, uint32_t asset_id);
+
+        // True for an executionReport or ORDER_TRADE_UPDATE, report is only complete when it returns true
+        bool decode(const char *message, size_t length, uint8_t exchange_id, execution_report *report);
+
+        // Exchange side of the messages for the bus, the trade adapter fills in the order details it tracks
+        static void build_exchange_ack(execution_report *report, RequestAck *ack);
+        static void build_fill(execution_report *report, Fill *fill);
+        static void build_trading_fee(execution_report *report, uint8_t exchange_id, TradingFee *fee);
+};
@@ -4,14 +4,124 @@
 #include <fstream>
 #include <chrono>
 #include <string_view>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "capture_format.hpp"
+#include "MyRingBuffer.hpp"
+#include "sl.hpp"
+
+#define CAPTURE_BLOCKS_PER_WRITER   8
+#define CAPTURE_COMPRESS_THREADS    2
+#define CAPTURE_COMPRESSION_LEVEL   3
+// Block buffers are shared by all compressed writers - this many per writer up front, and the
+// capture thread keeps a few spare on top of what is in use
+#define CAPTURE_POOL_BUFFERS_PER_WRITER 2
+#define CAPTURE_POOL_MIN_FREE       4
+
+enum FileWriterFormat {
+    TextFileFormat          = 0,
+    BinaryCaptureFormat     = 1,
+    CompressedCaptureFormat = 2
+};
+
+enum CaptureBlockState {
+    CAPTURE_BLOCK_FREE          = 0,
+    CAPTURE_BLOCK_FILLING       = 1,
+    CAPTURE_BLOCK_QUEUED        = 2,
+    CAPTURE_BLOCK_COMPRESSED    = 3,
+    CAPTURE_BLOCK_WRITING       = 4     // a frame is going in, or it is being sealed
+};
+
+// One memory mapped segment of a binary capture
+struct capture_segment {
+    int fd;
+    char *base;
+    uint64_t size;
+    std::atomic<uint64_t> write_offset;
+    uint64_t synced_offset;
+    uint32_t segment_number;
+    std::string filename;
+};
+typedef MyRingBuffer<capture_segment*, 16> RetiredSegmentRingT;
+
+class FileWriter;
+
+// One block of frames of a compressed capture, filled by the feed thread, compressed
+// by the worker pool and written out (in block order) by the capture thread. The buffers
+// come from the shared pool: data while it is filled and compressed, compressed until
+// it is written out - nullptr otherwise.
+struct capture_block {
+    FileWriter *writer;
+    std::atomic<uint8_t> state;
+    char *data;
+    uint32_t length;
+    char *compressed;
+    uint32_t compressed_size;
+    uint32_t compressed_length;
+    uint64_t first_timestamp;
+    uint64_t last_timestamp;
+    uint32_t num_frames;
+};
+typedef MyRingBuffer<capture_block*, 4096> CaptureBlockRingT;
 
 class FileWriter {
     private:
         std::ofstream writer_fh;
+        uint8_t format = TextFileFormat;
+
+        // Binary capture only - the feed thread only touches active_segment, everything
+        // else (creating, msync, truncating and closing segments) is done by the capture thread
+        std::string base_filename;
+        uint32_t instrument_id = 0;
+        uint64_t segment_size = 0;
+        uint32_t next_segment_number = 0;
+        std::atomic<capture_segment*> active_segment{nullptr};
+        std::atomic<capture_segment*> next_segment{nullptr};
+        RetiredSegmentRingT retired_segments;
+        uint64_t dropped_frames = 0;
+        uint64_t last_sync_time = 0;
+
+        // Compressed capture only - blocks are used round robin, the feed thread fills
+        // blocks[fill_seq] and the capture thread writes out blocks[write_seq]. Whoever
+        // takes the filling block to WRITING first gets to seal it, the capture thread
+        // does for blocks the feed has stopped writing to.
+        int capz_fd = -1;
+        int index_fd = -1;
+        uint64_t capz_offset = 0;
+        capture_block *blocks[CAPTURE_BLOCKS_PER_WRITER];
+        std::atomic<uint64_t> fill_seq{0};
+        uint64_t write_seq = 0;
+        std::atomic<bool> seal_requested{false};
+
+        capture_segment *create_segment(uint32_t segment_number);
+        void close_segment(capture_segment *segment);
+        bool rotate_segment();
+        void write_frame(std::string_view dump_line, uint64_t recv_ts, uint8_t stream_kind);
+
+        bool open_compressed(std::string output_filename);
+        capture_block *claim_block(uint64_t recv_ts);
+        void write_block_frame(std::string_view dump_line, uint64_t recv_ts, uint8_t stream_kind);
+        void seal_block(capture_block *block);
+        void seal_idle_block(uint64_t current_ts);
+        void write_compressed_blocks();
 
     public:
         FileWriter(std::string output_filename);
+        FileWriter(std::string output_filename, uint32_t _instrument_id, uint8_t _format, uint64_t segment_size_mb = CAPTURE_DEFAULT_SEGMENT_MB);
         ~FileWriter();
-        void write_to_file(std::string_view dump_line, uint64_t recv_ts);
+        void write_to_file(std::string_view dump_line, uint64_t recv_ts, uint8_t stream_kind = CAPTURE_STREAM_UNKNOWN);
         void flush_file();
-};
\ No newline at end of file
+
+        // Called from the shared capture thread
+        void service_capture(uint64_t current_ts);
+        uint64_t get_dropped_frames();
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Latency histograms in shared memory
+//
+// Log-linear buckets in the style of HdrHistogram: values below 32ns get a bucket each,
+// above that every power of two is split into 16 buckets (~3% resolution) up to 2^41ns (~36 minutes).
+// The process owning the region is the only writer and updates the counters with plain
+// relaxed atomic stores (no locks, no read-modify-write). Readers map the region read only
+// and can scrape it at any time, counts are cumulative since the writer started.
+//
+// Region layout: latency_shm_header followed by max_slots latency_slot. A slot holds the
+// histograms for one instrument/stream kind, one per hop. Slots are handed out in order and
+// published by bumping num_slots_used, so a reader only looks at slots below that.
+
+#define LATENCY_SHM_PREFIX          "/got_latency_"
+#define LATENCY_SHM_MAGIC           "GOTLAT01"
+#define LATENCY_SHM_VERSION         1
+#define LATENCY_DEFAULT_SLOTS       4096
+#define LATENCY_SUB_BUCKET_BITS     5
+#define LATENCY_SUB_BUCKETS         (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_HALF_SUB_BUCKETS    (LATENCY_SUB_BUCKETS / 2)
+#define LATENCY_MAX_EXPONENT        36
+#define LATENCY_BUCKETS             (LATENCY_SUB_BUCKETS + (LATENCY_MAX_EXPONENT * LATENCY_HALF_SUB_BUCKETS))
+
+enum LatencyHop {
+    LATENCY_HOP_EXCHANGE_TO_RECEIVE = 0,
+    LATENCY_HOP_RECEIVE_TO_DECODE   = 1,
+    LATENCY_HOP_DECODE_TO_PUBLISH   = 2,
+    LATENCY_NUM_HOPS                = 3
+};
+
+struct latency_histogram {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> below_zero;   // clock skew between us and the exchange, not bucketed
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+};
+
+struct latency_slot {
+    std::atomic<uint32_t> instrument_id;
+    uint8_t stream_kind;                // CaptureStreamKind
+    uint8_t reserved[3];
+    latency_histogram hops[LATENCY_NUM_HOPS];
+};
+
+struct latency_shm_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t max_slots;
+    uint32_t num_buckets;
+    uint32_t sub_bucket_bits;
+    std::atomic<uint32_t> num_slots_used;
+    uint32_t writer_pid;
+    uint64_t start_timestamp;
+    char process_name[64];
+};
+
+// -----------------------------------------------------------------------
+// Bucket a latency in ns falls into
+// -----------------------------------------------------------------------
+inline uint32_t latency_bucket_index(uint64_t value) {
+    if(value < LATENCY_SUB_BUCKETS)
+        return(value);
+    uint32_t exponent = (63 - __builtin_clzll(value)) - (LATENCY_SUB_BUCKET_BITS - 1);
+    if(exponent > LATENCY_MAX_EXPONENT)
+        return(LATENCY_BUCKETS - 1);
+    return(LATENCY_SUB_BUCKETS + ((exponent - 1) * LATENCY_HALF_SUB_BUCKETS) + ((value >> exponent) - LATENCY_HALF_SUB_BUCKETS));
+}
+
+// -----------------------------------------------------------------------
+// Lowest latency in ns that falls into a bucket
+// -----------------------------------------------------------------------
+inline uint64_t latency_bucket_value(uint32_t index) {
+    if(index < LATENCY_SUB_BUCKETS)
+        return(index);
+    uint32_t exponent = ((index - LATENCY_SUB_BUCKETS) / LATENCY_HALF_SUB_BUCKETS) + 1;
+    uint64_t sub_bucket = ((index - LATENCY_SUB_BUCKETS) % LATENCY_HALF_SUB_BUCKETS) + LATENCY_HALF_SUB_BUCKETS;
+    return(sub_bucket << exponent);
+}
+
+// -----------------------------------------------------------------------
+// Records one latency - single writer only, never locks
+// -----------------------------------------------------------------------
+inline void record_latency(latency_histogram *histogram, int64_t latency) {
+    if(latency < 0){
+        histogram->below_zero.store(histogram->below_zero.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t value = latency;
+    std::atomic<uint64_t> &bucket = histogram->buckets[latency_bucket_index(value)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    histogram->sum.store(histogram->sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    uint64_t count = histogram->count.load(std::memory_order_relaxed);
+    if((count == 0) || (value < histogram->min.load(std::memory_order_relaxed)))
+        histogram->min.store(value, std::memory_order_relaxed);
+    if(value > histogram->max.load(std::memory_order_relaxed))
+        histogram->max.store(value, std::memory_order_relaxed);
+    histogram->count.store(count + 1, std::memory_order_release);
+}
+
+// Creates the region and hands out slots, owned by the process that records
+class LatencyRecorder {
+    private:
+        std::string shm_name;
+        uint64_t region_size = 0;
+        latency_shm_header *header = nullptr;
+        latency_slot *slots = nullptr;
+        std::unordered_map<uint64_t, latency_slot*> slot_map;
+
+    public:
+        LatencyRecorder(std::string process_name, uint32_t max_slots = LATENCY_DEFAULT_SLOTS);
+        ~LatencyRecorder();
+        latency_slot *get_slot(uint32_t instrument_id, uint8_t stream_kind);
+        std::string get_shm_name();
+};
+
+// Maps an existing region read only
+class LatencyReader {
+    private:
+        uint64_t region_size = 0;
+        latency_shm_header *header = nullptr;
+        latency_slot *slots = nullptr;
+
+    public:
+        LatencyReader(std::string shm_name);
+        ~LatencyReader();
+        bool is_open();
+        latency_shm_header *get_header();
+        uint32_t get_num_slots();
+        latency_slot *get_slot(uint32_t slot_number);
+        static uint64_t get_percentile(const uint64_t *buckets, uint64_t count, double percentile);
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+#include "from_aeron.hpp"
+#include "to_aeron.hpp"
+#include "logger.hpp"
+#include "sl.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#define CONFLATOR_DEFAULT_INTERVAL_MS 100
+#define CONFLATOR_BUFFER_SIZE 16*1024*1024
+
+// Trades on one side of the book within an interval
+struct conflated_trades {
+    uint32_t num_trades;
+    double qty;
+    double notional;
+    double last_price;              // for an interval that only had zero qty trades
+    uint64_t first_receive_timestamp;
+    uint64_t last_receive_timestamp;
+    uint64_t last_exchange_timestamp;
+    char exchange_trade_id_first[sizeof(Trade::exchange_trade_id_first)];
+    char exchange_trade_id_last[sizeof(Trade::exchange_trade_id_last)];
+};
+
+struct conflated_instrument {
+    uint32_t instrument_id;
+    uint8_t exchange_id;
+    bool dirty;
+    uint64_t interval_seq;
+    uint32_t num_source_messages;
+
+    bool has_tob;
+    ToBUpdate last_tob;
+
+    bool book_reset;
+    InstrumentClearBook clear_msg;
+
+    // Net change per price level since the last interval, the last action on a level wins
+    bool has_pl;
+    std::vector<PriceLevelDetails> level_changes;
+    uint64_t start_seq_number;
+    uint64_t end_seq_number;
+    uint64_t pl_receive_timestamp;
+    uint64_t pl_exchange_timestamp;
+
+    // Indexed buy, sell, unknown side
+    conflated_trades trades[3];
+};
+
+// Reads AERON_IO and publishes a per instrument conflated view on AERON_CF every interval
+class MDConflator {
+    private:
+        Logger *logger;
+        from_aeron *from_aeron_io;
+        to_aeron *to_aeron_cf;
+        std::function<fragment_handler_t()> io_fh;
+
+        uint64_t interval_ns;
+        uint64_t stream_seq = 0;
+
+        // Protects instruments, taken by the aeron reader and the publishing thread
+        SL instrument_lock;
+        std::unordered_map<uint32_t, conflated_instrument*> instruments;
+
+        // Everything for an interval is serialised here under the lock and sent after it is released
+        char *publish_buffer;
+        uint32_t publish_length;
+        uint32_t publish_messages;
+
+        fragment_handler_t process_io_messages();
+        conflated_instrument *get_instrument(uint32_t instrument_id, uint8_t exchange_id);
+        void add_level_change(conflated_instrument *instrument, PriceLevelDetails *pl_detail, bool is_snapshot);
+        void add_trade(conflated_instrument *instrument, Trade *trade);
+        char *reserve(uint32_t length);
+        void serialise_instrument(conflated_instrument *instrument, uint64_t interval_start, uint64_t interval_end);
+        void publish_interval(uint64_t interval_start, uint64_t interval_end);
+        void start_publisher();
+
+        uint64_t get_current_ts();
+
+    public:
+        MDConflator(Logger *_logger, uint64_t interval_millis = CONFLATOR_DEFAULT_INTERVAL_MS);
+};
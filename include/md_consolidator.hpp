@@ -0,0 +1,102 @@
+#pragma once
+
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+#include "from_aeron.hpp"
+#include "to_aeron.hpp"
+#include "logger.hpp"
+#include "sl.hpp"
+#include "array_orderbook.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#define CONSOLIDATOR_MAX_VENUES             16      // instruments per asset pair
+#define CONSOLIDATOR_BOOK_TICKS             1024    // only the touch is used, keep the books small
+#define CONSOLIDATOR_DEFAULT_STALE_MS       0       // 0 - venues are only taken out by a book clear
+#define CONSOLIDATOR_LOOP_MS                100
+
+#define CONSOLIDATOR_BID                    0
+#define CONSOLIDATOR_ASK                    1
+
+struct consolidated_pair;
+
+// One instrument quoting the pair. The touch comes from an ArrayOrderbook fed with both the
+// ToB and the depth updates, so venues with either or both feeds are handled the same way.
+struct consolidated_venue {
+    uint32_t instrument_id;
+    uint8_t exchange_id;
+    uint8_t venue_index;                // in the pair's venues
+    consolidated_pair *pair;
+    ArrayOrderbook *book;
+    double price[2];
+    double qty[2];
+    int8_t heap_position[2];            // -1 when not quoting that side
+    uint64_t last_update;
+};
+
+// Every side keeps the venues quoting it in a binary heap with the best at the top and each
+// venue knowing its position, so a venue update is a sift up or down - O(log venues).
+struct consolidated_pair {
+    uint32_t base_asset_id;
+    uint32_t quote_asset_id;
+    uint8_t num_venues;
+    consolidated_venue *venues[CONSOLIDATOR_MAX_VENUES];
+    uint8_t heap[2][CONSOLIDATOR_MAX_VENUES];
+    uint8_t heap_size[2];
+    uint64_t sequence_nr;
+
+    // What was last published, a new message goes out when the top of a heap differs
+    double published_price[2];
+    double published_qty[2];
+    uint32_t published_instrument_id[2];
+};
+
+// Reads ToB and depth updates from AERON_IO and publishes the best bid and offer per asset
+// pair over all venues back on AERON_IO as ConsolidatedToB. Which instruments make up a pair
+// is given with add_instrument (from RefDB), updates for anything else are ignored.
+class MDConsolidator {
+    private:
+        Logger *logger;
+        from_aeron *from_aeron_io;
+        to_aeron *to_aeron_io;
+        std::function<fragment_handler_t()> io_fh;
+
+        uint64_t stale_ns;
+
+        // Protects the pairs and venues, taken by the aeron reader and the housekeeping thread
+        SL consolidator_lock;
+        std::unordered_map<uint32_t, consolidated_venue*> venues;
+        std::unordered_map<uint64_t, consolidated_pair*> pairs;
+        ConsolidatedToB consolidated_tob;
+
+        uint64_t num_updates = 0;
+        uint64_t num_published = 0;
+
+        fragment_handler_t process_io_messages();
+        bool is_better(int side, consolidated_venue *venue, consolidated_venue *other);
+        void heap_swap(consolidated_pair *pair, int side, int position, int other_position);
+        void heap_sift_up(consolidated_pair *pair, int side, int position);
+        void heap_sift_down(consolidated_pair *pair, int side, int position);
+        void heap_update(consolidated_pair *pair, int side, consolidated_venue *venue, double price, double qty);
+        void update_venue(consolidated_venue *venue, uint64_t receive_timestamp, uint64_t exchange_timestamp);
+        void check_best(consolidated_pair *pair, uint64_t receive_timestamp, uint64_t exchange_timestamp);
+        void publish(consolidated_pair *pair, uint64_t receive_timestamp, uint64_t exchange_timestamp);
+        void remove_stale_venues();
+        void start_housekeeping();
+
+        uint64_t get_current_ts();
+
+    public:
+        MDConsolidator(Logger *_logger, uint64_t stale_millis = CONSOLIDATOR_DEFAULT_STALE_MS);
+        bool add_instrument(uint32_t instrument_id, uint8_t exchange_id, uint32_t base_asset_id, uint32_t quote_asset_id);
+        void start();
+        uint32_t get_num_pairs();
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+#include "from_aeron.hpp"
+#include "to_aeron.hpp"
+#include "logger.hpp"
+#include "sl.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#define COORDINATOR_DEFAULT_INTERVAL_S      30
+#define COORDINATOR_DEFAULT_THRESHOLD       1.25    // rebalance when the busiest shard is this much above the average
+#define COORDINATOR_DEFAULT_MAX_MIGRATIONS  8       // instruments moved per rebalance
+#define COORDINATOR_LOAD_FACTOR             1.25    // no shard is given more than this times the average load
+#define COORDINATOR_VNODES_PER_SHARD        64
+#define COORDINATOR_MIN_RATE                1.0     // quiet instruments still cost a few sockets, spread them by count
+#define COORDINATOR_LOOP_MS                 500
+#define COORDINATOR_SHARD_TIMEOUT_MS        5000
+#define COORDINATOR_STARTUP_GRACE_MS        5000    // learn who owns what from the status reports before assigning
+#define COORDINATOR_MIGRATION_TIMEOUT_MS    60000
+#define COORDINATOR_ACTIVE_RETRY_MS         10000
+
+// Where an instrument is in a move between shards
+#define MIGRATION_NONE                      0
+#define MIGRATION_STANDBY_SENT              1       // target is subscribing and syncing
+#define MIGRATION_RELEASE_SENT              2       // owner is handing over to the target
+#define MIGRATION_ACTIVE_SENT               3       // no owner, target publishes straight away
+
+struct coordinator_shard {
+    uint32_t shard_id;
+    uint32_t pid;
+    uint64_t last_status_time;
+    double load;                    // message rate of the instruments it is active for
+
+    // A report can come in several parts, it is applied once all of them are in
+    uint64_t pending_timestamp;
+    uint16_t pending_parts;
+    std::vector<shard_instrument_status> pending;
+
+    // Last complete report
+    std::unordered_map<uint32_t, shard_instrument_status> reported;
+};
+
+struct coordinator_instrument {
+    uint32_t instrument_id;
+    bool in_universe;
+    double message_rate;
+    uint32_t owner;                 // shard publishing it, 0 for none
+    uint32_t target;                // shard it is moving to, 0 when not moving
+    uint8_t migration_step;
+    uint32_t source;                // owner when the move started, it hands over to the target
+    uint64_t migration_start;
+};
+
+// Spreads the Binance instruments over the svc_md_binance shards on AERON_MC.
+//
+// Placement is consistent hashing with bounded load: every shard has a number of points on a
+// hash ring and an instrument goes to the first shard clockwise from its own hash that still
+// has room, where room is COORDINATOR_LOAD_FACTOR times the average message rate. Instruments
+// stay with their current owner as long as it has room, so adding or losing a shard only moves
+// the instruments that have to move.
+//
+// A move never leaves the instrument unpublished: the target subscribes on standby, once its
+// book is in sync the owner is told to release and hands its last sequence number and exchange
+// time straight to the target, which publishes from there (see ShardHandover).
+class MDCoordinator {
+    private:
+        Logger *logger;
+        from_aeron *from_aeron_mc;
+        to_aeron *to_aeron_mc;
+        std::function<fragment_handler_t()> mc_fh;
+
+        uint64_t rebalance_interval_ns;
+        double imbalance_threshold;
+        uint32_t max_migrations;
+
+        uint64_t start_time;
+        uint64_t last_rebalance_time = 0;
+        bool membership_changed = false;
+
+        // Protects everything below, taken by the aeron reader and the coordinator thread
+        SL coordinator_lock;
+        std::map<uint32_t, coordinator_shard*> shards;
+        std::unordered_map<uint32_t, coordinator_instrument*> instruments;
+        std::vector<std::pair<uint64_t, uint32_t>> ring;
+
+        fragment_handler_t process_mc_messages();
+        coordinator_shard *get_shard(uint32_t shard_id);
+        coordinator_instrument *get_instrument(uint32_t instrument_id);
+        void process_register(ShardRegister *register_msg);
+        void process_status(ShardStatus *status);
+        void apply_report(coordinator_shard *shard);
+        void expire_shards(uint64_t current_ts);
+        void rebuild_ring();
+        void compute_placement(std::unordered_map<uint32_t, uint32_t> &placement);
+        void update_loads();
+        double get_imbalance();
+        void start_migration(coordinator_instrument *instrument, uint32_t target, uint64_t current_ts);
+        void assign_orphans(std::unordered_map<uint32_t, uint32_t> &placement, uint64_t current_ts);
+        void progress_migrations(uint64_t current_ts);
+        void rebalance(std::unordered_map<uint32_t, uint32_t> &placement, uint64_t current_ts);
+        void send_assignment(uint32_t shard_id, uint8_t action, uint32_t instrument_id, uint32_t to_shard_id = 0);
+        void flush_assignments();
+        void start_coordinator();
+
+        // Assignments are batched per shard/action/to_shard during a round and sent at the end
+        std::map<std::tuple<uint32_t, uint8_t, uint32_t>, std::vector<uint32_t>> outgoing;
+
+        uint64_t get_current_ts();
+        static uint64_t splitmix64(uint64_t value);
+
+    public:
+        MDCoordinator(Logger *_logger, uint64_t interval_seconds = COORDINATOR_DEFAULT_INTERVAL_S,
+                      double threshold = COORDINATOR_DEFAULT_THRESHOLD, uint32_t max_migrations_per_round = COORDINATOR_DEFAULT_MAX_MIGRATIONS);
+        void set_universe(std::vector<uint32_t> &instrument_ids);
+};
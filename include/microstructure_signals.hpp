@@ -0,0 +1,85 @@
+#pragma once
+
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#define SIGNALS_DEFAULT_INTERVAL_MS     10      // at most one SignalBlock per instrument this often
+#define SIGNALS_DEFAULT_TOP_LEVELS      5
+#define SIGNALS_DEFAULT_DISTANCE_BPS    10
+
+// One side of the book. Levels are keyed so that better is always smaller (-price for bids), and
+// two running windows are kept over them:
+//  - the top levels: count, quantity and notional of the best top_levels levels, top_last is the
+//    worst level in it
+//  - the band: quantity of the levels within distance of the touch, band_end is the first level
+//    outside of it
+// A level change only touches the window sums if it falls inside a window. When the touch moves
+// the band edge walks over the levels that cross it, nothing is ever summed over the whole side.
+struct signal_side {
+    std::map<double, double> levels;
+    uint32_t top_count;
+    double top_qty;
+    double top_notional;
+    std::map<double, double>::iterator top_last;
+    double band_limit;
+    double band_qty;
+    std::map<double, double>::iterator band_end;
+};
+
+struct signal_instrument {
+    uint32_t instrument_id;
+    uint8_t exchange_id;
+    signal_side bids;
+    signal_side asks;
+    bool valid;                         // false while a multi message snapshot is coming in
+    bool dirty;                         // changed since the last SignalBlock
+    bool queued;                        // in the list of instruments with a SignalBlock due
+    uint64_t last_publish;
+    uint64_t receive_timestamp;
+    uint64_t exchange_timestamp;
+};
+
+// Microprice, top of book imbalance, depth weighted mid and depth near the touch per instrument,
+// kept up to date from the same depth updates as the MergedOrderbook and published as SignalBlock.
+// A SignalBlock goes out at most once per interval per instrument, changes in between are folded
+// into the next one which publish_due sends once the interval has passed.
+class MicrostructureSignals {
+    private:
+        uint64_t interval_ns;
+        uint32_t top_levels;
+        uint32_t distance_bps;
+        double distance;
+        std::function<void(char *, uint32_t)> publish_callback;
+
+        std::unordered_map<uint32_t, signal_instrument*> instruments;
+        std::vector<signal_instrument*> due;
+        char block_buffer[sizeof(SignalBlock) + (MS_SIGNAL_COUNT * sizeof(SignalBlockItem))];
+
+        uint64_t num_level_changes = 0;
+        uint64_t num_published = 0;
+
+        signal_instrument *get_instrument(uint32_t instrument_id, uint8_t exchange_id);
+        void clear_side(signal_side &side);
+        void set_level(signal_side &side, double key, double qty);
+        void delete_level(signal_side &side, double key);
+        void move_band(signal_side &side);
+        void publish(signal_instrument *instrument, uint64_t now);
+        uint64_t get_current_ts();
+
+    public:
+        MicrostructureSignals(std::function<void(char *, uint32_t)> _publish_callback, uint64_t interval_millis = SIGNALS_DEFAULT_INTERVAL_MS,
+                                uint32_t _top_levels = SIGNALS_DEFAULT_TOP_LEVELS, uint32_t _distance_bps = SIGNALS_DEFAULT_DISTANCE_BPS);
+        void process_update(PLUpdates *pl_update);
+        void clear_book(uint32_t instrument_id, uint8_t exchange_id);
+        void publish_due();
+        std::string get_stats();
+};
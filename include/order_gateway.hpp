@@ -0,0 +1,192 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <deque>
+#include <cstring>
+#include <strings.h>
+#include <time.h>
+#include <curl/curl.h>
+
+// Internal projects
+#include "aeron_types.hpp"
+#include "logger.hpp"
+#include "MyRingBuffer.hpp"
+#include "rate_limit_scheduler.hpp"
+
+#define GATEWAY_MAX_ENDPOINTS 4
+#define GATEWAY_MAX_URL_LENGTH 512
+#define GATEWAY_RESPONSE_SIZE 8192
+#define GATEWAY_DEFAULT_IN_FLIGHT 16
+#define GATEWAY_DEFAULT_CONNECTIONS 4
+// Handles only ever used for cancels, so a burst of new orders can't hold them all
+#define GATEWAY_CANCEL_RESERVE 4
+// An endpoint that has been quiet for this long gets a ping so its connections stay open
+#define GATEWAY_KEEPALIVE_NS 30000000000L
+#define GATEWAY_STATS_NS 60000000000L
+#define GATEWAY_REQUEST_TIMEOUT_MS 10000L
+// Orders held back by the rate limits longer than this are rejected, they would only go out stale
+#define GATEWAY_MAX_HOLD_NS 1000000000L
+// How often the gateway looks at held requests again
+#define GATEWAY_HELD_POLL_MS 1
+#define GATEWAY_MAX_USAGE_HEADERS 4
+// One queue per rate limit class that can be held: cancels, reduce-only orders, new orders
+#define GATEWAY_NUM_QUEUES 3
+// Futures batchOrders - up to 5 new orders or 10 cancels of one symbol in a request
+#define GATEWAY_MAX_BATCH_ORDERS 5
+#define GATEWAY_MAX_BATCH_CANCELS 10
+#define GATEWAY_MAX_BATCH_ITEM 384
+#define GATEWAY_MAX_BATCH_BODY ((GATEWAY_MAX_BATCH_ORDERS * (GATEWAY_MAX_BATCH_ITEM + 3)) + 256)
+// Weight of a batch whatever is in it, the orders in it count one each against the order limits
+#define GATEWAY_BATCH_ORDER_WEIGHT 5
+#define GATEWAY_BATCH_CANCEL_WEIGHT 1
+
+enum gateway_launch_result {
+  GATEWAY_LAUNCHED,
+  GATEWAY_NO_HANDLE,
+  GATEWAY_THROTTLED
+};
+
+enum gateway_request_type {
+  GATEWAY_NEW_ORDER,
+  GATEWAY_CANCEL_ORDER,
+  GATEWAY_PING
+};
+
+// Request from the aeron thread, everything needed to send it and to report back on it is copied in
+struct gateway_request {
+    uint8_t request_type;
+    uint8_t endpoint;
+    bool reduce_only;
+    char url[GATEWAY_MAX_URL_LENGTH];
+    uint64_t internal_order_id;
+    char external_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    CancelOrder cancel_request;
+    uint64_t receive_ts;
+    // Endpoints that batch - the order as a batchOrders element (url encoded json), for a cancel the
+    // symbol. Requests without one always go out on their own.
+    uint32_t instrument_id;
+    char batch_item[GATEWAY_MAX_BATCH_ITEM];
+    uint16_t batch_item_length;
+};
+typedef MyRingBuffer<gateway_request, 1024> GatewayRequestRingT;
+
+// Requests of one endpoint and class waiting to go out together, in the order they came
+struct gateway_batch {
+    gateway_request requests[GATEWAY_MAX_BATCH_CANCELS];
+    int num_requests;
+    uint64_t first_ts;
+};
+
+// One of these per curl easy handle, the handle and the response buffer are reused for every request
+struct gateway_context {
+    CURL *easy;
+    gateway_request request;
+    // A batch has its requests here in the order of the results in the response, request is the first of them
+    gateway_request batch[GATEWAY_MAX_BATCH_CANCELS];
+    int batch_size;                 // 0 when it is a single request
+    char body[GATEWAY_MAX_BATCH_BODY];
+    char response[GATEWAY_RESPONSE_SIZE];
+    uint32_t length;
+    bool overflow;
+    long response_code;
+    // From the response headers
+    rate_limit_usage usage[GATEWAY_MAX_USAGE_HEADERS];
+    int num_usage;
+    uint64_t retry_after_ns;
+    CURLcode result;
+    uint64_t send_ts;
+    uint64_t complete_ts;
+    bool in_use;
+};
+
+// Everything the gateway knows about a REST endpoint, connections to it are kept in curl's pool
+struct gateway_endpoint {
+    std::string base_url;
+    std::string ping_url;
+    uint64_t last_request;
+    RateLimitScheduler *scheduler;
+    // Batching is on when there is a batch url
+    std::string batch_url;
+    uint64_t batch_window_ns;
+};
+
+// Sends order entry REST requests from a thread of its own on a curl multi handle, so the aeron
+// thread only builds the url and queues it. Many requests are in flight at the same time over
+// keep-alive (HTTP/2 multiplexed where the exchange offers it) connections that are opened at
+// startup and pinged when idle. Cancels, reduce-only orders and new orders have a queue each and
+// are started in that order. An endpoint can have a rate limit scheduler, requests it won't let
+// through yet are held per endpoint (so one exchange being throttled doesn't hold up the others)
+// and orders held for longer than GATEWAY_MAX_HOLD_NS go to the expiry callback instead.
+// On endpoints that batch, requests of a class that are queued together (or within the batch
+// window of the first) go out as one batch request, the body is built by the batch callback.
+// Finished requests are handed to the completion callback on the gateway thread.
+class OrderGateway {
+    private:
+        Logger *logger = nullptr;
+        int max_in_flight;
+        int num_in_flight = 0;
+        int connections_per_endpoint;
+        std::function<void(gateway_context *)> completion_callback;
+        std::function<void(gateway_request *)> expiry_callback;
+        std::function<int(gateway_request *, int, char *)> batch_callback;
+        struct curl_slist *headers = NULL;
+
+        // Channels from the aeron thread (single producer / single consumer each)
+        GatewayRequestRingT request_rings[GATEWAY_NUM_QUEUES];
+
+        // Gateway thread only
+        CURLM *multi_handle;
+        std::vector<gateway_context*> contexts;
+        std::vector<gateway_context*> free_contexts;
+        gateway_endpoint endpoints[GATEWAY_MAX_ENDPOINTS];
+        int num_endpoints = 0;
+        std::deque<gateway_request> held_requests[GATEWAY_MAX_ENDPOINTS][GATEWAY_NUM_QUEUES];
+        int num_held = 0;
+        gateway_batch pending_batches[GATEWAY_MAX_ENDPOINTS][GATEWAY_NUM_QUEUES];
+        int num_pending = 0;
+        uint64_t last_stats = 0;
+        uint64_t num_orders = 0;
+        uint64_t num_cancels = 0;
+        uint64_t num_failed = 0;
+        uint64_t num_throttled = 0;
+        uint64_t num_expired = 0;
+        uint64_t num_batches = 0;
+        int peak_in_flight = 0;
+
+        uint64_t get_current_ts_ns();
+        static int request_class(gateway_request *request);
+        static int batch_limit(gateway_request *request);
+        int launch_request(gateway_request *request, uint64_t current_ts, gateway_batch *batch = nullptr);
+        int launch_batch(int endpoint, int queue, uint64_t current_ts);
+        bool add_to_batch(gateway_request *request, int queue, uint64_t current_ts);
+        bool launch_batches(int queue, uint64_t current_ts);
+        bool launch_held_requests(int queue, uint64_t current_ts);
+        void launch_requests(uint64_t current_ts);
+        void send_ping(int endpoint, uint64_t current_ts);
+        void send_pings(uint64_t current_ts);
+        void complete_request(gateway_context *context, CURLcode result);
+        void gateway_loop();
+
+        static size_t write_callback(char *buffer, size_t size, size_t nmemb, void *data);
+        static size_t header_callback(char *buffer, size_t size, size_t nitems, void *data);
+
+    public:
+        OrderGateway(Logger *_logger, std::string header_line, std::function<void(gateway_context *)> _completion_callback,
+                        int _max_in_flight = GATEWAY_DEFAULT_IN_FLIGHT, int _connections_per_endpoint = GATEWAY_DEFAULT_CONNECTIONS);
+
+        // Called before start
+        uint8_t add_endpoint(std::string base_url);
+        void set_rate_limits(uint8_t endpoint, RateLimitScheduler *scheduler);
+        void set_expiry_callback(std::function<void(gateway_request *)> _expiry_callback);
+        void set_ca_file(std::string ca_file);
+        // batch_path is relative to the endpoint (batchOrders), window_ns 0 only batches what is queued together
+        void set_batching(uint8_t endpoint, std::string batch_path, uint64_t window_ns,
+                            std::function<int(gateway_request *, int, char *)> _batch_callback);
+        void start();
+
+        // Called from the aeron thread
+        void send_request(gateway_request &&request);
+};
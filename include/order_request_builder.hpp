@@ -0,0 +1,109 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include <wolfssl/options.h>
+#include <wolfssl/wolfcrypt/sha256.h>
+#include "double_to_ascii.hpp"
+
+#define HMAC_BLOCK_SIZE                 64
+#define HMAC_DIGEST_SIZE                32
+#define HMAC_HEX_SIZE                   64
+#define ORDER_TEMPLATE_PREFIX_LENGTH    256
+#define ORDER_TEMPLATE_SYMBOL_LENGTH    24
+
+// -----------------------------------------------------------------------
+// Lowercase hex of length bytes into output (2 * length chars, not terminated)
+// 16 bytes at a time with a shuffle lookup where SSSE3 is there
+// -----------------------------------------------------------------------
+inline int hex_encode(const unsigned char *input, int length, char *output) {
+    static const char lookup_table[] = "0123456789abcdef";
+    int i = 0;
+#ifdef __SSSE3__
+    const __m128i lookup = _mm_loadu_si128((const __m128i *) lookup_table);
+    const __m128i low_nibble = _mm_set1_epi8(0x0f);
+    for(; (i + 16) <= length; i += 16){
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (input + i));
+        __m128i high = _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(bytes, 4), low_nibble));
+        __m128i low = _mm_shuffle_epi8(lookup, _mm_and_si128(bytes, low_nibble));
+        _mm_storeu_si128((__m128i *) (output + (2 * i)), _mm_unpacklo_epi8(high, low));
+        _mm_storeu_si128((__m128i *) (output + (2 * i) + 16), _mm_unpackhi_epi8(high, low));
+    }
+#endif
+    for(; i < length; i++){
+        output[2 * i] = lookup_table[input[i] >> 4];
+        output[(2 * i) + 1] = lookup_table[input[i] & 0x0f];
+    }
+    return(2 * length);
+}
+
+// HMAC-SHA256 with the key folded in once: the SHA256 states after the key^ipad and key^opad
+// blocks are kept, so signing is a copy of each state plus hashing the message and the inner
+// digest - two compressions of the pads fewer per signature and no key setup at all.
+class HmacSigner {
+    private:
+        wc_Sha256 inner_state;
+        wc_Sha256 outer_state;
+
+    public:
+        HmacSigner(const char *key, size_t key_length);
+        ~HmacSigner();
+        void sign(const char *msg, size_t msg_length, unsigned char *digest);
+        int sign_hex(const char *msg, size_t msg_length, char *output);
+};
+
+// Everything in a new order/cancel query that doesn't change between orders of an instrument:
+// "<rest_endpoint>order?symbol=BTCUSDT&side=BUY&type=LIMIT&timeInForce=GTC&quantity="
+// Only quantity, price, client order id, timestamp and the signature are written per order.
+struct order_template {
+    uint32_t instrument_id;
+    uint8_t price_precision;
+    uint8_t qty_precision;
+    uint16_t body_offset;               // the signed part starts after "order?"
+    char buy_prefix[ORDER_TEMPLATE_PREFIX_LENGTH];
+    uint16_t buy_prefix_length;
+    char sell_prefix[ORDER_TEMPLATE_PREFIX_LENGTH];
+    uint16_t sell_prefix_length;
+    char cancel_prefix[ORDER_TEMPLATE_PREFIX_LENGTH];
+    uint16_t cancel_prefix_length;
+    // Futures batchOrders element (url encoded json) up to the quantity
+    char buy_batch_prefix[ORDER_TEMPLATE_PREFIX_LENGTH];
+    uint16_t buy_batch_prefix_length;
+    char sell_batch_prefix[ORDER_TEMPLATE_PREFIX_LENGTH];
+    uint16_t sell_batch_prefix_length;
+    char symbol[ORDER_TEMPLATE_SYMBOL_LENGTH];
+};
+
+// Builds signed Binance REST order and cancel urls into a caller supplied buffer, no allocations
+// once the instrument has its template. Only to be used from one thread.
+class OrderRequestBuilder {
+    private:
+        HmacSigner *signer;
+        std::unordered_map<uint32_t, order_template*> templates;
+
+        int write_prefix(char *output, std::string &rest_endpoint, const char *instrument_name, const char *params);
+        int write_batch_prefix(char *output, const char *instrument_name, const char *side);
+        int write_signed_tail(char *url, char *url_end, uint16_t body_offset, uint64_t timestamp_millis);
+
+    public:
+        OrderRequestBuilder(std::string secret_key);
+        order_template *get_template(uint32_t instrument_id);
+        order_template *add_template(uint32_t instrument_id, std::string rest_endpoint, const char *instrument_name,
+                                        uint8_t price_precision, uint8_t qty_precision, bool cancel_with_type);
+        int build_new_order(order_template *order_tmpl, bool is_buy, double price, double qty, const char *client_order_id,
+                                uint64_t timestamp_millis, char *output);
+        int build_cancel(order_template *order_tmpl, const char *client_order_id, uint64_t timestamp_millis, char *output);
+
+        // Futures batches - the signed params go in the body of a request to batchOrders
+        int build_batch_order_item(order_template *order_tmpl, bool is_buy, double price, double qty, const char *client_order_id, char *output);
+        int build_batch_orders(const char **items, const uint16_t *item_lengths, int num_items, uint64_t timestamp_millis, char *output);
+        int build_batch_cancel(const char *symbol, const char **client_order_ids, int num_ids, uint64_t timestamp_millis, char *output);
+        int sign_hex(const char *msg, size_t msg_length, char *output);
+};
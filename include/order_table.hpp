@@ -0,0 +1,119 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+// Internal projects
+#include "aeron_types_ext.hpp"
+#include "sl.hpp"
+
+// Both are rounded up to powers of two
+#define ORDER_TABLE_DEFAULT_CAPACITY    65536
+#define ORDER_TABLE_DEFAULT_HISTORY     16384
+// Indexes are twice the slab so probe sequences stay short when it is full
+#define ORDER_TABLE_INDEX_FACTOR        2
+#define ORDER_TABLE_EMPTY               0
+#define ORDER_TABLE_NOT_FOUND           UINT32_MAX
+
+enum order_record_state {
+  ORDER_RECORD_FREE,
+  ORDER_RECORD_OPEN,
+  ORDER_RECORD_CLOSED
+};
+
+enum order_key_type {
+  ORDER_KEY_INTERNAL,
+  ORDER_KEY_EXTERNAL,
+  ORDER_KEY_EXCHANGE
+};
+
+// One order as the trade adapter knows it, the ids are stored inline so a lookup never leaves the slab
+struct order_record {
+    SendOrder order;
+    char external_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH];   // zero padded, compared over the full width
+    uint64_t exchange_order_id;                             // 0 until the exchange has acked
+    uint8_t state;
+    TraceContext trace;                                     // magic 0 when the order came without one
+};
+
+struct order_table_stats {
+    uint32_t capacity;
+    uint32_t history_capacity;
+    uint32_t num_open;
+    uint32_t num_closed;
+    uint32_t peak_open;
+    uint32_t max_probe;
+    uint64_t num_inserts;
+    uint64_t num_retired;
+    uint64_t num_evicted;
+    uint64_t num_full;
+};
+
+// All orders of the trade adapter in a fixed size slab, found by internal, external or exchange order id
+// through open addressing indexes (linear probing, backward shift on delete - no tombstones). Orders that
+// are done (filled, cancelled, rejected) are retired into a history ring where they can still be looked up
+// for late messages, and the oldest of them is evicted when the ring or the slab fills up. Nothing is
+// allocated after the constructor. Used from the aeron thread and the exchange reader threads, so every
+// call takes the lock and lookups copy the record out.
+class OrderTable {
+    private:
+        SL table_lock;
+        uint32_t capacity;
+        uint32_t index_mask;
+        order_record *records;
+
+        // Slot number + 1 per index position, ORDER_TABLE_EMPTY where there is none
+        uint32_t *internal_index;
+        uint32_t *external_index;
+        uint32_t *exchange_index;
+
+        uint32_t *free_slots;
+        uint32_t num_free;
+
+        uint32_t *history;
+        uint32_t history_capacity;
+        uint32_t history_head = 0;
+        uint32_t history_count = 0;
+
+        order_table_stats stats = {};
+
+        static uint64_t mix_hash(uint64_t key);
+        static uint64_t external_hash(const char *key);
+        static void make_external_key(const char *external_order_id, char *key);
+
+        uint64_t slot_hash(uint32_t slot, int key_type);
+        uint32_t find_internal_slot(uint64_t internal_order_id);
+        uint32_t find_external_slot(const char *key);
+        uint32_t find_exchange_slot(uint64_t exchange_order_id);
+        void index_insert(uint32_t *index, uint64_t hash, uint32_t slot);
+        void index_remove(uint32_t *index, int key_type, uint32_t slot);
+        void evict_oldest();
+        bool retire_slot(uint32_t slot);
+        bool stamp_slot(uint32_t slot, int point, uint64_t ts, TraceContext *trace);
+
+    public:
+        OrderTable(uint32_t _capacity = ORDER_TABLE_DEFAULT_CAPACITY, uint32_t _history_capacity = ORDER_TABLE_DEFAULT_HISTORY);
+
+        // false when the slab is full of open orders
+        bool insert(SendOrder *order, const char *external_order_id, uint64_t exchange_order_id = 0, TraceContext *trace = nullptr);
+        bool link_exchange_order_id(const char *external_order_id, uint64_t exchange_order_id);
+
+        bool find_by_internal(uint64_t internal_order_id, order_record *record);
+        bool find_by_external(const char *external_order_id, order_record *record);
+        bool find_by_exchange(uint64_t exchange_order_id, order_record *record);
+
+        // Order is done - kept in the history until it is the oldest there
+        bool retire_by_external(const char *external_order_id, order_record *record = nullptr);
+        bool retire_by_exchange(uint64_t exchange_order_id, order_record *record = nullptr);
+
+        // Stamps a point on the trace of the order the first time it gets there (fills every time)
+        // and copies the trace out if asked for - false if the order has no trace
+        bool stamp_trace(uint64_t internal_order_id, int point, uint64_t ts, TraceContext *trace = nullptr);
+        bool stamp_trace(const char *external_order_id, int point, uint64_t ts, TraceContext *trace = nullptr);
+
+        // Open orders in slots first_slot..first_slot + num_slots, for going over the slab a bit at a time
+        uint32_t copy_open(uint32_t first_slot, uint32_t num_slots, order_record *output);
+
+        order_table_stats get_stats();
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+
+// Internal projects
+#include "aeron_types_ext.hpp"
+#include "sl.hpp"
+
+#define RATE_LIMIT_MAX_WINDOWS          4
+// Share of a budget each request class may use - cancels can always use all of it
+#define RATE_LIMIT_WARNING_FRACTION     0.70
+#define RATE_LIMIT_NEW_ORDER_FRACTION   0.80
+#define RATE_LIMIT_REDUCE_ONLY_FRACTION 0.90
+// Backoff when a 429/418 comes without a Retry-After
+#define RATE_LIMIT_DEFAULT_BACKOFF_NS   1000000000L
+#define RATE_LIMIT_DEFAULT_BAN_NS       60000000000L
+
+// In priority order, a class is only held back once the ones before it would be too
+enum rate_limit_class {
+  RATE_CLASS_CANCEL,
+  RATE_CLASS_REDUCE_ONLY,
+  RATE_CLASS_NEW_ORDER,
+  RATE_CLASS_PING,
+  RATE_NUM_CLASSES
+};
+
+// One budget of the exchange - fixed windows on the wall clock, the way Binance counts them
+struct rate_limit_window {
+    uint8_t limit_type;             // RATE_LIMIT_WEIGHT or RATE_LIMIT_ORDERS
+    uint64_t interval_ns;
+    uint32_t limit;
+    uint64_t window_start;
+    uint32_t used;
+};
+
+// Usage as the exchange reported it, from the response headers or the websocket API rateLimits
+struct rate_limit_usage {
+    uint8_t limit_type;
+    uint64_t interval_ns;
+    uint32_t used;
+    uint32_t limit;                 // 0 when the exchange didn't say
+};
+
+// Weight and order count budgets of one exchange. Every request is counted locally when it
+// goes out and the counts are raised to what the exchange reports back, so requests in flight
+// are never missed and nothing the exchange counted that we didn't is either. New orders may
+// use RATE_LIMIT_NEW_ORDER_FRACTION of every budget, reduce-only orders a bit more and cancels
+// all of it, so there is always room left to get out of positions and orders. A 429 or 418 stops
+// everything until the Retry-After. Level changes are handed to the status callback to go on
+// the bus. Shared by both order transports, so every call takes the lock.
+class RateLimitScheduler {
+    private:
+        SL scheduler_lock;
+        uint8_t exchange_id;
+        std::function<void(RateLimitStatus *)> status_callback;
+
+        rate_limit_window windows[RATE_LIMIT_MAX_WINDOWS];
+        int num_windows = 0;
+        // Cost of one request of each class, in weight and in orders
+        uint32_t class_weight[RATE_NUM_CLASSES] = {1, 1, 1, 1};
+        uint32_t class_orders[RATE_NUM_CLASSES] = {0, 1, 1, 0};
+
+        uint64_t blocked_until = 0;
+        uint8_t level = RATE_LIMIT_LEVEL_NORMAL;
+        uint32_t num_held = 0;
+
+        static double class_fraction(int request_class);
+        void roll_window(rate_limit_window *window, uint64_t current_ts);
+        rate_limit_window *find_window(uint8_t limit_type, uint64_t interval_ns);
+        uint8_t current_level(uint64_t current_ts, rate_limit_window **worst);
+        void update_level(uint64_t current_ts, RateLimitStatus *status, bool *changed);
+        void publish(RateLimitStatus *status, bool changed);
+
+    public:
+        RateLimitScheduler(uint8_t _exchange_id, std::function<void(RateLimitStatus *)> _status_callback);
+
+        // Called before any requests go out
+        void add_limit(uint8_t limit_type, uint64_t interval_ns, uint32_t limit);
+        void set_class_cost(int request_class, uint32_t weight, uint32_t orders);
+
+        // Counts the request and returns true if it can go out now
+        bool try_acquire(int request_class, uint64_t current_ts);
+        // Same for a request that costs something else than one of its class (batches)
+        bool try_acquire(int request_class, uint32_t weight, uint32_t orders, uint64_t current_ts);
+        // Gives back what try_acquire counted for a request that didn't go out after all
+        void release(int request_class, uint64_t current_ts);
+        // What the exchange says was used, sent_ts is when the request it came back on went out
+        void on_usage(rate_limit_usage *usage, int num_usage, uint64_t sent_ts, uint64_t current_ts);
+        // 429 (banned = false) or 418 (banned = true), retry_after_ns 0 if the exchange didn't say
+        void on_rate_limited(bool banned, uint64_t retry_after_ns, uint64_t current_ts);
+        // Picks up window rolls and the end of a block when nothing else is going on
+        void refresh(uint64_t current_ts);
+
+        static uint64_t interval_from_unit(uint32_t number, char unit);
+};
@@ -7,6 +7,12 @@
 #include <exception>
 #include <chrono>
 #include <string_view>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <vector>
+#include <zlib.h>
+#include "capture_format.hpp"
 
 
 enum RawFileOptions {
@@ -41,6 +47,39 @@ class RawFile {
         std::string_view  message_str_view;
         std::string_view  ts_str_view;
 
+        // Binary capture (see capture_format.hpp) - read straight from the mapped segments
+        bool is_binary_capture = false;
+        std::string capture_base_filename;
+        uint32_t segment_number = 0;
+        int segment_fd = -1;
+        char *segment_base = nullptr;
+        uint64_t segment_length = 0;
+        uint64_t segment_data_end = 0;
+        uint64_t read_offset = 0;
+        capture_frame_header *current_frame = nullptr;
+
+        // Compressed capture - one block at a time is inflated into block_buffer
+        bool is_compressed_capture = false;
+        int capz_fd = -1;
+        std::vector<capture_block_index_entry> block_index;
+        uint64_t block_number = 0;
+        std::vector<char> block_buffer;
+        std::vector<char> compressed_buffer;
+
+        // Time window - see seek_to_time and set_end_time
+        uint64_t end_time = 0;
+        bool reached_end_time = false;
+        bool message_pending = false;
+
+        bool open_capture(std::string filename);
+        bool open_compressed(std::string filename);
+        bool open_segment(std::string segment_filename);
+        bool load_block(uint64_t block_to_load);
+        bool next_capture_chunk();
+        void close_segment();
+        std::string_view read_binary_message();
+        std::string_view read_text_message();
+
     public:
         RawFile(std::string filename, unsigned char options);
         ~RawFile(); // all it does is closes the file appropriately - will also update headers etc in the future
@@ -48,5 +87,10 @@ class RawFile {
         uint64_t get_ts_of_message();
         void write_message(std::string_view dump_line, uint64_t recv_ts);
         std::string_view read_message();
+        bool is_binary();
+        uint8_t get_stream_kind_of_message();
+        uint32_t get_instrument_id_of_message();
+        bool seek_to_time(uint64_t start_ts);
+        void set_end_time(uint64_t end_ts);
 };
 
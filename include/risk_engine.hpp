@@ -0,0 +1,147 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+#include <unordered_map>
+
+// Internal projects
+#include "aeron_types.hpp"
+
+#define RISK_MAX_STRATEGY_SLOTS         64
+#define RISK_MAX_INSTRUMENTS            2048
+// Open addressing instrument id -> instrument slot, twice the slots so probes stay short
+#define RISK_INSTRUMENT_INDEX_SIZE      (RISK_MAX_INSTRUMENTS * 2)
+// Longest rate window that can be enforced, in orders
+#define RISK_MAX_RATE_ORDERS            512
+#define RISK_NO_SLOT                    0xffff
+#define RISK_DEFAULT_MAX_ORDER_VALUE    1000.0
+#define RISK_DEFAULT_PRICE_BAND         0.05
+#define RISK_DEFAULT_TOUCH_MAX_AGE_NS   5000000000L
+#define RISK_DEFAULT_MAX_OPEN_ORDERS    500
+#define RISK_DEFAULT_SHORT_WINDOW_NS    1000000000L
+#define RISK_DEFAULT_SHORT_WINDOW_ORDERS 50
+#define RISK_DEFAULT_LONG_WINDOW_NS     60000000000L
+#define RISK_DEFAULT_LONG_WINDOW_ORDERS 1200
+
+enum risk_check_result {
+  RISK_CHECK_OK,
+  RISK_BREACH_ORDER_VALUE,
+  RISK_BREACH_PRICE_BAND,
+  RISK_BREACH_POSITION,
+  RISK_BREACH_OPEN_ORDERS,
+  RISK_BREACH_SHORT_RATE,
+  RISK_BREACH_LONG_RATE,
+  RISK_BREACH_NO_SLOT
+};
+
+// Limits that aren't in the strategy/instrument info, from the config - 0 turns a check off
+struct risk_config {
+    double max_position_value = 0.0;                        // |position| x price (or contract size), quote currency
+    double price_band = RISK_DEFAULT_PRICE_BAND;            // fraction of the touch on the far side
+    uint64_t touch_max_age_ns = RISK_DEFAULT_TOUCH_MAX_AGE_NS;  // older touches aren't checked against, 0 never too old
+    uint32_t max_open_orders = RISK_DEFAULT_MAX_OPEN_ORDERS;
+    uint64_t short_window_ns = RISK_DEFAULT_SHORT_WINDOW_NS;
+    uint32_t short_window_orders = RISK_DEFAULT_SHORT_WINDOW_ORDERS;
+    uint64_t long_window_ns = RISK_DEFAULT_LONG_WINDOW_NS;
+    uint32_t long_window_orders = RISK_DEFAULT_LONG_WINDOW_ORDERS;
+};
+
+struct risk_strategy_limits {
+    double max_order_value;
+    uint32_t max_open_orders;
+    uint32_t short_window_orders;
+    uint32_t long_window_orders;
+};
+
+struct risk_instrument_limits {
+    double contract_size;
+    double max_position_value;
+    double price_band;
+};
+
+// Everything a check reads, compiled in one go and never changed after it is published
+struct risk_limits {
+    uint64_t version;
+    uint64_t short_window_ns;
+    uint64_t long_window_ns;
+    uint64_t touch_max_age_ns;
+    uint32_t num_strategy_slots;
+    uint32_t num_instrument_slots;
+    risk_strategy_limits default_strategy;
+    risk_instrument_limits default_instrument;
+    risk_strategy_limits strategies[RISK_MAX_STRATEGY_SLOTS];
+    risk_instrument_limits instruments[RISK_MAX_INSTRUMENTS];
+};
+
+// What the checks keep track of per strategy
+struct risk_strategy_state {
+    std::atomic<int32_t> open_orders;
+    uint32_t rate_head;
+    uint64_t send_times[RISK_MAX_RATE_ORDERS];
+};
+
+// Last touch per instrument, from the ToBUpdates on the bus
+struct risk_touch {
+    double bid_price;
+    double ask_price;
+    uint64_t update_ts;             // when it came in, the feed may have stopped since
+};
+
+// Pre-trade checks with the limits compiled into flat arrays indexed by strategy and instrument slot:
+// order value, price band against the last ToBUpdate, position, open orders and two order rate windows.
+// Strategy and instrument info go into the sources and compile() builds a new risk_limits that replaces
+// the current one with an atomic swap, so a check always sees one consistent set. A check doesn't lock,
+// hash or allocate.
+//
+// check, on_order_accepted, on_tob, the set_* and compile run on the aeron thread. on_fill and
+// on_order_closed can come from any of the exchange reader threads.
+class RiskEngine {
+    private:
+        // Sources the limits are compiled from
+        risk_config config;
+        double strategy_max_order_value[256];
+        std::unordered_map<uint32_t, double> instrument_contract_size;
+
+        std::atomic<risk_limits*> current_limits;
+        risk_limits *retired_limits = nullptr;
+        uint64_t limits_version = 0;
+
+        // Slots are handed out once and kept, so the state survives recompiles
+        std::atomic<uint16_t> strategy_slot[256];
+        uint32_t num_strategy_slots = 0;
+        std::atomic<uint32_t> instrument_keys[RISK_INSTRUMENT_INDEX_SIZE];      // instrument id + 1, 0 is empty
+        uint16_t instrument_values[RISK_INSTRUMENT_INDEX_SIZE];
+        uint32_t num_instrument_slots = 0;
+
+        risk_strategy_state *strategy_state;
+        std::atomic<double> *positions;                     // strategy slot x instrument slot
+        risk_touch *touches;
+
+        static uint32_t instrument_hash(uint32_t instrument_id);
+        uint16_t find_instrument_slot(uint32_t instrument_id);
+        uint16_t add_instrument_slot(uint32_t instrument_id);
+        uint16_t get_strategy_slot(uint8_t strategy_id);
+        bool rate_breached(risk_strategy_state *state, uint32_t max_orders, uint64_t window_ns, uint64_t current_ts);
+
+    public:
+        RiskEngine();
+
+        void set_config(risk_config &_config);
+        void set_strategy(uint8_t strategy_id, double max_order_value);
+        void set_instrument(uint32_t instrument_id, double contract_size);
+        void compile();
+        uint64_t get_limits_version();
+
+        uint8_t check(SendOrder *order, uint64_t current_ts);
+        std::string describe_breach(uint8_t result, SendOrder *order);
+        // Order only takes the position of its strategy towards flat, never through it
+        bool reduces_position(SendOrder *order);
+
+        void on_order_accepted(SendOrder *order, uint64_t current_ts);
+        void on_order_closed(uint8_t strategy_id);
+        void on_fill(uint8_t strategy_id, uint32_t instrument_id, bool is_buy, double qty);
+        void on_tob(ToBUpdate *tob, uint64_t current_ts);
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+#include "to_aeron.hpp"
+#include "logger.hpp"
+#include "sl.hpp"
+#include "wsock.hpp"
+#include "shard_publish_gate.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#define SHARD_STATUS_INTERVAL_MS 1000
+
+// Shard side of svc_md_coordinator: registers, reports status, takes assignments from AERON_MC
+// and decides per message whether this shard is the one publishing the instrument
+class ShardMember {
+    private:
+        Logger *logger;
+        uint32_t shard_id;
+        WSock *wsock;
+        std::function<int(uint32_t)> subscribe_instrument;
+
+        // Per instrument state, read by the feed thread for every message and changed by the shard thread
+        ShardPublishGate gate;
+
+        to_aeron *to_aeron_mc;
+        std::unordered_map<uint32_t, instrument_socket_stats> socket_stats;
+        std::vector<std::pair<uint32_t, uint8_t>> instrument_states;
+        ShardStatus status_msg;
+
+        void process_assignment(ShardAssignment *assignment);
+        void process_handover(ShardHandover *handover);
+        void release_instrument(uint32_t instrument_id, uint32_t to_shard_id);
+        void send_register();
+        void send_status();
+        void start();
+
+        uint64_t get_current_ts();
+
+    public:
+        ShardMember(Logger *_logger, uint32_t _shard_id, WSock *_wsock, std::function<int(uint32_t)> _subscribe_instrument);
+        // Feed thread - publish sends a message that was held while we were on standby, publish_book
+        // the clear and snapshot of a book whose held updates didn't reach back to the handover
+        void set_publisher(std::function<void(char *)> publish, std::function<void(uint32_t)> publish_book);
+        bool should_publish(uint32_t instrument_id, char *msg, uint64_t end_seq_number, uint64_t exchange_timestamp);
+        void replay_handovers();
+        bool is_active(uint32_t instrument_id);
+};
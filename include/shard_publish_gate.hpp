@@ -0,0 +1,109 @@
+#pragma once
+
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+#include "sl.hpp"
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+// Most recent messages kept per instrument while we are not publishing it, in bytes
+#define SHARD_REPLAY_DEFAULT_BYTES (4*1024*1024)
+// Instruments a shard can have assigned at the same time, power of two
+#define SHARD_MAX_INSTRUMENTS       4096
+// Released or removed, the entry stays for a later assignment
+#define SHARD_INSTRUMENT_NONE       0
+
+// Header of a message in the replay ring, the message follows and the record is padded to 8 bytes
+struct shard_ring_record {
+    uint64_t end_seq_number;                // 0 for anything but depth updates
+    uint64_t exchange_timestamp;
+    uint32_t length;
+    uint32_t discarded;                     // depth update of a book that was resynced since
+};
+
+// The feed thread reads state without a lock and only touches the rest while state allows it. The shard
+// thread changes state under gate_lock and waits for a message the feed thread is deciding on
+// (in_feed) before it touches what the feed thread owns.
+struct shard_instrument {
+    uint32_t instrument_id = 0;
+    std::atomic<uint8_t> state{SHARD_INSTRUMENT_NONE};
+    std::atomic<bool> in_feed{false};
+    std::atomic<bool> replay_pending{false};
+    // Only publish what the previous owner did not (see ShardHandover), 0 for a fresh assignment
+    uint64_t cutoff_end_seq_number = 0;
+    uint64_t cutoff_exchange_timestamp = 0;
+    // What we published last, handed to the next owner when we release the instrument
+    uint64_t last_end_seq_number = 0;
+    uint64_t last_exchange_timestamp = 0;
+    // Standby/ready - what we would have published, replayed above the cutoff when we take over.
+    // Records between read_position and write_position, offsets in the ring are position % size.
+    char *replay_ring = nullptr;
+    uint64_t read_position = 0;
+    uint64_t write_position = 0;
+    // Newest of what was pushed out of the buffer, a cutoff below it means the buffer can't close the gap
+    uint64_t dropped_end_seq_number = 0;
+    uint64_t dropped_exchange_timestamp = 0;
+    // Book was resynced while on standby, the depth updates held before it don't line up with the ones after
+    bool book_replaced = false;
+};
+
+// Decides per message whether this shard publishes it. Books of instruments on standby are kept in
+// sync by the caller, the messages are held here so a takeover can publish what came after the
+// previous owner stopped even when the handover arrives later than the data. When the buffer has
+// wrapped past the cutoff, or the book was resynced on standby, the book is republished instead
+// (publish_book: clear + snapshot), trades and tickers pushed out of the buffer are lost and logged.
+// should_publish/replay_handovers are called from the feed thread, the rest from the shard thread.
+// The feed thread takes no lock, instruments are never freed so it can look them up while the shard
+// thread adds more.
+class ShardPublishGate {
+    private:
+        SL gate_lock;
+        std::atomic<shard_instrument*> instrument_table[SHARD_MAX_INSTRUMENTS];
+        std::vector<shard_instrument*> instrument_list;
+        uint64_t max_replay_bytes;
+        std::atomic<int> num_pending_replays{0};
+        std::function<void(char *)> publish;
+        std::function<void(uint32_t)> publish_book;
+        std::function<void(std::string)> log_warning;
+
+        shard_instrument *find_instrument(uint32_t instrument_id);
+        shard_instrument *insert_instrument(uint32_t instrument_id);
+        void switch_state(shard_instrument *instrument, uint8_t state);
+        void reset_replay_ring(shard_instrument *instrument, bool keep_ring);
+        shard_ring_record *record_at(shard_instrument *instrument, uint64_t &position);
+        uint64_t record_size(uint32_t length);
+        void buffer_message(shard_instrument *instrument, char *msg, uint64_t end_seq_number, uint64_t exchange_timestamp);
+        void drop_oldest(shard_instrument *instrument);
+        void replay_instrument(shard_instrument *instrument, uint64_t in_book_end_seq_number);
+        bool passes_cutoff(shard_instrument *instrument, uint64_t end_seq_number, uint64_t exchange_timestamp);
+
+    public:
+        ShardPublishGate(uint64_t _max_replay_bytes = SHARD_REPLAY_DEFAULT_BYTES);
+        ~ShardPublishGate();
+
+        // Called before any messages come in
+        void set_publisher(std::function<void(char *)> _publish, std::function<void(uint32_t)> _publish_book,
+                            std::function<void(std::string)> _log_warning);
+
+        // Shard thread
+        bool add(uint32_t instrument_id, uint8_t state);
+        void mark_ready(uint32_t instrument_id);
+        void remove(uint32_t instrument_id);
+        bool release(uint32_t instrument_id, uint64_t *last_end_seq_number, uint64_t *last_exchange_timestamp);
+        bool take_over(uint32_t instrument_id, uint64_t cutoff_end_seq_number, uint64_t cutoff_exchange_timestamp);
+        void get_states(std::vector<std::pair<uint32_t, uint8_t>> &states);
+
+        // Feed thread - end_seq_number is 0 for anything but depth updates, which are in the book already.
+        // A clear of the book (end_seq_number 0) goes out as long as we are active.
+        bool should_publish(uint32_t instrument_id, char *msg, uint64_t end_seq_number, uint64_t exchange_timestamp);
+        void replay_handovers();
+        // Any thread
+        bool is_active(uint32_t instrument_id);
+};
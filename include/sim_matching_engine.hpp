@@ -0,0 +1,177 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// Internal projects
+#include "aeron_types.hpp"
+#include "sl.hpp"
+
+#define SIM_MAX_CLIENT_ORDER_ID         40
+#define SIM_MAX_SYMBOL                  24
+// Quantities below this are treated as nothing left
+#define SIM_QTY_EPSILON                 1e-12
+
+// Binance error codes the simulator answers with
+#define SIM_OK                          0
+#define SIM_ERROR_MANDATORY_PARAM       -1102
+#define SIM_ERROR_BAD_PARAM             -1100
+#define SIM_ERROR_NEW_ORDER_REJECTED    -2010
+#define SIM_ERROR_CANCEL_REJECTED       -2011
+
+enum sim_order_type {
+  SIM_TYPE_LIMIT,
+  SIM_TYPE_MARKET,
+  SIM_TYPE_LIMIT_MAKER
+};
+
+enum sim_time_in_force {
+  SIM_TIF_GTC,
+  SIM_TIF_IOC,
+  SIM_TIF_FOK,
+  SIM_TIF_GTX
+};
+
+enum sim_order_status {
+  SIM_STATUS_NEW,
+  SIM_STATUS_PARTIALLY_FILLED,
+  SIM_STATUS_FILLED,
+  SIM_STATUS_CANCELED,
+  SIM_STATUS_EXPIRED
+};
+
+enum sim_exec_type {
+  SIM_EXEC_NEW,
+  SIM_EXEC_TRADE,
+  SIM_EXEC_CANCELED,
+  SIM_EXEC_EXPIRED
+};
+
+struct sim_order {
+    uint64_t order_id;
+    char client_order_id[SIM_MAX_CLIENT_ORDER_ID];
+    char symbol[SIM_MAX_SYMBOL];
+    bool is_buy;
+    bool reduce_only;
+    uint8_t order_type;             // sim_order_type
+    uint8_t time_in_force;          // sim_time_in_force
+    uint8_t status;                 // sim_order_status
+    double price;                   // 0 for market orders
+    double orig_qty;
+    double executed_qty;
+    double cum_quote;
+    uint64_t order_time;            // epoch ms
+    uint64_t update_time;           // epoch ms
+};
+
+// One change to an order, what the user data stream reports
+struct sim_execution {
+    sim_order order;                // as it is after the change
+    uint8_t exec_type;              // sim_exec_type
+    bool is_maker;
+    double last_qty;
+    double last_price;
+    uint64_t trade_id;              // 0 when not a trade
+    uint64_t event_time;            // epoch ms
+    char cancel_client_order_id[SIM_MAX_CLIENT_ORDER_ID];   // spot cancels report the id of the cancel request
+};
+
+struct sim_order_request {
+    std::string symbol;
+    std::string client_order_id;
+    bool is_buy;
+    bool reduce_only;
+    uint8_t order_type;
+    uint8_t time_in_force;
+    double price;
+    double qty;
+};
+
+struct sim_engine_stats {
+    uint64_t num_orders;
+    uint64_t num_cancels;
+    uint64_t num_rejects;
+    uint64_t num_fills;
+    uint64_t num_market_updates;
+    uint32_t num_open;
+};
+
+// Market touch of a symbol from the replayed data, and how much of it our orders took since
+struct sim_market_touch {
+    double bid_price;
+    double bid_qty;
+    double ask_price;
+    double ask_qty;
+    double bid_taken;
+    double ask_taken;
+};
+
+struct sim_book {
+    std::string symbol;
+    uint32_t instrument_id;
+    std::map<double, std::list<sim_order*>, std::greater<double>> bids;
+    std::map<double, std::list<sim_order*>> asks;
+    sim_market_touch touch;
+};
+
+// Price-time matching of the orders sent to the simulator, against each other and against the
+// replayed market. An incoming order trades with whichever is better of the best resting order and
+// the replayed touch (resting orders first at the same price), only the touch quantity that our
+// orders haven't taken since the last update is there to trade with. Resting orders are filled as
+// the replayed market moves through them - by a touch crossing their price, or by a trade printing
+// at a worse price (all of it) or at their price (in time priority, up to the trade quantity).
+// Every change goes to the execution callback under the engine lock, in the order it happened.
+class SimMatchingEngine {
+    private:
+        SL engine_lock;
+        std::function<void(sim_execution *)> execution_callback;
+
+        std::unordered_map<std::string, sim_book*> books;
+        std::unordered_map<uint32_t, sim_book*> books_by_instrument;
+        std::unordered_map<uint64_t, sim_order*> orders;
+        // symbol + client order id of the open orders
+        std::unordered_map<std::string, sim_order*> orders_by_client_id;
+
+        uint64_t next_order_id = 1000000;
+        uint64_t next_trade_id = 1;
+        sim_engine_stats stats = {};
+
+        static uint64_t get_current_ms();
+        sim_book *get_book(const std::string &symbol);
+        void report(sim_order *order, uint8_t exec_type, double last_qty, double last_price, bool is_maker, const char *cancel_client_order_id = "");
+        void fill(sim_order *order, double qty, double price, bool is_maker);
+        void close_order(sim_order *order);
+        void remove_resting(sim_book *book, sim_order *order);
+        void add_resting(sim_book *book, sim_order *order);
+        bool crosses(sim_order *order, double price);
+        double available_to(sim_book *book, sim_order *order);
+        void match_incoming(sim_book *book, sim_order *order);
+        template<typename LEVELS>
+        double fill_through(LEVELS &levels, bool is_buy, double price, double qty, bool better_fill_all);
+
+    public:
+        SimMatchingEngine(std::function<void(sim_execution *)> _execution_callback);
+
+        // Symbols of the replayed instruments, orders for others still match against each other
+        void add_instrument(std::string symbol, uint32_t instrument_id);
+
+        // SIM_OK or a Binance error code with its message, the order as it is after matching goes in result
+        int new_order(sim_order_request &request, sim_order *result, std::string &error_message);
+        int cancel_order(std::string &symbol, uint64_t order_id, std::string &orig_client_order_id, std::string &cancel_client_order_id,
+                            sim_order *result, std::string &error_message);
+        // All open orders, of one symbol unless it is empty
+        std::vector<sim_order> get_open_orders(std::string &symbol);
+
+        // Replayed market data
+        void on_tob(ToBUpdate *tob);
+        void on_trade(Trade *trade);
+
+        sim_engine_stats get_stats();
+};
@@ -0,0 +1,169 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <deque>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+// Internal projects
+#include "sim_matching_engine.hpp"
+#include "sl.hpp"
+
+#include "wolfssl/options.h"
+#include "wolfssl/ssl.h"
+#include "wolfssl/wolfcrypt/sha.h"
+
+#define SIM_READ_BUFFER_SIZE            16384
+#define SIM_MAX_REQUEST_SIZE            1048576
+#define SIM_LISTEN_KEY_LENGTH           60
+#define SIM_WEBSOCKET_GUID              "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+// Longest a user stream session sleeps without anything due, it checks the socket in between anyway
+#define SIM_STREAM_IDLE_NS              100000000L
+// Most a futures batchOrders request takes of new orders and of cancels
+#define SIM_MAX_BATCH_ORDERS            5
+#define SIM_MAX_BATCH_CANCELS           10
+
+struct sim_config {
+    uint16_t port;
+    std::string cert_file;
+    std::string key_file;
+    bool futures;                       // fapi paths and ORDER_TRADE_UPDATE instead of executionReport
+    uint64_t request_latency_ns;        // added to every REST request before it reaches the engine
+    uint64_t request_jitter_ns;         // uniform on top of request_latency_ns
+    uint64_t stream_latency_ns;         // between a change in the engine and its user stream event
+    double order_reject_rate;           // share of new orders rejected as if the balance was too low
+    double cancel_reject_rate;          // share of cancels rejected as unknown orders
+};
+
+struct sim_http_request {
+    std::string method;
+    std::string path;
+    std::unordered_map<std::string, std::string> headers;  // names lower cased
+    std::unordered_map<std::string, std::string> params;   // query string and form body
+};
+
+// What has been used of each budget in the current windows, after counting a request
+struct sim_usage {
+    uint32_t weight_used;
+    uint32_t orders_used;
+    uint32_t long_orders_used;          // 1m on futures, 1d on spot
+    bool is_order;
+};
+
+struct sim_stream_event {
+    uint64_t due_ts;
+    std::string payload;
+};
+
+// One user data stream websocket, events are queued by the engine and written by the session thread
+struct sim_stream_session {
+    std::string listen_key;
+    int wake_fd;                        // eventfd, written when an event is queued
+    SL queue_lock;
+    std::deque<sim_stream_event> queue;
+};
+
+struct sim_server_stats {
+    uint64_t num_connections;
+    uint64_t num_requests;
+    uint64_t num_injected_rejects;
+    uint64_t num_stream_events;
+    uint32_t num_sessions;
+};
+
+// The Binance REST order endpoints and the user data stream over TLS, for a single account.
+// Spot (/api/v3) or futures (/fapi/v1) depending on the config, the requests are told apart by the
+// last part of the path only so the adapter's rest_endpoint/ws_endpoint config is all that changes.
+//  - order (POST new, DELETE cancel), openOrders (GET), userDataStream/listenKey, ping and time
+//  - the websocket API (ws-api/ws-fapi path) with order.place and order.cancel, on the same engine
+//  - signatures and API keys are not checked
+//  - weight and order counts go back in the X-MBX-* headers (rateLimits on the websocket API) but
+//    are never enforced
+//  - every connection gets its own thread, HTTP/1.1 with keep alive (no h2, curl falls back to it)
+// Every stream session gets every event, there is only the one account.
+class SimServer {
+    private:
+        sim_config config;
+        SimMatchingEngine *engine = nullptr;
+        WOLFSSL_CTX *ctx = nullptr;
+        int listen_fd = -1;
+
+        SL session_lock;
+        std::vector<sim_stream_session*> sessions;
+        std::unordered_map<std::string, bool> listen_keys;
+        uint64_t next_cancel_id = 1;
+
+        // Fixed windows the way Binance counts, only reported
+        SL usage_lock;
+        uint64_t weight_window = 0;
+        uint64_t order_window = 0;
+        uint64_t long_order_window = 0;
+        uint32_t weight_used = 0;
+        uint32_t orders_used = 0;
+        uint32_t long_orders_used = 0;
+
+        std::atomic<uint64_t> num_connections = 0;
+        std::atomic<uint64_t> num_requests = 0;
+        std::atomic<uint64_t> num_injected_rejects = 0;
+        std::atomic<uint64_t> num_stream_events = 0;
+
+        static uint64_t get_current_ts();
+        static double random_fraction();
+        static std::string url_decode(const std::string &value);
+        static void parse_params(const std::string &query, std::unordered_map<std::string, std::string> &params);
+        static std::string get_param(sim_http_request &request, const char *name);
+        static size_t read_json_value(const std::string &json, size_t pos, std::string &value);
+        static bool parse_json_list(const std::string &json, std::vector<std::unordered_map<std::string, std::string>> &objects,
+                                        std::vector<std::string> &values);
+        static std::string format_decimal(double value);
+        static std::string websocket_accept(const std::string &key);
+        static std::string make_listen_key();
+
+        void request_delay();
+        void accept_loop();
+        void connection_thread(int fd);
+        bool read_request(WOLFSSL *ssl, std::string &buffer, sim_http_request &request);
+        bool write_all(WOLFSSL *ssl, const char *data, int length);
+        bool write_response(WOLFSSL *ssl, int status, std::string &body, std::string usage_headers);
+        sim_usage count_usage(uint32_t weight, uint32_t num_orders);
+        std::string usage_headers(sim_usage usage);
+        std::string usage_rate_limits(sim_usage usage);
+        std::string error_body(int code, std::string message);
+
+        int handle_new_order(sim_http_request &request, std::string &body);
+        int handle_cancel(sim_http_request &request, std::string &body);
+        int handle_batch_orders(sim_http_request &request, std::string &body, uint32_t *num_orders);
+        int handle_batch_cancel(sim_http_request &request, std::string &body);
+        int handle_open_orders(sim_http_request &request, std::string &body);
+        int handle_listen_key(sim_http_request &request, std::string &body);
+
+        std::string format_order(sim_order *order, const char *cancel_client_order_id);
+        std::string format_execution(sim_execution *execution);
+        void run_stream_session(WOLFSSL *ssl, int fd, sim_http_request &request);
+        bool write_frame(WOLFSSL *ssl, uint8_t op_code, const char *payload, uint64_t length);
+        bool read_frame(WOLFSSL *ssl, std::string &buffer, uint8_t *op_code, std::string &payload);
+        bool accept_websocket(WOLFSSL *ssl, sim_http_request &request);
+        static bool parse_ws_api_request(const std::string &message, std::string &id, std::string &method, sim_http_request &request);
+        void run_ws_api_session(WOLFSSL *ssl, sim_http_request &request);
+
+    public:
+        SimServer(sim_config _config);
+        // The engine calls back into on_execution, so it is made after the server
+        void set_engine(SimMatchingEngine *_engine);
+        // Listens and accepts on a thread of its own, false if the port or certificates are no good
+        bool start();
+        // Engine execution callback - queues the user stream event on every session
+        void on_execution(sim_execution *execution);
+        sim_server_stats get_stats();
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <time.h>
+
+// Internal projects
+#include "aeron_types.hpp"
+#include "wsock.hpp"
+
+#define SNAPSHOT_CACHE_BUILD_BUFFER_SIZE 1024*1024
+// How long a serialised snapshot is served without even looking at the book
+#define SNAPSHOT_CACHE_DEFAULT_FRESHNESS_MS 50
+
+struct cached_snapshot {
+    std::vector<char> data;
+    uint32_t length;
+    int num_messages;
+    uint64_t book_version;
+    uint64_t built_time;
+};
+
+// Keeps the last serialised PLUpdates burst per instrument together with the book
+// version it was built from, so repeated requests do not rebuild from the book.
+// Only used from the snapshot publisher thread.
+class SnapshotCache {
+    private:
+        WSock *wsocket;
+        uint64_t freshness_ns;
+        char *build_buffer;
+        std::unordered_map<uint32_t, cached_snapshot*> snapshots;
+
+        uint64_t num_fresh_hits = 0;
+        uint64_t num_version_hits = 0;
+        uint64_t num_rebuilds = 0;
+
+        uint64_t get_current_ts_ns();
+
+    public:
+        SnapshotCache(WSock *_wsocket, uint64_t freshness_millis = SNAPSHOT_CACHE_DEFAULT_FRESHNESS_MS);
+
+        cached_snapshot *get_snapshot(uint32_t instrument_id);
+        std::string get_stats();
+};
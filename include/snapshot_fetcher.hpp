@@ -0,0 +1,128 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+#include <time.h>
+#include <curl/curl.h>
+
+// Internal projects
+#include "logger.hpp"
+#include "file_writer.hpp"
+#include "MyRingBuffer.hpp"
+
+#define SNAPSHOT_BUFFER_SIZE 1024*1024
+#define SNAPSHOT_MAX_IN_FLIGHT 16
+#define SNAPSHOT_DEFAULT_IN_FLIGHT 4
+
+// Binance resets the request weight at every wall clock minute
+#define SNAPSHOT_WEIGHT_WINDOW_NS 60000000000L
+// Fraction of the exchange weight limit we allow ourselves to use for snapshots
+#define SNAPSHOT_WEIGHT_HEADROOM 0.8
+// If a 429/418 comes back without a Retry-After header we back off this long
+#define SNAPSHOT_DEFAULT_BACKOFF_SECONDS 60
+// Snapshots not picked up by the feed thread within this time are dropped and their slot reused
+#define SNAPSHOT_READY_TIMEOUT_NS 30000000000L
+
+// Request from the feed thread - activity is used to prioritise which instrument gets fetched first
+struct snapshot_info {
+    uint8_t ex_id;
+    uint32_t instrument_id;
+    std::string instrument_name;
+    std::string current_date;
+    bool to_file;
+    double activity;
+};
+typedef MyRingBuffer<snapshot_info, 1024> SnapshotRingT;
+
+// Completed snapshot handed back to the feed thread, data points into one of the preallocated slots
+struct snapshot_result {
+    uint32_t instrument_id;
+    uint8_t ex_id;
+    int slot;
+    char *data;
+    uint32_t length;
+    uint64_t completed_time;
+};
+typedef MyRingBuffer<snapshot_result, 1024> SnapshotResultRingT;
+typedef MyRingBuffer<int, 1024> SnapshotSlotRingT;
+
+// Request weight book keeping per REST endpoint (spot, usd-m futures, coin-m futures)
+struct endpoint_weight {
+    std::string base_url;
+    uint32_t request_weight;
+    uint32_t weight_limit;
+    uint32_t used_weight;
+    uint64_t window_start;
+    uint64_t banned_until;
+};
+
+class SnapshotFetcher;
+
+// One of these per curl easy handle, reused for every request made on that handle
+struct fetch_context {
+    CURL *easy;
+    SnapshotFetcher *fetcher;
+    snapshot_info info;
+    std::string url;
+    int endpoint;
+    int slot;
+    uint32_t length;
+    bool overflow;
+    uint32_t header_used_weight;
+    uint32_t header_retry_after;
+    uint64_t start_time;
+    bool in_use;
+};
+
+class SnapshotFetcher {
+    private:
+        Logger *logger = nullptr;
+        int max_in_flight;
+        int num_in_flight = 0;
+        int num_slots;
+
+        // Channels between the feed thread and the fetcher thread (single producer / single consumer each)
+        SnapshotRingT       request_ring;
+        SnapshotResultRingT result_ring;
+        SnapshotSlotRingT   release_ring;
+
+        // Fetcher thread only
+        CURLM *multi_handle;
+        std::vector<fetch_context*> contexts;
+        std::vector<char*> slot_buffers;
+        std::vector<int> free_slots;
+        std::unordered_map<uint32_t, snapshot_info> pending_requests;
+        endpoint_weight endpoints[3];
+        uint64_t num_fetched = 0;
+        uint64_t num_retried = 0;
+
+        // Feed thread only
+        std::unordered_map<uint32_t, snapshot_result> ready_snapshots;
+
+        uint64_t get_current_ts_ns();
+        int get_endpoint(uint8_t ex_id);
+        void reset_weight_windows(uint64_t current_ts);
+        void drain_requests();
+        void drain_released_slots();
+        void launch_requests(uint64_t current_ts);
+        void complete_request(fetch_context *context, CURLcode result);
+        void requeue(snapshot_info &info);
+        void fetcher_loop();
+
+        static size_t write_callback(char *buffer, size_t size, size_t nmemb, void *data);
+        static size_t header_callback(char *buffer, size_t size, size_t nmemb, void *data);
+
+    public:
+        SnapshotFetcher(Logger *_logger, int _max_in_flight = SNAPSHOT_DEFAULT_IN_FLIGHT);
+
+        // Called from the feed thread
+        void request_snapshot(snapshot_info &&info);
+        void process_completed_snapshots();
+        const char *get_snapshot(uint32_t instrument_id);
+        void release_snapshot(uint32_t instrument_id);
+};
@@ -0,0 +1,104 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+
+// Internal projects
+#include "aeron_types_ext.hpp"
+#include "latency_histogram.hpp"
+#include "sl.hpp"
+
+// Stream kinds of the trace slots in the latency region, above the CaptureStreamKind values.
+// Each uses the three hops of the slot for its own breakdown:
+#define TRACE_STREAM_DECISION           16  // origin->publish, publish->strategy, strategy->adapter
+#define TRACE_STREAM_ORDER              17  // adapter receive->send, send->ack, origin->ack (tick to trade)
+#define TRACE_STREAM_FILL               18  // send->fill, ack->fill, origin->fill
+// Bits of the process id in a trace id, the rest is a sequence number of the process
+#define TRACE_ID_SEQUENCE_BITS          40
+
+// A message with the trace trailer after it. TraceContext is 8 byte aligned and a multiple of 8
+// long, so the trailer always ends the struct and msgLength is simply its size.
+template<typename T>
+struct traced_message {
+    T message;
+    TraceContext trace;
+};
+
+// -----------------------------------------------------------------------
+// Trace trailer of a message, nullptr if it was sent without one
+// -----------------------------------------------------------------------
+inline TraceContext *get_trace_context(MessageHeader *header, uint32_t message_size) {
+    if(header->msgLength < (message_size + sizeof(TraceContext)))
+        return(nullptr);
+    TraceContext *trace = (TraceContext *) ((char *) header + header->msgLength - sizeof(TraceContext));
+    if(trace->magic != TRACE_CONTEXT_MAGIC)
+        return(nullptr);
+    return(trace);
+}
+
+// -----------------------------------------------------------------------
+// Trace ids are unique over the market data processes without talking to each other
+// -----------------------------------------------------------------------
+inline uint64_t make_trace_id(uint64_t sequence) {
+    return(((uint64_t) getpid() << TRACE_ID_SEQUENCE_BITS) | (sequence & ((1UL << TRACE_ID_SEQUENCE_BITS) - 1)));
+}
+
+inline void trace_start(TraceContext *trace, uint64_t trace_id, uint32_t instrument_id, uint64_t receive_ts) {
+    memset(trace, 0, sizeof(TraceContext));
+    trace->magic = TRACE_CONTEXT_MAGIC;
+    trace->origin_instrument_id = instrument_id;
+    trace->trace_id = trace_id;
+    trace->origin_receive_timestamp = receive_ts;
+}
+
+inline void trace_stamp(TraceContext *trace, int point, uint64_t ts) {
+    trace->stamps[point] = ts;
+}
+
+// -----------------------------------------------------------------------
+// Carries the trace of the message a decision was made on over to the message sent because of it
+// and stamps the sending point - false if the message had no trace. This is what a strategy calls
+// with the Signal it acted on and the traced_message<SendOrder> it is about to send.
+// -----------------------------------------------------------------------
+inline bool trace_continue(TraceContext *to, MessageHeader *from, uint32_t from_size, int point, uint64_t ts) {
+    TraceContext *from_trace = get_trace_context(from, from_size);
+    if(from_trace == nullptr)
+        return(false);
+    *to = *from_trace;
+    to->stamps[point] = ts;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Fills in the trailer and msgLength, returns the length to send
+// -----------------------------------------------------------------------
+template<typename T>
+uint32_t attach_trace(traced_message<T> *traced, const TraceContext *trace) {
+    traced->trace = *trace;
+    traced->message.msg_header.msgLength = sizeof(traced_message<T>);
+    return(sizeof(traced_message<T>));
+}
+
+// Records the hops of traced orders into latency histograms in shared memory, read with
+// latency_reader. A slot per traded instrument and TRACE_STREAM_* kind. Slots are handed out
+// under the lock as the user stream threads of several exchanges record, the histograms of an
+// instrument are only ever written by the thread of its exchange.
+class TraceRecorder {
+    private:
+        SL recorder_lock;
+        LatencyRecorder *latency_recorder;
+
+        latency_slot *get_slot(uint32_t instrument_id, uint8_t stream_kind);
+        static void record_hop(latency_histogram *histogram, uint64_t from_ts, uint64_t to_ts);
+
+    public:
+        TraceRecorder(std::string process_name);
+        std::string get_shm_name();
+
+        // Decision and order hops, once the exchange acked the order
+        void record_ack(uint32_t instrument_id, TraceContext *trace);
+        // Fill hops, for every fill
+        void record_fill(uint32_t instrument_id, TraceContext *trace);
+};
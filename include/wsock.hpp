@@ -35,12 +35,14 @@
 #include "sl.hpp"
 #include "MyRingBuffer.hpp"
 #include "merged_orderbook.hpp"
+#include "capture_format.hpp"
 
 #define WOLFSSL_TLS13
 #define CERT_FILE "/usr/share/ca-certificates/mozilla/GlobalSign_Root_CA.crt"
 
 #define MAX_EVENTS 1
 #define FRAGMENT_BUFFER_SIZE 1024*1024
+#define MAX_SEND_FRAME_SIZE 4096
 
 // The same allocated struct is attached to all the sockets for a symbol as long asit is in the same process
 struct shared_symbol_details {
@@ -60,14 +62,21 @@ struct fd_info {
     uint64_t last_read_time;
     uint64_t last_epoll_time;
     uint64_t last_keepalive;
+    uint64_t connect_time;
+    uint64_t num_messages_received;
     uint64_t last_end_sequence_number;
     uint32_t instrument_id;
     uint8_t exchange_id;
     bool delete_me;
     bool in_shapshot_state;
+    bool is_depth;
+    uint8_t stream_kind;
     FileWriter *file_writer;
     MergedOrderbook *pl_book;
+    uint64_t pl_book_version;
     SL pl_lock;
+    // Serialises writes from other threads (keepalives, requests) with the pongs of the reader
+    SL write_lock;
 };
 
 struct subscription_info {
@@ -81,12 +90,22 @@ struct subscription_info {
 };
 typedef MyRingBuffer<subscription_info, 16384> SubscriptionRingT;
 
+// Per instrument view over all of its sockets, see get_instrument_stats
+struct instrument_socket_stats {
+    double message_rate;
+    bool synced;
+};
+
 class WSock {
     private:
         Logger *logger = nullptr;
         Logger *subscription_logger = nullptr;
 
         SubscriptionRingT   subscription_ring;
+        // Requests come from the main thread, the control thread and reconnects - serialise them
+        SL subscription_lock;
+        // Stream kinds currently wanted per instrument, a bit per CaptureStreamKind
+        std::unordered_map<uint32_t, uint16_t> subscribed_streams;
         WOLFSSL_CTX         *ctx = NULL;
         std::unordered_map<int, struct fd_info*> socket_to_fd_info;
         SL fd_map_lock;
@@ -104,6 +123,8 @@ class WSock {
 
         struct epoll_event EVENTS[MAX_EVENTS];
         int current_socket;
+        // Reused by get_plbook_levels
+        std::map<double, PLInfo*> level_map;
         int epoll_id;
         struct fd_info *current_fd_info;
 
@@ -114,6 +135,9 @@ class WSock {
 
         uint64_t last_delete_check_time;
 
+        // Unique across all books so a version never repeats, even after a reconnect
+        uint64_t book_version_counter = 0;
+
         uint64_t get_current_ts_ns();
 
         bool add_event_to_socket(struct fd_info *struct_ptr, int event_to_remove);
@@ -132,12 +156,17 @@ class WSock {
         void process_subscription_requests();
         // bool connect_to_websocket(std::string websocket_URI, uint32_t instrument_id);
         struct fd_info* connect_to_websocket(std::string websocket_URI, FileWriter *_file_writer, uint32_t instrument_id, uint8_t exchange_id);
+        struct fd_info* find_depth_socket(uint32_t instrument_id);
+        struct fd_info* find_exchange_socket(uint8_t exchange_id);
 
     public:
         WSock(Logger *_logger, Logger *_subscription_logger, int refresh_time, int subscription_delay);
         ~WSock();
 
         void add_subscription_request(std::string websocket_URI, FileWriter *_file_writer, std::string instrument_name, uint32_t instrument_id = 0, uint8_t exchange_id = 0, fd_info *socket_info = NULL);
+        void remove_subscriptions(uint32_t instrument_id, uint16_t stream_mask);
+        uint16_t get_subscribed_streams(uint32_t instrument_id);
+        void get_instrument_stats(std::unordered_map<uint32_t, instrument_socket_stats> &stats);
         std::string_view get_next_message_from_websocket();
         uint64_t get_message_receive_time();
         uint32_t get_instrument_id();
@@ -153,12 +182,20 @@ class WSock {
         void set_snapshot_state(bool new_snapshot_state);
         std::string get_connection_string();
         FileWriter *get_filewriter();
+        double get_message_rate();
+        uint8_t get_stream_kind();
+
+        // Request/response websockets (order entry) - sends on the socket added for the exchange
+        bool send_text_message(uint8_t exchange_id, const char *payload, uint32_t length);
+        bool is_connected(uint8_t exchange_id);
 
         // All related to PL publishing and snapshotting of the same
         void aquire_plbook_lock();
         void release_plbook_lock();
         void process_plbook_update(PLUpdates *pl_update);
         void clear_plbook();
+        int get_plbook_levels(uint8_t side, int x, PriceLevelDetails *levels);
         int num_sockets();
-        int get_snapshot(char *snap_buffer, uint32_t instrument_id);
+        int get_snapshot(char *snap_buffer, uint32_t instrument_id, uint64_t *book_version = nullptr);
+        uint64_t get_book_version(uint32_t instrument_id);
 };
\ No newline at end of file
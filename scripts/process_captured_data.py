@@ -40,11 +40,19 @@ class FileNameManager:
         self.build_pairs_list()
     
     def get_file_size(self, filename):
-        return(Path(filename).stat().st_size)
+        return(sum(Path(capture_file).stat().st_size for capture_file in get_capture_files(filename)))
 
     def build_pairs_list(self):
         json_files = glob.glob(self.path)
+        capture_bases = set()
         for json_file in json_files:
+            # Binary captures are segments (<base>.cap.0000, .0001..) - converted and uploaded once per base
+            segment_match = re.match(r"(.*_all\.cap)\.[0-9]{4}$", json_file)
+            if segment_match:
+                if segment_match.group(1) in capture_bases:
+                    continue
+                json_file = segment_match.group(1)
+                capture_bases.add(json_file)
             # All files that are older than today and that ends with _all.txt are used to filter with
             filename = json_file.split("/")[-1]
             file_instrument_id = str(filename.split("_")[-2:-1][0])
@@ -55,7 +63,7 @@ class FileNameManager:
             snapshot_filename = file_dirname + "/" + file_date + "_" + file_symbol_name + "_" + file_instrument_id + "_ss.txt"
             output_bin_filename = file_dirname + "/" + file_date + "_" + file_symbol_name + "_" + file_instrument_id + ".bin"
 
-            if(json_file.endswith("_all.txt") and self.date not in json_file):
+            if((json_file.endswith("_all.txt") or json_file.endswith("_all.capz") or json_file.endswith("_all.cap")) and self.date not in json_file):
                 if(os.path.isfile(snapshot_filename)) and (self.get_file_size(json_file) > 0) and (self.get_file_size(snapshot_filename) > 0):
                     # we need to add this to the good_pairs list
                     bin_upload_path = "binary/capture/" + self.symbol_details.exchange_name + "/" + file_date + "/"
@@ -111,6 +119,18 @@ class FileNameManager:
         return(output_bin_filename)
 
 
+############################################################################
+# Local files a capture is made of - the segments of a binary capture (convert_md_binance
+# takes the base name), a compressed capture with its index or the text file itself
+############################################################################
+def get_capture_files(capture_file):
+    if capture_file.endswith(".cap"):
+        return(sorted(glob.glob(capture_file + ".[0-9][0-9][0-9][0-9]")))
+    if capture_file.endswith(".capz"):
+        return([capture_file, capture_file + ".idx"] if os.path.isfile(capture_file + ".idx") else [capture_file])
+    return([capture_file])
+
+
 ############################################################################
 # Simple remove
 ############################################################################
@@ -161,7 +181,7 @@ def main():
     logging.basicConfig(filename='/home/ubuntu/process_captured_data.log', filemode='w', format='%(asctime)s - %(message)s', level=logging.INFO)
 
     # Build up the list of files to work with
-    files = FileNameManager("/datacollection/binance/*.txt")
+    files = FileNameManager("/datacollection/binance/*_all.*")
 
     logging.info("Found: " + str(len(files.good_pairs)) + " of good pairs")
     # Iterate over the good pairs
@@ -173,13 +193,19 @@ def main():
                                                     entry["output_filename"],
                                                     entry["instrument_id"])
 
-        # Compress json files
-        zipLocalFile(entry["json_file_all"], entry["json_file_all"] + ".zip")
+        # Compress json files - compressed captures (.capz) are uploaded as is with their index,
+        # binary captures (.cap) segment by segment
+        if entry["json_file_all"].endswith(".capz") or entry["json_file_all"].endswith(".cap"):
+            for capture_file in get_capture_files(entry["json_file_all"]):
+                uploadFileToS3(capture_file, 'got-data', entry["json_upload_path"])
+                removeLocalFile(capture_file)
+        else:
+            zipLocalFile(entry["json_file_all"], entry["json_file_all"] + ".zip")
+            uploadFileToS3(entry["json_file_all"] + ".zip", 'got-data', entry["json_upload_path"])
         zipLocalFile(entry["json_file_ss"], entry["json_file_ss"] + ".zip")
 
         # Upload files to S3
         uploadFileToS3(entry["output_filename"], 'got-data', entry["bin_upload_path"])
-        uploadFileToS3(entry["json_file_all"] + ".zip", 'got-data', entry["json_upload_path"])
         uploadFileToS3(entry["json_file_ss"] + ".zip", 'got-data', entry["json_upload_path"])        
 
         # Cleanup the local files
@@ -195,7 +221,8 @@ def main():
         for entry in files.bad_pairs:
             logging.info(entry)
             # Will delete these files - after logging
-            removeLocalFile(entry["json_file_all"])
+            for capture_file in get_capture_files(entry["json_file_all"]):
+                removeLocalFile(capture_file)
             removeLocalFile(entry["json_file_ss"])
 
 if __name__ == "__main__":
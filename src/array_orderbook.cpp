@@ -0,0 +1,397 @@
+#include "array_orderbook.hpp"
+
+#include <algorithm>
+
+static const double powers_of_ten[ARRAY_BOOK_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12
+};
+
+// -----------------------------------------------------------------------
+// Constructor - tick_size 0 works it out from the prices
+// -----------------------------------------------------------------------
+ArrayOrderbook::ArrayOrderbook(double _tick_size, uint32_t max_ticks) {
+    capacity = ARRAY_BOOK_MIN_TICKS;
+    while(capacity < max_ticks)
+        capacity <<= 1;
+    slot_mask = capacity - 1;
+    // Room for the touch to improve before the window has to move
+    margin = capacity / 8;
+
+    fixed_tick = (_tick_size > 0);
+    tick_size = _tick_size;
+    inverse_tick = fixed_tick ? (1.0 / _tick_size) : 0.0;
+
+    init_side(bids);
+    init_side(asks);
+}
+
+void ArrayOrderbook::init_side(ladder_side &side) {
+    side.levels.assign(capacity, ladder_level{0.0, 0.0, 0});
+    side.occupied.assign(capacity / 64, 0);
+    side.low_tick = 0;
+    side.best_tick = -1;
+    side.num_levels = 0;
+}
+
+// -----------------------------------------------------------------------
+// Empties a side, the levels themselves are left behind and overwritten on use
+// -----------------------------------------------------------------------
+void ArrayOrderbook::clear_side(ladder_side &side) {
+    for(auto &word: side.occupied)
+        word = 0;
+    side.best_tick = -1;
+    side.num_levels = 0;
+}
+
+void ArrayOrderbook::clear_orderbook() {
+    clear_side(bids);
+    clear_side(asks);
+}
+
+int64_t ArrayOrderbook::to_tick(double price) {
+    return(llround(price * inverse_tick));
+}
+
+// -----------------------------------------------------------------------
+// Without a given tick size - moves to a finer tick when a price is not on the current one.
+// Only happens while the first updates come in, the levels are re-indexed on the new tick.
+// -----------------------------------------------------------------------
+void ArrayOrderbook::refine_tick(double price) {
+    if(tick_size > 0){
+        double ticks = price * inverse_tick;
+        if(fabs(ticks - nearbyint(ticks)) <= 1e-6)
+            return;
+    }
+
+    int decimals = 0;
+    while(decimals < ARRAY_BOOK_MAX_DECIMALS){
+        double scaled = price * powers_of_ten[decimals];
+        if(fabs(scaled - nearbyint(scaled)) <= 1e-9 * std::max(1.0, fabs(scaled)))
+            break;
+        decimals++;
+    }
+    if((tick_size > 0) && (powers_of_ten[decimals] <= inverse_tick))
+        return;
+
+    std::vector<ladder_level> bid_levels;
+    std::vector<ladder_level> ask_levels;
+    for(int64_t tick = bids.best_tick; (bids.num_levels > 0) && (tick >= 0); tick = find_below(bids, tick))
+        bid_levels.push_back(bids.levels[tick & slot_mask]);
+    for(int64_t tick = asks.best_tick; (asks.num_levels > 0) && (tick >= 0); tick = find_above(asks, tick))
+        ask_levels.push_back(asks.levels[tick & slot_mask]);
+
+    tick_size = 1.0 / powers_of_ten[decimals];
+    inverse_tick = powers_of_ten[decimals];
+    clear_orderbook();
+    for(auto &level: bid_levels)
+        set_level(bids, true, level.price, level.qty, level.timestamp);
+    for(auto &level: ask_levels)
+        set_level(asks, false, level.price, level.qty, level.timestamp);
+}
+
+// -----------------------------------------------------------------------
+// Moves the window of a side, levels of the ticks that leave it are dropped
+// -----------------------------------------------------------------------
+void ArrayOrderbook::shift_window(ladder_side &side, int64_t new_low_tick) {
+    if(new_low_tick == side.low_tick)
+        return;
+    num_recentres++;
+
+    int64_t clear_from;
+    int64_t clear_to;
+    int64_t delta = new_low_tick - side.low_tick;
+    if((delta >= capacity) || (-delta >= capacity)){
+        num_pruned += side.num_levels;
+        clear_side(side);
+        side.low_tick = new_low_tick;
+        return;
+    }
+    if(delta > 0){
+        clear_from = side.low_tick;
+        clear_to = new_low_tick;
+    } else {
+        clear_from = new_low_tick + capacity;
+        clear_to = side.low_tick + capacity;
+    }
+    for(int64_t tick = clear_from; tick < clear_to; tick++){
+        uint64_t slot = tick & slot_mask;
+        uint64_t bit = 1ULL << (slot & 63);
+        if(side.occupied[slot >> 6] & bit){
+            side.occupied[slot >> 6] &= ~bit;
+            side.num_levels--;
+            num_pruned++;
+        }
+    }
+    side.low_tick = new_low_tick;
+    if(side.num_levels == 0)
+        side.best_tick = -1;
+}
+
+// -----------------------------------------------------------------------
+// Highest tick with a level below the given one, -1 if none in the window
+// -----------------------------------------------------------------------
+int64_t ArrayOrderbook::find_below(ladder_side &side, int64_t tick) {
+    int64_t current = tick - 1;
+    while(current >= side.low_tick){
+        uint64_t slot = current & slot_mask;
+        uint64_t bit = slot & 63;
+        uint64_t word = side.occupied[slot >> 6] & ((bit == 63) ? ~0ULL : ((2ULL << bit) - 1));
+        if(word != 0){
+            int64_t found = current - (int64_t) (bit - (63 - __builtin_clzll(word)));
+            return((found >= side.low_tick) ? found : -1);
+        }
+        current -= (bit + 1);
+    }
+    return(-1);
+}
+
+// -----------------------------------------------------------------------
+// Lowest tick with a level above the given one, -1 if none in the window
+// -----------------------------------------------------------------------
+int64_t ArrayOrderbook::find_above(ladder_side &side, int64_t tick) {
+    int64_t current = tick + 1;
+    int64_t high_tick = side.low_tick + capacity;
+    while(current < high_tick){
+        uint64_t slot = current & slot_mask;
+        uint64_t bit = slot & 63;
+        uint64_t word = side.occupied[slot >> 6] & (~0ULL << bit);
+        if(word != 0){
+            int64_t found = current + (int64_t) (__builtin_ctzll(word) - bit);
+            return((found < high_tick) ? found : -1);
+        }
+        current += (64 - bit);
+    }
+    return(-1);
+}
+
+// -----------------------------------------------------------------------
+// Adds or changes a level, a touch beyond the window re-centres it
+// -----------------------------------------------------------------------
+void ArrayOrderbook::set_level(ladder_side &side, bool is_bid, double price, double qty, uint64_t timestamp) {
+    int64_t tick = to_tick(price);
+    if(side.num_levels == 0){
+        side.low_tick = is_bid ? (tick + margin - capacity + 1) : (tick - margin);
+    }
+    else if(tick < side.low_tick) {
+        if(is_bid){
+            num_pruned++;
+            return;
+        }
+        shift_window(side, tick - margin);
+    }
+    else if(tick >= side.low_tick + capacity) {
+        if(! is_bid){
+            num_pruned++;
+            return;
+        }
+        shift_window(side, tick + margin - capacity + 1);
+    }
+
+    uint64_t slot = tick & slot_mask;
+    side.levels[slot] = ladder_level{price, qty, timestamp};
+    uint64_t bit = 1ULL << (slot & 63);
+    if(! (side.occupied[slot >> 6] & bit)){
+        side.occupied[slot >> 6] |= bit;
+        side.num_levels++;
+        if((side.num_levels == 1) || (is_bid ? (tick > side.best_tick) : (tick < side.best_tick)))
+            side.best_tick = tick;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Removes a level, when it was the touch the window follows the new touch into the book
+// -----------------------------------------------------------------------
+void ArrayOrderbook::delete_level(ladder_side &side, bool is_bid, double price) {
+    if(side.num_levels == 0)
+        return;
+    int64_t tick = to_tick(price);
+    if((tick < side.low_tick) || (tick >= side.low_tick + capacity) || ! is_occupied(side, tick))
+        return;
+
+    uint64_t slot = tick & slot_mask;
+    side.occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+    side.num_levels--;
+    if(side.num_levels == 0){
+        side.best_tick = -1;
+        return;
+    }
+    if(tick != side.best_tick)
+        return;
+
+    side.best_tick = is_bid ? find_below(side, tick) : find_above(side, tick);
+    if(is_bid && (side.best_tick < side.low_tick + margin))
+        shift_window(side, side.best_tick + margin - capacity + 1);
+    else if(! is_bid && (side.best_tick > side.low_tick + capacity - 1 - margin))
+        shift_window(side, side.best_tick - margin);
+}
+
+// -----------------------------------------------------------------------
+// Removes every level better than tick - they are stale once a newer touch says so
+// -----------------------------------------------------------------------
+void ArrayOrderbook::remove_through(ladder_side &side, bool is_bid, int64_t tick) {
+    while((side.num_levels > 0) && (is_bid ? (side.best_tick > tick) : (side.best_tick < tick))){
+        uint64_t slot = side.best_tick & slot_mask;
+        side.occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+        side.num_levels--;
+        side.best_tick = (side.num_levels == 0) ? -1 : (is_bid ? find_below(side, side.best_tick) : find_above(side, side.best_tick));
+    }
+}
+
+// -----------------------------------------------------------------------
+// Applies a depth update (or a part of a snapshot)
+// -----------------------------------------------------------------------
+void ArrayOrderbook::process_update(PLUpdates *pl_update) {
+    PriceLevelDetails *pl_details = (PriceLevelDetails *) ((char *) pl_update + sizeof(PLUpdates));
+    for(int i = 0; i < pl_update->num_of_pl_updates; i++){
+        PriceLevelDetails *detail = &pl_details[i];
+        if(! fixed_tick)
+            refine_tick(detail->price_level);
+        bool is_bid = (detail->side == BUY_SIDE);
+        ladder_side &side = is_bid ? bids : asks;
+        if((detail->pl_action_type == DELETE_PL_ACTION) || (detail->quantity == 0))
+            delete_level(side, is_bid, detail->price_level);
+        else
+            set_level(side, is_bid, detail->price_level, detail->quantity, pl_update->exchange_timestamp);
+    }
+
+    instrument_id = pl_update->instrument_id;
+    exchange_id = pl_update->exchange_id;
+    last_receive_timestamp = pl_update->receive_timestamp;
+    last_exchange_timestamp = pl_update->exchange_timestamp;
+    last_end_seq_number = pl_update->end_seq_number;
+    has_updates = true;
+}
+
+// -----------------------------------------------------------------------
+// Merges a top of book update, it replaces the touch and anything better than it
+// -----------------------------------------------------------------------
+void ArrayOrderbook::process_update(ToBUpdate *tob_update) {
+    if(! fixed_tick){
+        if(tob_update->bid_price > 0)
+            refine_tick(tob_update->bid_price);
+        if(tob_update->ask_price > 0)
+            refine_tick(tob_update->ask_price);
+    }
+    if(tob_update->bid_price > 0){
+        remove_through(bids, true, to_tick(tob_update->bid_price));
+        if(tob_update->bid_qty > 0)
+            set_level(bids, true, tob_update->bid_price, tob_update->bid_qty, tob_update->exchange_timestamp);
+    }
+    if(tob_update->ask_price > 0){
+        remove_through(asks, false, to_tick(tob_update->ask_price));
+        if(tob_update->ask_qty > 0)
+            set_level(asks, false, tob_update->ask_price, tob_update->ask_qty, tob_update->exchange_timestamp);
+    }
+}
+
+double ArrayOrderbook::get_touch_price_bid() {
+    return((bids.num_levels > 0) ? bids.levels[bids.best_tick & slot_mask].price : 0.0);
+}
+
+double ArrayOrderbook::get_touch_price_ask() {
+    return((asks.num_levels > 0) ? asks.levels[asks.best_tick & slot_mask].price : 0.0);
+}
+
+double ArrayOrderbook::get_touch_qty_bid() {
+    return((bids.num_levels > 0) ? bids.levels[bids.best_tick & slot_mask].qty : 0.0);
+}
+
+double ArrayOrderbook::get_touch_qty_ask() {
+    return((asks.num_levels > 0) ? asks.levels[asks.best_tick & slot_mask].qty : 0.0);
+}
+
+bool ArrayOrderbook::is_book_crossed() {
+    if((bids.num_levels == 0) || (asks.num_levels == 0))
+        return(false);
+    return(get_touch_price_bid() >= get_touch_price_ask());
+}
+
+// -----------------------------------------------------------------------
+// Copies up to x levels from the touch down into levels, returns how many
+// -----------------------------------------------------------------------
+int ArrayOrderbook::get_x_price_levels(uint8_t side, int x, PriceLevelDetails *levels) {
+    bool is_bid = (side == BUY_SIDE);
+    ladder_side &book_side = is_bid ? bids : asks;
+    int num_levels = 0;
+    int64_t tick = book_side.best_tick;
+    while((book_side.num_levels > 0) && (tick >= 0) && (num_levels < x)){
+        ladder_level &level = book_side.levels[tick & slot_mask];
+        levels[num_levels].price_level = level.price;
+        levels[num_levels].quantity = level.qty;
+        levels[num_levels].side = side;
+        levels[num_levels].pl_action_type = UPDATE_PL_ACTION;
+        num_levels++;
+        tick = is_bid ? find_below(book_side, tick) : find_above(book_side, tick);
+    }
+    return(num_levels);
+}
+
+// -----------------------------------------------------------------------
+// Writes the book as snapshot PL_UPDATE messages into snap_buffer, bids then asks from the
+// touch out, PL_UPDATE_MAX_DET_PER_MSG levels per message. Returns the number of messages.
+// -----------------------------------------------------------------------
+int ArrayOrderbook::build_snapshot_from_current_book(char *snap_buffer) {
+    if(! has_updates)
+        return(0);
+
+    uint32_t total_levels = bids.num_levels + asks.num_levels;
+    int num_messages = std::max((uint32_t) 1, (total_levels + PL_UPDATE_MAX_DET_PER_MSG - 1) / PL_UPDATE_MAX_DET_PER_MSG);
+    char *msg_pointer = snap_buffer;
+    PLUpdates *pl_updates = nullptr;
+    PriceLevelDetails *pl_details = nullptr;
+    int message_number = 0;
+
+    auto start_message = [&]() {
+        if(pl_updates != nullptr)
+            msg_pointer += pl_updates->msg_header.msgLength;
+        pl_updates = (PLUpdates *) msg_pointer;
+        pl_details = (PriceLevelDetails *) (msg_pointer + sizeof(PLUpdates));
+        message_number++;
+        pl_updates->msg_header = {sizeof(PLUpdates), PL_UPDATE, 1};
+        pl_updates->receive_timestamp = last_receive_timestamp;
+        pl_updates->exchange_timestamp = last_exchange_timestamp;
+        pl_updates->sending_timestamp = last_receive_timestamp;
+        pl_updates->start_seq_number = last_end_seq_number;
+        pl_updates->end_seq_number = last_end_seq_number;
+        pl_updates->instrument_id = instrument_id;
+        pl_updates->exchange_id = exchange_id;
+        pl_updates->num_of_pl_updates = 0;
+        pl_updates->update_flags = PL_UPDATE_SNAPSHOT_MSG;
+        if(num_messages > 1)
+            pl_updates->update_flags |= PL_UPDATE_MULTIPLE_MESSAGES;
+        if(message_number == num_messages)
+            pl_updates->update_flags |= PL_UPDATE_LAST_MSG_IN_SERIES;
+    };
+
+    auto add_level = [&](ladder_level &level, uint8_t side) {
+        if((pl_updates == nullptr) || (pl_updates->num_of_pl_updates == PL_UPDATE_MAX_DET_PER_MSG))
+            start_message();
+        PriceLevelDetails *detail = &pl_details[pl_updates->num_of_pl_updates];
+        detail->price_level = level.price;
+        detail->quantity = level.qty;
+        detail->side = side;
+        detail->pl_action_type = UPDATE_PL_ACTION;
+        pl_updates->num_of_pl_updates++;
+        pl_updates->msg_header.msgLength += sizeof(PriceLevelDetails);
+    };
+
+    for(int64_t tick = bids.best_tick; (bids.num_levels > 0) && (tick >= 0); tick = find_below(bids, tick))
+        add_level(bids.levels[tick & slot_mask], BUY_SIDE);
+    for(int64_t tick = asks.best_tick; (asks.num_levels > 0) && (tick >= 0); tick = find_above(asks, tick))
+        add_level(asks.levels[tick & slot_mask], SELL_SIDE);
+    if(pl_updates == nullptr)
+        start_message();
+    return(num_messages);
+}
+
+uint32_t ArrayOrderbook::get_num_levels(uint8_t side) {
+    return((side == BUY_SIDE) ? bids.num_levels : asks.num_levels);
+}
+
+uint64_t ArrayOrderbook::get_num_pruned() {
+    return(num_pruned);
+}
+
+uint64_t ArrayOrderbook::get_num_recentres() {
+    return(num_recentres);
+}
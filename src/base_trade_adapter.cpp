@@ -23,6 +23,10 @@ BaseTradeAdapter::BaseTradeAdapter(uint8_t order_environment, std::string exchan
     logger = log_worker->get_new_logger("base");
 
     oe_unique_order_id = generate_hash_for_oe(unique_part_for_order_id);
+    order_table = new OrderTable();
+    risk_engine = new RiskEngine();
+    trace_recorder = new TraceRecorder("trade_adapter_" + exchange_name);
+    logger->msg(INFO, "Publishing tick to trade latency histograms in shared memory: " + trace_recorder->get_shm_name());
 
     // wait for risk to be UP 
     // logger->msg(INFO, "Waiting for heartbeat request on risk channel before continuing");
@@ -158,20 +162,7 @@ size_t BaseTradeAdapter::curl_write_func(char *buffer, size_t size, size_t nmemb
 
 // =================================================================================
 int BaseTradeAdapter::convert_to_hex(char *buffer, unsigned char *array_to_convert, int length_to_convert) {
-    int buffer_offset = 0;
-    unsigned char char_to_print;
-    char lookup_table[] = "0123456789abcdef";
-
-    for(int i=0; i<length_to_convert; i++){
-        char_to_print = array_to_convert[i];
-        char_to_print >>= 4;
-        buffer[buffer_offset++] = lookup_table[char_to_print];
-        char_to_print = array_to_convert[i];
-        char_to_print <<= 4;
-        char_to_print >>= 4;
-        buffer[buffer_offset++] = lookup_table[char_to_print];
-    }
-    return(buffer_offset);
+    return(hex_encode(array_to_convert, length_to_convert, buffer));
 }
 
 // // =================================================================================
@@ -198,45 +189,13 @@ std::string BaseTradeAdapter::hmacHex(std::string key, std::string msg) {
     char        buffer[65];
     
     buffer[64] = 0;    
-    wc_HmacSetKey(&hmac, SHA256, (byte *) key.c_str(), sizeof(key));
-    wc_HmacUpdate(&hmac, (byte *) msg.c_str(), sizeof(msg));
+    wc_HmacSetKey(&hmac, SHA256, (byte *) key.c_str(), key.length());
+    wc_HmacUpdate(&hmac, (byte *) msg.c_str(), msg.length());
     wc_HmacFinal(&hmac, hmacDigest);
     convert_to_hex(buffer, hmacDigest, 32);
     return (std::string(buffer, 64));
 }
 
-// // =================================================================================
-// int BaseTradeAdapter::hmacHex(std::string key, std::string msg, char *output_string) {  
-//     unsigned char hash[32];
-//     output_string[64] = 0;
-//     HMAC_CTX *hmac;
-//     unsigned int len = 32;
-
-//     memcpy(output_string, "&signature=", 11);
-//     output_string+=11;
-
-//     hmac = HMAC_CTX_new();
-//     HMAC_Init_ex(hmac, &key[0], key.length(), EVP_sha256(), NULL);
-//     HMAC_Update(hmac, (unsigned char*)&msg[0], msg.length());
-//     HMAC_Final(hmac, hash, &len);
-//     HMAC_CTX_free(hmac);
-//     convert_to_hex(output_string, hash, 32);
-//     return (75);
-// }
-
-// =================================================================================
-int BaseTradeAdapter::hmacHex(std::string key, std::string msg, char *output_string) {  
-    Hmac        hmac;
-    byte        hmacDigest[SHA256_DIGEST_SIZE];
-    
-    output_string[64] = 0;   
-    wc_HmacSetKey(&hmac, SHA256, (byte *) key.c_str(), sizeof(key));
-    wc_HmacUpdate(&hmac, (byte *) msg.c_str(), sizeof(msg));
-    wc_HmacFinal(&hmac, hmacDigest);
-    convert_to_hex(output_string, hmacDigest, 32);
-    return (75);
-}
-
 // =================================================================================
 uint64_t BaseTradeAdapter::get_current_ts() {
   struct timespec t;
@@ -287,6 +246,9 @@ void BaseTradeAdapter::update_instrument_info(struct InstrumentInfoResponse *ins
             base_name_to_asset_id[quote_asset_code] = instrument_info->quote_asset_id;
             asset_id_to_base_name[instrument_info->base_asset_id] = base_asset_code;
             asset_id_to_base_name[instrument_info->quote_asset_id] = quote_asset_code;
+
+            risk_engine->set_instrument(instrument_info->instrument_id, instrument_info->contract_size);
+            risk_engine->compile();
         }
 
         // } else {
@@ -316,6 +278,8 @@ void BaseTradeAdapter::update_strategy_info(struct StrategyInfoResponse *strateg
         strategy->max_order_value_USD = strategy_info->max_order_value_USD;
         strategy->max_tradeconsideration_USD = strategy_info->max_tradeconsideration_USD;
     }
+    risk_engine->set_strategy(strategy_info->strategy_id, strategy_info->max_order_value_USD);
+    risk_engine->compile();
 }
 
 // =================================================================================
@@ -325,13 +289,6 @@ bool BaseTradeAdapter::order_pass_riskcheck(struct SendOrder *order_to_send, std
 
     // Extracing order_environment
     uint64_t order_order_env = order_to_send->internal_order_id>>56;
-    double max_order_value = 1000.00;
-    double contract_size = 0.000000;
-    if(strategy_info_map.count(order_to_send->strategy_id))
-        max_order_value = strategy_info_map[order_to_send->strategy_id]->max_order_value_USD;
-    
-    if(instrument_info_map.count(order_to_send->instrument_id))
-        contract_size = instrument_info_map[order_to_send->instrument_id]->contract_size;
 
     // Order environment of order is the same setting of exchange config
     if (order_order_env != _order_environment){
@@ -364,24 +321,15 @@ bool BaseTradeAdapter::order_pass_riskcheck(struct SendOrder *order_to_send, std
     //     order_ok = false;
     // }
 
-    // Breach MAX Order value contract_size
-    else if( (contract_size > 0.000000) && ((order_to_send->qty * contract_size) > max_order_value)) {
-        logger->msg(INFO, "failed riskchecks for max ordervalue - calculated against contract size");
-        double ord_val = order_to_send->qty * contract_size;
-        reject_message = "BREACH MAX ORDER VALUE: ";
-        reject_message += std::to_string(ord_val);
-        reject_reason = RISK_REJECT;
-        order_ok = false;
-    }
-
-    // Breach MAX Order value normal price
-    else if ((contract_size < 0.000001) && ((order_to_send->qty * order_to_send->price) > max_order_value)) {
-        logger->msg(INFO, "failed riskchecks for max ordervalue");
-        double ord_val = order_to_send->qty * order_to_send->price;
-        reject_message = "BREACH MAX ORDER VALUE: ";
-        reject_message += std::to_string(ord_val);
-        reject_reason = RISK_REJECT;
-        order_ok = false;
+    // Order value, price band, position, open orders and order rate - see risk_engine.hpp
+    else {
+        uint8_t risk_result = risk_engine->check(order_to_send, get_current_ts());
+        if(risk_result != RISK_CHECK_OK) {
+            reject_message = risk_engine->describe_breach(risk_result, order_to_send);
+            logger->msg(INFO, "failed riskchecks - " + reject_message);
+            reject_reason = RISK_REJECT;
+            order_ok = false;
+        }
     }
 
     // Instrument is not set to live
@@ -394,6 +342,55 @@ bool BaseTradeAdapter::order_pass_riskcheck(struct SendOrder *order_to_send, std
     return(order_ok);
 }
 
+// =================================================================================
+void BaseTradeAdapter::load_risk_limits() {
+    risk_config config;
+    std::string value = get_config_value("risk_max_position_value", "ALL");
+    if(value != "")
+        config.max_position_value = std::stod(value);
+    value = get_config_value("risk_price_band", "ALL");
+    if(value != "")
+        config.price_band = std::stod(value);
+    value = get_config_value("risk_touch_max_age_ms", "ALL");
+    if(value != "")
+        config.touch_max_age_ns = std::stoul(value) * 1000000UL;
+    value = get_config_value("risk_max_open_orders", "ALL");
+    if(value != "")
+        config.max_open_orders = std::stoul(value);
+    value = get_config_value("risk_short_window_orders", "ALL");
+    if(value != "")
+        config.short_window_orders = std::stoul(value);
+    value = get_config_value("risk_long_window_orders", "ALL");
+    if(value != "")
+        config.long_window_orders = std::stoul(value);
+
+    risk_engine->set_config(config);
+    risk_engine->compile();
+    logger->msg(INFO, "Risk limits loaded - max position value: " + std::to_string(config.max_position_value) +
+                        ", price band: " + std::to_string(config.price_band) +
+                        ", touch max age: " + std::to_string(config.touch_max_age_ns / 1000000) + "ms" +
+                        ", max open orders: " + std::to_string(config.max_open_orders) +
+                        ", orders per second: " + std::to_string(config.short_window_orders) +
+                        ", orders per minute: " + std::to_string(config.long_window_orders));
+}
+
+// =================================================================================
+// Manual and liquidation orders never went through the riskcheck, so they don't count as open
+// =================================================================================
+void BaseTradeAdapter::retire_order(char *external_order_id) {
+    order_record record;
+    if(order_table->retire_by_external(external_order_id, &record) &&
+        (record.order.order_type != MANUAL_ORDER) && (record.order.order_type != FORCED_LIQUIDATION))
+        risk_engine->on_order_closed(record.order.strategy_id);
+}
+
+void BaseTradeAdapter::retire_order(uint64_t exchange_order_id) {
+    order_record record;
+    if(order_table->retire_by_exchange(exchange_order_id, &record) &&
+        (record.order.order_type != MANUAL_ORDER) && (record.order.order_type != FORCED_LIQUIDATION))
+        risk_engine->on_order_closed(record.order.strategy_id);
+}
+
 // =================================================================================
 uint64_t BaseTradeAdapter::ascii_to_lserep( const char * str )
 {
@@ -422,7 +419,6 @@ uint64_t BaseTradeAdapter::ascii_to_lserep( const char * str )
 // =================================================================================
 double BaseTradeAdapter::ascii_to_double( const char * str )
 {
-    std::string value = str;
     double final_val = 0;
     double decimal_val = 0;
 
@@ -516,7 +512,7 @@ void BaseTradeAdapter::uint_to_ascii(unsigned int val, char* c)
 }
 
 // =================================================================================
-uint64_t BaseTradeAdapter::get_next_washbook_internal_order_id(std::string external_order_id, uint8_t exchange_id) {
+uint64_t BaseTradeAdapter::get_next_washbook_internal_order_id(uint8_t exchange_id) {
     uint64_t temp_location_id = 1;
     uint64_t tmep_environment_id = get_order_env();
     uint64_t temp_exchange_id = exchange_id;
@@ -525,21 +521,21 @@ uint64_t BaseTradeAdapter::get_next_washbook_internal_order_id(std::string exter
     temp_exchange_id <<= 40;
     wash_book_order_id++;
     uint64_t new_order_id = wash_book_order_id + tmep_environment_id + temp_location_id + temp_exchange_id;
-    washbook_external_to_internal_order_id[external_order_id] = new_order_id;
     return(new_order_id);
 }
 
 // =================================================================================
 uint64_t BaseTradeAdapter::get_internalid_from_external_map(std::string external_id) {
-    if(washbook_external_to_internal_order_id.count(external_id)) {
-        return(washbook_external_to_internal_order_id[external_id]);
+    order_record record;
+    if(order_table->find_by_external(external_id.c_str(), &record)) {
+        return(record.order.internal_order_id);
     } else {
         return (0);
     }
 }
 
 // =================================================================================
-void BaseTradeAdapter::send_internal_order_ack(char *external_order_id, struct SendOrder *send_order) {
+void BaseTradeAdapter::send_internal_order_ack(char *external_order_id, struct SendOrder *send_order, TraceContext *trace) {
     RequestAck r;
     r.msg_header = MessageHeaderT{sizeof(RequestAck), MSG_REQUEST_ACK, 1};
     strcpy((char *) r.external_order_id, (char *) external_order_id);
@@ -553,7 +549,10 @@ void BaseTradeAdapter::send_internal_order_ack(char *external_order_id, struct S
     r.instrument_id = send_order->instrument_id;
     r.strategy_id = send_order->strategy_id;
     r.send_timestamp = get_current_ts();       
-    send_any_io_message((char*)&r, sizeof(r));
+    if(trace != nullptr)
+        send_traced_io_message(&r, trace);
+    else
+        send_any_io_message((char*)&r, sizeof(r));
 }
 
 // =================================================================================
@@ -622,24 +621,36 @@ void BaseTradeAdapter::send_exchange_order_ack(char *external_order_id) {
     r.ack_type = EXCHANGE_ACK;
     r.reject_reason = UNKNOWN_REJECT;
     memset(r.reject_message, 0, MAX_REJECT_LENGTH);
+    send_exchange_order_ack(&r);
+}
 
-    auto iter = external_order_id_to_internal_order_id.find(external_order_id);
-    if(iter != external_order_id_to_internal_order_id.end()){
-        auto internal_order_id = iter->second;
-        auto order_details = internal_order_id_to_order[internal_order_id];
-        r.internal_order_id         = internal_order_id;
-        r.instrument_id             = order_details->instrument_id;
-        r.strategy_id               = order_details->strategy_id;
-        r.exchange_id               = order_details->exchange_id;
+// =================================================================================
+void BaseTradeAdapter::send_exchange_order_ack(RequestAck *r) {
+    order_record record;
+    if(order_table->find_by_external(r->external_order_id, &record)){
+        auto internal_order_id = record.order.internal_order_id;
+        auto order_details = &record.order;
+        r->internal_order_id         = internal_order_id;
+        r->instrument_id             = order_details->instrument_id;
+        r->strategy_id               = order_details->strategy_id;
+        r->exchange_id               = order_details->exchange_id;
     } else {
         // Can't find the order details - need to send fill with empty details for troubleshooting
-        r.internal_order_id         = 0;
-        r.instrument_id             = 0;
-        r.strategy_id               = 0;
-        r.exchange_id               = 0;
+        r->internal_order_id         = 0;
+        r->instrument_id             = 0;
+        r->strategy_id               = 0;
+        r->exchange_id               = 0;
+    }
+    r->send_timestamp = get_current_ts();
+
+    // Traced orders carry the trace on to the ack, the first ack is where tick to trade ends
+    TraceContext trace;
+    if((r->internal_order_id != 0) && (record.trace.magic == TRACE_CONTEXT_MAGIC) && order_table->stamp_trace(r->external_order_id, TRACE_POINT_EXCHANGE_ACK, r->send_timestamp, &trace)){
+        send_traced_io_message(r, &trace);
+        trace_recorder->record_ack(r->instrument_id, &trace);
+    } else {
+        send_any_io_message((char*)r, sizeof(RequestAck));
     }
-    r.send_timestamp = get_current_ts();
-    send_any_io_message((char*)&r, sizeof(r));
 }
 
 // =================================================================================
@@ -650,10 +661,10 @@ void BaseTradeAdapter::send_exchange_order_reject(char *external_order_id, std::
     r.ack_type = EXCHANGE_REJECT;
     r.reject_reason = reject_reason;
 
-    auto iter = external_order_id_to_internal_order_id.find(external_order_id);
-    if(iter != external_order_id_to_internal_order_id.end()){
-        auto internal_order_id = iter->second;
-        auto order_details = internal_order_id_to_order[internal_order_id];
+    order_record record;
+    if(order_table->find_by_external(external_order_id, &record)){
+        auto internal_order_id = record.order.internal_order_id;
+        auto order_details = &record.order;
         r.internal_order_id = internal_order_id;
         r.instrument_id = order_details->instrument_id;
         r.strategy_id = order_details->strategy_id;        
@@ -673,6 +684,7 @@ void BaseTradeAdapter::send_exchange_order_reject(char *external_order_id, std::
     }
     r.send_timestamp = get_current_ts();
     send_any_io_message((char*)&r, sizeof(r));
+    retire_order(external_order_id);
 }
 
 // =================================================================================
@@ -684,10 +696,10 @@ void BaseTradeAdapter::send_exchange_cancel_ack(char *external_order_id) {
     r.reject_reason = UNKNOWN_REJECT;
     memset(r.reject_message, 0, MAX_REJECT_LENGTH);
 
-    auto iter = external_order_id_to_internal_order_id.find(external_order_id);
-    if(iter != external_order_id_to_internal_order_id.end()){
-        auto internal_order_id = iter->second;
-        auto order_details = internal_order_id_to_order[internal_order_id];
+    order_record record;
+    if(order_table->find_by_external(external_order_id, &record)){
+        auto internal_order_id = record.order.internal_order_id;
+        auto order_details = &record.order;
         r.internal_order_id         = internal_order_id;
         r.instrument_id             = order_details->instrument_id;
         r.strategy_id               = order_details->strategy_id;
@@ -701,6 +713,7 @@ void BaseTradeAdapter::send_exchange_cancel_ack(char *external_order_id) {
     }
     r.send_timestamp = get_current_ts();
     send_any_io_message((char*)&r, sizeof(r));
+    retire_order(external_order_id);
 }
 
 // =================================================================================
@@ -736,22 +749,36 @@ void BaseTradeAdapter::send_fill(char *external_order_id, double price, double q
 
     strcpy(f.exchange_trade_id , exchange_trade_id.c_str());
     f.leaves_qty                = leaves_qty;
+    send_fill(&f);
+}
 
-    auto iter = external_order_id_to_internal_order_id.find(external_order_id);
-    if(iter != external_order_id_to_internal_order_id.end()){
-        auto internal_order_id = iter->second;
-        auto order_details = internal_order_id_to_order[internal_order_id];
-        f.internal_order_id         = internal_order_id;
-        f.instrument_id             = order_details->instrument_id;
-        f.strategy_id               = order_details->strategy_id;
-        f.exchange_id               = order_details->exchange_id;
+// =================================================================================
+void BaseTradeAdapter::send_fill(Fill *f) {
+    order_record record;
+    if(order_table->find_by_external(f->external_order_id, &record)){
+        auto internal_order_id = record.order.internal_order_id;
+        auto order_details = &record.order;
+        f->internal_order_id         = internal_order_id;
+        f->instrument_id             = order_details->instrument_id;
+        f->strategy_id               = order_details->strategy_id;
+        f->exchange_id               = order_details->exchange_id;
+        risk_engine->on_fill(order_details->strategy_id, order_details->instrument_id, order_details->is_buy, f->fill_qty);
     } else {
         // Can't find the order details - need to send fill with empty details for troubleshooting
-        f.internal_order_id         = 0;
-        f.instrument_id             = 0;
-        f.strategy_id               = 0;
-        f.exchange_id               = 0;
+        f->internal_order_id         = 0;
+        f->instrument_id             = 0;
+        f->strategy_id               = 0;
+        f->exchange_id               = 0;
+    }
+    f->send_timestamp = get_current_ts();
+    TraceContext trace;
+    if((f->internal_order_id != 0) && (record.trace.magic == TRACE_CONTEXT_MAGIC) && order_table->stamp_trace(f->external_order_id, TRACE_POINT_FILL_RECEIVE, f->send_timestamp, &trace)){
+        send_traced_io_message(f, &trace);
+        trace_recorder->record_fill(f->instrument_id, &trace);
+    } else {
+        send_any_io_message((char*)f, sizeof(Fill));
     }
-    f.send_timestamp = get_current_ts();
-    send_any_io_message((char*)&f, sizeof(f));
+    // Fully filled is done, anything after is a late duplicate
+    if(f->leaves_qty <= 0.0)
+        retire_order(f->external_order_id);
 }
@@ -3,6 +3,14 @@
 
 
 
+// =================================================================================
+// Trusts the configured CA file on a handle, the system bundle is used when there is none
+// =================================================================================
+void BinanceTradeAdapter::set_tls_ca_file(CURL *handle) {
+    if(tls_ca_file != "")
+        curl_easy_setopt(handle, CURLOPT_CAINFO, tls_ca_file.c_str());
+}
+
 // =================================================================================
 // Retrieves the initial listenkey for a private user websocket
 // =================================================================================
@@ -21,6 +29,7 @@ std::string BinanceTradeAdapter::get_listen_key(std::string rest_endpoint, uint8
     } 
 
     curl = curl_easy_init();
+    set_tls_ca_file(curl);
     struct curl_slist *chunk = NULL;
     std::string hdrs = "X-MBX-APIKEY: " + API_KEY;
     chunk = curl_slist_append(chunk, hdrs.c_str());
@@ -64,12 +73,28 @@ void BinanceTradeAdapter::listenkey_refresh_thread(Logger *keylogger) {
         CURL *curl;
 
         curl = curl_easy_init();
+        set_tls_ca_file(curl);
         uint64_t key_time = get_current_ts();
+        uint64_t stats_time = get_current_ts();
 
         keylogger->msg(INFO, "Started refresh thread (for listenkeys)");
 
         while(1) {
             sleep(1);
+            if (ws_api_sockets != nullptr)
+                expire_ws_api_requests(get_current_ts(), keylogger);
+            run_status_queries(curl, get_current_ts(), keylogger);
+            // Order table occupancy once a minute
+            if (get_current_ts() > stats_time) {
+                order_table_stats stats = order_table->get_stats();
+                keylogger->msg(INFO, "Order table - open: " + std::to_string(stats.num_open) + "/" + std::to_string(stats.capacity) +
+                                        " (peak " + std::to_string(stats.peak_open) + "), history: " + std::to_string(stats.num_closed) + "/" +
+                                        std::to_string(stats.history_capacity) + ", inserts: " + std::to_string(stats.num_inserts) +
+                                        ", evicted: " + std::to_string(stats.num_evicted) + ", full: " + std::to_string(stats.num_full) +
+                                        ", max probe: " + std::to_string(stats.max_probe));
+                reconcile_open_orders(curl, keylogger);
+                stats_time = get_current_ts() + (60*1000000000L);
+            }
             if (get_current_ts() > key_time) {
                 // Loop through all websockets and renew all of the keys
                 for (auto map_entry : listenkey_map) {
@@ -135,6 +160,7 @@ void BinanceTradeAdapter::user_websocket_loop_thread(Logger *wslogger) {
         std::string_view ws_message;
         uint8_t exchange_id;
         uint64_t recv_ts;
+        execution_report report;
 
         // message loop
         while (1) {
@@ -150,335 +176,296 @@ void BinanceTradeAdapter::user_websocket_loop_thread(Logger *wslogger) {
             uint64_t current_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
             uint64_t sent_ts;
 
-            simdjson::dom::element exchange_json_message;
-            simdjson::dom::element order_details;
-            // Parsing with SIMDJSON parser
-            auto error = parser.parse(ws_message.cbegin(), ws_message.length()).get(exchange_json_message);
-            if (error) { 
-                std::stringstream error_message; 
-                error_message << error;
-                wslogger->msg(ERROR, "Got an error when parsing: " + error_message.str());
-                return; 
-            }
+            // Only executionReport (spot) and ORDER_TRADE_UPDATE (futures) are acted on - decoded in one pass
+            // straight into report, the other events on the stream come back false and are dropped
+            if (! execution_decoder->decode(ws_message.data(), ws_message.length(), exchange_id, &report))
+                continue;
+
+            // Order details from the exchange message
+            char *external_order_id_temp = report.client_order_id;
+            bool is_web_order = (strncmp(report.client_order_id, "web_", 4) == 0);
+            bool is_liquidation_order = (report.order_type == EXEC_ORDER_TYPE_LIQUIDATION);
+
+            // Handle MARKET / LIMIT order updates (this includes web initiated orders and Liquidation orders)
+            if (    (report.order_type == EXEC_ORDER_TYPE_LIMIT) ||
+                    (report.order_type == EXEC_ORDER_TYPE_MARKET) ||
+                    is_liquidation_order)
+            {
+                // NEW ORDER MESSAGE
+                if(report.status == EXEC_STATUS_NEW) {
+
+                    // {"e":"executionReport",
+                    // "E":1624649424612,
+                    // "s":"BTCUSDT",
+                    // "c":"7zgSmQ9C1",
+                    // "S":"BUY",
+                    // "o":"LIMIT",
+                    // "f":"GTC",
+                    // "q":"0.00100000",
+                    // "p":"31765.38000000",
+                    // "P":"0.00000000",
+                    // "F":"0.00000000",
+                    // "g":-1,
+                    // "C":"",
+                    // "x":"NEW",
+                    // "X":"NEW",
+                    // "r":"NONE",
+                    // "i":6622961854,
+                    // "l":"0.00000000",
+                    // "z":"0.00000000",
+                    // "L":"0.00000000",
+                    // "n":"0",
+                    // "N":null,
+                    // "T":1624649424611,
+                    // "t":-1,
+                    // "I":14156327846,
+                    // "w":true,
+                    // "m":false,
+                    // "M":false,
+                    // "O":1624649424611,
+                    // "Z":"0.00000000",
+                    // "Y":"0.00000000",
+                    // "Q":"0.00000000"}                            
+
+                    // WEB INITIATED ORDER OR LIQUIDATION ORDERS
+                    // We synthesize an order/ack/exchange ack onto the bus so we can create new records for it
+                    if (is_web_order || is_liquidation_order) {
+                        wslogger->msg(INFO, "WebSocket Message=" + std::string(ws_message.cbegin(), ws_message.length()));
+                        // Create new order with internal order_id generated
+                        uint64_t temp_location_id = 1;
+                        uint64_t top_8_bits = get_order_env();
+                        top_8_bits <<= 56;
+                        temp_location_id <<= 48;
+
+                        uint64_t exchange_order_id = report.exchange_order_id;
+                        struct SendOrder s = {};
+                        s.msg_header.msgType = MSG_NEW_ORDER;
+                        s.msg_header.msgLength = sizeof(struct SendOrder);
+                        s.msg_header.protoVersion = 1;
+                        s.is_buy     = report.is_buy;
+                        s.price      = report.price;
+                        s.qty        = report.orig_qty;
+                        s.instrument_id   = report.instrument_id;
+                        s.internal_order_id = get_next_washbook_internal_order_id(exchange_id); // This gets the next available order id
+                        s.exchange_id   = exchange_id;
+                        s.strategy_id   = 0; // Strategy 0 is used as wash book for forced updates
+                        if(is_liquidation_order)
+                            s.order_type   = FORCED_LIQUIDATION;
+                        else
+                            s.order_type   = MANUAL_ORDER;
+                        send_any_io_message((char *)&s, sizeof(struct SendOrder));
+                        // Save order details for future use - these go by the exchange order id on the bus as well
+                        if(! order_table->insert(&s, std::to_string(exchange_order_id).c_str(), exchange_order_id))
+                            wslogger->msg(ERROR, "Order table full, can't track web/liquidation order: " + std::to_string(exchange_order_id));
+
+
+                        // SENDING INTERNAL ACK
+                        struct RequestAck request_message;
+                        request_message.msg_header.msgType = MSG_REQUEST_ACK;
+                        request_message.msg_header.msgLength = sizeof(struct RequestAck);
+                        request_message.msg_header.protoVersion = 1;
+                        request_message.internal_order_id = s.internal_order_id;
+                        strcpy(request_message.external_order_id, std::to_string(exchange_order_id).c_str());
+                        request_message.instrument_id = s.instrument_id;
+                        request_message.exchange_id = exchange_id;
+                        request_message.strategy_id = 0;
+                        request_message.ack_type = REQUEST_ACK;
+                        request_message.reject_reason = UNKNOWN_REJECT;
+                        request_message.reject_message[0] = '\0';
+                        send_any_io_message((char *)&request_message, sizeof(request_message));
+
+                        // NOW SEND THE EXCHANGE ACK
+                        request_message.ack_type = EXCHANGE_ACK;
+                        send_any_io_message((char *)&request_message, sizeof(request_message));
 
-            // We won't process any messages that doesn't contain an "e" (Event Type)
-            if (exchange_json_message["e"].error() != simdjson::NO_SUCH_FIELD) {
-
-                // ORDER UPDATE
-                if (    ((std::string_view) exchange_json_message["e"].get_string() == "ORDER_TRADE_UPDATE") || // Futures
-                        ((std::string_view) exchange_json_message["e"].get_string() == "executionReport"))      // Spot
-                {
-                    // Normalise exchange response into order_details for easier handling
-                    if ((std::string_view) exchange_json_message["e"].get_string() == "ORDER_TRADE_UPDATE")
-                        order_details = exchange_json_message["o"];
-                    else
-                        order_details = exchange_json_message;
-
-                    wslogger->msg(INFO, "WebSocket Message=" + std::string(ws_message.cbegin(), ws_message.length()));
-                    // Extract order details from the exchange message
-                    std::string_view response_order_id = order_details["c"].get_string();
-                    char external_order_id_temp[MAX_EXTERNAL_ORDER_ID_LENGTH];
-                    strcpy(external_order_id_temp, order_details["c"].get_c_str());
-                    bool isbid = ((std::string_view) order_details["S"].get_string() == "BUY");
-                    bool is_liquidation_order = ((std::string_view) order_details["o"].get_string() == "LIQUIDATION");
-
-                    // Handle MARKET / LIMIT order updates (this includes web initiated orders and Liquidation orders)
-                    if (    ((std::string_view) order_details["o"].get_string() == "LIMIT") ||
-                            ((std::string_view) order_details["o"].get_string() == "MARKET") ||
-                            is_liquidation_order)
+                    }
+
+                    // JUST AN ACK FROM OWN INITIATED ORDER
+                    else 
                     {
-                        // NEW ORDER MESSAGE
-                        if((std::string_view) order_details["X"].get_string() == "NEW") {
-
-                            // {"e":"executionReport",
-                            // "E":1624649424612,
-                            // "s":"BTCUSDT",
-                            // "c":"7zgSmQ9C1",
-                            // "S":"BUY",
-                            // "o":"LIMIT",
-                            // "f":"GTC",
-                            // "q":"0.00100000",
-                            // "p":"31765.38000000",
-                            // "P":"0.00000000",
-                            // "F":"0.00000000",
-                            // "g":-1,
-                            // "C":"",
-                            // "x":"NEW",
-                            // "X":"NEW",
-                            // "r":"NONE",
-                            // "i":6622961854,
-                            // "l":"0.00000000",
-                            // "z":"0.00000000",
-                            // "L":"0.00000000",
-                            // "n":"0",
-                            // "N":null,
-                            // "T":1624649424611,
-                            // "t":-1,
-                            // "I":14156327846,
-                            // "w":true,
-                            // "m":false,
-                            // "M":false,
-                            // "O":1624649424611,
-                            // "Z":"0.00000000",
-                            // "Y":"0.00000000",
-                            // "Q":"0.00000000"}                            
-
-                            // WEB INITIATED ORDER OR LIQUIDATION ORDERS
-                            // We synthesize an order/ack/exchange ack onto the bus so we can create new records for it
-                            if ((response_order_id.rfind("web_", 0) == 0) || (is_liquidation_order)) {
-                                // Create new order with internal order_id generated
-                                uint64_t temp_location_id = 1;
-                                uint64_t top_8_bits = get_order_env();
-                                top_8_bits <<= 56;
-                                temp_location_id <<= 48;
-
-                                struct SendOrder *s = new SendOrder();
-                                s->msg_header.msgType = MSG_NEW_ORDER;
-                                s->msg_header.msgLength = sizeof(struct SendOrder);
-                                s->msg_header.protoVersion = 1;
-                                s->is_buy     = isbid;
-                                s->price      = ascii_to_double(order_details["p"].get_c_str());
-                                s->qty        = ascii_to_double(order_details["q"].get_c_str());
-                                s->instrument_id   = instr_name_to_instr_id[as_string(order_details["s"])];
-                                s->internal_order_id = get_next_washbook_internal_order_id(std::to_string(order_details["i"].get_uint64()), exchange_id); // This gets the next available order id and adds to map
-                                s->exchange_id   = exchange_id;
-                                s->strategy_id   = 0; // Strategy 0 is used as wash book for forced updates
-                                if(is_liquidation_order)
-                                    s->order_type   = FORCED_LIQUIDATION;
-                                else
-                                    s->order_type   = MANUAL_ORDER;
-                                send_any_io_message((char *)s, sizeof(struct SendOrder));
-                                // Save order details for future use
-                                exchange_order_id_to_order[std::to_string(order_details["i"].get_uint64())] = s;
-
-
-                                // SENDING INTERNAL ACK
-                                struct RequestAck request_message;
-                                request_message.msg_header.msgType = MSG_REQUEST_ACK;
-                                request_message.msg_header.msgLength = sizeof(struct RequestAck);
-                                request_message.msg_header.protoVersion = 1;
-                                request_message.internal_order_id = s->internal_order_id;
-                                strcpy(request_message.external_order_id, order_details["i"].get_c_str());
-                                request_message.instrument_id = s->instrument_id;
-                                request_message.exchange_id = exchange_id;
-                                request_message.strategy_id = 0;
-                                request_message.ack_type = REQUEST_ACK;
-                                request_message.reject_reason = UNKNOWN_REJECT;
-                                request_message.reject_message[0] = '\0';
-                                send_any_io_message((char *)&request_message, sizeof(request_message));
-
-                                // NOW SEND THE EXCHANGE ACK
-                                request_message.ack_type = EXCHANGE_ACK;
-                                send_any_io_message((char *)&request_message, sizeof(request_message));
+                        RequestAck exchange_ack;
+                        ExecutionReportDecoder::build_exchange_ack(&report, &exchange_ack);
+                        clock_gettime(CLOCK_REALTIME, &t);
+                        sent_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
+                        send_exchange_order_ack(&exchange_ack);
+                        wslogger->msg(INFO, "Got Exchange Ack for exchange orderID: " + std::to_string(report.exchange_order_id));
 
-                            }
 
-                            // JUST AN ACK FROM OWN INITIATED ORDER
-                            else 
-                            {
-                                clock_gettime(CLOCK_REALTIME, &t);
-                                sent_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
-                                send_exchange_order_ack(external_order_id_temp);
-                                std::string exchange_order_id = std::to_string(order_details["i"].get_uint64());
-                                wslogger->msg(INFO, "Got Exchange Ack for exchange orderID: " + exchange_order_id);
-
-
-                                auto iter = external_order_id_to_order.find(external_order_id_temp);
-                                if(iter != external_order_id_to_order.end()){
-                                    wslogger->log_ts(OE_READER_THREAD, iter->second->internal_order_id, current_ts, sent_ts);
-                                    // make a link to the order details for the exchange order id for future updates
-                                    exchange_order_id_to_order[exchange_order_id] = external_order_id_to_order[std::string(external_order_id_temp)];
-                                } else {
-                                    wslogger->log_ts(OE_READER_THREAD, 0, current_ts, sent_ts);
-                                }
-                            }
+                        order_record record;
+                        if(order_table->find_by_external(external_order_id_temp, &record)){
+                            wslogger->log_ts(OE_READER_THREAD, record.order.internal_order_id, current_ts, sent_ts);
+                            // make a link to the order details for the exchange order id for future updates
+                            order_table->link_exchange_order_id(external_order_id_temp, report.exchange_order_id);
+                        } else {
+                            wslogger->log_ts(OE_READER_THREAD, 0, current_ts, sent_ts);
+                        }
+                    }
+                }
+                
+                // CANCEL ORDER
+                else if ((report.status == EXEC_STATUS_CANCELED) || (report.status == EXEC_STATUS_EXPIRED)) {
+
+                    if (is_web_order) {
+                        wslogger->msg(INFO, "WebSocket Message=" + std::string(ws_message.cbegin(), ws_message.length()));
+                        // Handle a cancel or expire from web interface
+                        // We need to synthesize a cancel request and then send the internal cancel ack and exchange cancel ack
+
+                        // websocket_messageloop_thread:WebSocket Message={ "e":"executionReport",
+                                                                        // "E":1624627518904,
+                                                                        // "s":"BTCUSDT",
+                                                                        // "c":"web_df8506846d754dc7b0fdd22ebcece41a",
+                                                                        // "S":"BUY",
+                                                                        // "o":"LIMIT",
+                                                                        // "f":"GTC",
+                                                                        // "q":"0.00100000",
+                                                                        // "p":"32245.73000000",
+                                                                        // "P":"0.00000000",
+                                                                        // "F":"0.00000000",
+                                                                        // "g":-1,
+                                                                        // "C":"5hjl9lcA0",
+                                                                        // "x":"CANCELED",
+                                                                        // "X":"CANCELED",
+                                                                        // "r":"NONE",
+                                                                        // "i":6617694906,
+                                                                        // "l":"0.00000000",
+                                                                        // "z":"0.00000000",
+                                                                        // "L":"0.00000000",
+                                                                        // "n":"0",
+                                                                        // "N":null,
+                                                                        // "T":1624627518904,
+                                                                        // "t":-1,
+                                                                        // "I":14145177253,
+                                                                        // "w":false,
+                                                                        // "m":false,
+                                                                        // "M":false,
+                                                                        // "O":1624627501404,
+                                                                        // "Z":"0.00000000",
+                                                                        // "Y":"0.00000000",
+                                                                        // "Q":"0.00000000"}
+
+                        // Check if the exchange_order_id is in our map
+                        uint64_t exchange_order_id = report.exchange_order_id;
+                        order_record record;
+                        bool web_cancel_of_existing_order = order_table->find_by_exchange(exchange_order_id, &record);
+
+                        // SENDING CANCEL REQ
+                        struct CancelOrder cancel_message;
+                        cancel_message.msg_header.msgType = MSG_CANCEL_ORDER;
+                        cancel_message.msg_header.msgLength = sizeof(struct CancelOrder);
+                        cancel_message.msg_header.protoVersion = 1;
+                        cancel_message.exchange_id = exchange_id;
+                        cancel_message.cancel_type = WEB_CANCEL;
+
+                        if(web_cancel_of_existing_order){
+                            cancel_message.internal_order_id = record.order.internal_order_id;
+                            cancel_message.instrument_id = report.instrument_id;
+                        }
+                        else {
+                            cancel_message.internal_order_id = 0;
+                        }
+                        cancel_message.strategy_id = 0;
+                        send_any_io_message((char *)&cancel_message, sizeof(struct CancelOrder));
+
+                        // SENDING INTERNAL ACK
+                        struct RequestAck request_message;
+                        request_message.msg_header.msgType = MSG_REQUEST_ACK;
+                        request_message.msg_header.msgLength = sizeof(struct RequestAck);
+                        request_message.msg_header.protoVersion = 1;
+                        request_message.internal_order_id = cancel_message.internal_order_id;
+                        if(web_cancel_of_existing_order){
+                            strcpy(request_message.external_order_id, record.external_order_id);
+                        }
+                        else {
+                            strcpy(request_message.external_order_id, report.client_order_id); // should never occurr
                         }
-                        
-                        // CANCEL ORDER
-                        else if (((std::string_view) order_details["X"].get_string() == "CANCELED") ||
-                                ((std::string_view) order_details["X"].get_string() == "EXPIRED")) {
-
-                            if (response_order_id.rfind("web_", 0) == 0) {
-                                // Handle a cancel or expire from web interface
-                                // We need to synthesize a cancel request and then send the internal cancel ack and exchange cancel ack
-
-                                // websocket_messageloop_thread:WebSocket Message={ "e":"executionReport",
-                                                                                // "E":1624627518904,
-                                                                                // "s":"BTCUSDT",
-                                                                                // "c":"web_df8506846d754dc7b0fdd22ebcece41a",
-                                                                                // "S":"BUY",
-                                                                                // "o":"LIMIT",
-                                                                                // "f":"GTC",
-                                                                                // "q":"0.00100000",
-                                                                                // "p":"32245.73000000",
-                                                                                // "P":"0.00000000",
-                                                                                // "F":"0.00000000",
-                                                                                // "g":-1,
-                                                                                // "C":"5hjl9lcA0",
-                                                                                // "x":"CANCELED",
-                                                                                // "X":"CANCELED",
-                                                                                // "r":"NONE",
-                                                                                // "i":6617694906,
-                                                                                // "l":"0.00000000",
-                                                                                // "z":"0.00000000",
-                                                                                // "L":"0.00000000",
-                                                                                // "n":"0",
-                                                                                // "N":null,
-                                                                                // "T":1624627518904,
-                                                                                // "t":-1,
-                                                                                // "I":14145177253,
-                                                                                // "w":false,
-                                                                                // "m":false,
-                                                                                // "M":false,
-                                                                                // "O":1624627501404,
-                                                                                // "Z":"0.00000000",
-                                                                                // "Y":"0.00000000",
-                                                                                // "Q":"0.00000000"}
-
-                                // Check if the exchange_order_id is in our map
-                                bool web_cancel_of_existing_order = false;
-                                std::string external_order_id;
-                                external_order_id = std::to_string(order_details["i"].get_uint64());
-
-                                if(exchange_order_id_to_order.count(external_order_id) > 0)
-                                    web_cancel_of_existing_order = true;
-
-                                // SENDING CANCEL REQ
-                                struct CancelOrder cancel_message;
-                                cancel_message.msg_header.msgType = MSG_CANCEL_ORDER;
-                                cancel_message.msg_header.msgLength = sizeof(struct CancelOrder);
-                                cancel_message.msg_header.protoVersion = 1;
-                                cancel_message.exchange_id = exchange_id;
-                                cancel_message.cancel_type = WEB_CANCEL;
-
-                                if(web_cancel_of_existing_order){
-                                    cancel_message.internal_order_id = exchange_order_id_to_order[external_order_id]->internal_order_id;                                
-                                    cancel_message.instrument_id = instr_name_to_instr_id[as_string(order_details["s"])];
-                                }
-                                else {
-                                    cancel_message.internal_order_id = 0;
-                                }
-                                cancel_message.strategy_id = 0;
-                                send_any_io_message((char *)&cancel_message, sizeof(struct CancelOrder));
-
-                                // SENDING INTERNAL ACK
-                                struct RequestAck request_message;
-                                request_message.msg_header.msgType = MSG_REQUEST_ACK;
-                                request_message.msg_header.msgLength = sizeof(struct RequestAck);
-                                request_message.msg_header.protoVersion = 1;
-                                request_message.internal_order_id = cancel_message.internal_order_id;
-                                if(web_cancel_of_existing_order){
-                                    strcpy(request_message.external_order_id, internal_order_id_to_external_order_id[request_message.internal_order_id].c_str());
-                                }
-                                else {
-                                    strcpy(request_message.external_order_id, order_details["c"].get_c_str()); // should never occurr
-                                }
 
-                                request_message.instrument_id = cancel_message.instrument_id;
-                                request_message.exchange_id = exchange_id;
-                                request_message.strategy_id = 0;
-                                request_message.ack_type = CANCEL_REQUEST_ACK;
-                                request_message.reject_reason = UNKNOWN_REJECT;
-                                request_message.reject_message[0] = '\0';
-                                send_any_io_message((char *)&request_message, sizeof(struct RequestAck));
-
-                                // NOW SEND THE EXCHANGE CANCEL ACK
-                                request_message.ack_type = EXCHANGE_CANCEL_ACK;
-                                send_any_io_message((char *)&request_message, sizeof(struct RequestAck));
-                            } 
-                            //Not Web order - internally sent
-                            else {
-                                std::string order;
-                                if (exchange_id == 16) // id = binance
-                                    order = as_string(order_details["C"]);
-                                else
-                                    order = as_string(order_details["c"]);
-
-                                clock_gettime(CLOCK_REALTIME, &t);
-                                sent_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
-                                send_exchange_cancel_ack((char *) order.c_str());
-                                wslogger->msg(INFO, "Got Exchange Cancel Ack for: " + order);
-                                auto iter = external_order_id_to_internal_order_id.find(order);
-                                if(iter != external_order_id_to_internal_order_id.end()){
-                                    wslogger->log_ts(OE_READER_THREAD, iter->second, current_ts, sent_ts);
-                                } else {
-                                    wslogger->log_ts(OE_READER_THREAD, 0, current_ts, sent_ts);
-                                }                                
-                            }
-                        } 
-                        
-                        // FILL
-                        else if (   ((std::string_view) order_details["X"].get_string() == "PARTIALLY_FILLED") ||
-                                    ((std::string_view) order_details["X"].get_string() == "FILLED")) {
-                            // Pre-calcluate leaves_qty for all
-                            double leaves_qty = ascii_to_double(order_details["q"].get_c_str()) - ascii_to_double(order_details["z"].get_c_str());
-
-                            // Commission details extracted - same across all trades
-                            double commission_fee = ascii_to_double(order_details["n"].get_c_str());
-                            uint32_t commission_asset_id = 0;
-                            std::string asset_lc = boost::algorithm::to_lower_copy(as_string(order_details["N"]));
-                            if (base_name_to_asset_id.count(asset_lc)) {
-                                commission_asset_id = base_name_to_asset_id[asset_lc];
-                            }
-                            TradingFee trading_fee;
-                            trading_fee.msg_header = MessageHeaderT{sizeof(struct TradingFee), TRADING_FEE, 1};
-                            trading_fee.commission_fee = commission_fee;
-                            trading_fee.asset_id = commission_asset_id;
-                            trading_fee.fee_type = EXECUTION_FEE;
-                            trading_fee.exchange_id = exchange_id;
-                            strcpy(trading_fee.exchange_trade_id , std::to_string(static_cast<uint64_t>(order_details["t"].get_uint64())).c_str());
-
-                            // WEB OR LIQUIDATION FILLS
-                            if ((response_order_id.rfind("web_", 0) == 0) || (is_liquidation_order)) {
-                                wslogger->msg(INFO, "Got FILL on web initiated order");
-                                SendOrder *s = exchange_order_id_to_order[std::to_string(order_details["i"].get_uint64())];
-
-                                Fill fill_message;
-                                fill_message.msg_header = MessageHeaderT{sizeof(Fill), MSG_FILL, 0};
-                                fill_message.fill_price                = ascii_to_double(order_details["L"].get_c_str());
-                                fill_message.fill_qty                  = ascii_to_double(order_details["l"].get_c_str());
-                                strcpy((char *) fill_message.external_order_id, order_details["i"].get_c_str());
-                                fill_message.exchange_id               = exchange_id;
-                                strcpy(fill_message.exchange_trade_id , std::to_string(static_cast<uint64_t>(order_details["t"].get_uint64())).c_str());
-                                fill_message.internal_order_id         = s->internal_order_id;
-
-                                if(fill_message.internal_order_id == 0) {
-                                    wslogger->msg(INFO, "Something went wrong with the lookup of the internal order id from the external when mapping the fill");
-                                }
+                        request_message.instrument_id = cancel_message.instrument_id;
+                        request_message.exchange_id = exchange_id;
+                        request_message.strategy_id = 0;
+                        request_message.ack_type = CANCEL_REQUEST_ACK;
+                        request_message.reject_reason = UNKNOWN_REJECT;
+                        request_message.reject_message[0] = '\0';
+                        send_any_io_message((char *)&request_message, sizeof(struct RequestAck));
+
+                        // NOW SEND THE EXCHANGE CANCEL ACK
+                        request_message.ack_type = EXCHANGE_CANCEL_ACK;
+                        send_any_io_message((char *)&request_message, sizeof(struct RequestAck));
+                        retire_order(exchange_order_id);
+                    } 
+                    //Not Web order - internally sent
+                    else {
+                        // Spot cancels carry the order in C, an expiry has C empty and the order in c
+                        char *order;
+                        if ((exchange_id == 16) && (report.orig_client_order_id[0] != 0)) // id = binance
+                            order = report.orig_client_order_id;
+                        else
+                            order = report.client_order_id;
 
-                                fill_message.instrument_id             = s->instrument_id;
-                                fill_message.strategy_id               = 0; // washbook strategy id
-                                fill_message.leaves_qty                = leaves_qty;
-                                send_any_io_message((char *)&fill_message, sizeof(fill_message));
-
-                                // Also send the trading fee
-                                trading_fee.internal_order_id = fill_message.internal_order_id;
-                                send_any_io_message((char *)&trading_fee, sizeof(trading_fee));
-                            } 
-                            
-                            // NORMAL FILL
-                            else 
-                            {
-                                clock_gettime(CLOCK_REALTIME, &t);
-                                sent_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
-                                send_fill(  external_order_id_temp, 
-                                            ascii_to_double(order_details["L"].get_c_str()), 
-                                            ascii_to_double(order_details["l"].get_c_str()),
-                                            leaves_qty,
-                                            isbid,
-                                            std::to_string(static_cast<uint64_t>(order_details["t"].get_uint64())));
-                                wslogger->msg(INFO, "Got FILL");
-                                auto iter = external_order_id_to_internal_order_id.find(external_order_id_temp);
-                                if(iter != external_order_id_to_internal_order_id.end()){
-                                    // Also send the trading fee (only do this when finding a corresponding internal order id)
-                                    trading_fee.internal_order_id = iter->second;
-                                    send_any_io_message((char *)&trading_fee, sizeof(trading_fee));
-                                    // log timestamp
-                                    wslogger->log_ts(OE_READER_THREAD, iter->second, current_ts, sent_ts);
-                                } else {
-                                    wslogger->log_ts(OE_READER_THREAD, 0, current_ts, sent_ts);
-                                }
-                            }
+                        clock_gettime(CLOCK_REALTIME, &t);
+                        sent_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
+                        send_exchange_cancel_ack(order);
+                        wslogger->msg(INFO, "Got Exchange Cancel Ack for: " + std::string(order));
+                        order_record record;
+                        if(order_table->find_by_external(order, &record)){
+                            wslogger->log_ts(OE_READER_THREAD, record.order.internal_order_id, current_ts, sent_ts);
+                        } else {
+                            wslogger->log_ts(OE_READER_THREAD, 0, current_ts, sent_ts);
+                        }                                
+                    }
+                } 
+                
+                // FILL
+                else if ((report.status == EXEC_STATUS_PARTIALLY_FILLED) || (report.status == EXEC_STATUS_FILLED)) {
+                    // Fill and commission straight from the report (leaves_qty, trade id and fee are in both)
+                    Fill fill_message;
+                    ExecutionReportDecoder::build_fill(&report, &fill_message);
+                    TradingFee trading_fee;
+                    ExecutionReportDecoder::build_trading_fee(&report, exchange_id, &trading_fee);
+
+                    // WEB OR LIQUIDATION FILLS
+                    if (is_web_order || is_liquidation_order) {
+                        wslogger->msg(INFO, "Got FILL on web initiated order");
+                        uint64_t exchange_order_id = report.exchange_order_id;
+                        order_record record = {};
+                        order_table->find_by_exchange(exchange_order_id, &record);
+                        SendOrder *s = &record.order;
+
+                        // These go by the exchange order id on the bus
+                        strcpy((char *) fill_message.external_order_id, std::to_string(exchange_order_id).c_str());
+                        fill_message.exchange_id               = exchange_id;
+                        fill_message.internal_order_id         = s->internal_order_id;
+
+                        if(fill_message.internal_order_id == 0) {
+                            wslogger->msg(INFO, "Something went wrong with the lookup of the internal order id from the external when mapping the fill");
+                        }
+
+                        fill_message.instrument_id             = s->instrument_id;
+                        fill_message.strategy_id               = 0; // washbook strategy id
+                        send_any_io_message((char *)&fill_message, sizeof(fill_message));
+
+                        // Also send the trading fee
+                        trading_fee.internal_order_id = fill_message.internal_order_id;
+                        send_any_io_message((char *)&trading_fee, sizeof(trading_fee));
+                        if(fill_message.leaves_qty <= 0.0)
+                            retire_order(exchange_order_id);
+                    } 
+                    
+                    // NORMAL FILL
+                    else 
+                    {
+                        clock_gettime(CLOCK_REALTIME, &t);
+                        sent_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
+                        send_fill(&fill_message);
+                        wslogger->msg(INFO, "Got FILL");
+                        order_record record;
+                        if(order_table->find_by_external(external_order_id_temp, &record)){
+                            // Also send the trading fee (only do this when finding a corresponding internal order id)
+                            trading_fee.internal_order_id = record.order.internal_order_id;
+                            send_any_io_message((char *)&trading_fee, sizeof(trading_fee));
+                            // log timestamp
+                            wslogger->log_ts(OE_READER_THREAD, record.order.internal_order_id, current_ts, sent_ts);
+                        } else {
+                            wslogger->log_ts(OE_READER_THREAD, 0, current_ts, sent_ts);
                         }
                     }
                 }
@@ -488,6 +475,853 @@ void BinanceTradeAdapter::user_websocket_loop_thread(Logger *wslogger) {
     user_ws_loop_thread.detach();
 }
 
+// =================================================================================
+// Returns the prebuilt request template of the instrument, built on its first order
+// =================================================================================
+order_template *BinanceTradeAdapter::get_order_template(uint32_t instrument_id, uint8_t exchange_id) {
+    order_template *order_tmpl = order_builder->get_template(instrument_id);
+    if(order_tmpl == nullptr){
+        auto *instrument = instrument_info_map[instrument_id];
+        order_tmpl = order_builder->add_template(instrument_id, listenkey_map[exchange_id]->rest_endpoint, instrument->instrument_name,
+                                                    instrument->price_precision, instrument->qty_precision, (exchange_id != 16));
+    }
+    return(order_tmpl);
+}
+
+// =================================================================================
+// Sends a new order over REST - the response comes back on the gateway thread
+// =================================================================================
+void BinanceTradeAdapter::send_new_order_rest(struct SendOrder *s, char *ext_order_id, uint64_t current_ts) {
+    gateway_request request;
+    request.request_type = GATEWAY_NEW_ORDER;
+    request.endpoint = listenkey_map[s->exchange_id]->gateway_endpoint;
+    request.reduce_only = risk_engine->reduces_position(s);
+    request.internal_order_id = s->internal_order_id;
+    strcpy(request.external_order_id, ext_order_id);
+    request.receive_ts = current_ts;
+    request.instrument_id = s->instrument_id;
+    request.batch_item_length = 0;
+
+    order_template *order_tmpl = get_order_template(s->instrument_id, s->exchange_id);
+    order_builder->build_new_order(order_tmpl, s->is_buy, s->price, s->qty, ext_order_id, get_current_ts_millis(), request.url);
+    // The url is only used if the gateway ends up sending it on its own
+    if (listenkey_map[s->exchange_id]->batch_orders)
+        request.batch_item_length = order_builder->build_batch_order_item(order_tmpl, s->is_buy, s->price, s->qty, ext_order_id, request.batch_item);
+
+    order_gateway->send_request(std::move(request));
+}
+
+// =================================================================================
+// Sends a cancel over REST - the response comes back on the gateway thread
+// =================================================================================
+void BinanceTradeAdapter::send_cancel_rest(struct CancelOrder *c, std::string &cancel_external_order_id, uint64_t current_ts) {
+    gateway_request request;
+    request.request_type = GATEWAY_CANCEL_ORDER;
+    request.endpoint = listenkey_map[c->exchange_id]->gateway_endpoint;
+    request.reduce_only = false;
+    request.internal_order_id = c->internal_order_id;
+    request.cancel_request = *c;
+    request.receive_ts = current_ts;
+    strncpy(request.external_order_id, cancel_external_order_id.c_str(), MAX_EXTERNAL_ORDER_ID_LENGTH - 1);
+    request.external_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH - 1] = 0;
+    request.instrument_id = c->instrument_id;
+    request.batch_item_length = 0;
+
+    order_template *order_tmpl = get_order_template(c->instrument_id, c->exchange_id);
+    order_builder->build_cancel(order_tmpl, request.external_order_id, get_current_ts_millis(), request.url);
+    // Cancels batch per symbol, the client order ids are added when the batch goes out
+    if (listenkey_map[c->exchange_id]->batch_orders) {
+        strcpy(request.batch_item, order_tmpl->symbol);
+        request.batch_item_length = strlen(request.batch_item);
+    }
+
+    order_gateway->send_request(std::move(request));
+}
+
+// =================================================================================
+// Adds a param to both the query string that gets signed and the json params
+// =================================================================================
+void BinanceTradeAdapter::add_ws_api_param(ws_api_params &params, const char *name, const char *value, bool quoted) {
+    params.query_length += snprintf(params.query + params.query_length, WS_API_MAX_MESSAGE_LENGTH - params.query_length,
+                                    "%s%s=%s", (params.query_length ? "&" : ""), name, value);
+    params.json_length += snprintf(params.json + params.json_length, WS_API_MAX_MESSAGE_LENGTH - params.json_length,
+                                    (quoted ? "\"%s\":\"%s\"," : "\"%s\":%s,"), name, value);
+}
+
+// =================================================================================
+// Signs and sends a websocket API request, the params have to be added sorted by name
+// Returns false if it couldn't go out (socket not connected) so the caller can use REST
+// =================================================================================
+bool BinanceTradeAdapter::send_ws_api_request(ws_api_request &request, const char *method, ws_api_params &params) {
+    char message[WS_API_MAX_MESSAGE_LENGTH + 128];
+    char signature[HMAC_HEX_SIZE + 1];
+    order_builder->sign_hex(params.query, params.query_length, signature);
+
+    uint64_t request_id = ++ws_api_request_id;
+    int message_length = snprintf(message, sizeof(message), "{\"id\":%lu,\"method\":\"%s\",\"params\":{%s\"signature\":\"%s\"}}",
+                                    request_id, method, params.json, signature);
+
+    // In the pending map before it goes out, the response can be back before send returns
+    ws_api_lock.acquire_lock();
+    request.send_ts = get_current_ts();
+    ws_api_pending[request_id] = request;
+    ws_api_lock.release_lock();
+
+    if(! ws_api_sockets->send_text_message(request.exchange_id, message, message_length)){
+        ws_api_lock.acquire_lock();
+        ws_api_pending.erase(request_id);
+        ws_api_lock.release_lock();
+        logger->msg(WARN, "Websocket API not connected for exchange_id: " + std::to_string(request.exchange_id) + " - sending over REST");
+        return(false);
+    }
+    // Not the message itself, it carries the apiKey and signature
+    logger->msg(INFO, "WS API " + std::string(method) + " id=" + std::to_string(request_id) + " clientOrderId=" + std::string(request.external_order_id));
+    return(true);
+}
+
+// =================================================================================
+// Requests that never got a response - timed out, or the connection they went out on is gone
+// and the response with it. They may well have got to the exchange, so they are not rejected
+// but left to the status query. Called once a second from the refresh thread.
+// =================================================================================
+void BinanceTradeAdapter::expire_ws_api_requests(uint64_t current_ts, Logger *log) {
+    std::vector<ws_api_request> expired;
+    std::unordered_map<uint8_t, bool> connected;
+
+    ws_api_lock.acquire_lock();
+    for (auto it = ws_api_pending.begin(); it != ws_api_pending.end();) {
+        uint8_t exchange_id = it->second.exchange_id;
+        if (connected.count(exchange_id) == 0)
+            connected[exchange_id] = ws_api_sockets->is_connected(exchange_id);
+        if (! connected[exchange_id] || ((current_ts - it->second.send_ts) > WS_API_REQUEST_TIMEOUT_NS)) {
+            expired.push_back(it->second);
+            it = ws_api_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ws_api_lock.release_lock();
+
+    for (auto &request : expired) {
+        log->msg(WARN, "No websocket API response for: " + std::string(request.external_order_id) + 
+                        (connected[request.exchange_id] ? " - timed out" : " - connection lost") + ", querying the order status");
+        queue_status_query(request.request_type, request.external_order_id, &request.cancel_request, request.send_ts, log);
+    }
+}
+
+// =================================================================================
+// Outcome of a new order or cancel isn't known - nothing goes on the bus until the exchange
+// says what happened to the order, recvWindow after the request went out at the earliest
+// =================================================================================
+void BinanceTradeAdapter::queue_status_query(uint8_t request_type, char *external_order_id, struct CancelOrder *cancel_request, uint64_t send_ts, Logger *log) {
+    order_record record;
+    if (! order_table->find_by_external(external_order_id, &record)) {
+        log->msg(ERROR, "Can't query the status of unknown order: " + std::string(external_order_id));
+        return;
+    }
+    order_status_query query;
+    query.request_type = request_type;
+    query.exchange_id = record.order.exchange_id;
+    query.instrument_id = record.order.instrument_id;
+    strcpy(query.external_order_id, record.external_order_id);
+    if (request_type == GATEWAY_CANCEL_ORDER)
+        query.cancel_request = *cancel_request;
+    query.query_ts = send_ts + ORDER_STATUS_QUERY_DELAY_NS;
+    query.num_queries = 0;
+
+    status_query_lock.acquire_lock();
+    status_queries.push_back(query);
+    status_query_lock.release_lock();
+}
+
+// =================================================================================
+// Asks for the status of the orders that are due, the ones the exchange couldn't answer for
+// are asked again a second later. Called once a second from the refresh thread.
+// =================================================================================
+void BinanceTradeAdapter::run_status_queries(CURL *handle, uint64_t current_ts, Logger *log) {
+    std::vector<order_status_query> due;
+
+    status_query_lock.acquire_lock();
+    for (auto it = status_queries.begin(); it != status_queries.end();) {
+        if (it->query_ts <= current_ts) {
+            due.push_back(*it);
+            it = status_queries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    status_query_lock.release_lock();
+
+    for (auto &query : due) {
+        if (query_order_status(handle, query, log))
+            continue;
+        if (++query.num_queries == ORDER_STATUS_MAX_QUERIES) {
+            log->msg(ERROR, "No status for order: " + std::string(query.external_order_id) + " after " + 
+                            std::to_string(ORDER_STATUS_MAX_QUERIES) + " queries, left as it is");
+            continue;
+        }
+        query.query_ts = current_ts + ORDER_STATUS_RETRY_NS;
+        status_query_lock.acquire_lock();
+        status_queries.push_back(query);
+        status_query_lock.release_lock();
+    }
+}
+
+// =================================================================================
+// GET order by origClientOrderId - true once the query is resolved one way or the other
+// =================================================================================
+bool BinanceTradeAdapter::query_order_status(CURL *handle, order_status_query &query, Logger *log) {
+    auto instrument = instrument_info_map.find(query.instrument_id);
+    if (instrument == instrument_info_map.end()) {
+        log->msg(ERROR, "Can't query the status of order: " + std::string(query.external_order_id) + " - unknown instrument_id: " + std::to_string(query.instrument_id));
+        return(true);
+    }
+    // Not an order and it can wait, lowest priority
+    if (! listenkey_map[query.exchange_id]->rate_limits->try_acquire(RATE_CLASS_PING, (query.exchange_id == 16) ? 4 : 1, 0, get_current_ts()))
+        return(false);
+
+    std::stringstream body;
+    std::string body_str;
+    std::string response;
+    body << "symbol=" << instrument->second->instrument_name << "&origClientOrderId=" << query.external_order_id << "&recvWindow=5000&timestamp=" << get_current_ts_millis();
+    body_str = body.str();
+    std::string signature = hmacHex(SECRET_KEY, body_str);
+    std::string tmp_url = listenkey_map[query.exchange_id]->rest_endpoint + "order?" + body_str + "&signature=" + signature;
+
+    struct curl_slist *chunk = NULL;
+    std::string hdrs = "X-MBX-APIKEY: " + API_KEY;
+    chunk = curl_slist_append(chunk, hdrs.c_str());
+    curl_easy_setopt(handle, CURLOPT_URL, tmp_url.c_str());
+    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_func);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, chunk);
+    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "GET");
+    CURLcode rc = curl_easy_perform(handle);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(chunk);
+    if (rc) {
+        log->msg(ERROR, "Order status query for: " + std::string(query.external_order_id) + " failed: " + curl_easy_strerror(rc));
+        return(false);
+    }
+    log->msg(INFO, "Order status response for: " + std::string(query.external_order_id) + " = " + response);
+
+    simdjson::dom::element status_json;
+    auto error = status_parser.parse(response.c_str(), response.length()).get(status_json);
+    if (error) { 
+        std::stringstream error_message; 
+        error_message << error;
+        log->msg(ERROR, "Got an error when parsing: " + error_message.str());
+        return(false); 
+    }
+
+    int64_t code;
+    if (! status_json["code"].get(code)) {
+        // Never got to the exchange - the only case where it is a reject
+        if (code == BINANCE_CODE_NO_SUCH_ORDER) {
+            send_request_reject(query.request_type, 
+                                query.external_order_id, 
+                                &query.cancel_request, 
+                                as_string(status_json["msg"]),
+                                log);
+            return(true);
+        }
+        log->msg(WARN, "Order status query for: " + std::string(query.external_order_id) + " rejected: " + as_string(status_json["msg"]));
+        return(false);
+    }
+    resolve_order_status(query, status_json, log);
+    return(true);
+}
+
+// =================================================================================
+// The order is on the exchange. Whatever the user stream has already said about it is left
+// alone, the rest is filled in from the status - fills always come on the user stream.
+// =================================================================================
+void BinanceTradeAdapter::resolve_order_status(order_status_query &query, simdjson::dom::element &status_json, Logger *log) {
+    std::string_view status;
+    status_json["status"].get(status);
+    bool is_done_unfilled = (status == "CANCELED") || (status == "EXPIRED") || (status == "EXPIRED_IN_MATCH");
+
+    order_record record;
+    bool is_open = order_table->find_by_external(query.external_order_id, &record) && (record.state == ORDER_RECORD_OPEN);
+    log->msg(INFO, "Order status for: " + std::string(query.external_order_id) + " = " + std::string(status) + (is_open ? " (open)" : " (done)"));
+
+    if (query.request_type == GATEWAY_NEW_ORDER) {
+        if (status == "REJECTED") {
+            send_request_reject(query.request_type, query.external_order_id, &query.cancel_request, "Rejected by the exchange", log);
+            return;
+        }
+        uint64_t exchange_order_id;
+        if (is_open && (record.exchange_order_id == 0)) {
+            send_exchange_order_ack(query.external_order_id);
+            if (! status_json["orderId"].get(exchange_order_id))
+                order_table->link_exchange_order_id(query.external_order_id, exchange_order_id);
+        }
+        if (is_open && is_done_unfilled)
+            send_exchange_cancel_ack(query.external_order_id);
+        // Fills came (or are still to come) on the user stream, the order is done either way
+        else if (is_open && (status == "FILLED"))
+            retire_order(query.external_order_id);
+    } else {
+        // Cancelled (or expired) is what was asked for, anything else and it didn't happen
+        if (is_done_unfilled) {
+            if (is_open)
+                send_exchange_cancel_ack(query.external_order_id);
+        } else {
+            send_request_reject(query.request_type, query.external_order_id, &query.cancel_request, "Not cancelled, order is " + std::string(status), log);
+        }
+    }
+}
+
+// =================================================================================
+// Client order ids of the open orders on the exchange - false if they couldn't be had
+// =================================================================================
+bool BinanceTradeAdapter::fetch_open_orders(CURL *handle, uint8_t exchange_id, std::unordered_set<std::string> &open_orders, Logger *log) {
+    if (listenkey_map[exchange_id]->rest_endpoint == "")
+        return(false);
+    // All symbols in one go - 80 weight on spot, 40 on futures
+    if (! listenkey_map[exchange_id]->rate_limits->try_acquire(RATE_CLASS_PING, (exchange_id == 16) ? 80 : 40, 0, get_current_ts()))
+        return(false);
+
+    std::stringstream body;
+    std::string body_str;
+    std::string response;
+    body << "recvWindow=5000&timestamp=" << get_current_ts_millis();
+    body_str = body.str();
+    std::string signature = hmacHex(SECRET_KEY, body_str);
+    std::string tmp_url = listenkey_map[exchange_id]->rest_endpoint + "openOrders?" + body_str + "&signature=" + signature;
+
+    struct curl_slist *chunk = NULL;
+    std::string hdrs = "X-MBX-APIKEY: " + API_KEY;
+    chunk = curl_slist_append(chunk, hdrs.c_str());
+    curl_easy_setopt(handle, CURLOPT_URL, tmp_url.c_str());
+    curl_easy_setopt(handle, CURLOPT_HTTPGET, 1);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_func);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, chunk);
+    curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, "GET");
+    CURLcode rc = curl_easy_perform(handle);
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(chunk);
+    if (rc) {
+        log->msg(ERROR, "openOrders request for exchange_id: " + std::to_string(exchange_id) + " failed: " + curl_easy_strerror(rc));
+        return(false);
+    }
+
+    simdjson::dom::array order_array;
+    auto error = status_parser.parse(response.c_str(), response.length()).get(order_array);
+    if (error) { 
+        log->msg(ERROR, "openOrders response for exchange_id: " + std::to_string(exchange_id) + " is not a list of orders: " + response);
+        return(false); 
+    }
+    for (simdjson::dom::element order_element : order_array) {
+        std::string_view client_order_id;
+        if (! order_element["clientOrderId"].get(client_order_id))
+            open_orders.insert(std::string(client_order_id));
+    }
+    return(true);
+}
+
+// =================================================================================
+// Orders that are open here but not on the exchange - whatever closed them never got to us (an
+// outcome that wasn't known, a report that couldn't be matched) and they would count towards the
+// open order limit for good. The ones missing at two checks in a row, when nothing about them can
+// still be on its way, get their status queried, which retires them. Called once a minute from
+// the refresh thread.
+// =================================================================================
+void BinanceTradeAdapter::reconcile_open_orders(CURL *handle, Logger *log) {
+    std::unordered_set<std::string> exchange_open_orders;
+    std::unordered_map<uint8_t, bool> is_listed;
+    for (auto map_entry : listenkey_map)
+        is_listed[map_entry.first] = fetch_open_orders(handle, map_entry.first, exchange_open_orders, log);
+
+    std::unordered_set<std::string> missing;
+    std::vector<order_record> records(OPEN_ORDERS_SCAN_SLOTS);
+    uint32_t capacity = order_table->get_stats().capacity;
+    for (uint32_t first_slot = 0; first_slot < capacity; first_slot += OPEN_ORDERS_SCAN_SLOTS) {
+        uint32_t num_open = order_table->copy_open(first_slot, OPEN_ORDERS_SCAN_SLOTS, records.data());
+        for (uint32_t i = 0; i < num_open; i++) {
+            order_record *record = &records[i];
+            // Manual and liquidation orders go by the exchange order id and don't count as open
+            if ((record->order.order_type == MANUAL_ORDER) || (record->order.order_type == FORCED_LIQUIDATION))
+                continue;
+            if (! is_listed[record->order.exchange_id] || (exchange_open_orders.count(record->external_order_id) > 0))
+                continue;
+            missing.insert(record->external_order_id);
+            if (missing_open_orders.count(record->external_order_id) > 0) {
+                log->msg(WARN, "Order open here but not on the exchange: " + std::string(record->external_order_id) + ", querying the order status");
+                // Went out well over recvWindow ago, queried right away
+                queue_status_query(GATEWAY_NEW_ORDER, record->external_order_id, nullptr, 0, log);
+            }
+        }
+    }
+    missing_open_orders = std::move(missing);
+}
+
+// =================================================================================
+// Binance answered, but doesn't know itself whether the request was executed
+// =================================================================================
+bool BinanceTradeAdapter::is_unknown_outcome(int64_t code) {
+    return((code == BINANCE_CODE_UNKNOWN_RESPONSE) || (code == BINANCE_CODE_BACKEND_TIMEOUT));
+}
+
+// =================================================================================
+// Sends a new order over the websocket API
+// =================================================================================
+bool BinanceTradeAdapter::send_new_order_ws_api(struct SendOrder *s, char *ext_order_id, uint64_t current_ts) {
+    // Not connected or no room in the rate limits - REST takes it (and holds it until there is),
+    // the budget is only taken once
+    if (! ws_api_sockets->is_connected(s->exchange_id))
+        return(false);
+    int rate_class = risk_engine->reduces_position(s) ? RATE_CLASS_REDUCE_ONLY : RATE_CLASS_NEW_ORDER;
+    if (! listenkey_map[s->exchange_id]->rate_limits->try_acquire(rate_class, current_ts))
+        return(false);
+
+    ws_api_params params;
+    char price[32];
+    char qty[32];
+    char timestamp[24];
+    auto *instrument = instrument_info_map[s->instrument_id];
+
+    memset(price, 0, sizeof(price));
+    memset(qty, 0, sizeof(qty));
+    double_to_ascii(s->price, price, (instrument->price_precision != 0) ? instrument->price_precision : 8);
+    double_to_ascii(s->qty, qty, (instrument->qty_precision != 0) ? instrument->qty_precision : 8);
+    snprintf(timestamp, sizeof(timestamp), "%lu", get_current_ts_millis());
+
+    add_ws_api_param(params, "apiKey", API_KEY.c_str());
+    add_ws_api_param(params, "newClientOrderId", ext_order_id);
+    add_ws_api_param(params, "price", price);
+    add_ws_api_param(params, "quantity", qty);
+    add_ws_api_param(params, "recvWindow", "5000", false);
+    add_ws_api_param(params, "side", s->is_buy ? "BUY" : "SELL");
+    add_ws_api_param(params, "symbol", instrument->instrument_name);
+    add_ws_api_param(params, "timeInForce", "GTC");
+    add_ws_api_param(params, "timestamp", timestamp, false);
+    add_ws_api_param(params, "type", "LIMIT");
+
+    ws_api_request request;
+    request.request_type = GATEWAY_NEW_ORDER;
+    request.exchange_id = s->exchange_id;
+    request.internal_order_id = s->internal_order_id;
+    strcpy(request.external_order_id, ext_order_id);
+    request.receive_ts = current_ts;
+    if (send_ws_api_request(request, "order.place", params))
+        return(true);
+    // Connection went away since the check, REST charges it again
+    listenkey_map[s->exchange_id]->rate_limits->release(rate_class, current_ts);
+    return(false);
+}
+
+// =================================================================================
+// Sends a cancel over the websocket API
+// =================================================================================
+bool BinanceTradeAdapter::send_cancel_ws_api(struct CancelOrder *c, std::string &cancel_external_order_id, uint64_t current_ts) {
+    if (! ws_api_sockets->is_connected(c->exchange_id))
+        return(false);
+    if (! listenkey_map[c->exchange_id]->rate_limits->try_acquire(RATE_CLASS_CANCEL, current_ts))
+        return(false);
+
+    ws_api_params params;
+    char timestamp[24];
+    snprintf(timestamp, sizeof(timestamp), "%lu", get_current_ts_millis());
+
+    add_ws_api_param(params, "apiKey", API_KEY.c_str());
+    add_ws_api_param(params, "origClientOrderId", cancel_external_order_id.c_str());
+    add_ws_api_param(params, "recvWindow", "5000", false);
+    add_ws_api_param(params, "symbol", instr_id_to_instr_name[c->instrument_id].c_str());
+    add_ws_api_param(params, "timestamp", timestamp, false);
+
+    ws_api_request request;
+    request.request_type = GATEWAY_CANCEL_ORDER;
+    request.exchange_id = c->exchange_id;
+    request.internal_order_id = c->internal_order_id;
+    request.cancel_request = *c;
+    strncpy(request.external_order_id, cancel_external_order_id.c_str(), MAX_EXTERNAL_ORDER_ID_LENGTH - 1);
+    request.external_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH - 1] = 0;
+    request.receive_ts = current_ts;
+    if (send_ws_api_request(request, "order.cancel", params))
+        return(true);
+    listenkey_map[c->exchange_id]->rate_limits->release(RATE_CLASS_CANCEL, current_ts);
+    return(false);
+}
+
+// =================================================================================
+// Opens the websocket API connection for the exchange if orders are to go that way
+// (order_transport = WS_API and a ws_api_endpoint in the config)
+// =================================================================================
+void BinanceTradeAdapter::add_ws_api_socket(uint8_t exchange_id, std::string ex_name) {
+    std::string ws_api_endpoint = get_config_value("ws_api_endpoint", ex_name);
+    listenkey_map[exchange_id]->use_ws_api = (get_config_value("order_transport", ex_name) == "WS_API") && (ws_api_endpoint != "");
+    if(! listenkey_map[exchange_id]->use_ws_api)
+        return;
+
+    if(ws_api_sockets == nullptr){
+        ws_api_sockets = new WSock(log_worker->get_new_logger("ws_api_main"), log_worker->get_new_logger("ws_api_subscriptions"), 36000, 50);
+        ws_api_loop_thread(log_worker->get_new_logger("ws_api_messageloop_thread"));
+    }
+    logger->msg(INFO, "Orders for " + ex_name + " go over the websocket API on: " + ws_api_endpoint);
+    ws_api_sockets->add_subscription_request(ws_api_endpoint, nullptr, "ws_api", 0, exchange_id);
+}
+
+// =================================================================================
+// Reads the websocket API responses and matches them to the requests on the id
+// Acks and fills come on the user websocket same as for REST, only rejects are handled here
+// =================================================================================
+void BinanceTradeAdapter::ws_api_loop_thread(Logger *wslogger) {
+    std::thread ws_api_thread([this, wslogger]() {
+        std::string_view ws_message;
+        ws_api_request request;
+
+        while (1) {
+            // This one will wait around epoll_wait
+            ws_message = ws_api_sockets->get_next_message_from_websocket();
+
+            simdjson::dom::element exchange_json_message;
+            auto error = ws_api_parser.parse(ws_message.cbegin(), ws_message.length()).get(exchange_json_message);
+            if (error) { 
+                std::stringstream error_message; 
+                error_message << error;
+                wslogger->msg(ERROR, "Got an error when parsing: " + error_message.str());
+                continue; 
+            }
+
+            uint64_t request_id;
+            if (exchange_json_message["id"].get(request_id)) {
+                wslogger->msg(INFO, "WS API message without request id=" + std::string(ws_message.cbegin(), ws_message.length()));
+                continue;
+            }
+
+            ws_api_lock.acquire_lock();
+            auto found = ws_api_pending.find(request_id);
+            bool is_pending = (found != ws_api_pending.end());
+            if (is_pending) {
+                request = found->second;
+                ws_api_pending.erase(found);
+            }
+            ws_api_lock.release_lock();
+
+            if (! is_pending) {
+                wslogger->msg(WARN, "WS API response for unknown request id: " + std::to_string(request_id));
+                continue;
+            }
+            int64_t status = 0;
+            exchange_json_message["status"].get(status);
+            wslogger->msg(INFO, "WS API response id=" + std::to_string(request_id) + " clientOrderId=" + std::string(request.external_order_id) +
+                                " status=" + std::to_string(status));
+            wslogger->log_ts(AERON_OE_THREAD, request.internal_order_id, request.receive_ts, request.send_ts);
+            process_ws_api_rate_limits(exchange_json_message, request, wslogger);
+
+            int64_t code;
+            if (! exchange_json_message["error"]["code"].get(code) && is_unknown_outcome(code)) {
+                wslogger->msg(WARN, "WS API outcome unknown for: " + std::string(request.external_order_id) + ", querying the order status");
+                queue_status_query(request.request_type, request.external_order_id, &request.cancel_request, request.send_ts, wslogger);
+            }
+            else if (exchange_json_message["error"].error() != simdjson::NO_SUCH_FIELD) {
+                send_request_reject(request.request_type, 
+                                    request.external_order_id, 
+                                    &request.cancel_request, 
+                                    as_string(exchange_json_message["error"]["msg"]),
+                                    wslogger);
+            }
+        }
+    });
+    ws_api_thread.detach();
+}
+
+// =================================================================================
+// Every websocket API response says how much of each budget is used, a 429/418 comes
+// with a retryAfter (epoch millis) in the error data
+// =================================================================================
+void BinanceTradeAdapter::process_ws_api_rate_limits(simdjson::dom::element &exchange_json_message, ws_api_request &request, Logger *wslogger) {
+    RateLimitScheduler *rate_limits = listenkey_map[request.exchange_id]->rate_limits;
+    uint64_t current_ts = get_current_ts();
+
+    simdjson::dom::array rate_limit_array;
+    if (! exchange_json_message["rateLimits"].get(rate_limit_array)) {
+        rate_limit_usage usage[WS_API_MAX_RATE_LIMITS];
+        int num_usage = 0;
+        for (simdjson::dom::element rate_limit : rate_limit_array) {
+            if (num_usage == WS_API_MAX_RATE_LIMITS)
+                break;
+            std::string_view limit_type = rate_limit["rateLimitType"].get_string();
+            std::string_view interval = rate_limit["interval"].get_string();
+            if (interval.empty() || ((limit_type != "REQUEST_WEIGHT") && (limit_type != "ORDERS")))
+                continue;
+            usage[num_usage].limit_type = (limit_type == "ORDERS") ? RATE_LIMIT_ORDERS : RATE_LIMIT_WEIGHT;
+            usage[num_usage].interval_ns = RateLimitScheduler::interval_from_unit(rate_limit["intervalNum"].get_uint64(), interval[0]);
+            usage[num_usage].used = rate_limit["count"].get_uint64();
+            usage[num_usage].limit = rate_limit["limit"].get_uint64();
+            num_usage++;
+        }
+        rate_limits->on_usage(usage, num_usage, request.send_ts, current_ts);
+    }
+
+    int64_t status;
+    if (! exchange_json_message["status"].get(status) && ((status == 429) || (status == 418))) {
+        uint64_t retry_after_millis;
+        uint64_t retry_after_ns = 0;
+        if ((! exchange_json_message["error"]["data"]["retryAfter"].get(retry_after_millis)) && ((retry_after_millis * 1000000UL) > current_ts))
+            retry_after_ns = (retry_after_millis * 1000000UL) - current_ts;
+        wslogger->msg(WARN, "Rate limited (" + std::to_string(status) + ") on the websocket API for exchange_id: " + std::to_string(request.exchange_id) +
+                            ", retry after " + std::to_string(retry_after_ns / 1000000000UL) + "s");
+        rate_limits->on_rate_limited(status == 418, retry_after_ns, current_ts);
+    }
+}
+
+// =================================================================================
+// Budgets per exchange - the documented Binance limits unless the config says otherwise.
+// Both get corrected from what the exchange reports on every response.
+// =================================================================================
+void BinanceTradeAdapter::add_rate_limits(uint8_t exchange_id, std::string ex_name) {
+    std::function<void(RateLimitStatus *)> status_callback = 
+                std::bind(&BinanceTradeAdapter::publish_rate_limit_status, this, std::placeholders::_1);
+    RateLimitScheduler *rate_limits = new RateLimitScheduler(exchange_id, status_callback);
+
+    uint32_t weight_1m = (exchange_id == 16) ? 6000 : 2400;
+    uint32_t orders_10s = (exchange_id == 16) ? 100 : 300;
+    uint32_t orders_1m = (exchange_id == 16) ? 0 : 1200;
+    uint32_t orders_1d = (exchange_id == 16) ? 200000 : 0;
+    std::string value;
+    if ((value = get_config_value("rate_limit_weight_1m", ex_name)) != "")
+        weight_1m = std::stoul(value);
+    if ((value = get_config_value("rate_limit_orders_10s", ex_name)) != "")
+        orders_10s = std::stoul(value);
+    if ((value = get_config_value("rate_limit_orders_1m", ex_name)) != "")
+        orders_1m = std::stoul(value);
+    if ((value = get_config_value("rate_limit_orders_1d", ex_name)) != "")
+        orders_1d = std::stoul(value);
+
+    rate_limits->add_limit(RATE_LIMIT_WEIGHT, RateLimitScheduler::interval_from_unit(1, 'm'), weight_1m);
+    if (orders_10s > 0)
+        rate_limits->add_limit(RATE_LIMIT_ORDERS, RateLimitScheduler::interval_from_unit(10, 's'), orders_10s);
+    if (orders_1m > 0)
+        rate_limits->add_limit(RATE_LIMIT_ORDERS, RateLimitScheduler::interval_from_unit(1, 'm'), orders_1m);
+    if (orders_1d > 0)
+        rate_limits->add_limit(RATE_LIMIT_ORDERS, RateLimitScheduler::interval_from_unit(1, 'd'), orders_1d);
+
+    listenkey_map[exchange_id]->rate_limits = rate_limits;
+    order_gateway->set_rate_limits(listenkey_map[exchange_id]->gateway_endpoint, rate_limits);
+    logger->msg(INFO, "Rate limits for " + ex_name + " - weight/1m: " + std::to_string(weight_1m) + ", orders/10s: " + std::to_string(orders_10s) +
+                        ", orders/1m: " + std::to_string(orders_1m) + ", orders/1d: " + std::to_string(orders_1d));
+}
+
+// =================================================================================
+// Level changes go on the bus so strategies can slow down before orders get held back
+// =================================================================================
+void BinanceTradeAdapter::publish_rate_limit_status(RateLimitStatus *status) {
+    logger->msg((status->level == RATE_LIMIT_LEVEL_NORMAL) ? INFO : WARN, 
+                "Rate limit level " + std::to_string(status->level) + " for exchange_id: " + std::to_string(status->exchange_id) +
+                " - used " + std::to_string(status->used) + " of " + std::to_string(status->limit) + ", held " + std::to_string(status->num_held));
+    send_any_io_message((char *) status, sizeof(RateLimitStatus));
+}
+
+// =================================================================================
+// Held back by the rate limits for too long - rejected rather than sent stale
+// =================================================================================
+void BinanceTradeAdapter::expire_held_order(gateway_request *request) {
+    gateway_logger->msg(WARN, "Order held back by the rate limits for too long, rejecting: " + std::string(request->external_order_id));
+    send_exchange_order_reject(request->external_order_id, "RATE LIMITED - ORDER NOT SENT", RISK_REJECT);
+}
+
+// =================================================================================
+// Exchange reject of a new order or cancel - same whichever transport it went over
+// =================================================================================
+void BinanceTradeAdapter::send_request_reject(uint8_t request_type, char *external_order_id, struct CancelOrder *cancel_request, std::string reject_message, Logger *log) {
+    if (request_type == GATEWAY_NEW_ORDER) {
+        send_exchange_order_reject( external_order_id, 
+                                    reject_message, 
+                                    EXCHANGE_REJECT);
+        log->msg(INFO, "Got Exchange New Order Reject for: " + std::string(external_order_id)); 
+    } else {
+        send_exchange_cancel_reject(cancel_request,
+                                    external_order_id, 
+                                    reject_message,
+                                    EXCHANGE_CANCEL_REJECT_REASON);
+        log->msg(INFO, "Got Exchange Cancel Reject for: " + std::string(external_order_id));
+    }
+}
+
+// =================================================================================
+// Called on the gateway thread for every finished new order/cancel request
+// Acks and fills come on the user websocket, only rejects are picked up from the response.
+// No usable response and it is left to the status query to say what happened.
+// =================================================================================
+void BinanceTradeAdapter::process_gateway_response(gateway_context *context) {
+    if (context->batch_size > 0) {
+        process_gateway_batch_response(context);
+        return;
+    }
+
+    gateway_request *request = &context->request;
+    bool is_new_order = (request->request_type == GATEWAY_NEW_ORDER);
+
+    gateway_logger->msg(INFO, "URL: " + std::string(request->url));
+    gateway_logger->msg(INFO, (is_new_order ? "NewOrder response=" : "Cancel response=") + std::string(context->response, context->length));
+    gateway_logger->log_ts(AERON_OE_THREAD, request->internal_order_id, request->receive_ts, context->send_ts);
+
+    if (context->result) {
+        std::string error_message = curl_easy_strerror(context->result);
+        gateway_logger->msg(ERROR, (is_new_order ? "Error in NewOrder: " : "Error in Cancel: ") + error_message);
+        queue_status_query(request->request_type, request->external_order_id, &request->cancel_request, context->send_ts, gateway_logger);
+        return;
+    }
+
+    simdjson::dom::element exchange_json_message;
+    auto error = gateway_parser.parse(context->response, context->length).get(exchange_json_message);
+    if (error) { 
+        std::stringstream error_message; 
+        error_message << error;
+        gateway_logger->msg(ERROR, "Got an error when parsing: " + error_message.str());
+        queue_status_query(request->request_type, request->external_order_id, &request->cancel_request, context->send_ts, gateway_logger);
+        return; 
+    }
+
+    int64_t code;
+    if (! exchange_json_message["code"].get(code) && is_unknown_outcome(code)) {
+        queue_status_query(request->request_type, request->external_order_id, &request->cancel_request, context->send_ts, gateway_logger);
+    }
+    else if( (exchange_json_message["code"].error() != simdjson::NO_SUCH_FIELD) && 
+             (exchange_json_message["msg"].error() != simdjson::NO_SUCH_FIELD)) {
+        // Any message back from binance with "code" tag is a exchange reject
+        send_request_reject(request->request_type, 
+                            request->external_order_id, 
+                            &request->cancel_request, 
+                            as_string(exchange_json_message["msg"]),
+                            gateway_logger);
+    }
+}
+
+// =================================================================================
+// Same for a batch - the response is an array with a result per request in the order they went out,
+// the order or a {"code":..,"msg":..} for each one that was rejected. A reject of the whole batch
+// (bad signature, rate limited..) comes back as a single object and goes to all of them.
+// Without a result for a request its status is queried, same as for a single one.
+// =================================================================================
+void BinanceTradeAdapter::process_gateway_batch_response(gateway_context *context) {
+    bool is_new_order = (context->request.request_type == GATEWAY_NEW_ORDER);
+
+    gateway_logger->msg(INFO, "Batch body: " + std::string(context->body));
+    gateway_logger->msg(INFO, (is_new_order ? "BatchOrders response=" : "BatchCancel response=") + std::string(context->response, context->length));
+    for (int i = 0; i < context->batch_size; i++)
+        gateway_logger->log_ts(AERON_OE_THREAD, context->batch[i].internal_order_id, context->batch[i].receive_ts, context->send_ts);
+
+    int num_results = 0;
+    if (context->result) {
+        std::string error_message = curl_easy_strerror(context->result);
+        gateway_logger->msg(ERROR, (is_new_order ? "Error in BatchOrders of " : "Error in BatchCancel of ") + std::to_string(context->batch_size) + ": " + error_message);
+        query_batch_status(context, num_results);
+        return;
+    }
+
+    simdjson::dom::element exchange_json_message;
+    auto error = gateway_parser.parse(context->response, context->length).get(exchange_json_message);
+    if (error) { 
+        std::stringstream error_message; 
+        error_message << error;
+        gateway_logger->msg(ERROR, "Got an error when parsing: " + error_message.str());
+        query_batch_status(context, num_results);
+        return; 
+    }
+
+    int64_t code;
+    if (exchange_json_message.is_array()) {
+        for (simdjson::dom::element result : exchange_json_message) {
+            if (num_results == context->batch_size)
+                break;
+            gateway_request *request = &context->batch[num_results++];
+            if (! result["code"].get(code) && is_unknown_outcome(code)) {
+                queue_status_query(request->request_type, request->external_order_id, &request->cancel_request, context->send_ts, gateway_logger);
+            }
+            else if( (result["code"].error() != simdjson::NO_SUCH_FIELD) && 
+                     (result["msg"].error() != simdjson::NO_SUCH_FIELD)) {
+                send_request_reject(request->request_type, 
+                                    request->external_order_id, 
+                                    &request->cancel_request, 
+                                    as_string(result["msg"]),
+                                    gateway_logger);
+            }
+        }
+        if (num_results != context->batch_size) {
+            gateway_logger->msg(WARN, "Batch response has " + std::to_string(num_results) + " results for " + std::to_string(context->batch_size) + " requests");
+            query_batch_status(context, num_results);
+        }
+    }
+    else if (! exchange_json_message["code"].get(code) && is_unknown_outcome(code)) {
+        query_batch_status(context, num_results);
+    }
+    else if( (exchange_json_message["code"].error() != simdjson::NO_SUCH_FIELD) && 
+             (exchange_json_message["msg"].error() != simdjson::NO_SUCH_FIELD)) {
+        std::string reject_message = as_string(exchange_json_message["msg"]);
+        for (int i = 0; i < context->batch_size; i++) {
+            gateway_request *request = &context->batch[i];
+            send_request_reject(request->request_type, 
+                                request->external_order_id, 
+                                &request->cancel_request, 
+                                reject_message,
+                                gateway_logger);
+        }
+    }
+}
+
+// =================================================================================
+// Batch went out but there is nothing to say what happened to the requests from first on
+// =================================================================================
+void BinanceTradeAdapter::query_batch_status(gateway_context *context, int first) {
+    for (int i = first; i < context->batch_size; i++) {
+        gateway_request *request = &context->batch[i];
+        queue_status_query(request->request_type, request->external_order_id, &request->cancel_request, context->send_ts, gateway_logger);
+    }
+}
+
+// =================================================================================
+// Signed body of a batch, called on the gateway thread when it goes out. New orders
+// carry their batchOrders element, cancels the symbol they are for.
+// =================================================================================
+int BinanceTradeAdapter::build_batch_request(gateway_request *requests, int num_requests, char *body) {
+    const char *items[GATEWAY_MAX_BATCH_CANCELS];
+    uint16_t item_lengths[GATEWAY_MAX_BATCH_CANCELS];
+    if (requests[0].request_type == GATEWAY_CANCEL_ORDER) {
+        for (int i = 0; i < num_requests; i++)
+            items[i] = requests[i].external_order_id;
+        return(batch_builder->build_batch_cancel(requests[0].batch_item, items, num_requests, get_current_ts_millis(), body));
+    }
+    for (int i = 0; i < num_requests; i++) {
+        items[i] = requests[i].batch_item;
+        item_lengths[i] = requests[i].batch_item_length;
+    }
+    return(batch_builder->build_batch_orders(items, item_lengths, num_requests, get_current_ts_millis(), body));
+}
+
+// =================================================================================
+// Futures orders and cancels queued in the gateway together go out as batches when the config
+// has batch_orders set - batch_window_us holds the first one back for more to come in.
+// Only the futures API (fapi) has batchOrders, anywhere else the setting is refused.
+// =================================================================================
+void BinanceTradeAdapter::add_batching(uint8_t exchange_id, std::string ex_name) {
+    listenkey_map[exchange_id]->batch_orders = false;
+    if (get_config_value("batch_orders", ex_name) != "true")
+        return;
+    if (exchange_id != 18) {
+        logger->msg(WARN, "batch_orders is only supported on Binance Futures (fapi) - not batching orders for " + ex_name);
+        return;
+    }
+    listenkey_map[exchange_id]->batch_orders = true;
+
+    uint64_t window_us = 0;
+    std::string value;
+    if ((value = get_config_value("batch_window_us", ex_name)) != "")
+        window_us = std::stoul(value);
+
+    if (batch_builder == nullptr)
+        batch_builder = new OrderRequestBuilder(SECRET_KEY);
+    std::function<int(gateway_request *, int, char *)> batch_callback = 
+                std::bind(&BinanceTradeAdapter::build_batch_request, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+    order_gateway->set_batching(listenkey_map[exchange_id]->gateway_endpoint, "batchOrders", window_us * 1000, batch_callback);
+    logger->msg(INFO, "Orders for " + ex_name + " go out in batches of up to " + std::to_string(GATEWAY_MAX_BATCH_ORDERS) + 
+                        " (cancels " + std::to_string(GATEWAY_MAX_BATCH_CANCELS) + "), batch window: " + std::to_string(window_us) + "us");
+}
+
 // =================================================================================
 // This handles all new orders/cancels from the message bus
 // =================================================================================
@@ -516,120 +1350,44 @@ fragment_handler_t BinanceTradeAdapter::aeron_msg_handler() {
                     std::string reject_message;
                     uint8_t reject_reason;
                     char ext_order_id[MAX_EXTERNAL_ORDER_ID_LENGTH];
-                    std::string rest_endpoint = listenkey_map[s->exchange_id]->rest_endpoint;
 
                     // Initialise new external orderid
                     strncpy((char *)ext_order_id, oe_unique_order_id.c_str(), unique_part_for_order_id);
                     snprintf((char *) ext_order_id + unique_part_for_order_id, 9, "%d", external_order_id);
-                    std::string order_id = ext_order_id;
 
-                    if (order_pass_riskcheck(s, reject_message, reject_reason)) 
+                    // Traced orders keep their trace in the order table for the ack and fills
+                    TraceContext order_trace;
+                    TraceContext *trace = get_trace_context(m, sizeof(SendOrder));
+                    if (trace != nullptr) {
+                        order_trace = *trace;
+                        trace_stamp(&order_trace, TRACE_POINT_ADAPTER_RECEIVE, current_ts);
+                        trace = &order_trace;
+                    }
+
+                    // Persisting the order details - a full order table (every slot open) rejects like a riskcheck
+                    bool order_ok = order_pass_riskcheck(s, reject_message, reject_reason);
+                    if (order_ok && ! order_table->insert(s, ext_order_id, 0, trace)) {
+                        reject_message = "ORDER TABLE FULL";
+                        reject_reason = RISK_REJECT;
+                        order_ok = false;
+                    }
+
+                    if (order_ok) 
                     {
                         // SUCCESFUL RISKCHECKS
-
-                        // Persisting the order details
-                        external_order_id_to_internal_order_id[order_id] = s->internal_order_id;
-                        internal_order_id_to_external_order_id[s->internal_order_id] = order_id;
                         external_order_id++;                        
-                        auto new_order = new struct SendOrder();
-                        *new_order = *s;
-                        internal_order_id_to_order[s->internal_order_id] = new_order;
-                        external_order_id_to_order[order_id] = new_order;
 
                         // send aeron internal ack that riskcecks went well - needed the external order id above
-                        send_internal_order_ack(ext_order_id, s);
-
-                        char order_uri[512];
-                        memset(order_uri, 0, 512); // this makes it safe that it always have a termination
-                        char *uri_ptr = order_uri;
-                        char *body_ptr;
-                        memcpy(order_uri, rest_endpoint.c_str(), rest_endpoint.length());
-                        uri_ptr += rest_endpoint.length();
-                        memcpy(uri_ptr, "order?", 6);
-                        uri_ptr += 6;
-                        body_ptr = uri_ptr; // this is used for signature creation
-
-                        auto *instrument = instrument_info_map[s->instrument_id];
-
-                        memcpy(uri_ptr, "symbol=", 7);
-                        uri_ptr += 7;
-
-                        memcpy(uri_ptr, instrument->instrument_name, strlen(instrument->instrument_name));
-                        uri_ptr += strlen(instrument->instrument_name);
-                       
-                        if (s->is_buy) {
-                            memcpy(uri_ptr, "&side=BUY&type=LIMIT&timeInForce=GTC&quantity=", 46);
-                            uri_ptr+=46;
-                        } else {
-                            memcpy(uri_ptr, "&side=SELL&type=LIMIT&timeInForce=GTC&quantity=", 47);
-                            uri_ptr+=47;
-                        }
-
-                        if (instrument->qty_precision != 0) { 
-                            uri_ptr += double_to_ascii(s->qty, uri_ptr, instrument->qty_precision);
-                        } else {
-                            uri_ptr += double_to_ascii(s->qty, uri_ptr, 8);
-                        }
-
-                        memcpy(uri_ptr, "&price=", 7);
-                        uri_ptr+=7;
-
-                        if (instrument->price_precision != 0) {
-                            uri_ptr += double_to_ascii(s->price, uri_ptr, instrument->price_precision);
-                        } else {
-                            uri_ptr += double_to_ascii(s->price, uri_ptr, 8);
-                        }
-
-                        memcpy(uri_ptr, "&newClientOrderId=", 18);
-                        uri_ptr+=18;
-
-                        memcpy(uri_ptr, ext_order_id, strlen(ext_order_id));
-                        uri_ptr += strlen(ext_order_id);
-
-                        memcpy(uri_ptr, "&recvWindow=5000&timestamp=", 27);
-                        uri_ptr+=27;
-                        
-                        memcpy(uri_ptr, std::to_string(get_current_ts_millis()).c_str(), 13); // copies 13 characters of millis in
-                        uri_ptr += 13;
-
-                        uri_ptr += hmacHex(SECRET_KEY, body_ptr, uri_ptr);
-
-                        curl_easy_setopt(new_order_curl, CURLOPT_URL, order_uri);
-                        
-                        // Get timestamp as close to sending the order as possible
-                        clock_gettime(CLOCK_REALTIME, &t);
-                        send_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
-                        CURLcode rc = curl_easy_perform(new_order_curl);
-
-                        logger->msg(INFO, "URL: " + std::string(order_uri, strlen(order_uri)));
-                        logger->msg(INFO, "NewOrder response=" + new_order_response);
-                        // Now check the response
-                        if (rc) {
-                            std::string error_message = curl_easy_strerror(rc);
-                            logger->msg(ERROR, "Error in NewOrder: " + error_message);
-                            return;
-                        }
-                        logger->log_ts(AERON_OE_THREAD, s->internal_order_id, current_ts, send_ts);
-
-                        simdjson::dom::element exchange_json_message;
-                        auto error = parser.parse(new_order_response.c_str(), new_order_response.length()).get(exchange_json_message);
-                        new_order_response.clear();
-                        if (error) { 
-                            std::stringstream error_message; 
-                            error_message << error;
-                            logger->msg(ERROR, "Got an error when parsing: " + error_message.str());
-                            break; 
-                        }
-                        if( (exchange_json_message["code"].error() != simdjson::NO_SUCH_FIELD) && 
-                            (exchange_json_message["msg"].error() != simdjson::NO_SUCH_FIELD)) {
-                            // Any message back from binance with "code" tag is a exchange reject
-                            send_exchange_order_reject(   ext_order_id, 
-                                                    as_string(exchange_json_message["msg"]), 
-                                                    EXCHANGE_REJECT);
-                            
-                            logger->msg(INFO, "Got Exchange New Order Reject for: " + order_id); 
-                        } 
-                    }
+                        send_internal_order_ack(ext_order_id, s, trace);
+                        risk_engine->on_order_accepted(s, current_ts);
+
+                        // Stamped before the send - the exchange ack can come in on another thread before the send returns
+                        if (trace != nullptr)
+                            order_table->stamp_trace(s->internal_order_id, TRACE_POINT_ADAPTER_SEND, get_current_ts());
+                        // Websocket API where it is selected for the exchange, REST if that isn't connected
+                        if (! (listenkey_map[s->exchange_id]->use_ws_api && send_new_order_ws_api(s, ext_order_id, current_ts)))
+                            send_new_order_rest(s, ext_order_id, current_ts);
+                    } 
                     else 
                     {
                         // FAILED RISKCHECKS
@@ -643,80 +1401,16 @@ fragment_handler_t BinanceTradeAdapter::aeron_msg_handler() {
                     if((c->exchange_id < 16) || (c->exchange_id > 18) || (c->cancel_type == WEB_CANCEL)){
                         break;
                     }
-                    if(internal_order_id_to_external_order_id.count(c->internal_order_id)){
-                        std::string post_data;
-                        std::string body;
-                        std::string cancel_external_order_id = internal_order_id_to_external_order_id[c->internal_order_id];
-                        std::string rest_endpoint = listenkey_map[c->exchange_id]->rest_endpoint;
-                        char url_char_array[512];
-                        char *url_end_ptr = url_char_array + 7; // Length of "symbol="
-                        memset(url_char_array, 0, 512);
+                    order_record record;
+                    if(order_table->find_by_internal(c->internal_order_id, &record)){
+                        std::string cancel_external_order_id = record.external_order_id;
 
                         // Internal Cancel ack
                         send_internal_cancel_ack(c, (char *)cancel_external_order_id.c_str());
 
-                        std::string symbol_name = instr_id_to_instr_name[c->instrument_id];
-                        memcpy(url_char_array, "symbol=", 7);
-                        memcpy(url_end_ptr, symbol_name.c_str(), symbol_name.length());
-                        url_end_ptr += symbol_name.length();
-
-                        if (c->exchange_id == 16) {
-                            memcpy(url_end_ptr, "&origClientOrderId=", 19);
-                            url_end_ptr += 19;
-                        } else {
-                            memcpy(url_end_ptr, "&type=DELETE&origClientOrderId=", 31);
-                            url_end_ptr += 31;
-                        }
-                        memcpy(url_end_ptr, cancel_external_order_id.c_str(), cancel_external_order_id.length());
-                        url_end_ptr += cancel_external_order_id.length();
-
-                        memcpy(url_end_ptr, "&recvWindow=5000&timestamp=", 27);
-                        url_end_ptr+=27;
-
-                        body = url_char_array + std::to_string(get_current_ts_millis());
-
-                        std::string signature = hmacHex(SECRET_KEY, body);
-                        post_data = "?" + body + "&signature=" + signature;
-                        std::string tmp_url = rest_endpoint + "order" + post_data;
-                        curl_easy_setopt(cancel_curl, CURLOPT_URL, tmp_url.c_str());
-
-                        // cancel timestamp first as close as possible to source
-                        clock_gettime(CLOCK_REALTIME, &t);
-                        send_ts = (t.tv_sec*1000000000L) + t.tv_nsec;
-                        CURLcode rc = curl_easy_perform(cancel_curl);
-
-                        // First log all that has happened (delayed until after curl call)
-                        logger->msg(INFO, "URL: " + tmp_url);
-                        logger->msg(INFO, "Cancel response=" + cancel_response);
-                        logger->log_ts(AERON_OE_THREAD, c->internal_order_id, current_ts, send_ts);
-
-                        // Now check response code
-                        if (rc) {
-                            std::string error_message = curl_easy_strerror(rc);
-                            logger->msg(ERROR, "Error in Cancel: " + error_message);
-                            return;
-                        }
-
-                        simdjson::dom::element exchange_json_message;
-                        auto error = parser.parse(cancel_response.c_str(), cancel_response.length()).get(exchange_json_message);
-                        cancel_response.clear();
-                        if (error) { 
-                            std::stringstream error_message; 
-                            error_message << error;
-                            logger->msg(ERROR, "Got an error when parsing: " + error_message.str());
-                            break; 
-                        }
-
-                        if( (exchange_json_message["code"].error() != simdjson::NO_SUCH_FIELD) && 
-                            (exchange_json_message["msg"].error() != simdjson::NO_SUCH_FIELD)) {
-
-                            send_exchange_cancel_reject(    c,
-                                                            (char *)cancel_external_order_id.c_str(), 
-                                                            as_string(exchange_json_message["msg"]),
-                                                            EXCHANGE_CANCEL_REJECT_REASON);
-
-                            logger->msg(INFO, "Got Exchange Cancel Reject for: " + cancel_external_order_id);
-                        }
+                        // Websocket API where it is selected for the exchange, REST if that isn't connected
+                        if (! (listenkey_map[c->exchange_id]->use_ws_api && send_cancel_ws_api(c, cancel_external_order_id, current_ts)))
+                            send_cancel_rest(c, cancel_external_order_id, current_ts);
                     } 
                     else 
                     {
@@ -726,6 +1420,11 @@ fragment_handler_t BinanceTradeAdapter::aeron_msg_handler() {
                 }
                 break;
 
+                // Touch for the price band check
+                case TOB_UPDATE:
+                    risk_engine->on_tob((ToBUpdate*) msg_ptr, current_ts);
+                    break;
+
                 case HEARTBEAT_REQUEST: {
                         got_hb.store(true, std::memory_order_release);
                         struct HeartbeatResponse h = HeartbeatResponse{   MessageHeaderT{sizeof(HeartbeatResponse), HEARTBEAT_RESPONSE, 0}, 
@@ -740,6 +1439,9 @@ fragment_handler_t BinanceTradeAdapter::aeron_msg_handler() {
                         struct InstrumentInfoResponse *instrument = (InstrumentInfoResponse*) msg_ptr;
                         if((instrument->exchange_id >= 16) && (instrument->exchange_id <= 18)){
                             update_instrument_info(instrument);
+                            execution_decoder->add_symbol(instrument->exchange_id, instrument->instrument_name, instrument->instrument_id);
+                            execution_decoder->add_asset(instrument->base_asset_code, instrument->base_asset_id);
+                            execution_decoder->add_asset(instrument->quote_asset_code, instrument->quote_asset_id);
                         }
                     }
                     break;
@@ -1569,6 +2271,7 @@ void BinanceTradeAdapter::load_all_open_orders(Logger *logger, uint8_t exchange_
     struct curl_slist *chunk = NULL;
     std::string hdrs = "X-MBX-APIKEY: " + API_KEY;
     curl = curl_easy_init();
+    set_tls_ca_file(curl);
     chunk = curl_slist_append(chunk, hdrs.c_str());
     curl_easy_setopt(curl, CURLOPT_URL, tmp_url.c_str());
     curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
@@ -1616,6 +2319,7 @@ BinanceTradeAdapter::BinanceTradeAdapter(   std::string location,
     // This pulls the key values into the ConfigDB object from the config database
     // Can later be fetched by get_config_value("keyname");
     load_config("svc_oe_binance");
+    load_risk_limits();
 
     // Initialise the user_websocket threads with appropriate loggers
     user_websockets = new WSock(log_worker->get_new_logger("user_websockets_main"), log_worker->get_new_logger("user_websockets_subscriptions"), 36000, 50);
@@ -1624,27 +2328,26 @@ BinanceTradeAdapter::BinanceTradeAdapter(   std::string location,
 
     API_KEY = get_config_value("API_KEY", "ALL");
     SECRET_KEY = get_config_value("SECRET_KEY", "ALL");
+    tls_ca_file = get_config_value("tls_ca_file", "ALL");
+    if(tls_ca_file != "")
+        logger->msg(INFO, "Trusting the certificates in: " + tls_ca_file);
     
     std::string hdrs = "X-MBX-APIKEY: " + API_KEY;
+    order_builder = new OrderRequestBuilder(SECRET_KEY);
+    execution_decoder = new ExecutionReportDecoder();
 
     curl = curl_easy_init();
-
-    new_order_curl = curl_easy_init();
-    curl_easy_setopt(new_order_curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(new_order_curl, CURLOPT_WRITEFUNCTION, curl_write_func);
-    new_order_chunk = curl_slist_append(new_order_chunk, hdrs.c_str());
-    curl_easy_setopt(new_order_curl, CURLOPT_WRITEDATA, &new_order_response);
-    curl_easy_setopt(new_order_curl, CURLOPT_HTTPHEADER, new_order_chunk);
-    curl_easy_setopt(new_order_curl, CURLOPT_POSTFIELDS, "");
-    curl_easy_setopt(new_order_curl, CURLOPT_CUSTOMREQUEST, "POST");
-
-    cancel_curl = curl_easy_init();
-    curl_easy_setopt(cancel_curl, CURLOPT_WRITEFUNCTION, curl_write_func);
-    cancel_chunk = curl_slist_append(cancel_chunk, hdrs.c_str());
-    curl_easy_setopt(cancel_curl, CURLOPT_WRITEDATA, &cancel_response);
-    curl_easy_setopt(cancel_curl, CURLOPT_HTTPHEADER, cancel_chunk);
-    curl_easy_setopt(cancel_curl, CURLOPT_POSTFIELDS, "");
-    curl_easy_setopt(cancel_curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+    set_tls_ca_file(curl);
+
+    gateway_logger = log_worker->get_new_logger("order_gateway");
+    std::function<void(gateway_context *)> gateway_callback = 
+                std::bind(&BinanceTradeAdapter::process_gateway_response, this, std::placeholders::_1);
+    order_gateway = new OrderGateway(gateway_logger, hdrs, gateway_callback);
+    std::function<void(gateway_request *)> expiry_callback = 
+                std::bind(&BinanceTradeAdapter::expire_held_order, this, std::placeholders::_1);
+    order_gateway->set_expiry_callback(expiry_callback);
+    if(tls_ca_file != "")
+        order_gateway->set_ca_file(tls_ca_file);
 
     fragment_handler = std::bind(&BinanceTradeAdapter::aeron_msg_handler, this);
     from_aeron_io = new from_aeron(AERON_IO, fragment_handler);    
@@ -1659,7 +2362,11 @@ BinanceTradeAdapter::BinanceTradeAdapter(   std::string location,
     listenkey_map[16]->rest_endpoint_margin = get_config_value("rest_endpoint_margin", "Binance");
     listenkey_map[16]->rest_endpoint_margin_v2 = get_config_value("rest_endpoint_margin_v2", "Binance");
     listenkey_map[16]->exchange_name = "Binance";
+    listenkey_map[16]->gateway_endpoint = order_gateway->add_endpoint(listenkey_map[16]->rest_endpoint);
     add_user_websocket(logger, 16, "Binance");
+    add_ws_api_socket(16, "Binance");
+    add_rate_limits(16, "Binance");
+    add_batching(16, "Binance");
     load_all_open_orders(log_worker->get_new_logger("open_order_loader"), 16);
 
 
@@ -1668,7 +2375,11 @@ BinanceTradeAdapter::BinanceTradeAdapter(   std::string location,
     listenkey_map[18]->rest_endpoint = get_config_value("rest_endpoint", "Binance Futures");
     listenkey_map[18]->ws_endpoint = get_config_value("ws_endpoint", "Binance Futures");
     listenkey_map[18]->exchange_name = "Binance Futures";
+    listenkey_map[18]->gateway_endpoint = order_gateway->add_endpoint(listenkey_map[18]->rest_endpoint);
     add_user_websocket(logger, 18, "Binance Futures");
+    add_ws_api_socket(18, "Binance Futures");
+    add_rate_limits(18, "Binance Futures");
+    add_batching(18, "Binance Futures");
     load_all_open_orders(log_worker->get_new_logger("open_order_loader"), 18);
 
     
@@ -1677,10 +2388,17 @@ BinanceTradeAdapter::BinanceTradeAdapter(   std::string location,
     listenkey_map[17]->rest_endpoint = get_config_value("rest_endpoint", "BinanceDEX");
     listenkey_map[17]->ws_endpoint = get_config_value("ws_endpoint", "BinanceDEX");
     listenkey_map[17]->exchange_name = "BinanceDEX";
+    listenkey_map[17]->gateway_endpoint = order_gateway->add_endpoint(listenkey_map[17]->rest_endpoint);
     add_user_websocket(logger, 17, "BinanceDEX");
+    add_ws_api_socket(17, "BinanceDEX");
+    add_rate_limits(17, "BinanceDEX");
+    add_batching(17, "BinanceDEX");
     load_all_open_orders(log_worker->get_new_logger("open_order_loader"), 17);
 
 
+    // Opens the order entry connections and starts taking requests
+    order_gateway->start();
+
     // Loop around the websockets
     user_websocket_loop_thread(log_worker->get_new_logger("websocket_messageloop_thread"));
 
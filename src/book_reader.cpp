@@ -0,0 +1,181 @@
+#include <getopt.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <dirent.h>
+#include <signal.h>
+#include "book_shm.hpp"
+
+void print_options(){
+    std::cout << "Options for book_reader:" << std::endl;
+    std::cout << "  [-n (--name) <SHM_NAME>]                                = Region to read, e.g. /got_books_svc_md_binance (default all)" << std::endl;
+    std::cout << "  [-i (--instrument) <instrument-id>]                     = Print the book of this instrument ID (default a summary of all)" << std::endl;
+    std::cout << "  [-d (--depth) <LEVELS>]                                 = Levels to print per side (default all in the region)" << std::endl;
+    std::cout << "  [-w (--watch) <MILLIS>]                                 = Keep printing the book whenever it changed, polling this often" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+// -----------------------------------------------------------------------
+// Finds all book regions in /dev/shm
+// -----------------------------------------------------------------------
+std::vector<std::string> find_regions() {
+    std::vector<std::string> regions;
+    std::string prefix = std::string(BOOK_SHM_PREFIX).substr(1);
+    DIR *shm_dir = opendir("/dev/shm");
+    if(shm_dir == NULL)
+        return(regions);
+    struct dirent *entry;
+    while((entry = readdir(shm_dir)) != NULL){
+        if(std::string(entry->d_name).rfind(prefix, 0) == 0)
+            regions.push_back("/" + std::string(entry->d_name));
+    }
+    closedir(shm_dir);
+    return(regions);
+}
+
+void print_header(std::string shm_name, BookShmReader *reader) {
+    book_shm_header *header = reader->get_header();
+    std::cout << shm_name << " (" << header->process_name << ", pid " << header->writer_pid;
+    if(kill(header->writer_pid, 0) != 0)
+        std::cout << " - no longer running";
+    std::cout << ", " << header->num_slots_used.load() << "/" << header->max_instruments << " books, depth " << header->depth << ")" << std::endl;
+}
+
+// -----------------------------------------------------------------------
+// One line per book - touch, levels and how stale it is
+// -----------------------------------------------------------------------
+void print_summary(BookShmReader *reader) {
+    book_shm_view view;
+    std::cout << std::setw(12) << "instrument" << std::setw(6) << "exch" << std::setw(7) << "valid";
+    std::cout << std::setw(18) << "bid" << std::setw(18) << "ask" << std::setw(7) << "bids" << std::setw(7) << "asks";
+    std::cout << std::setw(14) << "updates" << std::setw(12) << "age_ms" << std::endl;
+    std::vector<uint32_t> instrument_ids = reader->get_instrument_ids();
+    std::sort(instrument_ids.begin(), instrument_ids.end());
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    uint64_t now = (t.tv_sec*1000000000L)+t.tv_nsec;
+    for(auto instrument_id: instrument_ids){
+        if(! reader->read_book(instrument_id, &view))
+            continue;
+        std::cout << std::setw(12) << view.instrument_id << std::setw(6) << (int) view.exchange_id << std::setw(7) << (int) view.valid;
+        std::cout << std::setprecision(10) << std::setw(18) << ((view.num_bids > 0) ? view.bids[0].price : 0.0);
+        std::cout << std::setw(18) << ((view.num_asks > 0) ? view.asks[0].price : 0.0);
+        std::cout << std::setw(7) << view.num_bids << std::setw(7) << view.num_asks << std::setw(14) << view.update_count;
+        std::cout << std::setw(12) << ((view.publish_timestamp > 0) ? (now - view.publish_timestamp) / 1000000 : 0) << std::endl;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Levels of one book side by side, bids on the left
+// -----------------------------------------------------------------------
+void print_book(book_shm_view *view, int depth) {
+    std::cout << "instrument " << view->instrument_id << " exchange " << (int) view->exchange_id;
+    std::cout << (view->valid ? "" : " (NOT VALID - being rebuilt)") << " seq " << view->end_seq_number;
+    std::cout << " exch_ts " << view->exchange_timestamp << " updates " << view->update_count << std::endl;
+    std::cout << std::setw(18) << "bid_qty" << std::setw(18) << "bid" << std::setw(18) << "ask" << std::setw(18) << "ask_qty" << std::endl;
+    int levels = std::min(depth, (int) std::max(view->num_bids, view->num_asks));
+    std::cout << std::setprecision(10);
+    for(int i = 0; i < levels; i++){
+        if(i < view->num_bids)
+            std::cout << std::setw(18) << view->bids[i].qty << std::setw(18) << view->bids[i].price;
+        else
+            std::cout << std::setw(36) << "";
+        if(i < view->num_asks)
+            std::cout << std::setw(18) << view->asks[i].price << std::setw(18) << view->asks[i].qty;
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int option;
+    std::string shm_name = "";
+    uint32_t instrument_id = 0;
+    int depth = BOOK_SHM_MAX_DEPTH;
+    int watch_millis = 0;
+
+    static struct option long_options[] = {
+        {"name"         , optional_argument, NULL, 'n'},
+        {"instrument"   , optional_argument, NULL, 'i'},
+        {"depth"        , optional_argument, NULL, 'd'},
+        {"watch"        , optional_argument, NULL, 'w'},
+        {"help"         , optional_argument, NULL,'h'}};
+
+    while((option = getopt_long(argc, argv, "n:i:d:w:h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'h':
+                print_options();
+                exit(0);
+
+            case 'n':
+                shm_name = optarg;
+            break;
+
+            case 'i':
+                instrument_id = std::stoul(optarg);
+            break;
+
+            case 'd':
+                depth = atoi(optarg);
+            break;
+
+            case 'w':
+                watch_millis = atoi(optarg);
+            break;
+
+            default:
+            break;
+        }
+    }
+
+    std::vector<std::string> regions;
+    if(shm_name != "")
+        regions.push_back(shm_name);
+    else
+        regions = find_regions();
+
+    book_shm_view view;
+    for(auto &region: regions){
+        BookShmReader *reader = new BookShmReader(region);
+        if(! reader->is_open()){
+            std::cout << "Could not open book region: " << region << std::endl;
+            delete(reader);
+            continue;
+        }
+        print_header(region, reader);
+        if(instrument_id == 0){
+            print_summary(reader);
+            delete(reader);
+            continue;
+        }
+
+        uint64_t last_sequence = 0;
+        do {
+            // Writer restarted - the region we map is no longer updated, follow the name
+            if((watch_millis > 0) && reader->is_retired()){
+                BookShmReader *new_reader = new BookShmReader(region);
+                if(new_reader->is_open()){
+                    delete(reader);
+                    reader = new_reader;
+                    last_sequence = 0;
+                    print_header(region, reader);
+                } else {
+                    delete(new_reader);
+                }
+            }
+            if(reader->get_sequence(instrument_id) != last_sequence){
+                if(reader->read_book(instrument_id, &view)){
+                    print_book(&view, depth);
+                    last_sequence = view.sequence;
+                }
+            }
+            if(watch_millis > 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(watch_millis));
+        } while(watch_millis > 0);
+        delete(reader);
+    }
+    return(0);
+}
@@ -0,0 +1,300 @@
+#include "book_shm.hpp"
+
+#include <algorithm>
+
+// -----------------------------------------------------------------------
+// Creates /got_books_<name> with room for max_instruments books of depth levels a side
+// -----------------------------------------------------------------------
+BookShmWriter::BookShmWriter(std::string name, uint32_t _depth, uint32_t max_instruments) {
+    depth = std::min(std::max(_depth, (uint32_t) 1), (uint32_t) BOOK_SHM_MAX_DEPTH);
+    shm_name = BOOK_SHM_PREFIX + name;
+    uint32_t slot_size = sizeof(book_shm_slot) + (2 * depth * sizeof(book_shm_level));
+    slot_size = (slot_size + BOOK_SHM_ALIGNMENT - 1) & ~(BOOK_SHM_ALIGNMENT - 1);
+    uint64_t header_size = (sizeof(book_shm_header) + BOOK_SHM_ALIGNMENT - 1) & ~(BOOK_SHM_ALIGNMENT - 1);
+    region_size = header_size + ((uint64_t) max_instruments * slot_size);
+
+    // Truncating a region readers still map would fault them - start a new one instead
+    retire_region(shm_name);
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if(fd < 0){
+        std::cout << "Failed to create book shared memory: " << shm_name << std::endl;
+        return;
+    }
+    struct stat shm_stat;
+    if((ftruncate(fd, region_size) != 0) || (fstat(fd, &shm_stat) != 0)){
+        std::cout << "Failed to size book shared memory: " << shm_name << std::endl;
+        close(fd);
+        shm_unlink(shm_name.c_str());
+        return;
+    }
+    region_inode = shm_stat.st_ino;
+    char *region = (char *) mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED){
+        std::cout << "Failed to map book shared memory: " << shm_name << std::endl;
+        shm_unlink(shm_name.c_str());
+        return;
+    }
+
+    header = (book_shm_header *) region;
+    slots = region + header_size;
+    header->version = BOOK_SHM_VERSION;
+    header->max_instruments = max_instruments;
+    header->depth = depth;
+    header->slot_size = slot_size;
+    header->num_slots_used = 0;
+    header->writer_pid = getpid();
+    header->retired = 0;
+    header->start_timestamp = get_current_ts();
+    strncpy(header->process_name, name.c_str(), sizeof(header->process_name) - 1);
+    // Magic goes in last so a reader never sees a half initialised header as valid
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, BOOK_SHM_MAGIC, sizeof(header->magic));
+}
+
+// -----------------------------------------------------------------------
+// Marks the region retired and unlinks it, unless another writer already replaced it
+// -----------------------------------------------------------------------
+BookShmWriter::~BookShmWriter() {
+    if(header == nullptr)
+        return;
+    header->retired.store(1, std::memory_order_release);
+    munmap(header, region_size);
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        return;
+    struct stat shm_stat;
+    bool is_ours = (fstat(fd, &shm_stat) == 0) && (shm_stat.st_ino == region_inode);
+    close(fd);
+    if(is_ours)
+        shm_unlink(shm_name.c_str());
+}
+
+// -----------------------------------------------------------------------
+// Tells readers of a region left behind under this name (previous run, crashed writer) to
+// reopen, then unlinks it. Readers keep their mapping of it until they do.
+// -----------------------------------------------------------------------
+void BookShmWriter::retire_region(std::string name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if(fd < 0)
+        return;
+    struct stat shm_stat;
+    if((fstat(fd, &shm_stat) == 0) && (shm_stat.st_size >= (off_t) sizeof(book_shm_header))){
+        char *region = (char *) mmap(NULL, sizeof(book_shm_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(region != MAP_FAILED){
+            ((book_shm_header *) region)->retired.store(1, std::memory_order_release);
+            munmap(region, sizeof(book_shm_header));
+        }
+    }
+    close(fd);
+    shm_unlink(name.c_str());
+}
+
+uint64_t BookShmWriter::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+std::string BookShmWriter::get_shm_name() {
+    return(shm_name);
+}
+
+void BookShmWriter::set_level_source(book_level_source _level_source) {
+    level_source = _level_source;
+}
+
+// -----------------------------------------------------------------------
+// Returns the slot for an instrument, allocating it the first time
+// Returns nullptr if the region could not be created or is full
+// -----------------------------------------------------------------------
+book_shm_slot *BookShmWriter::get_slot(uint32_t instrument_id, uint8_t exchange_id) {
+    auto found = instruments.find(instrument_id);
+    if(found != instruments.end())
+        return(found->second);
+
+    if((header == nullptr) || (header->num_slots_used.load() >= header->max_instruments))
+        return(nullptr);
+
+    uint32_t slot_number = header->num_slots_used.load();
+    book_shm_slot *slot = (book_shm_slot *) (slots + ((uint64_t) slot_number * header->slot_size));
+    slot->instrument_id = instrument_id;
+    slot->exchange_id = exchange_id;
+    // Publish the slot to readers once it is filled in
+    header->num_slots_used.store(slot_number + 1, std::memory_order_release);
+
+    instruments[instrument_id] = slot;
+    return(slot);
+}
+
+// -----------------------------------------------------------------------
+// Copies the levels in bid_buffer and ask_buffer into the slot under its seqlock
+// -----------------------------------------------------------------------
+void BookShmWriter::publish(book_shm_slot *slot, PLUpdates *pl_update, int num_bids, int num_asks) {
+    book_shm_level *levels = (book_shm_level *) ((char *) slot + sizeof(book_shm_slot));
+
+    uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for(int i = 0; i < num_bids; i++)
+        levels[i] = book_shm_level{bid_buffer[i].price_level, bid_buffer[i].quantity};
+    for(int i = 0; i < num_asks; i++)
+        levels[depth + i] = book_shm_level{ask_buffer[i].price_level, ask_buffer[i].quantity};
+    slot->num_bids = num_bids;
+    slot->num_asks = num_asks;
+    if(pl_update != nullptr){
+        slot->exchange_timestamp = pl_update->exchange_timestamp;
+        slot->receive_timestamp = pl_update->receive_timestamp;
+        slot->end_seq_number = pl_update->end_seq_number;
+        // A multi message snapshot is only a book once its last message is in
+        if(! (pl_update->update_flags & PL_UPDATE_MULTIPLE_MESSAGES) || (pl_update->update_flags & PL_UPDATE_LAST_MSG_IN_SERIES))
+            slot->valid = 1;
+    } else {
+        slot->valid = 0;
+    }
+    slot->publish_timestamp = get_current_ts();
+    slot->update_count++;
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------
+// Call once the update is in the source book
+// -----------------------------------------------------------------------
+void BookShmWriter::process_update(PLUpdates *pl_update) {
+    book_shm_slot *slot = get_slot(pl_update->instrument_id, pl_update->exchange_id);
+    if((slot == nullptr) || ! level_source)
+        return;
+    // Levels are read before the slot goes odd, readers only retry for the copy itself
+    int num_bids = level_source(BUY_SIDE, depth, bid_buffer);
+    int num_asks = level_source(SELL_SIDE, depth, ask_buffer);
+    publish(slot, pl_update, num_bids, num_asks);
+}
+
+// -----------------------------------------------------------------------
+// Book is being rebuilt - readers see it empty and not valid until it is
+// -----------------------------------------------------------------------
+void BookShmWriter::clear_book(uint32_t instrument_id, uint8_t exchange_id) {
+    book_shm_slot *slot = get_slot(instrument_id, exchange_id);
+    if(slot == nullptr)
+        return;
+    publish(slot, nullptr, 0, 0);
+}
+
+// -----------------------------------------------------------------------
+// Maps a region created by a BookShmWriter read only
+// -----------------------------------------------------------------------
+BookShmReader::BookShmReader(std::string name) {
+    std::string shm_name = (name.rfind(BOOK_SHM_PREFIX, 0) == 0) ? name : (BOOK_SHM_PREFIX + name);
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        return;
+    struct stat shm_stat;
+    if((fstat(fd, &shm_stat) != 0) || (shm_stat.st_size < (off_t) sizeof(book_shm_header))){
+        close(fd);
+        return;
+    }
+    char *region = (char *) mmap(NULL, shm_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED)
+        return;
+
+    region_size = shm_stat.st_size;
+    header = (book_shm_header *) region;
+    uint64_t header_size = (sizeof(book_shm_header) + BOOK_SHM_ALIGNMENT - 1) & ~(BOOK_SHM_ALIGNMENT - 1);
+    if( (memcmp(header->magic, BOOK_SHM_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->depth > BOOK_SHM_MAX_DEPTH) ||
+        (region_size < header_size + ((uint64_t) header->max_instruments * header->slot_size))){
+        munmap(region, region_size);
+        header = nullptr;
+        return;
+    }
+    slots = region + header_size;
+}
+
+BookShmReader::~BookShmReader() {
+    if(header != nullptr)
+        munmap(header, region_size);
+}
+
+bool BookShmReader::is_open() {
+    return(header != nullptr);
+}
+
+// -----------------------------------------------------------------------
+// True once the writer has gone or a new writer replaced the region - reopen the name
+// -----------------------------------------------------------------------
+bool BookShmReader::is_retired() {
+    return((header == nullptr) || (header->retired.load(std::memory_order_acquire) != 0));
+}
+
+book_shm_header *BookShmReader::get_header() {
+    return(header);
+}
+
+// -----------------------------------------------------------------------
+// Slot of an instrument, picks up slots the writer added since the last lookup
+// -----------------------------------------------------------------------
+book_shm_slot *BookShmReader::find_slot(uint32_t instrument_id) {
+    auto found = slot_map.find(instrument_id);
+    if(found != slot_map.end())
+        return(found->second);
+
+    uint32_t num_slots_used = header->num_slots_used.load(std::memory_order_acquire);
+    for(; num_slots_known < num_slots_used; num_slots_known++){
+        book_shm_slot *slot = (book_shm_slot *) (slots + ((uint64_t) num_slots_known * header->slot_size));
+        slot_map[slot->instrument_id] = slot;
+    }
+    found = slot_map.find(instrument_id);
+    return((found != slot_map.end()) ? found->second : nullptr);
+}
+
+std::vector<uint32_t> BookShmReader::get_instrument_ids() {
+    std::vector<uint32_t> instrument_ids;
+    find_slot(0);
+    for(auto &[instrument_id, slot]: slot_map)
+        instrument_ids.push_back(instrument_id);
+    return(instrument_ids);
+}
+
+// -----------------------------------------------------------------------
+// Cheap change check - the book changed if this differs from the last view's sequence
+// -----------------------------------------------------------------------
+uint64_t BookShmReader::get_sequence(uint32_t instrument_id) {
+    book_shm_slot *slot = find_slot(instrument_id);
+    return((slot != nullptr) ? slot->sequence.load(std::memory_order_acquire) : 0);
+}
+
+// -----------------------------------------------------------------------
+// Consistent copy of an instrument's book, false if the region has no such instrument
+// -----------------------------------------------------------------------
+bool BookShmReader::read_book(uint32_t instrument_id, book_shm_view *view) {
+    book_shm_slot *slot = find_slot(instrument_id);
+    if(slot == nullptr)
+        return(false);
+
+    uint32_t depth = header->depth;
+    book_shm_level *levels = (book_shm_level *) ((char *) slot + sizeof(book_shm_slot));
+    uint64_t sequence;
+    do {
+        sequence = slot->sequence.load(std::memory_order_acquire);
+        if(sequence & 1)
+            continue;
+        view->instrument_id = slot->instrument_id;
+        view->exchange_id = slot->exchange_id;
+        view->valid = slot->valid;
+        view->num_bids = std::min((uint32_t) slot->num_bids, depth);
+        view->num_asks = std::min((uint32_t) slot->num_asks, depth);
+        view->exchange_timestamp = slot->exchange_timestamp;
+        view->receive_timestamp = slot->receive_timestamp;
+        view->publish_timestamp = slot->publish_timestamp;
+        view->end_seq_number = slot->end_seq_number;
+        view->update_count = slot->update_count;
+        memcpy(view->bids, levels, view->num_bids * sizeof(book_shm_level));
+        memcpy(view->asks, levels + depth, view->num_asks * sizeof(book_shm_level));
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while((sequence & 1) || (slot->sequence.load(std::memory_order_relaxed) != sequence));
+    view->sequence = sequence;
+    return(true);
+}
@@ -13,6 +13,10 @@
 #include "merged_orderbook.hpp"
 #include "binance_md_process.hpp"
 
+// Window conversions start this far before the snapshot they rebuild the book from, so the
+// diffs bridging the snapshot are read, and read this far past the end for late receives
+#define WINDOW_SNAPSHOT_LEAD_NS     10000000000L
+#define WINDOW_END_SLACK_NS         5000000000L
 
 void print_options(){
     std::cout << "Options for svc_md_binance:" << std::endl;
@@ -26,6 +30,8 @@ void print_options(){
     std::cout << "  -T (--tick-size) <TICK_SIZE>                            = The tick_size of the symbol in double" << std::endl;
     std::cout << "  -S (--step-size) <STEP_SIZE>                            = The step_size of the symbol in double" << std::endl;
     std::cout << "  -C (--contract-size) <CONTRACT_SIZE>                    = The contract_size of the symbol in double" << std::endl;
+    std::cout << "  -w (--window-start) <NANOS>                             = Only convert from this receive timestamp (default start of day)" << std::endl;
+    std::cout << "  -W (--window-end) <NANOS>                               = Only convert up to this receive timestamp (default end of day)" << std::endl;
     std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
 }
 
@@ -58,6 +64,8 @@ int main(int argc, char** argv) {
         {"tick-size"            , optional_argument, NULL, 'T'},
         {"step-size"            , optional_argument, NULL, 'S'},
         {"contract-size"        , optional_argument, NULL, 'C'},
+        {"window-start"         , optional_argument, NULL, 'w'},
+        {"window-end"           , optional_argument, NULL, 'W'},
         {"help"                 , optional_argument, NULL, 'h'}};
 
     bool exchange_id_given = false;
@@ -72,13 +80,15 @@ int main(int argc, char** argv) {
     double contract_size = 0.0;
     double maintenance_margin = 0.0;
     double required_margin = 0.0;
+    uint64_t window_start = 0;
+    uint64_t window_end = 0;
 
     
     std::stringstream ss;
     ss.clear();
 
     int cmd_option;
-    while((cmd_option = getopt_long(argc, argv, "i:I:o:e:s:P:Q:T:S:C:h", long_options, NULL)) != -1) {
+    while((cmd_option = getopt_long(argc, argv, "i:I:o:e:s:P:Q:T:S:C:w:W:h", long_options, NULL)) != -1) {
         switch (cmd_option) {
             case 'i':
                 raw_file_given = true;
@@ -139,6 +149,18 @@ int main(int argc, char** argv) {
                 ss.clear();
                 break;
 
+            case 'w':
+                ss << optarg;
+                ss >> window_start;
+                ss.clear();
+                break;
+
+            case 'W':
+                ss << optarg;
+                ss >> window_end;
+                ss.clear();
+                break;
+
             case 'h':
                 print_options();
                 exit(1);
@@ -165,6 +187,10 @@ int main(int argc, char** argv) {
     filter_start_time *= 1000000000;
     filter_end_time *= 1000000000;
     filter_end_time += 999999999;
+    if(window_start != 0)
+        filter_start_time = window_start;
+    if(window_end != 0)
+        filter_end_time = window_end;
 
     // Setup the clear message
     InstrumentClearBook instrument_clear_msg;
@@ -200,6 +226,28 @@ int main(int argc, char** argv) {
         }
     }
 
+    // For a window, start from the last snapshot before it rather than the start of the capture.
+    // Compressed captures seek straight to the block using their index.
+    if((window_start != 0) && ss_raw_file_given){
+        uint64_t snapshot_ts = 0;
+        int snapshots_before_window = 0;
+        RawFile snapshot_probe(ss_raw_filename, ReadOnly);
+        while((snapshot_probe.read_message().length() > 0) && (snapshot_probe.get_ts_of_message() <= window_start)){
+            snapshot_ts = snapshot_probe.get_ts_of_message();
+            snapshots_before_window++;
+        }
+
+        if(snapshots_before_window > 0){
+            for(int i = 1; i < snapshots_before_window; i++)
+                ss_raw_file->read_message();
+            raw_file->seek_to_time(snapshot_ts - WINDOW_SNAPSHOT_LEAD_NS);
+        } else {
+            std::cout << "No snapshot before the window start - converting from the start of the capture" << std::endl;
+        }
+    }
+    if(window_end != 0)
+        raw_file->set_end_time(window_end + WINDOW_END_SLACK_NS);
+
 
     bin_file = new BinaryFile(binary_filename, WriteOnlyBinary);
     bin_file->add_file_symbol_definition(   instrument_id,
@@ -0,0 +1,153 @@
+#include "diff_replay_buffer.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor
+// -----------------------------------------------------------------------
+DiffReplayBuffer::DiffReplayBuffer(Logger *_logger) {
+    logger = _logger;
+}
+
+// -----------------------------------------------------------------------
+// Returns the buffer for the instrument, allocating it the first time only
+// -----------------------------------------------------------------------
+replay_state *DiffReplayBuffer::get_state(uint32_t instrument_id) {
+    auto it = instrument_state.find(instrument_id);
+    if(it != instrument_state.end())
+        return(it->second);
+
+    replay_state *state = new replay_state();
+    state->buffer.resize(DIFF_REPLAY_INITIAL_SIZE);
+    state->used = 0;
+    state->read_offset = 0;
+    state->num_buffered = 0;
+    instrument_state[instrument_id] = state;
+    return(state);
+}
+
+// -----------------------------------------------------------------------
+// Queues a decoded diff while the instrument waits for its snapshot
+// -----------------------------------------------------------------------
+void DiffReplayBuffer::add_update(uint32_t instrument_id, PLUpdates *pl_update, uint64_t previous_end_seq_no) {
+    replay_state *state = get_state(instrument_id);
+    uint32_t needed = sizeof(buffered_diff_header) + pl_update->msg_header.msgLength;
+
+    if((state->used + needed) > state->buffer.size()){
+        if((state->used + needed) > DIFF_REPLAY_MAX_SIZE){
+            // Too far behind - start over, the snapshot will not bridge and we will ask for a new one
+            logger->msg(WARN, "Diff replay buffer full for instrument: " + std::to_string(instrument_id) + " - dropping buffered diffs");
+            state->used = 0;
+            state->read_offset = 0;
+        } else {
+            state->buffer.resize(state->buffer.size() * 2);
+        }
+    }
+
+    buffered_diff_header *header = (buffered_diff_header *) (state->buffer.data() + state->used);
+    header->previous_end_seq_no = previous_end_seq_no;
+    header->length = pl_update->msg_header.msgLength;
+    memcpy(state->buffer.data() + state->used + sizeof(buffered_diff_header), (char *) pl_update, pl_update->msg_header.msgLength);
+    state->used += needed;
+    state->num_buffered++;
+}
+
+// -----------------------------------------------------------------------
+// Drops diffs covered by the snapshot (u <= lastUpdateId) and checks that the
+// first remaining one straddles it (U <= lastUpdateId+1 <= u)
+// -----------------------------------------------------------------------
+bool DiffReplayBuffer::can_bridge(uint32_t instrument_id, uint64_t last_update_id) {
+    replay_state *state = get_state(instrument_id);
+    bool discarded_any = false;
+
+    while(state->read_offset < state->used){
+        buffered_diff_header *header = (buffered_diff_header *) (state->buffer.data() + state->read_offset);
+        PLUpdates *pl_update = (PLUpdates *) ((char *) header + sizeof(buffered_diff_header));
+        if(pl_update->end_seq_number > last_update_id)
+            break;
+        state->read_offset += sizeof(buffered_diff_header) + header->length;
+        num_diffs_discarded++;
+        discarded_any = true;
+    }
+
+    // Nothing buffered past the snapshot - the live feed continues from lastUpdateId
+    if(state->read_offset == state->used){
+        num_snapshots_bridged++;
+        if(discarded_any)
+            num_resyncs_saved++;
+        return(true);
+    }
+
+    buffered_diff_header *header = (buffered_diff_header *) (state->buffer.data() + state->read_offset);
+    PLUpdates *pl_update = (PLUpdates *) ((char *) header + sizeof(buffered_diff_header));
+
+    // Futures streams chain on pu rather than U, accept either
+    if(((pl_update->start_seq_number <= last_update_id + 1) && (last_update_id + 1 <= pl_update->end_seq_number)) ||
+        (header->previous_end_seq_no == last_update_id)){
+        num_snapshots_bridged++;
+        // With the plain gap check this overlap would have triggered another snapshot
+        if(discarded_any || (header->previous_end_seq_no != last_update_id))
+            num_resyncs_saved++;
+        return(true);
+    }
+
+    num_snapshots_stale++;
+    logger->msg(INFO, "Snapshot for instrument: " + std::to_string(instrument_id) + " (lastUpdateId " + std::to_string(last_update_id) +
+                        ") does not reach first buffered diff (U " + std::to_string(pl_update->start_seq_number) + ")");
+    return(false);
+}
+
+// -----------------------------------------------------------------------
+// Replays the remaining buffered diffs in order, stops if the diffs themselves have a gap
+// -----------------------------------------------------------------------
+bool DiffReplayBuffer::replay(uint32_t instrument_id, uint64_t last_update_id, std::function<void(PLUpdates*)> apply_update) {
+    replay_state *state = get_state(instrument_id);
+    uint64_t last_applied_seq = last_update_id;
+    bool first_update = true;
+
+    while(state->read_offset < state->used){
+        buffered_diff_header *header = (buffered_diff_header *) (state->buffer.data() + state->read_offset);
+        PLUpdates *pl_update = (PLUpdates *) ((char *) header + sizeof(buffered_diff_header));
+
+        // A diff split over several messages shares the same sequence numbers
+        if((! first_update) && (pl_update->end_seq_number != last_applied_seq) && (header->previous_end_seq_no != last_applied_seq)){
+            logger->msg(WARN, "Gap in buffered diffs for instrument: " + std::to_string(instrument_id) + " (expected " +
+                                std::to_string(last_applied_seq) + " got " + std::to_string(header->previous_end_seq_no) + ")");
+            clear(instrument_id);
+            return(false);
+        }
+        apply_update(pl_update);
+        last_applied_seq = pl_update->end_seq_number;
+        first_update = false;
+        num_diffs_replayed++;
+        state->read_offset += sizeof(buffered_diff_header) + header->length;
+    }
+
+    clear(instrument_id);
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Empties the buffer for the instrument (memory is kept for next time)
+// -----------------------------------------------------------------------
+void DiffReplayBuffer::clear(uint32_t instrument_id) {
+    replay_state *state = get_state(instrument_id);
+    state->used = 0;
+    state->read_offset = 0;
+}
+
+// -----------------------------------------------------------------------
+// Number of snapshot requests avoided by bridging overlapping diffs
+// -----------------------------------------------------------------------
+uint64_t DiffReplayBuffer::get_resyncs_saved() {
+    return(num_resyncs_saved);
+}
+
+// -----------------------------------------------------------------------
+// Summary of the counters for logging
+// -----------------------------------------------------------------------
+std::string DiffReplayBuffer::get_stats() {
+    return("bridged: " + std::to_string(num_snapshots_bridged) +
+            ", stale snapshots: " + std::to_string(num_snapshots_stale) +
+            ", diffs discarded: " + std::to_string(num_diffs_discarded) +
+            ", diffs replayed: " + std::to_string(num_diffs_replayed) +
+            ", resyncs saved: " + std::to_string(num_resyncs_saved));
+}
@@ -0,0 +1,343 @@
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <getopt.h>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <time.h>
+#include <cmath>
+#include <algorithm>
+
+#include "simdjson.h"
+#include "execution_report_decoder.hpp"
+#include "latency_histogram.hpp"
+
+#define BENCH_DEFAULT_ROUNDS        100000
+// How the adapter logs what came on the user stream, recorded lines can have it in front
+#define BENCH_LOG_PREFIX            "WebSocket Message="
+// Spot and futures symbols go in the same table, the legacy maps don't know the exchange either
+#define BENCH_EXCHANGE_ID           16
+
+// One of each event the adapter acts on, used when no recording is given
+static const char *sample_messages[] = {
+    "{\"e\":\"executionReport\",\"E\":1624649424612,\"s\":\"BTCUSDT\",\"c\":\"7zgSmQ9C1\",\"S\":\"BUY\",\"o\":\"LIMIT\",\"f\":\"GTC\",\"q\":\"0.00100000\","
+        "\"p\":\"31765.38000000\",\"P\":\"0.00000000\",\"F\":\"0.00000000\",\"g\":-1,\"C\":\"\",\"x\":\"NEW\",\"X\":\"NEW\",\"r\":\"NONE\",\"i\":6622961854,"
+        "\"l\":\"0.00000000\",\"z\":\"0.00000000\",\"L\":\"0.00000000\",\"n\":\"0\",\"N\":null,\"T\":1624649424611,\"t\":-1,\"I\":14156327846,\"w\":true,"
+        "\"m\":false,\"M\":false,\"O\":1624649424611,\"Z\":\"0.00000000\",\"Y\":\"0.00000000\",\"Q\":\"0.00000000\"}",
+    "{\"e\":\"executionReport\",\"E\":1624649425710,\"s\":\"BTCUSDT\",\"c\":\"7zgSmQ9C1\",\"S\":\"BUY\",\"o\":\"LIMIT\",\"f\":\"GTC\",\"q\":\"0.00100000\","
+        "\"p\":\"31765.38000000\",\"P\":\"0.00000000\",\"F\":\"0.00000000\",\"g\":-1,\"C\":\"\",\"x\":\"TRADE\",\"X\":\"PARTIALLY_FILLED\",\"r\":\"NONE\","
+        "\"i\":6622961854,\"l\":\"0.00040000\",\"z\":\"0.00040000\",\"L\":\"31765.38000000\",\"n\":\"0.00000040\",\"N\":\"BTC\",\"T\":1624649425709,"
+        "\"t\":935541282,\"I\":14156329001,\"w\":false,\"m\":true,\"M\":true,\"O\":1624649424611,\"Z\":\"12.70615200\",\"Y\":\"12.70615200\",\"Q\":\"0.00000000\"}",
+    "{\"e\":\"executionReport\",\"E\":1624627518904,\"s\":\"BTCUSDT\",\"c\":\"5hjl9lcA1\",\"S\":\"SELL\",\"o\":\"LIMIT\",\"f\":\"GTC\",\"q\":\"0.00100000\","
+        "\"p\":\"32245.73000000\",\"P\":\"0.00000000\",\"F\":\"0.00000000\",\"g\":-1,\"C\":\"5hjl9lcA0\",\"x\":\"CANCELED\",\"X\":\"CANCELED\",\"r\":\"NONE\","
+        "\"i\":6617694906,\"l\":\"0.00000000\",\"z\":\"0.00000000\",\"L\":\"0.00000000\",\"n\":\"0\",\"N\":null,\"T\":1624627518904,\"t\":-1,\"I\":14145177253,"
+        "\"w\":false,\"m\":false,\"M\":false,\"O\":1624627501404,\"Z\":\"0.00000000\",\"Y\":\"0.00000000\",\"Q\":\"0.00000000\"}",
+    "{\"e\":\"ORDER_TRADE_UPDATE\",\"E\":1568879465651,\"T\":1568879465650,\"o\":{\"s\":\"BTCUSDT\",\"c\":\"TEST\",\"S\":\"SELL\",\"o\":\"LIMIT\",\"f\":\"GTC\","
+        "\"q\":\"0.001\",\"p\":\"9910.50\",\"ap\":\"9910.50\",\"sp\":\"0\",\"x\":\"TRADE\",\"X\":\"FILLED\",\"i\":8886774,\"l\":\"0.001\",\"z\":\"0.001\","
+        "\"L\":\"9910.50\",\"N\":\"USDT\",\"n\":\"0.00396420\",\"T\":1568879465650,\"t\":3712,\"b\":\"0\",\"a\":\"9.91\",\"m\":false,\"R\":false,"
+        "\"wt\":\"CONTRACT_PRICE\",\"ot\":\"LIMIT\",\"ps\":\"BOTH\",\"cp\":false,\"rp\":\"0.00000000\",\"pP\":false,\"si\":0,\"ss\":0,\"V\":\"NONE\","
+        "\"pm\":\"NONE\",\"gtd\":0}}",
+    "{\"e\":\"outboundAccountPosition\",\"E\":1564034571105,\"u\":1564034571073,\"B\":[{\"a\":\"ETH\",\"f\":\"10000.000000\",\"l\":\"0.000000\"}]}"
+};
+
+struct bench_result {
+    std::string name;
+    latency_histogram *decode_latency;
+};
+
+void print_options(){
+    std::cout << "Options for exec_report_bench:" << std::endl;
+    std::cout << "  [-f (--file) <filename>]                                = Recorded user stream messages, one per line (default built in samples)" << std::endl;
+    std::cout << "  [-n (--rounds) <ROUNDS>]                                = Times every message is decoded per run (default 100000)" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+uint64_t get_monotonic_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// The way the trade adapter read the events before the decoder: a DOM parse, a lookup
+// per field and std::strings for the symbol and commission asset
+// -----------------------------------------------------------------------
+double legacy_ascii_to_double(const char *str) {
+    std::string value = str;
+    double final_val = 0;
+    double decimal_val = 0;
+    int sign_multiplier = 1;
+    if (*str == '-') {
+        str++;
+        sign_multiplier = -1;
+    }
+    while( *str  && (*str != '.')) {
+        final_val = final_val*10 + (*str++ - '0');
+    }
+    if (*str == '.') {
+        str++;
+        uint64_t divider = 10;
+        while( *str) {
+            decimal_val += (double)(*str++ - '0') / (double) divider;
+            divider *= 10;
+        }
+    }
+    return (sign_multiplier * (final_val + decimal_val));
+}
+
+bool legacy_decode(simdjson::dom::parser &parser, std::unordered_map<std::string, int> &instruments, std::unordered_map<std::string, uint32_t> &assets,
+                    std::string &message, execution_report *report) {
+    *report = execution_report{};
+    report->trade_id = -1;
+    simdjson::dom::element exchange_json_message;
+    simdjson::dom::element order_details;
+    if(parser.parse(message.c_str(), message.length()).get(exchange_json_message))
+        return(false);
+    if(exchange_json_message["e"].error() == simdjson::NO_SUCH_FIELD)
+        return(false);
+    if((std::string_view) exchange_json_message["e"].get_string() == "ORDER_TRADE_UPDATE"){
+        report->event = EXEC_EVENT_ORDER_TRADE_UPDATE;
+        order_details = exchange_json_message["o"];
+    } else if((std::string_view) exchange_json_message["e"].get_string() == "executionReport") {
+        report->event = EXEC_EVENT_EXECUTION_REPORT;
+        order_details = exchange_json_message;
+    } else {
+        return(false);
+    }
+
+    strncpy(report->client_order_id, order_details["c"].get_c_str(), MAX_EXTERNAL_ORDER_ID_LENGTH - 1);
+    report->is_buy = ((std::string_view) order_details["S"].get_string() == "BUY");
+    std::string_view order_type = order_details["o"].get_string();
+    if(order_type == "LIMIT")
+        report->order_type = EXEC_ORDER_TYPE_LIMIT;
+    else if(order_type == "MARKET")
+        report->order_type = EXEC_ORDER_TYPE_MARKET;
+    else if(order_type == "LIQUIDATION")
+        report->order_type = EXEC_ORDER_TYPE_LIQUIDATION;
+    std::string_view status = order_details["X"].get_string();
+    if(status == "NEW")
+        report->status = EXEC_STATUS_NEW;
+    else if(status == "CANCELED")
+        report->status = EXEC_STATUS_CANCELED;
+    else if(status == "EXPIRED")
+        report->status = EXEC_STATUS_EXPIRED;
+    else if(status == "PARTIALLY_FILLED")
+        report->status = EXEC_STATUS_PARTIALLY_FILLED;
+    else if(status == "FILLED")
+        report->status = EXEC_STATUS_FILLED;
+
+    std::string symbol(order_details["s"].get_string().value());
+    strncpy(report->symbol, symbol.c_str(), EXEC_REPORT_MAX_SYMBOL - 1);
+    if(instruments.count(symbol))
+        report->instrument_id = instruments[symbol];
+    report->exchange_order_id = order_details["i"].get_uint64();
+    report->price = legacy_ascii_to_double(order_details["p"].get_c_str());
+    report->orig_qty = legacy_ascii_to_double(order_details["q"].get_c_str());
+    report->cum_qty = legacy_ascii_to_double(order_details["z"].get_c_str());
+    if((report->status == EXEC_STATUS_PARTIALLY_FILLED) || (report->status == EXEC_STATUS_FILLED)){
+        report->last_qty = legacy_ascii_to_double(order_details["l"].get_c_str());
+        report->last_price = legacy_ascii_to_double(order_details["L"].get_c_str());
+        report->commission = legacy_ascii_to_double(order_details["n"].get_c_str());
+        report->trade_id = order_details["t"].get_int64();
+        std::string asset(order_details["N"].get_string().value());
+        std::transform(asset.begin(), asset.end(), asset.begin(), ::tolower);
+        if(assets.count(asset))
+            report->commission_asset_id = assets[asset];
+    }
+    if((report->event == EXEC_EVENT_EXECUTION_REPORT) && (report->status == EXEC_STATUS_CANCELED))
+        strncpy(report->orig_client_order_id, order_details["C"].get_c_str(), MAX_EXTERNAL_ORDER_ID_LENGTH - 1);
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Recorded messages, the adapter's log prefix taken off if they were cut out of its log
+// -----------------------------------------------------------------------
+std::vector<std::string> load_messages(std::string filename) {
+    std::vector<std::string> messages;
+    if(filename.empty()){
+        for(const char *message: sample_messages)
+            messages.push_back(message);
+        return(messages);
+    }
+    std::ifstream input(filename);
+    std::string line;
+    while(std::getline(input, line)){
+        size_t prefix = line.find(BENCH_LOG_PREFIX);
+        if(prefix != std::string::npos)
+            line = line.substr(prefix + strlen(BENCH_LOG_PREFIX));
+        if(line.find('{') != std::string::npos)
+            messages.push_back(line.substr(line.find('{')));
+    }
+    return(messages);
+}
+
+// -----------------------------------------------------------------------
+// Decodes every message rounds times, each decode timed on its own
+// -----------------------------------------------------------------------
+bench_result run_benchmark(std::string name, std::vector<std::string> &messages, uint64_t rounds,
+                            std::function<bool(std::string &, execution_report *)> decode) {
+    bench_result result;
+    result.name = name;
+    result.decode_latency = new latency_histogram();
+    execution_report report;
+    std::cout << "Running " << name << std::endl;
+
+    // What the clock itself costs, taken off every sample
+    uint64_t timer_overhead = UINT64_MAX;
+    for(int i = 0; i < 1000; i++){
+        uint64_t before = get_monotonic_ts();
+        timer_overhead = std::min(timer_overhead, get_monotonic_ts() - before);
+    }
+
+    for(uint64_t round = 0; round < rounds; round++){
+        for(auto &message: messages){
+            uint64_t before = get_monotonic_ts();
+            decode(message, &report);
+            uint64_t after = get_monotonic_ts();
+            record_latency(result.decode_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+        }
+    }
+    return(result);
+}
+
+// -----------------------------------------------------------------------
+// p50..max from a histogram, in ns
+// -----------------------------------------------------------------------
+std::string format_percentiles(latency_histogram *histogram) {
+    uint64_t count = histogram->count.load();
+    uint64_t buckets[LATENCY_BUCKETS];
+    for(int i = 0; i < LATENCY_BUCKETS; i++)
+        buckets[i] = histogram->buckets[i].load();
+    std::ostringstream line;
+    line << std::setw(10) << count;
+    line << std::setw(9) << ((count > 0) ? histogram->sum.load() / count : 0);
+    for(double percentile: {50.0, 90.0, 99.0, 99.9})
+        line << std::setw(9) << LatencyReader::get_percentile(buckets, count, percentile);
+    line << std::setw(11) << histogram->max.load();
+    return(line.str());
+}
+
+void print_results(std::vector<bench_result> &results) {
+    std::cout << std::endl << std::setw(12) << "decoder" << std::setw(10) << "count" << std::setw(9) << "avg_ns";
+    std::cout << std::setw(9) << "p50_ns" << std::setw(9) << "p90_ns" << std::setw(9) << "p99_ns" << std::setw(9) << "p99.9_ns" << std::setw(11) << "max_ns" << std::endl;
+    for(auto &result: results)
+        std::cout << std::setw(12) << result.name << format_percentiles(result.decode_latency) << std::endl;
+}
+
+// The legacy conversion adds up the digits one by one, so it can be a bit off in the last place
+bool same_value(double legacy_value, double decoder_value) {
+    return(std::abs(legacy_value - decoder_value) <= 1e-12 * std::max(1.0, std::abs(decoder_value)));
+}
+
+// -----------------------------------------------------------------------
+// Both have to read the same out of every message the adapter acts on, or the timings don't mean anything
+// -----------------------------------------------------------------------
+uint64_t cross_check(std::vector<std::string> &messages, std::function<bool(std::string &, execution_report *)> legacy,
+                        std::function<bool(std::string &, execution_report *)> decoder) {
+    uint64_t num_mismatches = 0;
+    uint64_t num_events = 0;
+    for(auto &message: messages){
+        execution_report legacy_report;
+        execution_report decoder_report;
+        bool legacy_ok = legacy(message, &legacy_report);
+        bool decoder_ok = decoder(message, &decoder_report);
+        bool same = (legacy_ok == decoder_ok);
+        if(legacy_ok && decoder_ok){
+            num_events++;
+            same = (legacy_report.event == decoder_report.event) && (legacy_report.status == decoder_report.status) &&
+                    (legacy_report.is_buy == decoder_report.is_buy) && (legacy_report.instrument_id == decoder_report.instrument_id) &&
+                    (legacy_report.exchange_order_id == decoder_report.exchange_order_id) &&
+                    (strcmp(legacy_report.client_order_id, decoder_report.client_order_id) == 0) &&
+                    same_value(legacy_report.orig_qty, decoder_report.orig_qty) && same_value(legacy_report.cum_qty, decoder_report.cum_qty) &&
+                    same_value(legacy_report.price, decoder_report.price);
+            if((legacy_report.status == EXEC_STATUS_PARTIALLY_FILLED) || (legacy_report.status == EXEC_STATUS_FILLED))
+                same = same && same_value(legacy_report.last_qty, decoder_report.last_qty) && same_value(legacy_report.last_price, decoder_report.last_price) &&
+                        same_value(legacy_report.commission, decoder_report.commission) &&
+                        (legacy_report.trade_id == decoder_report.trade_id) && (legacy_report.commission_asset_id == decoder_report.commission_asset_id);
+            if((legacy_report.event == EXEC_EVENT_EXECUTION_REPORT) && (legacy_report.status == EXEC_STATUS_CANCELED))
+                same = same && (strcmp(legacy_report.orig_client_order_id, decoder_report.orig_client_order_id) == 0);
+        }
+        if(! same){
+            if(num_mismatches == 0)
+                std::cout << "Mismatch on: " << message << std::endl;
+            num_mismatches++;
+        }
+    }
+    std::cout << messages.size() << " messages (" << num_events << " order events) cross checked, " << num_mismatches << " mismatches" << std::endl;
+    return(num_mismatches);
+}
+
+int main(int argc, char* argv[]) {
+
+    std::string filename;
+    uint64_t rounds = BENCH_DEFAULT_ROUNDS;
+
+    static struct option long_options[] = {
+        {"file"             , optional_argument, NULL, 'f'},
+        {"rounds"           , optional_argument, NULL, 'n'},
+        {"help"             , optional_argument, NULL,'h'}};
+
+    int cmd_option;
+    while((cmd_option = getopt_long(argc,argv,"f:n:h", long_options, NULL)) != -1) {
+        switch (cmd_option) {
+            case 'h':
+            print_options();
+            exit(0);
+            break;
+
+            case 'f':
+            filename = optarg;
+            break;
+
+            case 'n':
+            rounds = std::max(1L, atol(optarg));
+            break;
+        }
+    }
+
+    std::vector<std::string> messages = load_messages(filename);
+    if(messages.empty()){
+        std::cout << "No messages in: " << filename << std::endl;
+        exit(1);
+    }
+
+    // Symbols and assets the way refdata hands them to the adapter
+    ExecutionReportDecoder *decoder = new ExecutionReportDecoder();
+    std::unordered_map<std::string, int> instruments;
+    std::unordered_map<std::string, uint32_t> assets;
+    for(auto &message: messages){
+        execution_report report;
+        if(! decoder->decode(message.c_str(), message.length(), BENCH_EXCHANGE_ID, &report) || instruments.count(report.symbol))
+            continue;
+        uint32_t instrument_id = instruments.size() + 1;
+        instruments[report.symbol] = instrument_id;
+        decoder->add_symbol(BENCH_EXCHANGE_ID, report.symbol, instrument_id);
+    }
+    for(const char *asset: {"btc", "eth", "bnb", "usdt", "busd", "usdc"}){
+        assets[asset] = assets.size() + 1;
+        decoder->add_asset(asset, assets[asset]);
+    }
+
+    simdjson::dom::parser parser;
+    std::function<bool(std::string &, execution_report *)> legacy = [&](std::string &message, execution_report *report) {
+        return(legacy_decode(parser, instruments, assets, message, report));
+    };
+    std::function<bool(std::string &, execution_report *)> single_pass = [&](std::string &message, execution_report *report) {
+        return(decoder->decode(message.c_str(), message.length(), BENCH_EXCHANGE_ID, report));
+    };
+
+    uint64_t num_mismatches = cross_check(messages, legacy, single_pass);
+
+    std::vector<bench_result> results;
+    results.push_back(run_benchmark("legacy", messages, rounds, legacy));
+    results.push_back(run_benchmark("single_pass", messages, rounds, single_pass));
+
+    print_results(results);
+    std::cout << std::endl;
+    return((num_mismatches == 0) ? 0 : 1);
+}
@@ -0,0 +1,444 @@
+#include "execution_report_decoder.hpp"
+
+struct enum_name {
+    const char *name;
+    uint8_t length;
+    uint8_t value;
+};
+
+static const enum_name order_type_names[] = {
+    {"LIMIT",               5,  EXEC_ORDER_TYPE_LIMIT},
+    {"MARKET",              6,  EXEC_ORDER_TYPE_MARKET},
+    {"LIMIT_MAKER",         11, EXEC_ORDER_TYPE_LIMIT_MAKER},
+    {"LIQUIDATION",         11, EXEC_ORDER_TYPE_LIQUIDATION}
+};
+
+static const enum_name status_names[] = {
+    {"NEW",                 3,  EXEC_STATUS_NEW},
+    {"PARTIALLY_FILLED",    16, EXEC_STATUS_PARTIALLY_FILLED},
+    {"FILLED",              6,  EXEC_STATUS_FILLED},
+    {"CANCELED",            8,  EXEC_STATUS_CANCELED},
+    {"EXPIRED",             7,  EXEC_STATUS_EXPIRED},
+    {"REJECTED",            8,  EXEC_STATUS_REJECTED}
+};
+
+static const enum_name exec_type_names[] = {
+    {"NEW",                 3,  EXEC_EXEC_NEW},
+    {"TRADE",               5,  EXEC_EXEC_TRADE},
+    {"CANCELED",            8,  EXEC_EXEC_CANCELED},
+    {"EXPIRED",             7,  EXEC_EXEC_EXPIRED},
+    {"REJECTED",            8,  EXEC_EXEC_REJECTED}
+};
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+template<size_t N>
+static uint8_t lookup_name(const enum_name (&names)[N], const char *value, size_t length) {
+    for(size_t i = 0; i < N; i++){
+        if((names[i].length == length) && (memcmp(names[i].name, value, length) == 0))
+            return(names[i].value);
+    }
+    return(0);
+}
+
+static inline void skip_whitespace(const char *&ptr, const char *end) {
+    while((ptr < end) && ((*ptr == ' ') || (*ptr == '\n') || (*ptr == '\r') || (*ptr == '\t')))
+        ptr++;
+}
+
+// -----------------------------------------------------------------------
+// Constructor - the only allocation the table makes
+// -----------------------------------------------------------------------
+InternTable::InternTable(bool _lower_case) {
+    lower_case = _lower_case;
+    entries = new intern_entry[EXEC_REPORT_INTERN_CAPACITY]();
+}
+
+uint64_t InternTable::key_hash(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325UL;
+    for(int i = 0; (i < EXEC_REPORT_MAX_SYMBOL) && (key[i] != 0); i++){
+        hash ^= (uint8_t) key[i];
+        hash *= 0x100000001b3UL;
+    }
+    return(hash ^ (hash >> 32));
+}
+
+// -----------------------------------------------------------------------
+// Slot of the key, or the empty slot it would go in
+// -----------------------------------------------------------------------
+uint32_t InternTable::find_slot(const char *key) {
+    uint32_t slot = key_hash(key) & (EXEC_REPORT_INTERN_CAPACITY - 1);
+    while(entries[slot].key[0] != 0){
+        if(memcmp(entries[slot].key, key, EXEC_REPORT_MAX_SYMBOL) == 0)
+            return(slot);
+        slot = (slot + 1) & (EXEC_REPORT_INTERN_CAPACITY - 1);
+    }
+    return(slot);
+}
+
+bool InternTable::make_key(const char *key, size_t length, char *padded_key) {
+    if((length == 0) || (length >= EXEC_REPORT_MAX_SYMBOL))
+        return(false);
+    memset(padded_key, 0, EXEC_REPORT_MAX_SYMBOL);
+    for(size_t i = 0; i < length; i++)
+        padded_key[i] = (lower_case && (key[i] >= 'A') && (key[i] <= 'Z')) ? (key[i] + ('a' - 'A')) : key[i];
+    return(true);
+}
+
+bool InternTable::add(const char *key, size_t length, uint32_t value) {
+    char padded_key[EXEC_REPORT_MAX_SYMBOL];
+    if(! make_key(key, length, padded_key))
+        return(false);
+    MyGuard guard(intern_lock);
+    uint32_t slot = find_slot(padded_key);
+    if(entries[slot].key[0] == 0){
+        // Kept at most half full so probes stay short
+        if(num_entries >= (EXEC_REPORT_INTERN_CAPACITY / 2))
+            return(false);
+        memcpy(entries[slot].key, padded_key, EXEC_REPORT_MAX_SYMBOL);
+        num_entries++;
+    }
+    entries[slot].value = value;
+    return(true);
+}
+
+uint32_t InternTable::get(const char *key, size_t length) {
+    char padded_key[EXEC_REPORT_MAX_SYMBOL];
+    if(! make_key(key, length, padded_key))
+        return(EXEC_REPORT_NOT_FOUND);
+    MyGuard guard(intern_lock);
+    uint32_t slot = find_slot(padded_key);
+    return((entries[slot].key[0] != 0) ? entries[slot].value : EXEC_REPORT_NOT_FOUND);
+}
+
+// -----------------------------------------------------------------------
+// Steps over any value, objects and arrays included
+// -----------------------------------------------------------------------
+bool ExecutionReportDecoder::skip_value(const char *&ptr, const char *end) {
+    int depth = 0;
+    while(ptr < end){
+        switch(*ptr){
+            case '"': {
+                    const char *value;
+                    size_t length;
+                    if(! read_string(ptr, end, value, length))
+                        return(false);
+                    if(depth == 0)
+                        return(true);
+                }
+                continue;
+
+            case '{':
+            case '[':
+                depth++;
+                break;
+
+            case '}':
+            case ']':
+                if(depth == 0)
+                    return(true);
+                if(--depth == 0){
+                    ptr++;
+                    return(true);
+                }
+                break;
+
+            case ',':
+                if(depth == 0)
+                    return(true);
+                break;
+        }
+        ptr++;
+    }
+    return(false);
+}
+
+// -----------------------------------------------------------------------
+// ptr on the opening quote, value/length get what is between the quotes (escapes are left as they are)
+// -----------------------------------------------------------------------
+bool ExecutionReportDecoder::read_string(const char *&ptr, const char *end, const char *&value, size_t &length) {
+    if((ptr >= end) || (*ptr != '"'))
+        return(false);
+    value = ++ptr;
+    while(ptr < end){
+        if(*ptr == '\\'){
+            ptr += 2;
+            continue;
+        }
+        if(*ptr == '"'){
+            length = ptr - value;
+            ptr++;
+            return(true);
+        }
+        ptr++;
+    }
+    return(false);
+}
+
+// -----------------------------------------------------------------------
+// Decimal string to double with one rounding - the digits go in an integer and are divided once
+// -----------------------------------------------------------------------
+double ExecutionReportDecoder::read_decimal(const char *value, size_t length) {
+    const char *end = value + length;
+    bool negative = (value < end) && (*value == '-');
+    if(negative)
+        value++;
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool fraction = false;
+    for(; value < end; value++){
+        if(*value == '.'){
+            fraction = true;
+            continue;
+        }
+        if((*value < '0') || (*value > '9'))
+            break;
+        // Past 19 digits they no longer fit, the rest only moves the decimal point
+        if(significant < 19){
+            mantissa = mantissa * 10 + (*value - '0');
+            if(mantissa != 0)
+                significant++;
+            if(fraction)
+                exponent--;
+        } else if(! fraction) {
+            exponent++;
+        }
+    }
+    double result = (double) mantissa;
+    while(exponent < -22){
+        result /= 1e22;
+        exponent += 22;
+    }
+    while(exponent > 22){
+        result *= 1e22;
+        exponent -= 22;
+    }
+    result = (exponent < 0) ? (result / powers_of_ten[-exponent]) : (result * powers_of_ten[exponent]);
+    return(negative ? -result : result);
+}
+
+int64_t ExecutionReportDecoder::read_integer(const char *value, size_t length) {
+    int64_t result = 0;
+    std::from_chars(value, value + length, result);
+    return(result);
+}
+
+void ExecutionReportDecoder::copy_string(char *target, size_t target_size, const char *value, size_t length) {
+    if(length >= target_size)
+        length = target_size - 1;
+    memcpy(target, value, length);
+    target[length] = 0;
+}
+
+// -----------------------------------------------------------------------
+// One object of the event, ptr on its opening brace. The futures event has the order fields in "o",
+// which is decoded into the same report as nested.
+// -----------------------------------------------------------------------
+bool ExecutionReportDecoder::decode_object(const char *&ptr, const char *end, InternTable *exchange_symbols, execution_report *report, bool nested) {
+    ptr++;
+    while(true){
+        skip_whitespace(ptr, end);
+        if(ptr >= end)
+            return(false);
+        if(*ptr == '}'){
+            ptr++;
+            return(true);
+        }
+
+        const char *key;
+        size_t key_length;
+        if(! read_string(ptr, end, key, key_length))
+            return(false);
+        skip_whitespace(ptr, end);
+        if((ptr >= end) || (*ptr != ':'))
+            return(false);
+        ptr++;
+        skip_whitespace(ptr, end);
+        if(ptr >= end)
+            return(false);
+
+        // Every field we use has a one letter key, values are either strings or bare numbers/null/true/false
+        const char *value = ptr;
+        size_t length = 0;
+        bool is_string = (*ptr == '"');
+        bool is_object = (*ptr == '{') || (*ptr == '[');
+        if(is_string){
+            if(! read_string(ptr, end, value, length))
+                return(false);
+        } else if(! is_object) {
+            while((ptr < end) && (*ptr != ',') && (*ptr != '}') && (*ptr != ' ') && (*ptr != '\n') && (*ptr != '\r'))
+                ptr++;
+            length = ptr - value;
+        }
+
+        if(key_length == 1){
+            switch(key[0]){
+                case 'e':
+                    if(nested)
+                        break;
+                    if((length == 15) && (memcmp(value, "executionReport", 15) == 0))
+                        report->event = EXEC_EVENT_EXECUTION_REPORT;
+                    else if((length == 18) && (memcmp(value, "ORDER_TRADE_UPDATE", 18) == 0))
+                        report->event = EXEC_EVENT_ORDER_TRADE_UPDATE;
+                    else
+                        return(false);
+                    break;
+
+                case 'o':
+                    if(is_object && ! nested && (*ptr == '{')){
+                        if(! decode_object(ptr, end, exchange_symbols, report, true))
+                            return(false);
+                        is_object = false;
+                    } else if(is_string) {
+                        report->order_type = lookup_name(order_type_names, value, length);
+                    }
+                    break;
+
+                case 's':
+                    copy_string(report->symbol, EXEC_REPORT_MAX_SYMBOL, value, length);
+                    if(exchange_symbols != nullptr)
+                        report->instrument_id = exchange_symbols->get(value, length);
+                    break;
+
+                case 'c':
+                    copy_string(report->client_order_id, MAX_EXTERNAL_ORDER_ID_LENGTH, value, length);
+                    break;
+
+                case 'C':
+                    if(is_string)
+                        copy_string(report->orig_client_order_id, MAX_EXTERNAL_ORDER_ID_LENGTH, value, length);
+                    break;
+
+                case 'S':
+                    report->is_buy = (length == 3) && (memcmp(value, "BUY", 3) == 0);
+                    break;
+
+                case 'X':
+                    report->status = lookup_name(status_names, value, length);
+                    break;
+
+                case 'x':
+                    report->exec_type = lookup_name(exec_type_names, value, length);
+                    break;
+
+                case 'i':
+                    report->exchange_order_id = read_integer(value, length);
+                    break;
+
+                case 't':
+                    report->trade_id = read_integer(value, length);
+                    break;
+
+                case 'E':
+                    report->event_time = read_integer(value, length);
+                    break;
+
+                case 'T':
+                    report->transaction_time = read_integer(value, length);
+                    break;
+
+                case 'p':
+                    report->price = read_decimal(value, length);
+                    break;
+
+                case 'q':
+                    report->orig_qty = read_decimal(value, length);
+                    break;
+
+                case 'z':
+                    report->cum_qty = read_decimal(value, length);
+                    break;
+
+                case 'l':
+                    report->last_qty = read_decimal(value, length);
+                    break;
+
+                case 'L':
+                    report->last_price = read_decimal(value, length);
+                    break;
+
+                case 'n':
+                    report->commission = read_decimal(value, length);
+                    break;
+
+                case 'N':
+                    if(is_string)
+                        report->commission_asset_id = assets.get(value, length);
+                    break;
+            }
+        }
+        if(is_object && ! skip_value(ptr, end))
+            return(false);
+
+        skip_whitespace(ptr, end);
+        if((ptr < end) && (*ptr == ','))
+            ptr++;
+    }
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+void ExecutionReportDecoder::add_symbol(uint8_t exchange_id, const char *symbol, uint32_t instrument_id) {
+    MyGuard guard(add_lock);
+    if(symbols[exchange_id].load() == nullptr)
+        symbols[exchange_id].store(new InternTable());
+    symbols[exchange_id].load()->add(symbol, strnlen(symbol, EXEC_REPORT_MAX_SYMBOL), instrument_id);
+}
+
+void ExecutionReportDecoder::add_asset(const char *asset_code, uint32_t asset_id) {
+    assets.add(asset_code, strnlen(asset_code, EXEC_REPORT_MAX_SYMBOL), asset_id);
+}
+
+bool ExecutionReportDecoder::decode(const char *message, size_t length, uint8_t exchange_id, execution_report *report) {
+    *report = execution_report{};
+    report->trade_id = -1;
+    const char *ptr = message;
+    const char *end = message + length;
+    skip_whitespace(ptr, end);
+    if((ptr >= end) || (*ptr != '{'))
+        return(false);
+    if(! decode_object(ptr, end, symbols[exchange_id].load(std::memory_order_acquire), report, false))
+        return(false);
+    return((report->event != EXEC_EVENT_NONE) && (report->client_order_id[0] != 0));
+}
+
+void ExecutionReportDecoder::build_exchange_ack(execution_report *report, RequestAck *ack) {
+    ack->msg_header = MessageHeaderT{sizeof(RequestAck), MSG_REQUEST_ACK, 0};
+    ack->internal_order_id = 0;
+    strncpy(ack->external_order_id, report->client_order_id, MAX_EXTERNAL_ORDER_ID_LENGTH);
+    ack->instrument_id = 0;
+    ack->exchange_id = 0;
+    ack->strategy_id = 0;
+    ack->ack_type = EXCHANGE_ACK;
+    ack->reject_reason = UNKNOWN_REJECT;
+    memset(ack->reject_message, 0, MAX_REJECT_LENGTH);
+}
+
+void ExecutionReportDecoder::build_fill(execution_report *report, Fill *fill) {
+    fill->msg_header = MessageHeaderT{sizeof(Fill), MSG_FILL, 0};
+    fill->internal_order_id = 0;
+    strncpy(fill->external_order_id, report->client_order_id, MAX_EXTERNAL_ORDER_ID_LENGTH);
+    *std::to_chars(fill->exchange_trade_id, fill->exchange_trade_id + sizeof(fill->exchange_trade_id) - 1, report->trade_id).ptr = 0;
+    fill->fill_price = report->last_price;
+    fill->fill_qty = report->last_qty;
+    fill->leaves_qty = report->orig_qty - report->cum_qty;
+    fill->instrument_id = 0;
+    fill->exchange_id = 0;
+    fill->strategy_id = 0;
+}
+
+void ExecutionReportDecoder::build_trading_fee(execution_report *report, uint8_t exchange_id, TradingFee *fee) {
+    fee->msg_header = MessageHeaderT{sizeof(TradingFee), TRADING_FEE, 1};
+    fee->internal_order_id = 0;
+    fee->commission_fee = report->commission;
+    fee->asset_id = report->commission_asset_id;
+    fee->fee_type = EXECUTION_FEE;
+    fee->exchange_id = exchange_id;
+    *std::to_chars(fee->exchange_trade_id, fee->exchange_trade_id + sizeof(fee->exchange_trade_id) - 1, report->trade_id).ptr = 0;
+}
@@ -1,7 +1,243 @@
 #include "file_writer.hpp"
 
+// All binary capture writers in the process are serviced by one background thread
+static SL capture_registry_lock;
+static std::vector<FileWriter*> capture_registry;
+static bool capture_thread_started = false;
+
+// Compressed capture blocks from all writers are queued here for the worker pool
+static SL compress_queue_lock;
+static CaptureBlockRingT compress_queue;
+static bool compress_workers_started = false;
+
+// Block buffers shared by all compressed writers. The free list has room for every data buffer
+// there is, so taking one or giving it back never allocates - new ones are only ever added by
+// writers being created and by the capture thread.
+static SL buffer_pool_lock;
+static std::vector<char*> free_data_buffers;
+static uint64_t num_data_buffers = 0;
+static std::vector<char*> free_compressed_buffers;
+
+static uint64_t get_capture_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// gzip adds a larger header and trailer than the zlib wrapper compressBound allows for
+static uint32_t compressed_buffer_size() {
+    return(compressBound(CAPTURE_BLOCK_SIZE) + 32);
+}
+
+static void add_data_buffers(uint64_t count) {
+    std::vector<char*> buffers;
+    for(uint64_t i = 0; i < count; i++)
+        buffers.push_back(new char[CAPTURE_BLOCK_SIZE]);
+    MyGuard guard(buffer_pool_lock);
+    num_data_buffers += count;
+    free_data_buffers.reserve(num_data_buffers);
+    for(auto buffer: buffers)
+        free_data_buffers.push_back(buffer);
+}
+
+// -----------------------------------------------------------------------
+// Frees up to count data buffers, the ones in use by other writers stay
+// -----------------------------------------------------------------------
+static void remove_data_buffers(uint64_t count) {
+    std::vector<char*> buffers;
+    buffer_pool_lock.acquire_lock();
+    while((count > 0) && ! free_data_buffers.empty()){
+        buffers.push_back(free_data_buffers.back());
+        free_data_buffers.pop_back();
+        num_data_buffers--;
+        count--;
+    }
+    buffer_pool_lock.release_lock();
+    for(auto buffer: buffers)
+        delete[] buffer;
+}
+
+// -----------------------------------------------------------------------
+// Keeps CAPTURE_POOL_MIN_FREE data buffers spare once there are compressed writers (capture thread)
+// -----------------------------------------------------------------------
+static void top_up_data_buffers() {
+    buffer_pool_lock.acquire_lock();
+    uint64_t num_free = free_data_buffers.size();
+    bool in_use = (num_data_buffers > 0);
+    buffer_pool_lock.release_lock();
+    if(in_use && (num_free < CAPTURE_POOL_MIN_FREE))
+        add_data_buffers(CAPTURE_POOL_MIN_FREE - num_free);
+}
+
+// nullptr when there is none spare, the feed thread drops the frame then
+static char *take_data_buffer() {
+    MyGuard guard(buffer_pool_lock);
+    if(free_data_buffers.empty())
+        return(nullptr);
+    char *buffer = free_data_buffers.back();
+    free_data_buffers.pop_back();
+    return(buffer);
+}
+
+static void give_data_buffer(char *buffer) {
+    MyGuard guard(buffer_pool_lock);
+    free_data_buffers.push_back(buffer);
+}
+
+// Only taken by the compression workers, which can wait for an allocation
+static char *take_compressed_buffer() {
+    buffer_pool_lock.acquire_lock();
+    char *buffer = nullptr;
+    if(! free_compressed_buffers.empty()){
+        buffer = free_compressed_buffers.back();
+        free_compressed_buffers.pop_back();
+    }
+    buffer_pool_lock.release_lock();
+    if(buffer == nullptr)
+        buffer = new char[compressed_buffer_size()];
+    return(buffer);
+}
+
+static void give_compressed_buffer(char *buffer) {
+    MyGuard guard(buffer_pool_lock);
+    free_compressed_buffers.push_back(buffer);
+}
+
+// -----------------------------------------------------------------------
+// Adds the writer to the capture thread, starting it the first time
+// -----------------------------------------------------------------------
+static void register_capture_writer(FileWriter *writer) {
+    MyGuard guard(capture_registry_lock);
+    capture_registry.push_back(writer);
+    if(capture_thread_started)
+        return;
+    capture_thread_started = true;
+    std::thread capture_thread([]() {
+        while(1){
+            uint64_t current_ts = get_capture_ts();
+            top_up_data_buffers();
+            capture_registry_lock.acquire_lock();
+            for(auto writer: capture_registry)
+                writer->service_capture(current_ts);
+            capture_registry_lock.release_lock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+    capture_thread.detach();
+}
+
+// -----------------------------------------------------------------------
+// Removes the writer from the capture thread
+// -----------------------------------------------------------------------
+static void unregister_capture_writer(FileWriter *writer) {
+    MyGuard guard(capture_registry_lock);
+    for(auto it = capture_registry.begin(); it != capture_registry.end(); it++){
+        if(*it == writer){
+            capture_registry.erase(it);
+            break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Compresses one block into a standalone gzip member (worker pool), the
+// data buffer goes back to the pool as soon as it is done with
+// -----------------------------------------------------------------------
+static void compress_block(z_stream *stream, capture_block *block) {
+    block->compressed = take_compressed_buffer();
+    block->compressed_size = compressed_buffer_size();
+    deflateReset(stream);
+    stream->next_in = (Bytef *) block->data;
+    stream->avail_in = block->length;
+    stream->next_out = (Bytef *) block->compressed;
+    stream->avail_out = block->compressed_size;
+    if(deflate(stream, Z_FINISH) == Z_STREAM_END)
+        block->compressed_length = block->compressed_size - stream->avail_out;
+    else
+        block->compressed_length = 0;
+    give_data_buffer(block->data);
+    block->data = nullptr;
+    block->state.store(CAPTURE_BLOCK_COMPRESSED, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------
+// Starts the compression workers the first time a compressed writer is created
+// -----------------------------------------------------------------------
+static void start_compress_workers() {
+    MyGuard guard(compress_queue_lock);
+    if(compress_workers_started)
+        return;
+    compress_workers_started = true;
+    for(int i = 0; i < CAPTURE_COMPRESS_THREADS; i++){
+        std::thread compress_thread([]() {
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            // windowBits + 16 gives a gzip wrapper rather than a zlib one
+            deflateInit2(&stream, CAPTURE_COMPRESSION_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+            while(1){
+                capture_block *block = nullptr;
+                capture_block **queued;
+                compress_queue_lock.acquire_lock();
+                if(compress_queue.GetPopPtr(&queued)){
+                    block = *queued;
+                    compress_queue.incrTail();
+                }
+                compress_queue_lock.release_lock();
+
+                if(block != nullptr)
+                    compress_block(&stream, block);
+                else
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        compress_thread.detach();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Writes the whole buffer, retrying on short writes
+// -----------------------------------------------------------------------
+static bool write_all(int fd, const char *buffer, uint64_t length) {
+    while(length > 0){
+        ssize_t written = write(fd, buffer, length);
+        if(written <= 0)
+            return(false);
+        buffer += written;
+        length -= written;
+    }
+    return(true);
+}
+
 FileWriter::FileWriter(std::string output_filename) {
-    writer_fh.open(output_filename, std::ios::out | std::ios::app); 
+    writer_fh.open(output_filename, std::ios::out | std::ios::app);
+}
+
+// -----------------------------------------------------------------------
+// Binary capture writer, either <base>.0000, <base>.0001 etc of segment_size_mb
+// each or a single compressed <base> with its block index in <base>.idx
+// -----------------------------------------------------------------------
+FileWriter::FileWriter(std::string output_filename, uint32_t _instrument_id, uint8_t _format, uint64_t segment_size_mb) {
+    format = _format;
+    base_filename = output_filename;
+    instrument_id = _instrument_id;
+    segment_size = segment_size_mb * 1024 * 1024;
+
+    if(format == CompressedCaptureFormat){
+        if(open_compressed(output_filename)){
+            add_data_buffers(CAPTURE_POOL_BUFFERS_PER_WRITER);
+            start_compress_workers();
+            register_capture_writer(this);
+        }
+        return;
+    }
+
+    // Continue after any segments already written today (restarts append, like the text files)
+    while(access(capture_segment_filename(base_filename, next_segment_number).c_str(), F_OK) == 0)
+        next_segment_number++;
+
+    // First segment is created here so the feed thread can write from the first message
+    active_segment = create_segment(next_segment_number++);
+    register_capture_writer(this);
 }
 
 FileWriter::~FileWriter() {
@@ -9,16 +245,401 @@ FileWriter::~FileWriter() {
         flush_file();
         writer_fh.close();
     }
+    if((format == CompressedCaptureFormat) && (capz_fd >= 0)){
+        unregister_capture_writer(this);
+        capture_block *filling = blocks[fill_seq % CAPTURE_BLOCKS_PER_WRITER];
+        if(filling->state.load() == CAPTURE_BLOCK_FILLING)
+            seal_block(filling);
+
+        // Wait for the workers to finish what is queued, then write it out ourselves
+        for(auto block: blocks)
+            while(block->state.load(std::memory_order_acquire) == CAPTURE_BLOCK_QUEUED)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        write_compressed_blocks();
+
+        close(capz_fd);
+        close(index_fd);
+        for(auto block: blocks)
+            delete(block);
+        remove_data_buffers(CAPTURE_POOL_BUFFERS_PER_WRITER);
+    }
+    if(format == BinaryCaptureFormat){
+        unregister_capture_writer(this);
+        capture_segment **retired;
+        while(retired_segments.GetPopPtr(&retired)){
+            close_segment(*retired);
+            retired_segments.incrTail();
+        }
+        if(active_segment.load() != nullptr)
+            close_segment(active_segment.load());
+        // Never written to - remove it again
+        capture_segment *unused = next_segment.exchange(nullptr);
+        if(unused != nullptr){
+            std::string unused_filename = unused->filename;
+            unused->write_offset = 0;
+            close_segment(unused);
+            unlink(unused_filename.c_str());
+        }
+    }
 }
 
-void FileWriter::write_to_file(std::string_view dump_line, uint64_t recv_ts) {
+// -----------------------------------------------------------------------
+// Creates, preallocates and maps a new segment file
+// -----------------------------------------------------------------------
+capture_segment *FileWriter::create_segment(uint32_t segment_number) {
+    capture_segment *segment = new capture_segment();
+    segment->filename = capture_segment_filename(base_filename, segment_number);
+    segment->segment_number = segment_number;
+    segment->size = segment_size;
+    segment->fd = open(segment->filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(segment->fd < 0){
+        std::cout << "Failed to create capture segment: " << segment->filename << std::endl;
+        delete(segment);
+        return(nullptr);
+    }
+
+    // Allocate the disk blocks up front and fault the pages in here rather than on the feed thread
+    if(posix_fallocate(segment->fd, 0, segment_size) != 0)
+        ftruncate(segment->fd, segment_size);
+    segment->base = (char *) mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, segment->fd, 0);
+    if(segment->base == MAP_FAILED){
+        std::cout << "Failed to map capture segment: " << segment->filename << std::endl;
+        close(segment->fd);
+        delete(segment);
+        return(nullptr);
+    }
+
+    capture_segment_header *header = (capture_segment_header *) segment->base;
+    memcpy(header->magic, CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CAPTURE_VERSION;
+    header->header_size = sizeof(capture_segment_header);
+    header->segment_size = segment_size;
+    header->data_end = sizeof(capture_segment_header);
+    header->created_timestamp = get_capture_ts();
+    header->segment_number = segment_number;
+    header->instrument_id = instrument_id;
+
+    segment->write_offset = sizeof(capture_segment_header);
+    segment->synced_offset = 0;
+    return(segment);
+}
+
+// -----------------------------------------------------------------------
+// Syncs, unmaps and truncates a segment to what was actually written
+// -----------------------------------------------------------------------
+void FileWriter::close_segment(capture_segment *segment) {
+    uint64_t data_end = segment->write_offset;
+    msync(segment->base, segment->size, MS_SYNC);
+    munmap(segment->base, segment->size);
+    ftruncate(segment->fd, data_end);
+    close(segment->fd);
+    delete(segment);
+}
+
+// -----------------------------------------------------------------------
+// Swaps in the segment prepared by the capture thread (feed thread)
+// -----------------------------------------------------------------------
+bool FileWriter::rotate_segment() {
+    capture_segment *segment = next_segment.exchange(nullptr);
+    if(segment == nullptr)
+        return(false);
+    capture_segment *old_segment = active_segment.load();
+    if(! retired_segments.tryEnqueue(std::move(old_segment))){
+        next_segment.store(segment);
+        return(false);
+    }
+    active_segment.store(segment);
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Appends one frame to the active segment, never blocks or allocates
+// -----------------------------------------------------------------------
+void FileWriter::write_frame(std::string_view dump_line, uint64_t recv_ts, uint8_t stream_kind) {
+    uint64_t frame_size = capture_frame_size(dump_line.length());
+    capture_segment *segment = active_segment.load(std::memory_order_relaxed);
+    if((segment == nullptr) || ((frame_size + sizeof(capture_segment_header)) > segment_size)){
+        dropped_frames++;
+        return;
+    }
+
+    uint64_t offset = segment->write_offset.load(std::memory_order_relaxed);
+    if((offset + frame_size) > segment->size){
+        if(! rotate_segment()){
+            // Capture thread has not caught up - better to lose a frame than stall the feed
+            dropped_frames++;
+            return;
+        }
+        segment = active_segment.load(std::memory_order_relaxed);
+        offset = segment->write_offset.load(std::memory_order_relaxed);
+    }
+
+    capture_frame_header *frame = (capture_frame_header *) (segment->base + offset);
+    frame->instrument_id = instrument_id;
+    frame->receive_timestamp = recv_ts;
+    frame->stream_kind = stream_kind;
+    frame->flags = 0;
+    memcpy((char *) frame + sizeof(capture_frame_header), dump_line.data(), dump_line.length());
+    // Length goes in last, a reader treats length 0 as end of data
+    frame->length = dump_line.length();
+
+    ((capture_segment_header *) segment->base)->data_end = offset + frame_size;
+    segment->write_offset.store(offset + frame_size, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------
+// Opens the compressed capture and its index for append and sets up the blocks
+// -----------------------------------------------------------------------
+bool FileWriter::open_compressed(std::string output_filename) {
+    capz_fd = open(output_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    index_fd = open((output_filename + CAPTURE_INDEX_SUFFIX).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if((capz_fd < 0) || (index_fd < 0)){
+        std::cout << "Failed to open compressed capture: " << output_filename << std::endl;
+        if(capz_fd >= 0)
+            close(capz_fd);
+        if(index_fd >= 0)
+            close(index_fd);
+        capz_fd = -1;
+        index_fd = -1;
+        return(false);
+    }
+    // Restarts append, the index offsets continue from the end of the existing file
+    capz_offset = lseek(capz_fd, 0, SEEK_END);
+
+    // Buffers are taken from the pool as they are needed
+    for(auto &block: blocks){
+        block = new capture_block();
+        block->writer = this;
+        block->state = CAPTURE_BLOCK_FREE;
+        block->data = nullptr;
+        block->compressed = nullptr;
+        block->compressed_size = 0;
+    }
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Hands a filled block over to the compression workers - by whichever
+// thread has it in WRITING, the feed thread or the capture thread
+// -----------------------------------------------------------------------
+void FileWriter::seal_block(capture_block *block) {
+    // Moves on first, so once the block is out of WRITING fill_seq is past it
+    fill_seq.fetch_add(1, std::memory_order_release);
+    block->state.store(CAPTURE_BLOCK_QUEUED, std::memory_order_release);
+    compress_queue_lock.acquire_lock();
+    bool queued = compress_queue.tryEnqueue(std::move(block));
+    compress_queue_lock.release_lock();
+    if(! queued){
+        // Keep the block order intact for the capture thread, it skips empty blocks
+        dropped_frames += block->num_frames;
+        block->compressed_length = 0;
+        give_data_buffer(block->data);
+        block->data = nullptr;
+        block->state.store(CAPTURE_BLOCK_COMPRESSED, std::memory_order_release);
+    }
+}
+
+// -----------------------------------------------------------------------
+// The block to write the next frame into, in WRITING - nullptr if there is
+// none (feed thread). A filling block that can't be taken has been sealed
+// by the capture thread, the one after it is looked at then.
+// -----------------------------------------------------------------------
+capture_block *FileWriter::claim_block(uint64_t recv_ts) {
+    for(int attempt = 0; attempt < 2; attempt++){
+        uint64_t seq = fill_seq.load(std::memory_order_acquire);
+        capture_block *block = blocks[seq % CAPTURE_BLOCKS_PER_WRITER];
+        uint8_t state = CAPTURE_BLOCK_FILLING;
+        if(block->state.compare_exchange_strong(state, CAPTURE_BLOCK_WRITING, std::memory_order_acquire))
+            return(block);
+        if(state == CAPTURE_BLOCK_WRITING){
+            // The capture thread is sealing it right now, that only takes a moment
+            while(fill_seq.load(std::memory_order_acquire) == seq)
+                ;
+            continue;
+        }
+        if(state == CAPTURE_BLOCK_FREE){
+            // Only the feed thread starts blocks, nothing else touches a free one
+            block->data = take_data_buffer();
+            if(block->data == nullptr)
+                return(nullptr);
+            block->length = 0;
+            block->num_frames = 0;
+            block->first_timestamp = recv_ts;
+            block->state.store(CAPTURE_BLOCK_WRITING, std::memory_order_relaxed);
+            return(block);
+        }
+        // Still queued or compressed from the last time round - compression or disk has not caught up
+        if(fill_seq.load(std::memory_order_acquire) == seq)
+            return(nullptr);
+    }
+    return(nullptr);
+}
+
+// -----------------------------------------------------------------------
+// Appends one frame to the current block, never blocks or allocates
+// -----------------------------------------------------------------------
+void FileWriter::write_block_frame(std::string_view dump_line, uint64_t recv_ts, uint8_t stream_kind) {
+    uint64_t frame_size = capture_frame_size(dump_line.length());
+    if((capz_fd < 0) || (frame_size > CAPTURE_BLOCK_SIZE)){
+        dropped_frames++;
+        return;
+    }
+
+    capture_block *block = claim_block(recv_ts);
+    if((block != nullptr) && ((block->length + frame_size) > CAPTURE_BLOCK_SIZE)){
+        seal_block(block);
+        block = claim_block(recv_ts);
+    }
+    if(block == nullptr){
+        // Better to lose a frame than stall the feed
+        dropped_frames++;
+        return;
+    }
+
+    capture_frame_header *frame = (capture_frame_header *) (block->data + block->length);
+    frame->length = dump_line.length();
+    frame->instrument_id = instrument_id;
+    frame->receive_timestamp = recv_ts;
+    frame->stream_kind = stream_kind;
+    frame->flags = 0;
+    frame->reserved = 0;
+    frame->reserved2 = 0;
+    memcpy((char *) frame + sizeof(capture_frame_header), dump_line.data(), dump_line.length());
+    memset((char *) frame + sizeof(capture_frame_header) + dump_line.length(), 0, frame_size - sizeof(capture_frame_header) - dump_line.length());
+    block->length += frame_size;
+    block->last_timestamp = recv_ts;
+    block->num_frames++;
+
+    // Blocks of feeds that go quiet are sealed by the capture thread
+    if((recv_ts - block->first_timestamp) > CAPTURE_BLOCK_MAX_AGE_NS)
+        seal_block(block);
+    else
+        block->state.store(CAPTURE_BLOCK_FILLING, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------
+// Seals the block being filled once it is CAPTURE_BLOCK_MAX_AGE_NS old or a
+// flush asked for it, so quiet feeds get to disk without the next message
+// (capture thread). If the feed thread is writing into it right now it is
+// left to the next pass.
+// -----------------------------------------------------------------------
+void FileWriter::seal_idle_block(uint64_t current_ts) {
+    capture_block *block = blocks[fill_seq.load(std::memory_order_acquire) % CAPTURE_BLOCKS_PER_WRITER];
+    if(block->state.load(std::memory_order_acquire) != CAPTURE_BLOCK_FILLING)
+        return;
+    if(! seal_requested.load(std::memory_order_relaxed) && ((current_ts - block->first_timestamp) <= CAPTURE_BLOCK_MAX_AGE_NS))
+        return;
+    uint8_t state = CAPTURE_BLOCK_FILLING;
+    if(block->state.compare_exchange_strong(state, CAPTURE_BLOCK_WRITING, std::memory_order_acquire)){
+        seal_requested.store(false, std::memory_order_relaxed);
+        seal_block(block);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Writes compressed blocks out in order and indexes them (capture thread)
+// -----------------------------------------------------------------------
+void FileWriter::write_compressed_blocks() {
+    while(1){
+        capture_block *block = blocks[write_seq % CAPTURE_BLOCKS_PER_WRITER];
+        if(block->state.load(std::memory_order_acquire) != CAPTURE_BLOCK_COMPRESSED)
+            break;
+
+        if(block->compressed_length > 0){
+            if(write_all(capz_fd, block->compressed, block->compressed_length)){
+                capture_block_index_entry entry;
+                entry.file_offset = capz_offset;
+                entry.compressed_length = block->compressed_length;
+                entry.uncompressed_length = block->length;
+                entry.first_timestamp = block->first_timestamp;
+                entry.last_timestamp = block->last_timestamp;
+                entry.num_frames = block->num_frames;
+                entry.instrument_id = instrument_id;
+                write_all(index_fd, (char *) &entry, sizeof(entry));
+                capz_offset += block->compressed_length;
+            } else {
+                std::cout << "Failed to write compressed capture block for: " << base_filename << std::endl;
+                dropped_frames += block->num_frames;
+                // Keep the offsets in the index right after a partial write
+                capz_offset = lseek(capz_fd, 0, SEEK_END);
+            }
+        }
+        if(block->compressed != nullptr){
+            give_compressed_buffer(block->compressed);
+            block->compressed = nullptr;
+        }
+        block->state.store(CAPTURE_BLOCK_FREE, std::memory_order_release);
+        write_seq++;
+    }
+}
+
+void FileWriter::write_to_file(std::string_view dump_line, uint64_t recv_ts, uint8_t stream_kind) {
     if(dump_line.length() > 3){
-        std::string new_string = std::to_string(recv_ts) + ":" + std::string(dump_line) + "\n";
-        writer_fh << new_string;
-        // writer_fh << recv_ts << ":" << dump_line << "\n";
+        if(format == BinaryCaptureFormat){
+            write_frame(dump_line, recv_ts, stream_kind);
+        } else if(format == CompressedCaptureFormat){
+            write_block_frame(dump_line, recv_ts, stream_kind);
+        } else {
+            writer_fh << recv_ts << ':';
+            writer_fh.write(dump_line.data(), dump_line.length());
+            writer_fh.put('\n');
+        }
     }
 }
 
 void FileWriter::flush_file() {
-    writer_fh.flush();
-}
\ No newline at end of file
+    if(format == BinaryCaptureFormat){
+        // The capture thread syncs the active segment, force it on the next pass
+        last_sync_time = 0;
+    } else if(format == CompressedCaptureFormat){
+        // The capture thread seals the block being filled on its next pass
+        seal_requested = true;
+    } else {
+        writer_fh.flush();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Capture thread work: seal idle blocks and write out compressed ones, or for
+// segments prepare the next one, close retired ones and msync the active one
+// about once a second
+// -----------------------------------------------------------------------
+void FileWriter::service_capture(uint64_t current_ts) {
+    if(format == CompressedCaptureFormat){
+        seal_idle_block(current_ts);
+        write_compressed_blocks();
+        return;
+    }
+
+    if(next_segment.load() == nullptr){
+        capture_segment *segment = create_segment(next_segment_number);
+        if(segment != nullptr){
+            next_segment_number++;
+            next_segment.store(segment);
+        }
+    }
+
+    capture_segment **retired;
+    while(retired_segments.GetPopPtr(&retired)){
+        close_segment(*retired);
+        retired_segments.incrTail();
+    }
+
+    if((current_ts - last_sync_time) > 1000000000L){
+        last_sync_time = current_ts;
+        capture_segment *segment = active_segment.load();
+        if(segment == nullptr)
+            return;
+        uint64_t write_offset = segment->write_offset.load(std::memory_order_acquire);
+        if(write_offset > segment->synced_offset){
+            uint64_t page_size = sysconf(_SC_PAGESIZE);
+            uint64_t sync_start = segment->synced_offset & ~(page_size - 1);
+            msync(segment->base + sync_start, write_offset - sync_start, MS_ASYNC);
+            segment->synced_offset = write_offset;
+        }
+    }
+}
+
+uint64_t FileWriter::get_dropped_frames() {
+    return(dropped_frames);
+}
@@ -0,0 +1,145 @@
+#include "latency_histogram.hpp"
+
+// -----------------------------------------------------------------------
+// Creates /got_latency_<process_name>_<pid> big enough for max_slots
+// -----------------------------------------------------------------------
+LatencyRecorder::LatencyRecorder(std::string process_name, uint32_t max_slots) {
+    shm_name = LATENCY_SHM_PREFIX + process_name + "_" + std::to_string(getpid());
+    region_size = sizeof(latency_shm_header) + ((uint64_t) max_slots * sizeof(latency_slot));
+
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        std::cout << "Failed to create latency shared memory: " << shm_name << std::endl;
+        return;
+    }
+    // Pages are only backed once a slot is used, so a generous max_slots costs nothing
+    if(ftruncate(fd, region_size) != 0){
+        std::cout << "Failed to size latency shared memory: " << shm_name << std::endl;
+        close(fd);
+        return;
+    }
+    char *region = (char *) mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED){
+        std::cout << "Failed to map latency shared memory: " << shm_name << std::endl;
+        return;
+    }
+
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    header = (latency_shm_header *) region;
+    slots = (latency_slot *) (region + sizeof(latency_shm_header));
+    header->version = LATENCY_SHM_VERSION;
+    header->max_slots = max_slots;
+    header->num_buckets = LATENCY_BUCKETS;
+    header->sub_bucket_bits = LATENCY_SUB_BUCKET_BITS;
+    header->num_slots_used = 0;
+    header->writer_pid = getpid();
+    header->start_timestamp = (t.tv_sec*1000000000L)+t.tv_nsec;
+    strncpy(header->process_name, process_name.c_str(), sizeof(header->process_name) - 1);
+    // Magic goes in last so a reader never sees a half initialised header as valid
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, LATENCY_SHM_MAGIC, sizeof(header->magic));
+}
+
+LatencyRecorder::~LatencyRecorder() {
+    if(header != nullptr){
+        munmap(header, region_size);
+        shm_unlink(shm_name.c_str());
+    }
+}
+
+// -----------------------------------------------------------------------
+// Returns the slot for an instrument/stream kind, allocating it the first time
+// Returns nullptr if the region could not be created or is full
+// -----------------------------------------------------------------------
+latency_slot *LatencyRecorder::get_slot(uint32_t instrument_id, uint8_t stream_kind) {
+    uint64_t key = ((uint64_t) instrument_id << 8) | stream_kind;
+    auto found = slot_map.find(key);
+    if(found != slot_map.end())
+        return(found->second);
+
+    latency_slot *slot = nullptr;
+    if((header != nullptr) && (header->num_slots_used.load() < header->max_slots)){
+        uint32_t slot_number = header->num_slots_used.load();
+        slot = &slots[slot_number];
+        slot->instrument_id = instrument_id;
+        slot->stream_kind = stream_kind;
+        // Publish the slot to readers once it is filled in
+        header->num_slots_used.store(slot_number + 1, std::memory_order_release);
+    }
+    slot_map[key] = slot;
+    return(slot);
+}
+
+std::string LatencyRecorder::get_shm_name() {
+    return(shm_name);
+}
+
+// -----------------------------------------------------------------------
+// Maps a region created by a LatencyRecorder read only
+// -----------------------------------------------------------------------
+LatencyReader::LatencyReader(std::string shm_name) {
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        return;
+    struct stat shm_stat;
+    if((fstat(fd, &shm_stat) != 0) || (shm_stat.st_size < (off_t) sizeof(latency_shm_header))){
+        close(fd);
+        return;
+    }
+    char *region = (char *) mmap(NULL, shm_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED)
+        return;
+
+    region_size = shm_stat.st_size;
+    header = (latency_shm_header *) region;
+    if( (memcmp(header->magic, LATENCY_SHM_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->num_buckets != LATENCY_BUCKETS) ||
+        (region_size < sizeof(latency_shm_header) + ((uint64_t) header->max_slots * sizeof(latency_slot)))){
+        munmap(region, region_size);
+        header = nullptr;
+        return;
+    }
+    slots = (latency_slot *) (region + sizeof(latency_shm_header));
+}
+
+LatencyReader::~LatencyReader() {
+    if(header != nullptr)
+        munmap(header, region_size);
+}
+
+bool LatencyReader::is_open() {
+    return(header != nullptr);
+}
+
+latency_shm_header *LatencyReader::get_header() {
+    return(header);
+}
+
+uint32_t LatencyReader::get_num_slots() {
+    return(header->num_slots_used.load(std::memory_order_acquire));
+}
+
+latency_slot *LatencyReader::get_slot(uint32_t slot_number) {
+    return(&slots[slot_number]);
+}
+
+// -----------------------------------------------------------------------
+// Latency in ns at the given percentile (0-100) from a copy of the buckets
+// -----------------------------------------------------------------------
+uint64_t LatencyReader::get_percentile(const uint64_t *buckets, uint64_t count, double percentile) {
+    if(count == 0)
+        return(0);
+    uint64_t wanted = (uint64_t) ((percentile / 100.0) * count);
+    if(wanted == 0)
+        wanted = 1;
+    uint64_t seen = 0;
+    for(uint32_t i = 0; i < LATENCY_BUCKETS; i++){
+        seen += buckets[i];
+        if(seen >= wanted)
+            return(latency_bucket_value(i));
+    }
+    return(latency_bucket_value(LATENCY_BUCKETS - 1));
+}
@@ -0,0 +1,193 @@
+#include <getopt.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <dirent.h>
+#include <signal.h>
+#include "latency_histogram.hpp"
+#include "capture_format.hpp"
+#include "trace_context.hpp"
+
+const char *hop_names[LATENCY_NUM_HOPS] = {"exch->recv", "recv->decode", "decode->pub"};
+const char *stream_names[] = {"unknown", "depth", "trade", "bookticker", "markprice", "forceorder", "snapshot"};
+// Tick to trade slots of the trade adapters, TRACE_STREAM_DECISION onwards
+const char *trace_hop_names[][LATENCY_NUM_HOPS] = {
+    {"tick->pub", "pub->strategy", "strategy->oe"},
+    {"oe->send", "send->ack", "tick->ack"},
+    {"send->fill", "ack->fill", "tick->fill"}};
+const char *trace_stream_names[] = {"decision", "order", "fill"};
+
+// Copy of one histogram so two reads can be diffed for a window
+struct histogram_copy {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t below_zero;
+    uint64_t buckets[LATENCY_BUCKETS];
+};
+
+void print_options(){
+    std::cout << "Options for latency_reader:" << std::endl;
+    std::cout << "  [-n (--name) <SHM_NAME>]                                = Region to read, e.g. /got_latency_svc_md_binance_1234 (default all)" << std::endl;
+    std::cout << "  [-i (--instrument) <instrument-id>]                     = Only print this instrument ID" << std::endl;
+    std::cout << "  [-w (--window) <SECONDS>]                               = Print the latencies seen during this window instead of since start" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+// -----------------------------------------------------------------------
+// Finds all latency regions in /dev/shm
+// -----------------------------------------------------------------------
+std::vector<std::string> find_regions() {
+    std::vector<std::string> regions;
+    std::string prefix = std::string(LATENCY_SHM_PREFIX).substr(1);
+    DIR *shm_dir = opendir("/dev/shm");
+    if(shm_dir == NULL)
+        return(regions);
+    struct dirent *entry;
+    while((entry = readdir(shm_dir)) != NULL){
+        if(std::string(entry->d_name).rfind(prefix, 0) == 0)
+            regions.push_back("/" + std::string(entry->d_name));
+    }
+    closedir(shm_dir);
+    return(regions);
+}
+
+// -----------------------------------------------------------------------
+// Takes a copy of all slots in the region
+// -----------------------------------------------------------------------
+void copy_region(LatencyReader *reader, std::vector<histogram_copy> &copies) {
+    uint32_t num_slots = reader->get_num_slots();
+    copies.resize(num_slots * LATENCY_NUM_HOPS);
+    for(uint32_t slot_number = 0; slot_number < num_slots; slot_number++){
+        latency_slot *slot = reader->get_slot(slot_number);
+        for(int hop = 0; hop < LATENCY_NUM_HOPS; hop++){
+            latency_histogram *histogram = &slot->hops[hop];
+            histogram_copy *copy = &copies[(slot_number * LATENCY_NUM_HOPS) + hop];
+            copy->count = histogram->count.load(std::memory_order_acquire);
+            copy->sum = histogram->sum.load(std::memory_order_relaxed);
+            copy->max = histogram->max.load(std::memory_order_relaxed);
+            copy->below_zero = histogram->below_zero.load(std::memory_order_relaxed);
+            for(int i = 0; i < LATENCY_BUCKETS; i++)
+                copy->buckets[i] = histogram->buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Prints one region, diffing against the earlier copy when given a window
+// -----------------------------------------------------------------------
+void print_region(std::string shm_name, LatencyReader *reader, std::vector<histogram_copy> &copies, std::vector<histogram_copy> *earlier, uint32_t instrument_id) {
+    latency_shm_header *header = reader->get_header();
+    std::cout << shm_name << " (" << header->process_name << ", pid " << header->writer_pid;
+    if(kill(header->writer_pid, 0) != 0)
+        std::cout << " - no longer running";
+    std::cout << ")" << std::endl;
+    std::cout << std::setw(12) << "instrument" << std::setw(12) << "stream" << std::setw(14) << "hop";
+    std::cout << std::setw(12) << "count" << std::setw(10) << "avg_us" << std::setw(10) << "p50_us" << std::setw(10) << "p90_us";
+    std::cout << std::setw(10) << "p99_us" << std::setw(10) << "p99.9_us" << std::setw(12) << "max_us" << std::setw(10) << "skewed" << std::endl;
+
+    uint32_t num_slots = copies.size() / LATENCY_NUM_HOPS;
+    for(uint32_t slot_number = 0; slot_number < num_slots; slot_number++){
+        latency_slot *slot = reader->get_slot(slot_number);
+        if((instrument_id != 0) && (slot->instrument_id != instrument_id))
+            continue;
+        for(int hop = 0; hop < LATENCY_NUM_HOPS; hop++){
+            histogram_copy copy = copies[(slot_number * LATENCY_NUM_HOPS) + hop];
+            if((earlier != nullptr) && (((slot_number * LATENCY_NUM_HOPS) + hop) < earlier->size())){
+                histogram_copy *before = &(*earlier)[(slot_number * LATENCY_NUM_HOPS) + hop];
+                copy.count -= before->count;
+                copy.sum -= before->sum;
+                copy.below_zero -= before->below_zero;
+                for(int i = 0; i < LATENCY_BUCKETS; i++)
+                    copy.buckets[i] -= before->buckets[i];
+            }
+            if(copy.count == 0)
+                continue;
+
+            std::cout << std::setw(12) << slot->instrument_id;
+            if((slot->stream_kind >= TRACE_STREAM_DECISION) && (slot->stream_kind <= TRACE_STREAM_FILL)){
+                uint8_t trace_kind = slot->stream_kind - TRACE_STREAM_DECISION;
+                std::cout << std::setw(12) << trace_stream_names[trace_kind] << std::setw(14) << trace_hop_names[trace_kind][hop];
+            } else {
+                uint8_t stream_kind = (slot->stream_kind <= CAPTURE_STREAM_SNAPSHOT) ? slot->stream_kind : 0;
+                std::cout << std::setw(12) << stream_names[stream_kind] << std::setw(14) << hop_names[hop];
+            }
+            std::cout << std::setw(12) << copy.count << std::fixed << std::setprecision(1);
+            std::cout << std::setw(10) << (copy.sum / (double) copy.count) / 1000.0;
+            std::cout << std::setw(10) << LatencyReader::get_percentile(copy.buckets, copy.count, 50.0) / 1000.0;
+            std::cout << std::setw(10) << LatencyReader::get_percentile(copy.buckets, copy.count, 90.0) / 1000.0;
+            std::cout << std::setw(10) << LatencyReader::get_percentile(copy.buckets, copy.count, 99.0) / 1000.0;
+            std::cout << std::setw(10) << LatencyReader::get_percentile(copy.buckets, copy.count, 99.9) / 1000.0;
+            // Max is since start, a window can not take it out
+            std::cout << std::setw(12) << copy.max / 1000.0 << std::setw(10) << copy.below_zero << std::endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int option;
+    std::string shm_name = "";
+    uint32_t instrument_id = 0;
+    int window_seconds = 0;
+
+    static struct option long_options[] = {
+        {"name"         , optional_argument, NULL, 'n'},
+        {"instrument"   , optional_argument, NULL, 'i'},
+        {"window"       , optional_argument, NULL, 'w'},
+        {"help"         , optional_argument, NULL,'h'}};
+
+    while((option = getopt_long(argc, argv, "n:i:w:h", long_options, NULL)) != -1) {
+        switch (option) {
+            case 'h':
+                print_options();
+                exit(0);
+
+            case 'n':
+                shm_name = optarg;
+            break;
+
+            case 'i':
+                instrument_id = std::stoul(optarg);
+            break;
+
+            case 'w':
+                window_seconds = atoi(optarg);
+            break;
+
+            default:
+            break;
+        }
+    }
+
+    std::vector<std::string> regions;
+    if(shm_name != "")
+        regions.push_back(shm_name);
+    else
+        regions = find_regions();
+
+    std::vector<LatencyReader*> readers;
+    std::vector<std::vector<histogram_copy>> earlier(regions.size());
+    for(uint32_t i = 0; i < regions.size(); i++){
+        readers.push_back(new LatencyReader(regions[i]));
+        if(! readers[i]->is_open())
+            std::cout << "Could not open latency region: " << regions[i] << std::endl;
+        else if(window_seconds > 0)
+            copy_region(readers[i], earlier[i]);
+    }
+
+    if(window_seconds > 0)
+        std::this_thread::sleep_for(std::chrono::seconds(window_seconds));
+
+    for(uint32_t i = 0; i < regions.size(); i++){
+        if(! readers[i]->is_open())
+            continue;
+        std::vector<histogram_copy> copies;
+        copy_region(readers[i], copies);
+        print_region(regions[i], readers[i], copies, (window_seconds > 0) ? &earlier[i] : nullptr, instrument_id);
+        delete(readers[i]);
+    }
+    return(0);
+}
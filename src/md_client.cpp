@@ -8,14 +8,52 @@
 #include <getopt.h>
 #include <chrono>
 #include <thread>
+#include <unordered_set>
+#include <vector>
 #include "logger.hpp"
 #include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
 #include "to_aeron.hpp"
 #include "merged_orderbook.hpp"
+#include "diff_replay_buffer.hpp"
 #include "PLUpdates.h"
 
 static const int FRAGMENTS_LIMIT = 10;
 
+#define SNAPSHOT_RETRY_MS   1000
+#define SNAPSHOT_MAX_TOB_ONLY_REQUESTS 5    // then a book without depth updates is taken as ToB only
+
+#define BOOK_PENDING        1       // waiting for a snapshot, AERON_IO depth updates are buffered
+#define BOOK_LIVE           2       // in sync, AERON_IO updates are applied
+
+// Where the snapshot replies of an instrument on AERON_SS are, a reply is only collected from its first part
+#define SERIES_UNKNOWN      0       // nothing seen yet, we may have joined in the middle of one
+#define SERIES_AT_START     1       // the next part starts a reply
+#define SERIES_IN_SERIES    2       // in the middle of a reply
+
+struct client_book {
+    MergedOrderbook *book;
+    uint8_t state;
+    bool snapshot_in_progress;      // part of a multi message snapshot reply is in the book
+    uint64_t snapshot_seq;          // of the reply being collected, all its parts carry the same one
+    uint64_t last_end_seq;          // of the last depth update seen on AERON_IO
+    uint64_t live_from_seq;         // updates ending before this are already in the book
+    uint64_t request_time;          // 0 when queued to be requested
+    uint32_t num_requests;
+};
+
+// Instruments joining late - their AERON_IO updates are buffered until a snapshot from
+// AERON_SS is in, while everything else keeps streaming
+struct late_join_state {
+    DiffReplayBuffer *diff_replay;
+    std::unordered_set<uint32_t> pending;
+    // SERIES_ per instrument, of every reply on AERON_SS whoever asked for it
+    std::unordered_map<uint32_t, uint8_t> series_position;
+    std::vector<uint32_t> request_queue;
+    uint64_t num_requested = 0;
+    uint64_t num_live = 0;
+};
+
 void print_options(){
     std::cout << "Options for md_client:" << std::endl;
     std::cout << "  -E (--environment) <PROD|UAT>                           = Sets to Prod or UAT config (need one of them)" << std::endl;
@@ -28,48 +66,115 @@ uint64_t get_current_ts() {
   return((t.tv_sec*1000000000L)+t.tv_nsec);
 }
 
-void get_snapshot_for_instrument(MergedOrderbook *pl_book, uint32_t instrument_id, to_aeron *to_aeron_ss) {
-    bool                                finished = false;
-    DepthSnapshotRequest                snap_request;
-
-    aeron::Context                      snap_context;
-    std::shared_ptr<Aeron>              snap_aeron = Aeron::connect(snap_context);
-    std::int64_t                        snap_channel_id = snap_aeron->addSubscription("aeron:ipc", AERON_SS);
-    std::shared_ptr<Subscription>       snap_subscription = snap_aeron->findSubscription(snap_channel_id);
-
-    // First clear the orderbook
-    pl_book->clear_orderbook();
-    snap_request.msg_header = {sizeof(DepthSnapshotRequest), DEPTH_SNAPSHOT_REQUEST, 1};
-    snap_request.instrument_id = instrument_id;
+// -----------------------------------------------------------------------
+// Returns the book for the instrument, a new one starts pending and is queued for a snapshot
+// -----------------------------------------------------------------------
+client_book *get_book(std::unordered_map<uint32_t, client_book *> &pl_books, uint32_t instrument_id, late_join_state *late_join) {
+    auto item = pl_books.find(instrument_id);
+    if(item != pl_books.end())
+        return(item->second);
 
-    while (!snap_subscription) {
-      snap_subscription = snap_aeron->findSubscription(snap_channel_id);
-    }
+    client_book *book = new client_book();
+    book->book = new MergedOrderbook();
+    book->state = BOOK_PENDING;
+    pl_books[instrument_id] = book;
+    late_join->pending.insert(instrument_id);
+    late_join->request_queue.push_back(instrument_id);
+    return(book);
+}
 
-    // Fragment handler lambda, putting it here so I can easily pass extra variables..:)
-    auto snap_fragment_lambda = [&pl_book, &instrument_id, &finished](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
-        struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
-        if(m->msgType == PL_UPDATE) {
-            struct PLUpdates *pl_update = (struct PLUpdates*)m;
-            if(pl_update->instrument_id == instrument_id){
-                // Process update
-                pl_book->process_update(pl_update);
-                // Check if this is the last message from the series
-                if(pl_update->update_flags & PL_UPDATE_LAST_MSG_IN_SERIES){
-                    // Set this to true so the loop has finished
-                    finished = true;
-                }
-            }
+// -----------------------------------------------------------------------
+// Sends the queued snapshot requests, up to MAX_SNAPSHOT_REQUEST_INSTRUMENTS per message
+// -----------------------------------------------------------------------
+void send_snapshot_requests(std::unordered_map<uint32_t, client_book *> &pl_books, late_join_state *late_join, to_aeron *to_aeron_ss) {
+    if(late_join->request_queue.empty())
+        return;
+    uint64_t now = get_current_ts();
+    DepthSnapshotRequestMulti snap_request;
+    snap_request.num_instruments = 0;
+    for(auto instrument_id: late_join->request_queue){
+        client_book *book = pl_books[instrument_id];
+        if(book->state != BOOK_PENDING)
+            continue;
+        book->request_time = now;
+        book->num_requests++;
+        // Nothing of another reply seen, the first part that comes in is the start of ours
+        uint8_t &position = late_join->series_position[instrument_id];
+        if(position == SERIES_UNKNOWN)
+            position = SERIES_AT_START;
+        snap_request.instrument_ids[snap_request.num_instruments++] = instrument_id;
+        if(snap_request.num_instruments == MAX_SNAPSHOT_REQUEST_INSTRUMENTS){
+            snap_request.msg_header = {sizeof(DepthSnapshotRequestMulti), DEPTH_SNAPSHOT_REQUEST_MULTI, 1};
+            to_aeron_ss->send_data((char *) &snap_request, sizeof(DepthSnapshotRequestMulti));
+            snap_request.num_instruments = 0;
         }
-    };
+        late_join->num_requested++;
+    }
+    if(snap_request.num_instruments > 0){
+        uint16_t msg_length = sizeof(DepthSnapshotRequestMulti) - ((MAX_SNAPSHOT_REQUEST_INSTRUMENTS - snap_request.num_instruments) * sizeof(uint32_t));
+        snap_request.msg_header = {msg_length, DEPTH_SNAPSHOT_REQUEST_MULTI, 1};
+        to_aeron_ss->send_data((char *) &snap_request, msg_length);
+    }
+    late_join->request_queue.clear();
+}
 
-    to_aeron_ss->send_data((char *) &snap_request, sizeof(DepthSnapshotRequest));
+// -----------------------------------------------------------------------
+// Book is in sync from here on, anything on AERON_IO before from_seq is already in it
+// -----------------------------------------------------------------------
+void set_book_live(client_book *book, uint32_t instrument_id, uint64_t from_seq, late_join_state *late_join) {
+    book->state = BOOK_LIVE;
+    book->live_from_seq = from_seq;
+    late_join->pending.erase(instrument_id);
+    late_join->num_live++;
+}
 
-    while(finished == false) {
-      const int fragmentsRead = snap_subscription->poll(snap_fragment_lambda, FRAGMENTS_LIMIT);
-      usleep(10);
+// -----------------------------------------------------------------------
+// Queues pending instruments again when their snapshot has not come back in time
+// -----------------------------------------------------------------------
+void retry_snapshot_requests(std::unordered_map<uint32_t, client_book *> &pl_books, late_join_state *late_join) {
+    uint64_t now = get_current_ts();
+    std::vector<uint32_t> tob_only;
+    for(auto instrument_id: late_join->pending){
+        client_book *book = pl_books[instrument_id];
+        if((book->request_time == 0) || ((now - book->request_time) < (SNAPSHOT_RETRY_MS * 1000000L)))
+            continue;
+        // Nobody publishes depth for it (Kraken), nothing to snapshot
+        if((book->last_end_seq == 0) && (book->num_requests >= SNAPSHOT_MAX_TOB_ONLY_REQUESTS)){
+            tob_only.push_back(instrument_id);
+            continue;
+        }
+        if((book->num_requests % 10) == 0)
+            std::cout << "No snapshot for instrument " << instrument_id << " after " << book->num_requests << " requests" << std::endl;
+        // A reply that is still coming in is left alone, its parts may be in flight. If it never
+        // finishes the next one is told apart by its sequence number.
+        book->request_time = 0;
+        late_join->request_queue.push_back(instrument_id);
     }
+    for(auto instrument_id: tob_only)
+        set_book_live(pl_books[instrument_id], instrument_id, 0, late_join);
+}
 
+// -----------------------------------------------------------------------
+// A complete snapshot came in on AERON_SS, merge the buffered updates by sequence
+// -----------------------------------------------------------------------
+void finish_snapshot(client_book *book, uint32_t instrument_id, uint64_t snapshot_seq, late_join_state *late_join) {
+    if(! late_join->diff_replay->can_bridge(instrument_id, snapshot_seq)){
+        // Buffered updates start after the snapshot - ask for a newer one, the buffer is kept
+        late_join->request_queue.push_back(instrument_id);
+        return;
+    }
+    uint64_t last_applied_seq = 0;
+    bool replayed = late_join->diff_replay->replay(instrument_id, snapshot_seq, [&](PLUpdates *pl_update) {
+        book->book->process_update(pl_update);
+        last_applied_seq = pl_update->end_seq_number;
+    });
+    if(! replayed){
+        late_join->request_queue.push_back(instrument_id);
+        return;
+    }
+    // Without a replay the snapshot covers everything up to and including its sequence,
+    // otherwise later parts of the last replayed update may still be on their way
+    set_book_live(book, instrument_id, (last_applied_seq != 0) ? last_applied_seq : snapshot_seq + 1, late_join);
 }
 
 
@@ -77,14 +182,15 @@ void get_snapshot_for_instrument(MergedOrderbook *pl_book, uint32_t instrument_i
 // Main thread for MD_CLIENT
 // -----------------------------------------------------------------------
 int main(int argc, char** argv) {
-    // LogWorker                           *log_worker;
-    // Logger                              *logger;
-    // char                                snapshot_buffer[1024*1024];
+    LogWorker                               *log_worker;
     aeron::Context                          context;
     std::string                             environment_name = "PROD";
-    std::map<uint32_t, MergedOrderbook *>   pl_books;
+    std::unordered_map<uint32_t, client_book *> pl_books;
+    late_join_state                         late_join;
     uint64_t                                msg_counter = 0;
     uint64_t                                timestamp = 0;
+    uint64_t                                retry_timestamp = 0;
+    int                                     idle_count = 0;
     to_aeron                                *to_aeron_ss;
 
     static struct option long_options[] = {
@@ -93,17 +199,12 @@ int main(int argc, char** argv) {
 
     int ch;
     while((ch = getopt_long(argc, argv, "E:h", long_options, NULL)) != -1) {
-        std::string instrument_string;
-        std::stringstream instr_stringstream;
-        std::string cell;
-
         switch (ch) {
             case 'h':
                 print_options();
                 exit(0);
 
             case 'E':
-            // environment_given = true;
             environment_name = optarg;
             break;
 
@@ -112,7 +213,8 @@ int main(int argc, char** argv) {
         }
     }
 
-    to_aeron_ss = new to_aeron(AERON_SS);
+    log_worker = new LogWorker("md_client", "All_Exchanges", environment_name, true);
+    late_join.diff_replay = new DiffReplayBuffer(log_worker->get_new_logger("late_join"));
 
     std::shared_ptr<Aeron> aeron = Aeron::connect(context);
     std::int64_t channel_id = aeron->addSubscription("aeron:ipc", AERON_IO);
@@ -121,44 +223,42 @@ int main(int argc, char** argv) {
       subscription = aeron->findSubscription(channel_id);
     }
 
+    // One subscription for all snapshot replies, it lives as long as the client
+    std::int64_t snap_channel_id = aeron->addSubscription("aeron:ipc", AERON_SS);
+    std::shared_ptr<Subscription> snap_subscription = aeron->findSubscription(snap_channel_id);
+    while (!snap_subscription) {
+      snap_subscription = aeron->findSubscription(snap_channel_id);
+    }
+
     to_aeron_ss = new to_aeron(AERON_SS);
     timestamp = get_current_ts();
 
     // Fragment handler lambda, putting it here so I can easily pass extra variables..:)
-    auto fragment_lambda = [&pl_books, &msg_counter, &timestamp, &to_aeron_ss](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+    auto fragment_lambda = [&pl_books, &late_join, &msg_counter, &timestamp](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
         struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
         
         switch(m->msgType) {
             case TOB_UPDATE: {
                 struct ToBUpdate *tob_update = (struct ToBUpdate*)m;
-                auto item = pl_books.find(tob_update->instrument_id);
-                if(item != pl_books.end()){
-                    // we have the symbol orderbook..
-                    item->second->process_update(tob_update);
-                } else {
-                    auto new_book = new MergedOrderbook();
-                    get_snapshot_for_instrument(new_book, tob_update->instrument_id, to_aeron_ss);
-                    new_book->process_update(tob_update);
-                    pl_books[tob_update->instrument_id] = new_book;
-                }
+                client_book *book = get_book(pl_books, tob_update->instrument_id, &late_join);
+                // A pending book gets its touch from the snapshot and the buffered depth updates
+                if(book->state == BOOK_LIVE)
+                    book->book->process_update(tob_update);
                 msg_counter++;
-
             }
             break;
             
             case PL_UPDATE: {
                 struct PLUpdates *pl_update = (struct PLUpdates*)m;
-
-                auto item = pl_books.find(pl_update->instrument_id);
-                if(item != pl_books.end()){
-                    // we have the symbol orderbook..
-                    item->second->process_update(pl_update);
-                } else {
-                    auto new_book = new MergedOrderbook();
-                    get_snapshot_for_instrument(new_book, pl_update->instrument_id, to_aeron_ss);
-                    new_book->process_update(pl_update);
-                    pl_books[pl_update->instrument_id] = new_book;
+                client_book *book = get_book(pl_books, pl_update->instrument_id, &late_join);
+                if(book->state == BOOK_PENDING){
+                    if(book->last_end_seq == 0)
+                        book->last_end_seq = pl_update->start_seq_number - 1;
+                    late_join.diff_replay->add_update(pl_update->instrument_id, pl_update, book->last_end_seq);
+                } else if(pl_update->end_seq_number >= book->live_from_seq){
+                    book->book->process_update(pl_update);
                 }
+                book->last_end_seq = pl_update->end_seq_number;
                 msg_counter++;
             }
             break;
@@ -171,26 +271,89 @@ int main(int argc, char** argv) {
 
             case INSTRUMENT_CLEAR_BOOK: {
                 struct InstrumentClearBook *instr_clear = (struct InstrumentClearBook*)m;
-                auto item = pl_books.find(instr_clear->instrument_id);
-                if(item != pl_books.end()){
-                    // we have the symbol orderbook..
-                    item->second->clear_orderbook();
+                client_book *book = get_book(pl_books, instr_clear->instrument_id, &late_join);
+                book->book->clear_orderbook();
+                // The whole book follows on AERON_IO, no need for our own snapshot any more
+                if(book->state == BOOK_PENDING){
+                    late_join.diff_replay->clear(instr_clear->instrument_id);
+                    book->snapshot_in_progress = false;
+                    set_book_live(book, instr_clear->instrument_id, 0, &late_join);
                 }
+                book->live_from_seq = 0;
             }
             break;
         }
         if(msg_counter > 10000){
             auto new_ts = get_current_ts();
             auto messages_per_second = (msg_counter*1.0) / ((new_ts*1.0 - timestamp)/1000000000);
-            std::cout << "Messagerate: " << std::to_string(messages_per_second) << std::endl;
+            std::cout << "Messagerate: " << std::to_string(messages_per_second) << " - books live: " << std::to_string(pl_books.size() - late_join.pending.size());
+            std::cout << " pending: " << std::to_string(late_join.pending.size()) << " snapshots requested: " << std::to_string(late_join.num_requested) << std::endl;
             timestamp = new_ts;
             msg_counter = 0;
         }
     };
 
+    // Snapshot replies, whoever asked for them - any complete snapshot of a pending instrument will do,
+    // as long as we have it from its first part
+    auto snap_fragment_lambda = [&pl_books, &late_join](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+        struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
+        if(m->msgType != PL_UPDATE)
+            return;
+        struct PLUpdates *pl_update = (struct PLUpdates*)m;
+        bool last_part = pl_update->update_flags & PL_UPDATE_LAST_MSG_IN_SERIES;
+        uint8_t &position = late_join.series_position[pl_update->instrument_id];
+        uint8_t part_position = position;
+        position = last_part ? SERIES_AT_START : SERIES_IN_SERIES;
+
+        auto item = pl_books.find(pl_update->instrument_id);
+        if((item == pl_books.end()) || (item->second->state != BOOK_PENDING))
+            return;
+        client_book *book = item->second;
+        if(book->snapshot_in_progress && (pl_update->end_seq_number != book->snapshot_seq)){
+            // Another reply got mixed in with the one we were collecting, neither is complete
+            book->snapshot_in_progress = false;
+            book->book->clear_orderbook();
+            return;
+        }
+        if(! book->snapshot_in_progress){
+            // Joined in the middle of a reply, wait for the next one
+            if(part_position != SERIES_AT_START)
+                return;
+            book->book->clear_orderbook();
+            book->snapshot_in_progress = true;
+            book->snapshot_seq = pl_update->end_seq_number;
+        }
+        book->book->process_update(pl_update);
+        if(last_part){
+            book->snapshot_in_progress = false;
+            finish_snapshot(book, pl_update->instrument_id, pl_update->end_seq_number, &late_join);
+        }
+    };
+
     while(1) {
-      const int fragmentsRead = subscription->poll(fragment_lambda, FRAGMENTS_LIMIT);
-      usleep(10);
+      int fragments_read = subscription->poll(fragment_lambda, FRAGMENTS_LIMIT);
+      fragments_read += snap_subscription->poll(snap_fragment_lambda, FRAGMENTS_LIMIT);
+      if(! late_join.pending.empty()){
+          uint64_t now = get_current_ts();
+          if((now - retry_timestamp) > 100000000L){
+              retry_snapshot_requests(pl_books, &late_join);
+              retry_timestamp = now;
+          }
+      }
+      // Everything that became pending in this round goes out together
+      send_snapshot_requests(pl_books, &late_join, to_aeron_ss);
+
+      // Back off gradually when there is nothing to do
+      if(fragments_read == 0){
+          if(idle_count < 100)
+              idle_count++;
+          if(idle_count < 10)
+              std::this_thread::yield();
+          else
+              std::this_thread::sleep_for(std::chrono::microseconds(idle_count));
+      } else {
+          idle_count = 0;
+      }
     }
 
-}
\ No newline at end of file
+}
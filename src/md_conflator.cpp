@@ -0,0 +1,302 @@
+#include "md_conflator.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - starts reading AERON_IO and the interval publisher
+// -----------------------------------------------------------------------
+MDConflator::MDConflator(Logger *_logger, uint64_t interval_millis) {
+    logger = _logger;
+    interval_ns = interval_millis * 1000000L;
+    publish_buffer = (char*) malloc(sizeof(char) * CONFLATOR_BUFFER_SIZE);
+    to_aeron_cf = new to_aeron(AERON_CF);
+
+    start_publisher();
+
+    io_fh = std::bind(&MDConflator::process_io_messages, this);
+    from_aeron_io = new from_aeron(AERON_IO, io_fh);
+}
+
+// -----------------------------------------------------------------------
+// Returns current time in nanoseconds
+// -----------------------------------------------------------------------
+uint64_t MDConflator::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Returns conflation state for the instrument, created first time we see it
+// -----------------------------------------------------------------------
+conflated_instrument *MDConflator::get_instrument(uint32_t instrument_id, uint8_t exchange_id) {
+    auto it = instruments.find(instrument_id);
+    if(it != instruments.end())
+        return(it->second);
+
+    conflated_instrument *instrument = new conflated_instrument();
+    instrument->instrument_id = instrument_id;
+    instrument->exchange_id = exchange_id;
+    instrument->level_changes.reserve(2 * PL_UPDATE_MAX_DET_PER_MSG);
+    instruments[instrument_id] = instrument;
+    return(instrument);
+}
+
+// -----------------------------------------------------------------------
+// Records the net change of a level, snapshot levels are unique so they are just appended
+// -----------------------------------------------------------------------
+void MDConflator::add_level_change(conflated_instrument *instrument, PriceLevelDetails *pl_detail, bool is_snapshot) {
+    if(! is_snapshot){
+        for(auto &level: instrument->level_changes){
+            if((level.price_level == pl_detail->price_level) && (level.side == pl_detail->side)){
+                level = *pl_detail;
+                return;
+            }
+        }
+    }
+    instrument->level_changes.push_back(*pl_detail);
+}
+
+// -----------------------------------------------------------------------
+// Adds the trade to the aggregate for its side
+// -----------------------------------------------------------------------
+void MDConflator::add_trade(conflated_instrument *instrument, Trade *trade) {
+    int side_index = (trade->side == BUY_SIDE) ? 0 : ((trade->side == SELL_SIDE) ? 1 : 2);
+    conflated_trades *trades = &instrument->trades[side_index];
+
+    if(trades->num_trades == 0){
+        trades->first_receive_timestamp = trade->receive_timestamp;
+        memcpy(trades->exchange_trade_id_first, trade->exchange_trade_id_first, sizeof(trades->exchange_trade_id_first));
+    }
+    trades->num_trades++;
+    trades->qty += trade->qty;
+    trades->notional += trade->qty * trade->price;
+    trades->last_price = trade->price;
+    trades->last_receive_timestamp = trade->receive_timestamp;
+    trades->last_exchange_timestamp = trade->exchange_timestamp;
+    memcpy(trades->exchange_trade_id_last, trade->exchange_trade_id_last, sizeof(trades->exchange_trade_id_last));
+}
+
+// -----------------------------------------------------------------------
+// Fragment handler for AERON_IO - only updates state, publishing happens on the interval
+// -----------------------------------------------------------------------
+fragment_handler_t MDConflator::process_io_messages() {
+    return
+        [&](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+            struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
+
+            switch(m->msgType) {
+                case TOB_UPDATE: {
+                    struct ToBUpdate *t = (struct ToBUpdate*)m;
+                    MyGuard guard(instrument_lock);
+                    conflated_instrument *instrument = get_instrument(t->instrument_id, t->exchange_id);
+                    instrument->last_tob = *t;
+                    instrument->has_tob = true;
+                    instrument->dirty = true;
+                    instrument->num_source_messages++;
+                }
+                break;
+
+                case PL_UPDATE: {
+                    struct PLUpdates *p = (struct PLUpdates*)m;
+                    PriceLevelDetails *pl_details = (PriceLevelDetails *) ((char *) p + sizeof(PLUpdates));
+                    MyGuard guard(instrument_lock);
+                    conflated_instrument *instrument = get_instrument(p->instrument_id, p->exchange_id);
+                    if(! instrument->has_pl){
+                        instrument->start_seq_number = p->start_seq_number;
+                        instrument->has_pl = true;
+                    }
+                    instrument->end_seq_number = p->end_seq_number;
+                    instrument->pl_receive_timestamp = p->receive_timestamp;
+                    instrument->pl_exchange_timestamp = p->exchange_timestamp;
+                    for(int i = 0; i < p->num_of_pl_updates; i++)
+                        add_level_change(instrument, &pl_details[i], p->update_flags & PL_UPDATE_SNAPSHOT_MSG);
+                    instrument->dirty = true;
+                    instrument->num_source_messages++;
+                }
+                break;
+
+                case INSTRUMENT_CLEAR_BOOK: {
+                    struct InstrumentClearBook *c = (struct InstrumentClearBook*)m;
+                    MyGuard guard(instrument_lock);
+                    conflated_instrument *instrument = get_instrument(c->instrument_id, c->exchange_id);
+                    // Whatever changed before the clear does not matter any more
+                    instrument->level_changes.clear();
+                    instrument->has_pl = false;
+                    instrument->book_reset = true;
+                    instrument->clear_msg = *c;
+                    instrument->dirty = true;
+                    instrument->num_source_messages++;
+                }
+                break;
+
+                case TRADE: {
+                    struct Trade *t = (struct Trade*)m;
+                    MyGuard guard(instrument_lock);
+                    conflated_instrument *instrument = get_instrument(t->instrument_id, t->exchange_id);
+                    add_trade(instrument, t);
+                    instrument->dirty = true;
+                    instrument->num_source_messages++;
+                }
+                break;
+            }
+        };
+}
+
+// -----------------------------------------------------------------------
+// Returns space in the publish buffer for a message
+// -----------------------------------------------------------------------
+char *MDConflator::reserve(uint32_t length) {
+    char *msg_pointer = publish_buffer + publish_length;
+    publish_length += length;
+    publish_messages++;
+    return(msg_pointer);
+}
+
+// -----------------------------------------------------------------------
+// Writes the interval header and all conflated messages for the instrument, then resets it
+// -----------------------------------------------------------------------
+void MDConflator::serialise_instrument(conflated_instrument *instrument, uint64_t interval_start, uint64_t interval_end) {
+    uint64_t sending_timestamp = get_current_ts();
+    uint32_t messages_before = publish_messages;
+
+    ConflatedInterval *interval = (ConflatedInterval *) reserve(sizeof(ConflatedInterval));
+    interval->msg_header = {sizeof(ConflatedInterval), CONFLATED_INTERVAL, 1};
+    interval->stream_seq = ++stream_seq;
+    interval->interval_seq = ++instrument->interval_seq;
+    interval->interval_number = interval_end / interval_ns;
+    interval->interval_start = interval_start;
+    interval->interval_end = interval_end;
+    interval->start_seq_number = instrument->has_pl ? instrument->start_seq_number : 0;
+    interval->end_seq_number = instrument->has_pl ? instrument->end_seq_number : 0;
+    interval->instrument_id = instrument->instrument_id;
+    interval->exchange_id = instrument->exchange_id;
+    interval->num_source_messages = instrument->num_source_messages;
+    interval->flags = 0;
+
+    if(instrument->book_reset){
+        interval->flags |= CONFLATED_BOOK_RESET;
+        InstrumentClearBook *clear_msg = (InstrumentClearBook *) reserve(sizeof(InstrumentClearBook));
+        *clear_msg = instrument->clear_msg;
+        clear_msg->sending_timestamp = sending_timestamp;
+    }
+
+    if(instrument->has_pl && (! instrument->level_changes.empty())){
+        interval->flags |= CONFLATED_HAS_PL;
+        size_t num_levels = instrument->level_changes.size();
+        size_t level = 0;
+        while(level < num_levels){
+            uint16_t num_in_msg = std::min((size_t) PL_UPDATE_MAX_DET_PER_MSG, num_levels - level);
+            bool last_msg = (level + num_in_msg) == num_levels;
+            uint32_t msg_length = sizeof(PLUpdates) + (num_in_msg * sizeof(PriceLevelDetails));
+            PLUpdates *pl_updates = (PLUpdates *) reserve(msg_length);
+            pl_updates->msg_header = {msg_length, PL_UPDATE, 1};
+            pl_updates->receive_timestamp = instrument->pl_receive_timestamp;
+            pl_updates->exchange_timestamp = instrument->pl_exchange_timestamp;
+            pl_updates->sending_timestamp = sending_timestamp;
+            pl_updates->instrument_id = instrument->instrument_id;
+            pl_updates->exchange_id = instrument->exchange_id;
+            pl_updates->start_seq_number = instrument->start_seq_number;
+            pl_updates->end_seq_number = instrument->end_seq_number;
+            pl_updates->num_of_pl_updates = num_in_msg;
+            pl_updates->update_flags = 0;
+            if(num_levels > PL_UPDATE_MAX_DET_PER_MSG)
+                pl_updates->update_flags |= PL_UPDATE_MULTIPLE_MESSAGES;
+            if(last_msg)
+                pl_updates->update_flags |= PL_UPDATE_LAST_MSG_IN_SERIES;
+            // After a clear the net changes are the whole book
+            if(instrument->book_reset)
+                pl_updates->update_flags |= PL_UPDATE_SNAPSHOT_MSG;
+            memcpy((char *) pl_updates + sizeof(PLUpdates), &instrument->level_changes[level], num_in_msg * sizeof(PriceLevelDetails));
+            level += num_in_msg;
+        }
+    }
+
+    if(instrument->has_tob){
+        interval->flags |= CONFLATED_HAS_TOB;
+        ToBUpdate *tob_update = (ToBUpdate *) reserve(sizeof(ToBUpdate));
+        *tob_update = instrument->last_tob;
+        tob_update->sending_timestamp = sending_timestamp;
+    }
+
+    static const uint8_t trade_sides[3] = {BUY_SIDE, SELL_SIDE, UNKNOWN_SIDE};
+    for(int side_index = 0; side_index < 3; side_index++){
+        conflated_trades *trades = &instrument->trades[side_index];
+        if(trades->num_trades == 0)
+            continue;
+        interval->flags |= CONFLATED_HAS_TRADES;
+        Trade *trade_msg = (Trade *) reserve(sizeof(Trade));
+        memset(trade_msg, 0, sizeof(Trade));
+        trade_msg->msg_header = {sizeof(Trade), TRADE, 1};
+        trade_msg->receive_timestamp = trades->last_receive_timestamp;
+        trade_msg->exchange_timestamp = trades->last_exchange_timestamp;
+        trade_msg->sending_timestamp = sending_timestamp;
+        trade_msg->instrument_id = instrument->instrument_id;
+        trade_msg->exchange_id = instrument->exchange_id;
+        // Volume weighted price of everything that traded on this side in the interval
+        trade_msg->price = (trades->qty > 0) ? trades->notional / trades->qty : trades->last_price;
+        trade_msg->qty = trades->qty;
+        trade_msg->side = trade_sides[side_index];
+        trade_msg->is_aggregated_trade = true;
+        memcpy(trade_msg->exchange_trade_id_first, trades->exchange_trade_id_first, sizeof(trade_msg->exchange_trade_id_first));
+        memcpy(trade_msg->exchange_trade_id_last, trades->exchange_trade_id_last, sizeof(trade_msg->exchange_trade_id_last));
+        memset(trades, 0, sizeof(conflated_trades));
+    }
+
+    interval->num_messages = publish_messages - messages_before - 1;
+
+    // Reset for the next interval (keeping the vector capacity)
+    instrument->dirty = false;
+    instrument->has_tob = false;
+    instrument->book_reset = false;
+    instrument->has_pl = false;
+    instrument->level_changes.clear();
+    instrument->num_source_messages = 0;
+}
+
+// -----------------------------------------------------------------------
+// Serialises all instruments that changed under the lock, then publishes them
+// -----------------------------------------------------------------------
+void MDConflator::publish_interval(uint64_t interval_start, uint64_t interval_end) {
+    publish_length = 0;
+    publish_messages = 0;
+
+    instrument_lock.acquire_lock();
+    for(auto const& [instrument_id, instrument] : instruments){
+        if(! instrument->dirty)
+            continue;
+        // Worst case size for the instrument, if it doesn't fit it goes out next interval
+        uint32_t max_length = sizeof(ConflatedInterval) + sizeof(InstrumentClearBook) + sizeof(ToBUpdate) + (3 * sizeof(Trade)) +
+                                (((instrument->level_changes.size() / PL_UPDATE_MAX_DET_PER_MSG) + 1) * sizeof(PLUpdates)) +
+                                (instrument->level_changes.size() * sizeof(PriceLevelDetails));
+        if((publish_length + max_length) > CONFLATOR_BUFFER_SIZE){
+            logger->msg(WARN, "Conflation buffer full, deferring remaining instruments to the next interval");
+            break;
+        }
+        serialise_instrument(instrument, interval_start, interval_end);
+    }
+    instrument_lock.release_lock();
+
+    uint32_t offset = 0;
+    for(uint32_t i = 0; i < publish_messages; i++){
+        char *msg_pointer = publish_buffer + offset;
+        to_aeron_cf->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
+        offset += ((MessageHeader *) msg_pointer)->msgLength;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Thread that wakes up on every interval boundary and publishes
+// -----------------------------------------------------------------------
+void MDConflator::start_publisher() {
+    std::thread publisher_thread([this]() {
+        logger->msg(INFO, "Conflator publishing every " + std::to_string(interval_ns / 1000000) + "ms on stream " + std::to_string(AERON_CF));
+        uint64_t interval_start = get_current_ts();
+        while(1){
+            uint64_t current_ts = get_current_ts();
+            uint64_t next_boundary = (current_ts - (current_ts % interval_ns)) + interval_ns;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(next_boundary - current_ts));
+            publish_interval(interval_start, next_boundary);
+            interval_start = next_boundary;
+        }
+    });
+    publisher_thread.detach();
+}
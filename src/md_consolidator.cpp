@@ -0,0 +1,310 @@
+#include "md_consolidator.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - nothing is read until start, so the instruments can be added first
+// -----------------------------------------------------------------------
+MDConsolidator::MDConsolidator(Logger *_logger, uint64_t stale_millis) {
+    logger = _logger;
+    stale_ns = stale_millis * 1000000L;
+    memset(&consolidated_tob, 0, sizeof(ConsolidatedToB));
+    consolidated_tob.msg_header = {sizeof(ConsolidatedToB), CONSOLIDATED_TOB, 1};
+    to_aeron_io = new to_aeron(AERON_IO);
+}
+
+void MDConsolidator::start() {
+    start_housekeeping();
+    io_fh = std::bind(&MDConsolidator::process_io_messages, this);
+    from_aeron_io = new from_aeron(AERON_IO, io_fh);
+}
+
+// -----------------------------------------------------------------------
+// Returns current time in nanoseconds
+// -----------------------------------------------------------------------
+uint64_t MDConsolidator::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+uint32_t MDConsolidator::get_num_pairs() {
+    MyGuard guard(consolidator_lock);
+    return(pairs.size());
+}
+
+// -----------------------------------------------------------------------
+// Adds an instrument to the pair of its base and quote asset, false if it was known already
+// -----------------------------------------------------------------------
+bool MDConsolidator::add_instrument(uint32_t instrument_id, uint8_t exchange_id, uint32_t base_asset_id, uint32_t quote_asset_id) {
+    MyGuard guard(consolidator_lock);
+    if(venues.find(instrument_id) != venues.end())
+        return(false);
+
+    uint64_t pair_key = ((uint64_t) base_asset_id << 32) | quote_asset_id;
+    consolidated_pair *pair;
+    auto found = pairs.find(pair_key);
+    if(found != pairs.end()){
+        pair = found->second;
+    } else {
+        pair = new consolidated_pair();
+        pair->base_asset_id = base_asset_id;
+        pair->quote_asset_id = quote_asset_id;
+        pairs[pair_key] = pair;
+    }
+    if(pair->num_venues == CONSOLIDATOR_MAX_VENUES){
+        logger->msg(WARN, "Too many venues for asset pair " + std::to_string(base_asset_id) + "/" + std::to_string(quote_asset_id) +
+                                " - not consolidating instrument " + std::to_string(instrument_id));
+        return(false);
+    }
+
+    consolidated_venue *venue = new consolidated_venue();
+    venue->instrument_id = instrument_id;
+    venue->exchange_id = exchange_id;
+    venue->venue_index = pair->num_venues;
+    venue->pair = pair;
+    venue->heap_position[CONSOLIDATOR_BID] = -1;
+    venue->heap_position[CONSOLIDATOR_ASK] = -1;
+    pair->venues[pair->num_venues++] = venue;
+    venues[instrument_id] = venue;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Higher bid or lower ask is better, on the same price the larger quantity
+// -----------------------------------------------------------------------
+bool MDConsolidator::is_better(int side, consolidated_venue *venue, consolidated_venue *other) {
+    if(venue->price[side] != other->price[side])
+        return((side == CONSOLIDATOR_BID) ? (venue->price[side] > other->price[side]) : (venue->price[side] < other->price[side]));
+    return(venue->qty[side] > other->qty[side]);
+}
+
+void MDConsolidator::heap_swap(consolidated_pair *pair, int side, int position, int other_position) {
+    uint8_t *heap = pair->heap[side];
+    std::swap(heap[position], heap[other_position]);
+    pair->venues[heap[position]]->heap_position[side] = position;
+    pair->venues[heap[other_position]]->heap_position[side] = other_position;
+}
+
+void MDConsolidator::heap_sift_up(consolidated_pair *pair, int side, int position) {
+    uint8_t *heap = pair->heap[side];
+    while(position > 0){
+        int parent = (position - 1) / 2;
+        if(! is_better(side, pair->venues[heap[position]], pair->venues[heap[parent]]))
+            break;
+        heap_swap(pair, side, position, parent);
+        position = parent;
+    }
+}
+
+void MDConsolidator::heap_sift_down(consolidated_pair *pair, int side, int position) {
+    uint8_t *heap = pair->heap[side];
+    for(;;){
+        int best = position;
+        int left = (2 * position) + 1;
+        int right = left + 1;
+        if((left < pair->heap_size[side]) && is_better(side, pair->venues[heap[left]], pair->venues[heap[best]]))
+            best = left;
+        if((right < pair->heap_size[side]) && is_better(side, pair->venues[heap[right]], pair->venues[heap[best]]))
+            best = right;
+        if(best == position)
+            break;
+        heap_swap(pair, side, position, best);
+        position = best;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Moves the venue to where its new price belongs, in, out or within the heap of a side
+// -----------------------------------------------------------------------
+void MDConsolidator::heap_update(consolidated_pair *pair, int side, consolidated_venue *venue, double price, double qty) {
+    if((venue->price[side] == price) && (venue->qty[side] == qty))
+        return;
+    venue->price[side] = price;
+    venue->qty[side] = qty;
+    int position = venue->heap_position[side];
+
+    if(price == 0.0){
+        // Not quoting this side any more - replace it with the last one and fix that up
+        if(position < 0)
+            return;
+        int last = --pair->heap_size[side];
+        if(position != last){
+            consolidated_venue *moved = pair->venues[pair->heap[side][last]];
+            heap_swap(pair, side, position, last);
+            heap_sift_up(pair, side, position);
+            heap_sift_down(pair, side, moved->heap_position[side]);
+        }
+        venue->heap_position[side] = -1;
+        return;
+    }
+
+    if(position < 0){
+        position = pair->heap_size[side]++;
+        pair->heap[side][position] = venue->venue_index;
+        venue->heap_position[side] = position;
+        heap_sift_up(pair, side, position);
+        return;
+    }
+    heap_sift_up(pair, side, position);
+    heap_sift_down(pair, side, venue->heap_position[side]);
+}
+
+// -----------------------------------------------------------------------
+// Takes the venue's touch from its book and publishes if the best of the pair changed
+// -----------------------------------------------------------------------
+void MDConsolidator::update_venue(consolidated_venue *venue, uint64_t receive_timestamp, uint64_t exchange_timestamp) {
+    venue->last_update = get_current_ts();
+    heap_update(venue->pair, CONSOLIDATOR_BID, venue, venue->book->get_touch_price_bid(), venue->book->get_touch_qty_bid());
+    heap_update(venue->pair, CONSOLIDATOR_ASK, venue, venue->book->get_touch_price_ask(), venue->book->get_touch_qty_ask());
+    num_updates++;
+    check_best(venue->pair, receive_timestamp, exchange_timestamp);
+}
+
+// -----------------------------------------------------------------------
+// Publishes if the top of either heap is not what was last sent
+// -----------------------------------------------------------------------
+void MDConsolidator::check_best(consolidated_pair *pair, uint64_t receive_timestamp, uint64_t exchange_timestamp) {
+    for(int side = CONSOLIDATOR_BID; side <= CONSOLIDATOR_ASK; side++){
+        consolidated_venue *best = (pair->heap_size[side] > 0) ? pair->venues[pair->heap[side][0]] : nullptr;
+        double price = (best != nullptr) ? best->price[side] : 0.0;
+        double qty = (best != nullptr) ? best->qty[side] : 0.0;
+        uint32_t instrument_id = (best != nullptr) ? best->instrument_id : 0;
+        if( (price != pair->published_price[side]) ||
+            (qty != pair->published_qty[side]) ||
+            (instrument_id != pair->published_instrument_id[side])){
+            publish(pair, receive_timestamp, exchange_timestamp);
+            return;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Sends the top of both heaps
+// -----------------------------------------------------------------------
+void MDConsolidator::publish(consolidated_pair *pair, uint64_t receive_timestamp, uint64_t exchange_timestamp) {
+    consolidated_venue *best_bid = (pair->heap_size[CONSOLIDATOR_BID] > 0) ? pair->venues[pair->heap[CONSOLIDATOR_BID][0]] : nullptr;
+    consolidated_venue *best_ask = (pair->heap_size[CONSOLIDATOR_ASK] > 0) ? pair->venues[pair->heap[CONSOLIDATOR_ASK][0]] : nullptr;
+
+    consolidated_tob.receive_timestamp = receive_timestamp;
+    consolidated_tob.exchange_timestamp = exchange_timestamp;
+    consolidated_tob.sequence_nr = ++pair->sequence_nr;
+    consolidated_tob.base_asset_id = pair->base_asset_id;
+    consolidated_tob.quote_asset_id = pair->quote_asset_id;
+    consolidated_tob.bid_price = (best_bid != nullptr) ? best_bid->price[CONSOLIDATOR_BID] : 0.0;
+    consolidated_tob.bid_qty = (best_bid != nullptr) ? best_bid->qty[CONSOLIDATOR_BID] : 0.0;
+    consolidated_tob.bid_instrument_id = (best_bid != nullptr) ? best_bid->instrument_id : 0;
+    consolidated_tob.bid_exchange_id = (best_bid != nullptr) ? best_bid->exchange_id : 0;
+    consolidated_tob.ask_price = (best_ask != nullptr) ? best_ask->price[CONSOLIDATOR_ASK] : 0.0;
+    consolidated_tob.ask_qty = (best_ask != nullptr) ? best_ask->qty[CONSOLIDATOR_ASK] : 0.0;
+    consolidated_tob.ask_instrument_id = (best_ask != nullptr) ? best_ask->instrument_id : 0;
+    consolidated_tob.ask_exchange_id = (best_ask != nullptr) ? best_ask->exchange_id : 0;
+    consolidated_tob.num_bid_venues = pair->heap_size[CONSOLIDATOR_BID];
+    consolidated_tob.num_ask_venues = pair->heap_size[CONSOLIDATOR_ASK];
+    consolidated_tob.flags = 0;
+    if((best_bid != nullptr) && (best_ask != nullptr) && (consolidated_tob.bid_price >= consolidated_tob.ask_price))
+        consolidated_tob.flags |= CONSOLIDATED_CROSSED;
+    consolidated_tob.sending_timestamp = get_current_ts();
+    to_aeron_io->send_data((char *) &consolidated_tob, sizeof(ConsolidatedToB));
+
+    pair->published_price[CONSOLIDATOR_BID] = consolidated_tob.bid_price;
+    pair->published_qty[CONSOLIDATOR_BID] = consolidated_tob.bid_qty;
+    pair->published_instrument_id[CONSOLIDATOR_BID] = consolidated_tob.bid_instrument_id;
+    pair->published_price[CONSOLIDATOR_ASK] = consolidated_tob.ask_price;
+    pair->published_qty[CONSOLIDATOR_ASK] = consolidated_tob.ask_qty;
+    pair->published_instrument_id[CONSOLIDATOR_ASK] = consolidated_tob.ask_instrument_id;
+    num_published++;
+}
+
+// -----------------------------------------------------------------------
+// Fragment handler for AERON_IO - every update goes into the venue's book, then the heaps
+// -----------------------------------------------------------------------
+fragment_handler_t MDConsolidator::process_io_messages() {
+    return
+        [&](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+            struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
+
+            switch(m->msgType) {
+                case TOB_UPDATE: {
+                    struct ToBUpdate *t = (struct ToBUpdate*)m;
+                    MyGuard guard(consolidator_lock);
+                    auto found = venues.find(t->instrument_id);
+                    if(found == venues.end())
+                        break;
+                    consolidated_venue *venue = found->second;
+                    if(venue->book == nullptr)
+                        venue->book = new ArrayOrderbook(0.0, CONSOLIDATOR_BOOK_TICKS);
+                    venue->book->process_update(t);
+                    update_venue(venue, t->receive_timestamp, t->exchange_timestamp);
+                }
+                break;
+
+                case PL_UPDATE: {
+                    struct PLUpdates *p = (struct PLUpdates*)m;
+                    MyGuard guard(consolidator_lock);
+                    auto found = venues.find(p->instrument_id);
+                    if(found == venues.end())
+                        break;
+                    consolidated_venue *venue = found->second;
+                    if(venue->book == nullptr)
+                        venue->book = new ArrayOrderbook(0.0, CONSOLIDATOR_BOOK_TICKS);
+                    venue->book->process_update(p);
+                    // Half a snapshot is not a touch, wait for the rest of it
+                    if((p->update_flags & PL_UPDATE_MULTIPLE_MESSAGES) && ! (p->update_flags & PL_UPDATE_LAST_MSG_IN_SERIES))
+                        break;
+                    update_venue(venue, p->receive_timestamp, p->exchange_timestamp);
+                }
+                break;
+
+                case INSTRUMENT_CLEAR_BOOK: {
+                    struct InstrumentClearBook *c = (struct InstrumentClearBook*)m;
+                    MyGuard guard(consolidator_lock);
+                    auto found = venues.find(c->instrument_id);
+                    if((found == venues.end()) || (found->second->book == nullptr))
+                        break;
+                    // Out of the consolidated view until the book is rebuilt
+                    found->second->book->clear_orderbook();
+                    update_venue(found->second, c->sending_timestamp, 0);
+                }
+                break;
+            }
+        };
+}
+
+// -----------------------------------------------------------------------
+// Takes out venues that have not updated for stale_ns. Their books are kept, so they come
+// back with the touch from the next update.
+// -----------------------------------------------------------------------
+void MDConsolidator::remove_stale_venues() {
+    MyGuard guard(consolidator_lock);
+    uint64_t now = get_current_ts();
+    for(auto &[instrument_id, venue]: venues){
+        if((venue->book == nullptr) || (now - venue->last_update < stale_ns))
+            continue;
+        if((venue->heap_position[CONSOLIDATOR_BID] < 0) && (venue->heap_position[CONSOLIDATOR_ASK] < 0))
+            continue;
+        logger->msg(INFO, "No updates for instrument " + std::to_string(instrument_id) + " - taking it out of the consolidated view");
+        heap_update(venue->pair, CONSOLIDATOR_BID, venue, 0.0, 0.0);
+        heap_update(venue->pair, CONSOLIDATOR_ASK, venue, 0.0, 0.0);
+        check_best(venue->pair, now, 0);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Stale venue check and a periodic stats line
+// -----------------------------------------------------------------------
+void MDConsolidator::start_housekeeping() {
+    std::thread([&]() {
+        uint64_t last_stats = get_current_ts();
+        for(;;){
+            std::this_thread::sleep_for(std::chrono::milliseconds(CONSOLIDATOR_LOOP_MS));
+            if(stale_ns > 0)
+                remove_stale_venues();
+            uint64_t now = get_current_ts();
+            if(now - last_stats > 60000000000L){
+                MyGuard guard(consolidator_lock);
+                logger->msg(INFO, "Consolidating " + std::to_string(venues.size()) + " instruments in " + std::to_string(pairs.size()) +
+                                    " pairs - updates: " + std::to_string(num_updates) + " published: " + std::to_string(num_published));
+                last_stats = now;
+            }
+        }
+    }).detach();
+}
@@ -0,0 +1,542 @@
+#include "md_coordinator.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - starts reading AERON_MC and the coordinator thread
+// -----------------------------------------------------------------------
+MDCoordinator::MDCoordinator(Logger *_logger, uint64_t interval_seconds, double threshold, uint32_t max_migrations_per_round) {
+    logger = _logger;
+    rebalance_interval_ns = interval_seconds * 1000000000L;
+    imbalance_threshold = threshold;
+    max_migrations = max_migrations_per_round;
+    start_time = get_current_ts();
+    to_aeron_mc = new to_aeron(AERON_MC);
+
+    start_coordinator();
+
+    mc_fh = std::bind(&MDCoordinator::process_mc_messages, this);
+    from_aeron_mc = new from_aeron(AERON_MC, mc_fh);
+}
+
+// -----------------------------------------------------------------------
+// Returns current time in nanoseconds
+// -----------------------------------------------------------------------
+uint64_t MDCoordinator::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Hash for the ring, spreads sequential ids evenly
+// -----------------------------------------------------------------------
+uint64_t MDCoordinator::splitmix64(uint64_t value) {
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return(value ^ (value >> 31));
+}
+
+// -----------------------------------------------------------------------
+// Replaces the instruments we want published, anything not in it is dropped on the next rebalance
+// -----------------------------------------------------------------------
+void MDCoordinator::set_universe(std::vector<uint32_t> &instrument_ids) {
+    MyGuard guard(coordinator_lock);
+    for(auto &[instrument_id, instrument]: instruments)
+        instrument->in_universe = false;
+    for(auto instrument_id: instrument_ids)
+        get_instrument(instrument_id)->in_universe = true;
+    logger->msg(INFO, "Universe has " + std::to_string(instrument_ids.size()) + " instruments");
+}
+
+// -----------------------------------------------------------------------
+// Returns the shard, created the first time we hear from it
+// -----------------------------------------------------------------------
+coordinator_shard *MDCoordinator::get_shard(uint32_t shard_id) {
+    auto found = shards.find(shard_id);
+    if(found != shards.end())
+        return(found->second);
+
+    coordinator_shard *shard = new coordinator_shard();
+    shard->shard_id = shard_id;
+    shard->last_status_time = get_current_ts();
+    shards[shard_id] = shard;
+    membership_changed = true;
+    rebuild_ring();
+    logger->msg(INFO, "Shard " + std::to_string(shard_id) + " joined, " + std::to_string(shards.size()) + " shards");
+    return(shard);
+}
+
+coordinator_instrument *MDCoordinator::get_instrument(uint32_t instrument_id) {
+    auto found = instruments.find(instrument_id);
+    if(found != instruments.end())
+        return(found->second);
+
+    coordinator_instrument *instrument = new coordinator_instrument();
+    instrument->instrument_id = instrument_id;
+    instruments[instrument_id] = instrument;
+    return(instrument);
+}
+
+// -----------------------------------------------------------------------
+// Fragment handler for AERON_MC - registrations and status reports
+// -----------------------------------------------------------------------
+fragment_handler_t MDCoordinator::process_mc_messages() {
+    return
+        [&](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+            struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
+
+            switch(m->msgType) {
+                case SHARD_REGISTER: {
+                    MyGuard guard(coordinator_lock);
+                    process_register((ShardRegister *) m);
+                }
+                break;
+
+                case SHARD_STATUS: {
+                    MyGuard guard(coordinator_lock);
+                    process_status((ShardStatus *) m);
+                }
+                break;
+
+                default:
+                    // Our own assignments and the handovers between shards
+                break;
+            }
+        };
+}
+
+// -----------------------------------------------------------------------
+// A shard (re)started - a restarted shard has nothing, whatever it owned is orphaned
+// -----------------------------------------------------------------------
+void MDCoordinator::process_register(ShardRegister *register_msg) {
+    coordinator_shard *shard = get_shard(register_msg->shard_id);
+    if((shard->pid != 0) && (shard->pid != register_msg->pid)){
+        logger->msg(WARN, "Shard " + std::to_string(shard->shard_id) + " restarted (pid " + std::to_string(register_msg->pid) + ")");
+        shard->reported.clear();
+        apply_report(shard);
+        membership_changed = true;
+    }
+    shard->pid = register_msg->pid;
+    shard->last_status_time = get_current_ts();
+}
+
+// -----------------------------------------------------------------------
+// Collects the parts of a status report and applies it once complete
+// -----------------------------------------------------------------------
+void MDCoordinator::process_status(ShardStatus *status) {
+    coordinator_shard *shard = get_shard(status->shard_id);
+    shard->last_status_time = get_current_ts();
+
+    if(status->part == 0){
+        shard->pending.clear();
+        shard->pending_timestamp = status->timestamp;
+        shard->pending_parts = 0;
+    }
+    else if(status->timestamp != shard->pending_timestamp) {
+        // Missed the start of this report, wait for the next one
+        return;
+    }
+
+    for(int i = 0; (i < status->num_instruments) && (i < MAX_SHARD_STATUS_INSTRUMENTS); i++)
+        shard->pending.push_back(status->instruments[i]);
+    shard->pending_parts++;
+    if(shard->pending_parts < status->num_parts)
+        return;
+
+    shard->reported.clear();
+    for(auto &entry: shard->pending)
+        shard->reported[entry.instrument_id] = entry;
+    shard->pending.clear();
+    apply_report(shard);
+}
+
+// -----------------------------------------------------------------------
+// Derives ownership from what a shard says it is doing
+// -----------------------------------------------------------------------
+void MDCoordinator::apply_report(coordinator_shard *shard) {
+    uint64_t current_ts = get_current_ts();
+    bool in_grace = (current_ts - start_time) < (COORDINATOR_STARTUP_GRACE_MS * 1000000L);
+
+    // Instruments it no longer publishes
+    for(auto &[instrument_id, instrument]: instruments){
+        if(instrument->owner != shard->shard_id)
+            continue;
+        auto found = shard->reported.find(instrument_id);
+        if((found == shard->reported.end()) || (found->second.state != SHARD_INSTRUMENT_ACTIVE))
+            instrument->owner = 0;
+    }
+
+    for(auto &[instrument_id, entry]: shard->reported){
+        coordinator_instrument *instrument = get_instrument(instrument_id);
+        if(entry.message_rate > 0)
+            instrument->message_rate = entry.message_rate;
+
+        switch(entry.state){
+            case SHARD_INSTRUMENT_ACTIVE:
+                if(instrument->target == shard->shard_id){
+                    logger->msg(INFO, "Instrument " + std::to_string(instrument_id) + " now published by shard " + std::to_string(shard->shard_id));
+                    instrument->owner = shard->shard_id;
+                    instrument->target = 0;
+                    instrument->migration_step = MIGRATION_NONE;
+                }
+                else if(instrument->owner == 0) {
+                    instrument->owner = shard->shard_id;
+                }
+                else if(instrument->owner != shard->shard_id) {
+                    // Two shards publishing the same instrument - the one we knew about first keeps it
+                    auto owner_shard = shards.find(instrument->owner);
+                    if( (owner_shard != shards.end()) &&
+                        (owner_shard->second->reported.count(instrument_id) > 0) &&
+                        (owner_shard->second->reported[instrument_id].state == SHARD_INSTRUMENT_ACTIVE)){
+                        logger->msg(WARN, "Instrument " + std::to_string(instrument_id) + " published by shards " + std::to_string(instrument->owner) +
+                                            " and " + std::to_string(shard->shard_id) + ", dropping it from " + std::to_string(shard->shard_id));
+                        send_assignment(shard->shard_id, SHARD_ASSIGN_DROP, instrument_id);
+                    } else {
+                        instrument->owner = shard->shard_id;
+                    }
+                }
+                break;
+
+            case SHARD_INSTRUMENT_STANDBY:
+            case SHARD_INSTRUMENT_READY:
+                // Left over from a cancelled move or from before we started
+                if(! in_grace && (instrument->target != shard->shard_id))
+                    send_assignment(shard->shard_id, SHARD_ASSIGN_DROP, instrument_id);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Takes out shards that stopped reporting, what they owned is orphaned
+// -----------------------------------------------------------------------
+void MDCoordinator::expire_shards(uint64_t current_ts) {
+    for(auto it = shards.begin(); it != shards.end();){
+        coordinator_shard *shard = it->second;
+        if((current_ts - shard->last_status_time) < (COORDINATOR_SHARD_TIMEOUT_MS * 1000000L)){
+            it++;
+            continue;
+        }
+
+        uint32_t num_orphaned = 0;
+        for(auto &[instrument_id, instrument]: instruments){
+            if(instrument->owner == shard->shard_id){
+                instrument->owner = 0;
+                num_orphaned++;
+            }
+            if(instrument->target == shard->shard_id){
+                instrument->target = 0;
+                instrument->migration_step = MIGRATION_NONE;
+            }
+        }
+        logger->msg(WARN, "Shard " + std::to_string(shard->shard_id) + " stopped reporting, " + std::to_string(num_orphaned) + " instruments orphaned");
+        delete(shard);
+        it = shards.erase(it);
+        membership_changed = true;
+        rebuild_ring();
+    }
+}
+
+// -----------------------------------------------------------------------
+// COORDINATOR_VNODES_PER_SHARD points on the ring per shard
+// -----------------------------------------------------------------------
+void MDCoordinator::rebuild_ring() {
+    ring.clear();
+    for(auto &[shard_id, shard]: shards){
+        for(uint64_t vnode = 0; vnode < COORDINATOR_VNODES_PER_SHARD; vnode++)
+            ring.push_back({splitmix64(((uint64_t) shard_id << 32) | vnode), shard_id});
+    }
+    std::sort(ring.begin(), ring.end());
+}
+
+// -----------------------------------------------------------------------
+// Where every instrument in the universe should be - bounded load consistent hashing.
+// Owners (or move targets) first keep what fits, smallest first so a rebalance moves a few
+// busy instruments rather than many quiet ones, the rest is placed biggest first on the ring.
+// -----------------------------------------------------------------------
+void MDCoordinator::compute_placement(std::unordered_map<uint32_t, uint32_t> &placement) {
+    placement.clear();
+    if(ring.empty())
+        return;
+
+    std::vector<coordinator_instrument*> universe;
+    double total_rate = 0;
+    for(auto &[instrument_id, instrument]: instruments){
+        if(! instrument->in_universe)
+            continue;
+        universe.push_back(instrument);
+        total_rate += std::max(instrument->message_rate, COORDINATOR_MIN_RATE);
+    }
+    std::sort(universe.begin(), universe.end(), [](coordinator_instrument *a, coordinator_instrument *b) {
+        if(a->message_rate != b->message_rate)
+            return(a->message_rate < b->message_rate);
+        return(a->instrument_id < b->instrument_id);
+    });
+
+    double capacity = (total_rate / shards.size()) * COORDINATOR_LOAD_FACTOR;
+    std::unordered_map<uint32_t, double> shard_load;
+    for(auto &[shard_id, shard]: shards)
+        shard_load[shard_id] = 0;
+
+    std::vector<coordinator_instrument*> unplaced;
+    for(auto instrument: universe){
+        double rate = std::max(instrument->message_rate, COORDINATOR_MIN_RATE);
+        uint32_t current = (instrument->target != 0) ? instrument->target : instrument->owner;
+        if((current != 0) && (shard_load.count(current) > 0) && ((shard_load[current] + rate) <= capacity)){
+            shard_load[current] += rate;
+            placement[instrument->instrument_id] = current;
+        } else {
+            unplaced.push_back(instrument);
+        }
+    }
+
+    for(auto it = unplaced.rbegin(); it != unplaced.rend(); it++){
+        coordinator_instrument *instrument = *it;
+        double rate = std::max(instrument->message_rate, COORDINATOR_MIN_RATE);
+        uint32_t chosen = 0;
+        auto point = std::lower_bound(ring.begin(), ring.end(), std::make_pair(splitmix64(instrument->instrument_id), (uint32_t) 0));
+        size_t start = point - ring.begin();
+        for(size_t i = 0; i < ring.size(); i++){
+            uint32_t shard_id = ring[(start + i) % ring.size()].second;
+            if((shard_load[shard_id] + rate) <= capacity){
+                chosen = shard_id;
+                break;
+            }
+        }
+        if(chosen == 0){
+            // Only with a single huge instrument - take the least loaded
+            chosen = std::min_element(shard_load.begin(), shard_load.end(),
+                        [](const std::pair<const uint32_t, double> &a, const std::pair<const uint32_t, double> &b) { return(a.second < b.second); })->first;
+        }
+        shard_load[chosen] += rate;
+        placement[instrument->instrument_id] = chosen;
+    }
+}
+
+void MDCoordinator::update_loads() {
+    for(auto &[shard_id, shard]: shards)
+        shard->load = 0;
+    for(auto &[instrument_id, instrument]: instruments){
+        auto owner = shards.find(instrument->owner);
+        if(owner != shards.end())
+            owner->second->load += std::max(instrument->message_rate, COORDINATOR_MIN_RATE);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Load of the busiest shard over the average, 1.0 is perfectly even
+// -----------------------------------------------------------------------
+double MDCoordinator::get_imbalance() {
+    if(shards.size() < 2)
+        return(1.0);
+    double total_load = 0;
+    double max_load = 0;
+    for(auto &[shard_id, shard]: shards){
+        total_load += shard->load;
+        max_load = std::max(max_load, shard->load);
+    }
+    double average_load = total_load / shards.size();
+    if(average_load <= 0)
+        return(1.0);
+    return(max_load / average_load);
+}
+
+// -----------------------------------------------------------------------
+// Target subscribes on standby - or publishes straight away when nobody owns the instrument
+// -----------------------------------------------------------------------
+void MDCoordinator::start_migration(coordinator_instrument *instrument, uint32_t target, uint64_t current_ts) {
+    instrument->target = target;
+    instrument->source = instrument->owner;
+    instrument->migration_start = current_ts;
+    if(instrument->owner == 0){
+        instrument->migration_step = MIGRATION_ACTIVE_SENT;
+        send_assignment(target, SHARD_ASSIGN_ACTIVE, instrument->instrument_id);
+    } else {
+        instrument->migration_step = MIGRATION_STANDBY_SENT;
+        send_assignment(target, SHARD_ASSIGN_STANDBY, instrument->instrument_id);
+    }
+}
+
+void MDCoordinator::assign_orphans(std::unordered_map<uint32_t, uint32_t> &placement, uint64_t current_ts) {
+    uint32_t num_assigned = 0;
+    for(auto &[instrument_id, instrument]: instruments){
+        if(! instrument->in_universe || (instrument->owner != 0) || (instrument->target != 0))
+            continue;
+        auto found = placement.find(instrument_id);
+        if(found == placement.end())
+            continue;
+        start_migration(instrument, found->second, current_ts);
+        num_assigned++;
+    }
+    if(num_assigned > 0)
+        logger->msg(INFO, "Assigned " + std::to_string(num_assigned) + " unowned instruments");
+}
+
+// -----------------------------------------------------------------------
+// Moves every migration on a step once the shards have reported back
+// -----------------------------------------------------------------------
+void MDCoordinator::progress_migrations(uint64_t current_ts) {
+    for(auto &[instrument_id, instrument]: instruments){
+        if(instrument->target == 0)
+            continue;
+
+        uint8_t target_state = 0;
+        auto target = shards.find(instrument->target);
+        if(target != shards.end()){
+            auto reported = target->second->reported.find(instrument_id);
+            if(reported != target->second->reported.end())
+                target_state = reported->second.state;
+        }
+
+        uint64_t timeout_ms = (instrument->migration_step == MIGRATION_ACTIVE_SENT) ? COORDINATOR_ACTIVE_RETRY_MS : COORDINATOR_MIGRATION_TIMEOUT_MS;
+        if((current_ts - instrument->migration_start) > (timeout_ms * 1000000L)){
+            logger->msg(WARN, "Moving instrument " + std::to_string(instrument_id) + " to shard " + std::to_string(instrument->target) + " timed out");
+            if(target_state != SHARD_INSTRUMENT_ACTIVE)
+                send_assignment(instrument->target, SHARD_ASSIGN_DROP, instrument_id);
+            instrument->target = 0;
+            instrument->migration_step = MIGRATION_NONE;
+            continue;
+        }
+
+        switch(instrument->migration_step){
+            case MIGRATION_STANDBY_SENT:
+                if(instrument->owner == 0){
+                    // Owner went away while the target was syncing, nothing to hand over
+                    instrument->migration_step = MIGRATION_ACTIVE_SENT;
+                    send_assignment(instrument->target, SHARD_ASSIGN_ACTIVE, instrument_id);
+                }
+                else if(target_state == SHARD_INSTRUMENT_READY) {
+                    instrument->migration_step = MIGRATION_RELEASE_SENT;
+                    send_assignment(instrument->owner, SHARD_ASSIGN_RELEASE, instrument_id, instrument->target);
+                }
+                break;
+
+            case MIGRATION_RELEASE_SENT:
+                // The handover goes straight from owner to target, only step in if the owner died with it
+                if((instrument->owner == 0) && (shards.count(instrument->source) == 0)){
+                    instrument->migration_step = MIGRATION_ACTIVE_SENT;
+                    send_assignment(instrument->target, SHARD_ASSIGN_ACTIVE, instrument_id);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Every interval, if the shards changed or the load is uneven, starts moving instruments to
+// where the placement wants them - biggest first, at most max_migrations at a time
+// -----------------------------------------------------------------------
+void MDCoordinator::rebalance(std::unordered_map<uint32_t, uint32_t> &placement, uint64_t current_ts) {
+    if((current_ts - last_rebalance_time) < rebalance_interval_ns)
+        return;
+    last_rebalance_time = current_ts;
+
+    double imbalance = get_imbalance();
+    std::string loads = "";
+    for(auto &[shard_id, shard]: shards)
+        loads += " " + std::to_string(shard_id) + ":" + std::to_string((uint64_t) shard->load);
+    logger->msg(INFO, "Shard loads (msgs/s):" + loads + " - imbalance " + std::to_string(imbalance));
+
+    bool universe_loaded = false;
+    for(auto &[instrument_id, instrument]: instruments){
+        if(instrument->in_universe){
+            universe_loaded = true;
+            break;
+        }
+    }
+
+    std::vector<coordinator_instrument*> candidates;
+    for(auto &[instrument_id, instrument]: instruments){
+        if((instrument->owner == 0) || (instrument->target != 0))
+            continue;
+        if(! instrument->in_universe){
+            // Delisted or no longer live
+            if(universe_loaded){
+                logger->msg(INFO, "Instrument " + std::to_string(instrument_id) + " left the universe, dropping it from shard " + std::to_string(instrument->owner));
+                send_assignment(instrument->owner, SHARD_ASSIGN_DROP, instrument_id);
+            }
+            continue;
+        }
+        auto found = placement.find(instrument_id);
+        if((found != placement.end()) && (found->second != instrument->owner))
+            candidates.push_back(instrument);
+    }
+
+    if(! membership_changed && (imbalance <= imbalance_threshold))
+        return;
+    membership_changed = false;
+
+    std::sort(candidates.begin(), candidates.end(), [](coordinator_instrument *a, coordinator_instrument *b) {
+        return(a->message_rate > b->message_rate);
+    });
+    uint32_t num_moves = std::min((size_t) max_migrations, candidates.size());
+    for(uint32_t i = 0; i < num_moves; i++){
+        logger->msg(INFO, "Moving instrument " + std::to_string(candidates[i]->instrument_id) + " from shard " +
+                            std::to_string(candidates[i]->owner) + " to " + std::to_string(placement[candidates[i]->instrument_id]));
+        start_migration(candidates[i], placement[candidates[i]->instrument_id], current_ts);
+    }
+    // Anything left is picked up next interval, the imbalance will still be there
+    if(candidates.size() > num_moves)
+        membership_changed = true;
+}
+
+void MDCoordinator::send_assignment(uint32_t shard_id, uint8_t action, uint32_t instrument_id, uint32_t to_shard_id) {
+    outgoing[std::make_tuple(shard_id, action, to_shard_id)].push_back(instrument_id);
+}
+
+// -----------------------------------------------------------------------
+// Sends what was decided this round, MAX_SHARD_ASSIGNMENT_INSTRUMENTS per message
+// -----------------------------------------------------------------------
+void MDCoordinator::flush_assignments() {
+    ShardAssignment assignment;
+    for(auto &[key, instrument_ids]: outgoing){
+        for(size_t first = 0; first < instrument_ids.size(); first += MAX_SHARD_ASSIGNMENT_INSTRUMENTS){
+            memset(&assignment, 0, sizeof(ShardAssignment));
+            assignment.shard_id = std::get<0>(key);
+            assignment.action = std::get<1>(key);
+            assignment.to_shard_id = std::get<2>(key);
+            assignment.num_instruments = std::min((size_t) MAX_SHARD_ASSIGNMENT_INSTRUMENTS, instrument_ids.size() - first);
+            memcpy(assignment.instrument_ids, &instrument_ids[first], assignment.num_instruments * sizeof(uint32_t));
+            uint16_t msg_length = sizeof(ShardAssignment) - ((MAX_SHARD_ASSIGNMENT_INSTRUMENTS - assignment.num_instruments) * sizeof(uint32_t));
+            assignment.msg_header = {msg_length, SHARD_ASSIGNMENT, 1};
+            to_aeron_mc->send_data((char *) &assignment, msg_length);
+        }
+    }
+    outgoing.clear();
+}
+
+// -----------------------------------------------------------------------
+// Coordinator thread
+// -----------------------------------------------------------------------
+void MDCoordinator::start_coordinator() {
+    std::thread coordinator_thread([this]() {
+        logger->msg(INFO, "Coordinator started, rebalancing every " + std::to_string(rebalance_interval_ns / 1000000000L) + "s on stream " + std::to_string(AERON_MC));
+        std::unordered_map<uint32_t, uint32_t> placement;
+        while(1){
+            std::this_thread::sleep_for(std::chrono::milliseconds(COORDINATOR_LOOP_MS));
+            uint64_t current_ts = get_current_ts();
+
+            MyGuard guard(coordinator_lock);
+            expire_shards(current_ts);
+            if((current_ts - start_time) < (COORDINATOR_STARTUP_GRACE_MS * 1000000L)){
+                // Shards keep running without us, find out who owns what before changing anything
+                flush_assignments();
+                continue;
+            }
+
+            update_loads();
+            compute_placement(placement);
+            progress_migrations(current_ts);
+            assign_orphans(placement, current_ts);
+            rebalance(placement, current_ts);
+            flush_assignments();
+        }
+    });
+    coordinator_thread.detach();
+}
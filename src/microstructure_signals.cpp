@@ -0,0 +1,257 @@
+#include "microstructure_signals.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - publish_callback sends a finished SignalBlock
+// -----------------------------------------------------------------------
+MicrostructureSignals::MicrostructureSignals(std::function<void(char *, uint32_t)> _publish_callback, uint64_t interval_millis,
+                                                uint32_t _top_levels, uint32_t _distance_bps) {
+    publish_callback = _publish_callback;
+    interval_ns = interval_millis * 1000000L;
+    top_levels = std::max(_top_levels, (uint32_t) 1);
+    distance_bps = _distance_bps;
+    distance = _distance_bps / 10000.0;
+}
+
+uint64_t MicrostructureSignals::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+signal_instrument *MicrostructureSignals::get_instrument(uint32_t instrument_id, uint8_t exchange_id) {
+    auto found = instruments.find(instrument_id);
+    if(found != instruments.end())
+        return(found->second);
+
+    signal_instrument *instrument = new signal_instrument();
+    instrument->instrument_id = instrument_id;
+    instrument->exchange_id = exchange_id;
+    instrument->valid = true;
+    clear_side(instrument->bids);
+    clear_side(instrument->asks);
+    instruments[instrument_id] = instrument;
+    return(instrument);
+}
+
+// -----------------------------------------------------------------------
+// Empties a side, also where the running sums get rid of any rounding they picked up
+// -----------------------------------------------------------------------
+void MicrostructureSignals::clear_side(signal_side &side) {
+    side.levels.clear();
+    side.top_count = 0;
+    side.top_qty = 0.0;
+    side.top_notional = 0.0;
+    side.top_last = side.levels.end();
+    side.band_limit = -INFINITY;
+    side.band_qty = 0.0;
+    side.band_end = side.levels.end();
+}
+
+// -----------------------------------------------------------------------
+// Moves the band edge after the touch changed, over the levels that cross it only
+// -----------------------------------------------------------------------
+void MicrostructureSignals::move_band(signal_side &side) {
+    double touch = side.levels.begin()->first;
+    double limit = touch + (fabs(touch) * distance);
+    if(limit > side.band_limit){
+        while((side.band_end != side.levels.end()) && (side.band_end->first <= limit)){
+            side.band_qty += side.band_end->second;
+            ++side.band_end;
+        }
+    } else {
+        while((side.band_end != side.levels.begin()) && (std::prev(side.band_end)->first > limit)){
+            --side.band_end;
+            side.band_qty -= side.band_end->second;
+        }
+    }
+    side.band_limit = limit;
+}
+
+// -----------------------------------------------------------------------
+// Adds or changes a level and the windows it is in
+// -----------------------------------------------------------------------
+void MicrostructureSignals::set_level(signal_side &side, double key, double qty) {
+    auto found = side.levels.find(key);
+    if(found != side.levels.end()){
+        double delta = qty - found->second;
+        if(key <= side.top_last->first){
+            side.top_qty += delta;
+            side.top_notional += delta * fabs(key);
+        }
+        if(key <= side.band_limit)
+            side.band_qty += delta;
+        found->second = qty;
+        return;
+    }
+
+    auto level = side.levels.emplace(key, qty).first;
+    if(side.top_count < top_levels){
+        // Fewer levels than the window holds - all of them are in it
+        side.top_count++;
+        side.top_qty += qty;
+        side.top_notional += qty * fabs(key);
+        side.top_last = std::prev(side.levels.end());
+    } else if(key < side.top_last->first){
+        // Pushes the worst level out of the window
+        side.top_qty += qty - side.top_last->second;
+        side.top_notional += (qty * fabs(key)) - (side.top_last->second * fabs(side.top_last->first));
+        side.top_last = std::prev(side.top_last);
+    }
+
+    if(key <= side.band_limit)
+        side.band_qty += qty;
+    else if((side.band_end == side.levels.end()) || (key < side.band_end->first))
+        side.band_end = level;
+
+    if(level == side.levels.begin())
+        move_band(side);
+}
+
+// -----------------------------------------------------------------------
+// Removes a level, the next level outside the top window moves into it
+// -----------------------------------------------------------------------
+void MicrostructureSignals::delete_level(signal_side &side, double key) {
+    auto found = side.levels.find(key);
+    if(found == side.levels.end())
+        return;
+    double qty = found->second;
+    bool was_touch = (found == side.levels.begin());
+
+    if(key <= side.band_limit)
+        side.band_qty -= qty;
+    if(found == side.band_end)
+        side.band_end = std::next(found);
+
+    if(key <= side.top_last->first){
+        side.top_qty -= qty;
+        side.top_notional -= qty * fabs(key);
+        auto candidate = std::next(side.top_last);
+        if(found == side.top_last)
+            side.top_last = (found == side.levels.begin()) ? side.levels.end() : std::prev(found);
+        side.levels.erase(found);
+        if(candidate != side.levels.end()){
+            side.top_qty += candidate->second;
+            side.top_notional += candidate->second * fabs(candidate->first);
+            side.top_last = candidate;
+        } else {
+            side.top_count--;
+        }
+    } else {
+        side.levels.erase(found);
+    }
+
+    if(side.levels.empty())
+        clear_side(side);
+    else if(was_touch)
+        move_band(side);
+}
+
+// -----------------------------------------------------------------------
+// Applies a depth update, publishes straight away unless the instrument published within the interval
+// -----------------------------------------------------------------------
+void MicrostructureSignals::process_update(PLUpdates *pl_update) {
+    signal_instrument *instrument = get_instrument(pl_update->instrument_id, pl_update->exchange_id);
+    PriceLevelDetails *pl_details = (PriceLevelDetails *) ((char *) pl_update + sizeof(PLUpdates));
+    for(int i = 0; i < pl_update->num_of_pl_updates; i++){
+        PriceLevelDetails *detail = &pl_details[i];
+        bool is_bid = (detail->side == BUY_SIDE);
+        signal_side &side = is_bid ? instrument->bids : instrument->asks;
+        double key = is_bid ? -detail->price_level : detail->price_level;
+        if((detail->pl_action_type == DELETE_PL_ACTION) || (detail->quantity == 0))
+            delete_level(side, key);
+        else
+            set_level(side, key, detail->quantity);
+    }
+    num_level_changes += pl_update->num_of_pl_updates;
+
+    instrument->receive_timestamp = pl_update->receive_timestamp;
+    instrument->exchange_timestamp = pl_update->exchange_timestamp;
+    instrument->dirty = true;
+    // Nothing goes out in the middle of a multi message snapshot
+    instrument->valid = ! (pl_update->update_flags & PL_UPDATE_MULTIPLE_MESSAGES) || (pl_update->update_flags & PL_UPDATE_LAST_MSG_IN_SERIES);
+    if(! instrument->valid)
+        return;
+
+    uint64_t now = get_current_ts();
+    if((now - instrument->last_publish) >= interval_ns){
+        publish(instrument, now);
+    } else if(! instrument->queued){
+        instrument->queued = true;
+        due.push_back(instrument);
+    }
+}
+
+void MicrostructureSignals::clear_book(uint32_t instrument_id, uint8_t exchange_id) {
+    signal_instrument *instrument = get_instrument(instrument_id, exchange_id);
+    clear_side(instrument->bids);
+    clear_side(instrument->asks);
+    instrument->valid = false;
+}
+
+// -----------------------------------------------------------------------
+// Sends the rate limited SignalBlocks whose interval has passed
+// -----------------------------------------------------------------------
+void MicrostructureSignals::publish_due() {
+    if(due.empty())
+        return;
+    uint64_t now = get_current_ts();
+    for(size_t i = 0; i < due.size();){
+        signal_instrument *instrument = due[i];
+        if(instrument->valid && ((now - instrument->last_publish) < interval_ns)){
+            i++;
+            continue;
+        }
+        if(instrument->valid && instrument->dirty)
+            publish(instrument, now);
+        instrument->queued = false;
+        due[i] = due.back();
+        due.pop_back();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Builds the SignalBlock from the window sums - the same work however deep the book is
+// -----------------------------------------------------------------------
+void MicrostructureSignals::publish(signal_instrument *instrument, uint64_t now) {
+    signal_side &bids = instrument->bids;
+    signal_side &asks = instrument->asks;
+    SignalBlock *block = (SignalBlock *) block_buffer;
+    SignalBlockItem *items = (SignalBlockItem *) (block_buffer + sizeof(SignalBlock));
+    int num_items = 0;
+
+    auto add_item = [&](uint16_t signal_id, uint16_t parameter, double value) {
+        items[num_items++] = SignalBlockItem{value, signal_id, parameter, 0};
+    };
+
+    if(! bids.levels.empty() && ! asks.levels.empty()){
+        double bid_price = -bids.levels.begin()->first;
+        double bid_qty = bids.levels.begin()->second;
+        double ask_price = asks.levels.begin()->first;
+        double ask_qty = asks.levels.begin()->second;
+        add_item(MS_SIGNAL_MICROPRICE, 1, ((bid_price * ask_qty) + (ask_price * bid_qty)) / (bid_qty + ask_qty));
+        add_item(MS_SIGNAL_IMBALANCE, top_levels, (bids.top_qty - asks.top_qty) / (bids.top_qty + asks.top_qty));
+        add_item(MS_SIGNAL_DEPTH_WEIGHTED_MID, top_levels, ((bids.top_notional / bids.top_qty) + (asks.top_notional / asks.top_qty)) / 2.0);
+    }
+    add_item(MS_SIGNAL_BID_DEPTH_WITHIN, distance_bps, bids.band_qty);
+    add_item(MS_SIGNAL_ASK_DEPTH_WITHIN, distance_bps, asks.band_qty);
+
+    uint32_t msg_length = sizeof(SignalBlock) + (num_items * sizeof(SignalBlockItem));
+    block->msg_header = {msg_length, SIGNAL_BLOCK, 1};
+    block->receive_timestamp = instrument->receive_timestamp;
+    block->exchange_timestamp = instrument->exchange_timestamp;
+    block->sending_timestamp = now;
+    block->instrument_id = instrument->instrument_id;
+    block->exchange_id = instrument->exchange_id;
+    block->signal_block_data_type = SIGNAL_BLOCK_MICROSTRUCTURE;
+    block->num_of_signal_update_items = num_items;
+    publish_callback(block_buffer, msg_length);
+
+    instrument->last_publish = now;
+    instrument->dirty = false;
+    num_published++;
+}
+
+std::string MicrostructureSignals::get_stats() {
+    return("instruments: " + std::to_string(instruments.size()) + ", level changes: " + std::to_string(num_level_changes) +
+            ", signal blocks: " + std::to_string(num_published));
+}
@@ -0,0 +1,506 @@
+#include "order_gateway.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - preallocates the handles, requests go out once start is called
+// -----------------------------------------------------------------------
+OrderGateway::OrderGateway(Logger *_logger, std::string header_line, std::function<void(gateway_context *)> _completion_callback,
+                            int _max_in_flight, int _connections_per_endpoint) {
+    logger = _logger;
+    completion_callback = _completion_callback;
+    max_in_flight = _max_in_flight;
+    if(max_in_flight <= GATEWAY_CANCEL_RESERVE)
+        max_in_flight = GATEWAY_CANCEL_RESERVE + 1;
+    connections_per_endpoint = _connections_per_endpoint;
+    if(connections_per_endpoint < 1)
+        connections_per_endpoint = 1;
+
+    headers = curl_slist_append(headers, header_line.c_str());
+
+    multi_handle = curl_multi_init();
+    curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long) connections_per_endpoint);
+
+    for(int i = 0; i < max_in_flight; i++){
+        gateway_context *context = new gateway_context();
+        context->easy = curl_easy_init();
+        context->in_use = false;
+        curl_easy_setopt(context->easy, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(context->easy, CURLOPT_WRITEDATA, context);
+        curl_easy_setopt(context->easy, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(context->easy, CURLOPT_HEADERDATA, context);
+        curl_easy_setopt(context->easy, CURLOPT_PRIVATE, context);
+        curl_easy_setopt(context->easy, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(context->easy, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(context->easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(context->easy, CURLOPT_TCP_NODELAY, 1L);
+        curl_easy_setopt(context->easy, CURLOPT_TIMEOUT_MS, GATEWAY_REQUEST_TIMEOUT_MS);
+        contexts.push_back(context);
+        free_contexts.push_back(context);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Returns current time in nanoseconds
+// -----------------------------------------------------------------------
+uint64_t OrderGateway::get_current_ts_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Adds a REST endpoint (with trailing /), its index goes in the requests for it
+// -----------------------------------------------------------------------
+uint8_t OrderGateway::add_endpoint(std::string base_url) {
+    for(int i = 0; i < num_endpoints; i++){
+        if(endpoints[i].base_url == base_url)
+            return(i);
+    }
+    if(num_endpoints == GATEWAY_MAX_ENDPOINTS){
+        logger->msg(ERROR, "Too many endpoints in the order gateway, not adding: " + base_url);
+        return(0);
+    }
+    endpoints[num_endpoints] = {base_url, base_url + "ping", 0, nullptr, "", 0};
+    return(num_endpoints++);
+}
+
+// -----------------------------------------------------------------------
+// Requests to the endpoint only go out when the scheduler has room for them
+// -----------------------------------------------------------------------
+void OrderGateway::set_rate_limits(uint8_t endpoint, RateLimitScheduler *scheduler) {
+    endpoints[endpoint].scheduler = scheduler;
+}
+
+void OrderGateway::set_expiry_callback(std::function<void(gateway_request *)> _expiry_callback) {
+    expiry_callback = _expiry_callback;
+}
+
+// -----------------------------------------------------------------------
+// Queued requests to the endpoint that carry a batch item go out together, through batch_callback
+// -----------------------------------------------------------------------
+void OrderGateway::set_batching(uint8_t endpoint, std::string batch_path, uint64_t window_ns,
+                                std::function<int(gateway_request *, int, char *)> _batch_callback) {
+    endpoints[endpoint].batch_url = endpoints[endpoint].base_url + batch_path;
+    endpoints[endpoint].batch_window_ns = window_ns;
+    batch_callback = _batch_callback;
+}
+
+// -----------------------------------------------------------------------
+// CA bundle to verify the endpoints against instead of the system one (e.g. a local simulator's certificate)
+// -----------------------------------------------------------------------
+void OrderGateway::set_ca_file(std::string ca_file) {
+    for(gateway_context *context: contexts)
+        curl_easy_setopt(context->easy, CURLOPT_CAINFO, ca_file.c_str());
+}
+
+// -----------------------------------------------------------------------
+// Writes response body straight into the preallocated context buffer
+// -----------------------------------------------------------------------
+size_t OrderGateway::write_callback(char *buffer, size_t size, size_t nmemb, void *data) {
+    gateway_context *context = (gateway_context *) data;
+    size_t data_size = size * nmemb;
+    // Always leave room for the terminating zero
+    if((context->length + data_size + 1) > GATEWAY_RESPONSE_SIZE){
+        context->overflow = true;
+        return(0);
+    }
+    memcpy(context->response + context->length, buffer, data_size);
+    context->length += data_size;
+    return(data_size);
+}
+
+// -----------------------------------------------------------------------
+// Picks the rate limit headers (X-MBX-USED-WEIGHT-1M: 12, X-MBX-ORDER-COUNT-10S: 3..) and
+// Retry-After out of the response headers
+// -----------------------------------------------------------------------
+size_t OrderGateway::header_callback(char *buffer, size_t size, size_t nitems, void *data) {
+    gateway_context *context = (gateway_context *) data;
+    size_t length = size * nitems;
+    char line[128];
+    if((length < 14) || (length >= sizeof(line)))
+        return(length);
+    memcpy(line, buffer, length);
+    line[length] = 0;
+
+    uint8_t limit_type;
+    if(strncasecmp(line, "x-mbx-used-weight-", 18) == 0)
+        limit_type = RATE_LIMIT_WEIGHT;
+    else if(strncasecmp(line, "x-mbx-order-count-", 18) == 0)
+        limit_type = RATE_LIMIT_ORDERS;
+    else {
+        if(strncasecmp(line, "retry-after:", 12) == 0)
+            context->retry_after_ns = strtoul(line + 12, NULL, 10) * 1000000000UL;
+        return(length);
+    }
+
+    // <number><unit>: <used>
+    char *end;
+    uint32_t number = strtoul(line + 18, &end, 10);
+    char unit = *end;
+    char *colon = strchr(end, ':');
+    if((colon == NULL) || (context->num_usage == GATEWAY_MAX_USAGE_HEADERS))
+        return(length);
+    rate_limit_usage *usage = &context->usage[context->num_usage];
+    usage->limit_type = limit_type;
+    usage->interval_ns = RateLimitScheduler::interval_from_unit(number, unit);
+    usage->used = strtoul(colon + 1, NULL, 10);
+    usage->limit = 0;
+    if(usage->interval_ns != 0)
+        context->num_usage++;
+    return(length);
+}
+
+int OrderGateway::request_class(gateway_request *request) {
+    switch(request->request_type) {
+        case GATEWAY_CANCEL_ORDER:  return(RATE_CLASS_CANCEL);
+        case GATEWAY_NEW_ORDER:     return(request->reduce_only ? RATE_CLASS_REDUCE_ONLY : RATE_CLASS_NEW_ORDER);
+        default:                    return(RATE_CLASS_PING);
+    }
+}
+
+int OrderGateway::batch_limit(gateway_request *request) {
+    return((request->request_type == GATEWAY_CANCEL_ORDER) ? GATEWAY_MAX_BATCH_CANCELS : GATEWAY_MAX_BATCH_ORDERS);
+}
+
+// -----------------------------------------------------------------------
+// Puts a request on a free handle if there is one and the rate limits have room for it
+// With a batch, request is its first one and the whole batch goes out as one request
+// -----------------------------------------------------------------------
+int OrderGateway::launch_request(gateway_request *request, uint64_t current_ts, gateway_batch *batch) {
+    // The last few handles are kept for cancels
+    int reserve = (request->request_type == GATEWAY_CANCEL_ORDER) ? 0 : GATEWAY_CANCEL_RESERVE;
+    if((int) free_contexts.size() <= reserve)
+        return(GATEWAY_NO_HANDLE);
+    RateLimitScheduler *scheduler = endpoints[request->endpoint].scheduler;
+    if(scheduler != nullptr){
+        bool allowed;
+        if(batch == nullptr)
+            allowed = scheduler->try_acquire(request_class(request), current_ts);
+        else if(request->request_type == GATEWAY_CANCEL_ORDER)
+            allowed = scheduler->try_acquire(RATE_CLASS_CANCEL, GATEWAY_BATCH_CANCEL_WEIGHT, 0, current_ts);
+        else
+            allowed = scheduler->try_acquire(request_class(request), GATEWAY_BATCH_ORDER_WEIGHT, batch->num_requests, current_ts);
+        if(! allowed)
+            return(GATEWAY_THROTTLED);
+    }
+
+    gateway_context *context = free_contexts.back();
+    free_contexts.pop_back();
+    context->request = *request;
+    context->length = 0;
+    context->overflow = false;
+    context->response_code = 0;
+    context->num_usage = 0;
+    context->retry_after_ns = 0;
+    context->in_use = true;
+
+    // A batch is signed now and its params go in the body
+    const char *url = context->request.url;
+    const char *body = "";
+    context->batch_size = 0;
+    if(batch != nullptr){
+        context->batch_size = batch->num_requests;
+        memcpy(context->batch, batch->requests, batch->num_requests * sizeof(gateway_request));
+        batch_callback(context->batch, context->batch_size, context->body);
+        url = endpoints[request->endpoint].batch_url.c_str();
+        body = context->body;
+    }
+
+    curl_easy_setopt(context->easy, CURLOPT_URL, url);
+    switch(context->request.request_type) {
+        case GATEWAY_NEW_ORDER:
+            curl_easy_setopt(context->easy, CURLOPT_POST, 1L);
+            curl_easy_setopt(context->easy, CURLOPT_POSTFIELDS, body);
+            curl_easy_setopt(context->easy, CURLOPT_CUSTOMREQUEST, "POST");
+            break;
+        case GATEWAY_CANCEL_ORDER:
+            curl_easy_setopt(context->easy, CURLOPT_POST, 1L);
+            curl_easy_setopt(context->easy, CURLOPT_POSTFIELDS, body);
+            curl_easy_setopt(context->easy, CURLOPT_CUSTOMREQUEST, "DELETE");
+            break;
+        default:
+            curl_easy_setopt(context->easy, CURLOPT_HTTPGET, 1L);
+            curl_easy_setopt(context->easy, CURLOPT_CUSTOMREQUEST, NULL);
+            break;
+    }
+
+    endpoints[context->request.endpoint].last_request = current_ts;
+    context->send_ts = get_current_ts_ns();
+    curl_multi_add_handle(multi_handle, context->easy);
+    num_in_flight++;
+    if(num_in_flight > peak_in_flight)
+        peak_in_flight = num_in_flight;
+    int num_requests = (batch != nullptr) ? batch->num_requests : 1;
+    if(context->request.request_type == GATEWAY_CANCEL_ORDER)
+        num_cancels += num_requests;
+    else if(context->request.request_type == GATEWAY_NEW_ORDER)
+        num_orders += num_requests;
+    if(batch != nullptr)
+        num_batches++;
+    return(GATEWAY_LAUNCHED);
+}
+
+// -----------------------------------------------------------------------
+// Sends the pending batch of the endpoint and class, a batch of one as the plain request it is.
+// When the rate limits hold it back its requests are held one by one, in order.
+// -----------------------------------------------------------------------
+int OrderGateway::launch_batch(int endpoint, int queue, uint64_t current_ts) {
+    gateway_batch *batch = &pending_batches[endpoint][queue];
+    if(batch->num_requests == 0)
+        return(GATEWAY_LAUNCHED);
+    int result = launch_request(&batch->requests[0], current_ts, (batch->num_requests > 1) ? batch : nullptr);
+    if(result == GATEWAY_NO_HANDLE)
+        return(result);
+    if(result == GATEWAY_THROTTLED){
+        for(int i = 0; i < batch->num_requests; i++)
+            held_requests[endpoint][queue].push_back(batch->requests[i]);
+        num_held += batch->num_requests;
+        num_throttled += batch->num_requests;
+    }
+    num_pending -= batch->num_requests;
+    batch->num_requests = 0;
+    return(result);
+}
+
+// -----------------------------------------------------------------------
+// Adds the request to the pending batch of its endpoint and class, the batch goes out once it is full.
+// Cancels in a batch have to be for one symbol, one for another sends the batch there is first.
+// False when the request couldn't be taken as there are no handles left.
+// -----------------------------------------------------------------------
+bool OrderGateway::add_to_batch(gateway_request *request, int queue, uint64_t current_ts) {
+    gateway_batch *batch = &pending_batches[request->endpoint][queue];
+    if( (batch->num_requests == batch_limit(request)) ||
+        ((batch->num_requests > 0) && (request->request_type == GATEWAY_CANCEL_ORDER) && (request->instrument_id != batch->requests[0].instrument_id)))
+    {
+        if(launch_batch(request->endpoint, queue, current_ts) == GATEWAY_NO_HANDLE)
+            return(false);
+    }
+    if(batch->num_requests == 0)
+        batch->first_ts = request->receive_ts;
+    batch->requests[batch->num_requests++] = *request;
+    num_pending++;
+    if(batch->num_requests == batch_limit(request))
+        launch_batch(request->endpoint, queue, current_ts);
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Sends the batches of the class that are full or whose window (from when the first request came in) is over.
+// False when there are no handles left.
+// -----------------------------------------------------------------------
+bool OrderGateway::launch_batches(int queue, uint64_t current_ts) {
+    for(int endpoint = 0; endpoint < num_endpoints; endpoint++){
+        gateway_batch *batch = &pending_batches[endpoint][queue];
+        if(batch->num_requests == 0)
+            continue;
+        uint64_t window_ns = endpoints[endpoint].batch_window_ns;
+        if( (batch->num_requests == batch_limit(&batch->requests[0])) || (window_ns == 0) ||
+            (current_ts >= (batch->first_ts + window_ns)))
+        {
+            if(launch_batch(endpoint, queue, current_ts) == GATEWAY_NO_HANDLE)
+                return(false);
+        }
+    }
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Retries the requests held back on the queue, oldest first per endpoint. Orders that
+// have waited too long are expired. False when there are no handles left.
+// -----------------------------------------------------------------------
+bool OrderGateway::launch_held_requests(int queue, uint64_t current_ts) {
+    for(int endpoint = 0; endpoint < num_endpoints; endpoint++){
+        std::deque<gateway_request> &held = held_requests[endpoint][queue];
+        while(! held.empty()){
+            gateway_request *request = &held.front();
+            // Cancels are never expired, they only get more important the longer they wait
+            if((queue != RATE_CLASS_CANCEL) && ((current_ts - request->receive_ts) > GATEWAY_MAX_HOLD_NS)){
+                if(expiry_callback)
+                    expiry_callback(request);
+                num_expired++;
+            } else {
+                int result = launch_request(request, current_ts);
+                if(result == GATEWAY_NO_HANDLE)
+                    return(false);
+                if(result == GATEWAY_THROTTLED)
+                    break;
+            }
+            held.pop_front();
+            num_held--;
+        }
+    }
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Starts queued requests - cancels first, then reduce-only orders, then new orders.
+// Requests behind a held one for the same endpoint are held too so they go out in order.
+// On endpoints that batch, what was queued together goes out as batches once the queue is
+// empty (or later, when the endpoint has a batch window).
+// -----------------------------------------------------------------------
+void OrderGateway::launch_requests(uint64_t current_ts) {
+    gateway_request *request;
+    for(int queue = 0; queue < GATEWAY_NUM_QUEUES; queue++){
+        if(! launch_held_requests(queue, current_ts))
+            return;
+        while(request_rings[queue].GetPopPtr(&request)){
+            std::deque<gateway_request> &held = held_requests[request->endpoint][queue];
+            int result;
+            if(! held.empty())
+                result = GATEWAY_THROTTLED;
+            else if((request->batch_item_length > 0) && (endpoints[request->endpoint].batch_url != "")){
+                if(! add_to_batch(request, queue, current_ts))
+                    return;
+                request_rings[queue].incrTail();
+                continue;
+            } else {
+                // Anything waiting to be batched was queued before it
+                if(launch_batch(request->endpoint, queue, current_ts) == GATEWAY_NO_HANDLE)
+                    return;
+                result = launch_request(request, current_ts);
+            }
+            if(result == GATEWAY_NO_HANDLE)
+                return;
+            if(result == GATEWAY_THROTTLED){
+                held.push_back(*request);
+                num_held++;
+                num_throttled++;
+            }
+            request_rings[queue].incrTail();
+        }
+        if(! launch_batches(queue, current_ts))
+            return;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Sends a ping to the endpoint, the response is only checked for errors
+// -----------------------------------------------------------------------
+void OrderGateway::send_ping(int endpoint, uint64_t current_ts) {
+    gateway_request ping = {};
+    ping.request_type = GATEWAY_PING;
+    ping.endpoint = endpoint;
+    strncpy(ping.url, endpoints[endpoint].ping_url.c_str(), GATEWAY_MAX_URL_LENGTH - 1);
+    launch_request(&ping, current_ts);
+}
+
+// -----------------------------------------------------------------------
+// Pings the endpoints that have been quiet so their connections don't go cold
+// -----------------------------------------------------------------------
+void OrderGateway::send_pings(uint64_t current_ts) {
+    for(int i = 0; i < num_endpoints; i++){
+        if((current_ts - endpoints[i].last_request) >= GATEWAY_KEEPALIVE_NS)
+            send_ping(i, current_ts);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Hands a finished transfer to the completion callback and frees the handle
+// -----------------------------------------------------------------------
+void OrderGateway::complete_request(gateway_context *context, CURLcode result) {
+    curl_easy_getinfo(context->easy, CURLINFO_RESPONSE_CODE, &context->response_code);
+    curl_multi_remove_handle(multi_handle, context->easy);
+    num_in_flight--;
+
+    RateLimitScheduler *scheduler = endpoints[context->request.endpoint].scheduler;
+    if(scheduler != nullptr){
+        uint64_t current_ts = get_current_ts_ns();
+        if(context->num_usage > 0)
+            scheduler->on_usage(context->usage, context->num_usage, context->send_ts, current_ts);
+        // 429 - over a limit, 418 - banned for carrying on after the 429s
+        if((context->response_code == 429) || (context->response_code == 418)){
+            logger->msg(WARN, "Rate limited (" + std::to_string(context->response_code) + ") by: " + endpoints[context->request.endpoint].base_url +
+                                ", retry after " + std::to_string(context->retry_after_ns / 1000000000UL) + "s");
+            scheduler->on_rate_limited(context->response_code == 418, context->retry_after_ns, current_ts);
+        }
+    }
+
+    context->result = context->overflow ? CURLE_WRITE_ERROR : result;
+    context->complete_ts = get_current_ts_ns();
+    context->response[context->length] = 0;
+
+    if(context->request.request_type == GATEWAY_PING){
+        if(context->result != CURLE_OK)
+            logger->msg(WARN, "Keepalive ping failed for: " + endpoints[context->request.endpoint].base_url + " (" + std::string(curl_easy_strerror(context->result)) + ")");
+    } else {
+        if(context->result != CURLE_OK)
+            num_failed++;
+        completion_callback(context);
+    }
+
+    context->in_use = false;
+    free_contexts.push_back(context);
+}
+
+// -----------------------------------------------------------------------
+// The gateway thread - opens the connections and then drives the multi handle
+// -----------------------------------------------------------------------
+void OrderGateway::gateway_loop() {
+    int running_handles;
+    int msgs_in_queue;
+    CURLMsg *curl_msg;
+
+    // Opens the connections up front so the first orders don't pay for the TLS handshakes
+    uint64_t current_ts = get_current_ts_ns();
+    for(int i = 0; i < num_endpoints; i++){
+        for(int j = 0; j < connections_per_endpoint; j++)
+            send_ping(i, current_ts);
+    }
+    logger->msg(INFO, "Order gateway started with " + std::to_string(max_in_flight) + " requests in flight and " +
+                        std::to_string(connections_per_endpoint) + " connections to each of " + std::to_string(num_endpoints) + " endpoints");
+
+    while(1){
+        current_ts = get_current_ts_ns();
+        launch_requests(current_ts);
+        send_pings(current_ts);
+
+        curl_multi_perform(multi_handle, &running_handles);
+        while((curl_msg = curl_multi_info_read(multi_handle, &msgs_in_queue))){
+            if(curl_msg->msg == CURLMSG_DONE){
+                gateway_context *context;
+                curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_PRIVATE, (char **) &context);
+                complete_request(context, curl_msg->data.result);
+            }
+        }
+        // Completions free handles, anything still queued can go out straight away
+        launch_requests(current_ts);
+        for(int i = 0; i < num_endpoints; i++){
+            if(endpoints[i].scheduler != nullptr)
+                endpoints[i].scheduler->refresh(current_ts);
+        }
+
+        if((current_ts - last_stats) > GATEWAY_STATS_NS){
+            last_stats = current_ts;
+            logger->msg(INFO, "Order gateway - orders: " + std::to_string(num_orders) + ", cancels: " + std::to_string(num_cancels) +
+                                ", failed: " + std::to_string(num_failed) + ", peak in flight: " + std::to_string(peak_in_flight) +
+                                ", throttled: " + std::to_string(num_throttled) + ", expired: " + std::to_string(num_expired) + ", held: " + std::to_string(num_held) +
+                                ", batches: " + std::to_string(num_batches));
+        }
+
+        // Sleeps until there is socket activity or send_request wakes us up - not for long if requests are held or waiting for a batch
+        curl_multi_poll(multi_handle, NULL, 0, ((num_held > 0) || (num_pending > 0)) ? GATEWAY_HELD_POLL_MS : 100, NULL);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Starts the gateway thread
+// -----------------------------------------------------------------------
+void OrderGateway::start() {
+    std::thread gateway_thread([this]() {
+        gateway_loop();
+    });
+    gateway_thread.detach();
+}
+
+// ########################################################################
+// PUBLIC METHODS - only to be called from the aeron thread
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// Queue a request to the gateway thread and wake it up
+// -----------------------------------------------------------------------
+void OrderGateway::send_request(gateway_request &&request) {
+    GatewayRequestRingT *ring = &request_rings[request_class(&request)];
+    while(!ring->tryEnqueue(std::move(request)));
+    curl_multi_wakeup(multi_handle);
+}
@@ -0,0 +1,285 @@
+#include "order_request_builder.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - hashes the padded key blocks once
+// -----------------------------------------------------------------------
+HmacSigner::HmacSigner(const char *key, size_t key_length) {
+    unsigned char key_block[HMAC_BLOCK_SIZE];
+    unsigned char pad[HMAC_BLOCK_SIZE];
+    memset(key_block, 0, HMAC_BLOCK_SIZE);
+
+    // Keys longer than a block are hashed first
+    if(key_length > HMAC_BLOCK_SIZE){
+        wc_Sha256 key_hash;
+        wc_InitSha256(&key_hash);
+        wc_Sha256Update(&key_hash, (const byte *) key, key_length);
+        wc_Sha256Final(&key_hash, key_block);
+        wc_Sha256Free(&key_hash);
+    } else {
+        memcpy(key_block, key, key_length);
+    }
+
+    for(int i = 0; i < HMAC_BLOCK_SIZE; i++)
+        pad[i] = key_block[i] ^ 0x36;
+    wc_InitSha256(&inner_state);
+    wc_Sha256Update(&inner_state, pad, HMAC_BLOCK_SIZE);
+
+    for(int i = 0; i < HMAC_BLOCK_SIZE; i++)
+        pad[i] = key_block[i] ^ 0x5c;
+    wc_InitSha256(&outer_state);
+    wc_Sha256Update(&outer_state, pad, HMAC_BLOCK_SIZE);
+
+    memset(key_block, 0, HMAC_BLOCK_SIZE);
+    memset(pad, 0, HMAC_BLOCK_SIZE);
+}
+
+HmacSigner::~HmacSigner() {
+    wc_Sha256Free(&inner_state);
+    wc_Sha256Free(&outer_state);
+}
+
+// -----------------------------------------------------------------------
+// HMAC-SHA256 of msg into digest (32 bytes) - works on copies so the signer can be shared
+// -----------------------------------------------------------------------
+void HmacSigner::sign(const char *msg, size_t msg_length, unsigned char *digest) {
+    wc_Sha256 state;
+    unsigned char inner_digest[HMAC_DIGEST_SIZE];
+
+    wc_Sha256Copy(&inner_state, &state);
+    wc_Sha256Update(&state, (const byte *) msg, msg_length);
+    wc_Sha256Final(&state, inner_digest);
+
+    wc_Sha256Copy(&outer_state, &state);
+    wc_Sha256Update(&state, inner_digest, HMAC_DIGEST_SIZE);
+    wc_Sha256Final(&state, digest);
+    wc_Sha256Free(&state);
+}
+
+// -----------------------------------------------------------------------
+// HMAC-SHA256 of msg as 64 hex chars into output, terminated
+// -----------------------------------------------------------------------
+int HmacSigner::sign_hex(const char *msg, size_t msg_length, char *output) {
+    unsigned char digest[HMAC_DIGEST_SIZE];
+    sign(msg, msg_length, digest);
+    hex_encode(digest, HMAC_DIGEST_SIZE, output);
+    output[HMAC_HEX_SIZE] = 0;
+    return(HMAC_HEX_SIZE);
+}
+
+// -----------------------------------------------------------------------
+// Writes the digits of value, returns how many
+// -----------------------------------------------------------------------
+static int uint64_to_ascii(uint64_t value, char *output) {
+    char digits[20];
+    int num_digits = 0;
+    do {
+        digits[num_digits++] = '0' + (value % 10);
+        value /= 10;
+    } while(value != 0);
+    for(int i = 0; i < num_digits; i++)
+        output[i] = digits[num_digits - 1 - i];
+    return(num_digits);
+}
+
+// -----------------------------------------------------------------------
+// Constructor
+// -----------------------------------------------------------------------
+OrderRequestBuilder::OrderRequestBuilder(std::string secret_key) {
+    signer = new HmacSigner(secret_key.c_str(), secret_key.length());
+}
+
+order_template *OrderRequestBuilder::get_template(uint32_t instrument_id) {
+    auto found = templates.find(instrument_id);
+    if(found == templates.end())
+        return(nullptr);
+    return(found->second);
+}
+
+int OrderRequestBuilder::write_prefix(char *output, std::string &rest_endpoint, const char *instrument_name, const char *params) {
+    return(snprintf(output, ORDER_TEMPLATE_PREFIX_LENGTH, "%sorder?symbol=%s%s", rest_endpoint.c_str(), instrument_name, params));
+}
+
+// {"symbol":"BTCUSDT","side":"BUY","type":"LIMIT","timeInForce":"GTC","quantity":" - url encoded
+int OrderRequestBuilder::write_batch_prefix(char *output, const char *instrument_name, const char *side) {
+    return(snprintf(output, ORDER_TEMPLATE_PREFIX_LENGTH, "%%7B%%22symbol%%22%%3A%%22%s%%22%%2C%%22side%%22%%3A%%22%s%%22%%2C"
+                                                            "%%22type%%22%%3A%%22LIMIT%%22%%2C%%22timeInForce%%22%%3A%%22GTC%%22%%2C"
+                                                            "%%22quantity%%22%%3A%%22", instrument_name, side));
+}
+
+// -----------------------------------------------------------------------
+// Builds the template of an instrument, done once on its first order
+// cancel_with_type - futures/DEX cancels carry type=DELETE
+// -----------------------------------------------------------------------
+order_template *OrderRequestBuilder::add_template(uint32_t instrument_id, std::string rest_endpoint, const char *instrument_name,
+                                                    uint8_t price_precision, uint8_t qty_precision, bool cancel_with_type) {
+    order_template *order_tmpl = new order_template();
+    order_tmpl->instrument_id = instrument_id;
+    order_tmpl->price_precision = (price_precision != 0) ? price_precision : 8;
+    order_tmpl->qty_precision = (qty_precision != 0) ? qty_precision : 8;
+    order_tmpl->body_offset = rest_endpoint.length() + 6;   // "order?"
+    order_tmpl->buy_prefix_length = write_prefix(order_tmpl->buy_prefix, rest_endpoint, instrument_name,
+                                                    "&side=BUY&type=LIMIT&timeInForce=GTC&quantity=");
+    order_tmpl->sell_prefix_length = write_prefix(order_tmpl->sell_prefix, rest_endpoint, instrument_name,
+                                                    "&side=SELL&type=LIMIT&timeInForce=GTC&quantity=");
+    order_tmpl->cancel_prefix_length = write_prefix(order_tmpl->cancel_prefix, rest_endpoint, instrument_name,
+                                                    cancel_with_type ? "&type=DELETE&origClientOrderId=" : "&origClientOrderId=");
+    order_tmpl->buy_batch_prefix_length = write_batch_prefix(order_tmpl->buy_batch_prefix, instrument_name, "BUY");
+    order_tmpl->sell_batch_prefix_length = write_batch_prefix(order_tmpl->sell_batch_prefix, instrument_name, "SELL");
+    strncpy(order_tmpl->symbol, instrument_name, ORDER_TEMPLATE_SYMBOL_LENGTH - 1);
+    templates[instrument_id] = order_tmpl;
+    return(order_tmpl);
+}
+
+// -----------------------------------------------------------------------
+// Appends timestamp and the signature over everything from body_offset, returns the url length
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::write_signed_tail(char *url, char *url_end, uint16_t body_offset, uint64_t timestamp_millis) {
+    memcpy(url_end, "&recvWindow=5000&timestamp=", 27);
+    url_end += 27;
+    url_end += uint64_to_ascii(timestamp_millis, url_end);
+
+    char *body = url + body_offset;
+    size_t body_length = url_end - body;
+    memcpy(url_end, "&signature=", 11);
+    url_end += 11;
+    url_end += signer->sign_hex(body, body_length, url_end);
+    return(url_end - url);
+}
+
+// -----------------------------------------------------------------------
+// Signed limit GTC new order url into output, returns its length (output is terminated)
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::build_new_order(order_template *order_tmpl, bool is_buy, double price, double qty, const char *client_order_id,
+                                            uint64_t timestamp_millis, char *output) {
+    char *url_end = output;
+    if(is_buy){
+        memcpy(url_end, order_tmpl->buy_prefix, order_tmpl->buy_prefix_length);
+        url_end += order_tmpl->buy_prefix_length;
+    } else {
+        memcpy(url_end, order_tmpl->sell_prefix, order_tmpl->sell_prefix_length);
+        url_end += order_tmpl->sell_prefix_length;
+    }
+
+    // double_to_ascii counts the terminating zero in for 0.0
+    url_end += double_to_ascii(qty, url_end, order_tmpl->qty_precision);
+    url_end = output + strnlen(output, url_end - output);
+    memcpy(url_end, "&price=", 7);
+    url_end += 7;
+    url_end += double_to_ascii(price, url_end, order_tmpl->price_precision);
+    url_end = output + strnlen(output, url_end - output);
+
+    memcpy(url_end, "&newClientOrderId=", 18);
+    url_end += 18;
+    size_t id_length = strlen(client_order_id);
+    memcpy(url_end, client_order_id, id_length);
+    url_end += id_length;
+
+    return(write_signed_tail(output, url_end, order_tmpl->body_offset, timestamp_millis));
+}
+
+// -----------------------------------------------------------------------
+// Signed cancel url into output, returns its length (output is terminated)
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::build_cancel(order_template *order_tmpl, const char *client_order_id, uint64_t timestamp_millis, char *output) {
+    char *url_end = output;
+    memcpy(url_end, order_tmpl->cancel_prefix, order_tmpl->cancel_prefix_length);
+    url_end += order_tmpl->cancel_prefix_length;
+
+    size_t id_length = strlen(client_order_id);
+    memcpy(url_end, client_order_id, id_length);
+    url_end += id_length;
+
+    return(write_signed_tail(output, url_end, order_tmpl->body_offset, timestamp_millis));
+}
+
+// -----------------------------------------------------------------------
+// Signature for anything else signed with the same key (websocket API params)
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::sign_hex(const char *msg, size_t msg_length, char *output) {
+    return(signer->sign_hex(msg, msg_length, output));
+}
+
+// -----------------------------------------------------------------------
+// One url encoded batchOrders element into output, returns its length (not terminated)
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::build_batch_order_item(order_template *order_tmpl, bool is_buy, double price, double qty, const char *client_order_id,
+                                                    char *output) {
+    char *item_end = output;
+    if(is_buy){
+        memcpy(item_end, order_tmpl->buy_batch_prefix, order_tmpl->buy_batch_prefix_length);
+        item_end += order_tmpl->buy_batch_prefix_length;
+    } else {
+        memcpy(item_end, order_tmpl->sell_batch_prefix, order_tmpl->sell_batch_prefix_length);
+        item_end += order_tmpl->sell_batch_prefix_length;
+    }
+
+    // double_to_ascii counts the terminating zero in for 0.0
+    item_end += double_to_ascii(qty, item_end, order_tmpl->qty_precision);
+    item_end = output + strnlen(output, item_end - output);
+    memcpy(item_end, "%22%2C%22price%22%3A%22", 23);
+    item_end += 23;
+    item_end += double_to_ascii(price, item_end, order_tmpl->price_precision);
+    item_end = output + strnlen(output, item_end - output);
+
+    memcpy(item_end, "%22%2C%22newClientOrderId%22%3A%22", 34);
+    item_end += 34;
+    size_t id_length = strlen(client_order_id);
+    memcpy(item_end, client_order_id, id_length);
+    item_end += id_length;
+    memcpy(item_end, "%22%7D", 6);
+    item_end += 6;
+    return(item_end - output);
+}
+
+// -----------------------------------------------------------------------
+// Signed "batchOrders=[<item>,<item>..]" body into output, returns its length (output is terminated)
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::build_batch_orders(const char **items, const uint16_t *item_lengths, int num_items, uint64_t timestamp_millis,
+                                                char *output) {
+    char *body_end = output;
+    memcpy(body_end, "batchOrders=%5B", 15);
+    body_end += 15;
+    for(int i = 0; i < num_items; i++){
+        if(i > 0){
+            memcpy(body_end, "%2C", 3);
+            body_end += 3;
+        }
+        memcpy(body_end, items[i], item_lengths[i]);
+        body_end += item_lengths[i];
+    }
+    memcpy(body_end, "%5D", 3);
+    body_end += 3;
+
+    return(write_signed_tail(output, body_end, 0, timestamp_millis));
+}
+
+// -----------------------------------------------------------------------
+// Signed "symbol=<symbol>&origClientOrderIdList=["<id>","<id>"..]" body into output, returns its length
+// (output is terminated)
+// -----------------------------------------------------------------------
+int OrderRequestBuilder::build_batch_cancel(const char *symbol, const char **client_order_ids, int num_ids, uint64_t timestamp_millis,
+                                                char *output) {
+    char *body_end = output;
+    memcpy(body_end, "symbol=", 7);
+    body_end += 7;
+    size_t symbol_length = strlen(symbol);
+    memcpy(body_end, symbol, symbol_length);
+    body_end += symbol_length;
+    memcpy(body_end, "&origClientOrderIdList=%5B", 26);
+    body_end += 26;
+    for(int i = 0; i < num_ids; i++){
+        if(i > 0){
+            memcpy(body_end, "%2C", 3);
+            body_end += 3;
+        }
+        size_t id_length = strlen(client_order_ids[i]);
+        memcpy(body_end, "%22", 3);
+        memcpy(body_end + 3, client_order_ids[i], id_length);
+        memcpy(body_end + 3 + id_length, "%22", 3);
+        body_end += id_length + 6;
+    }
+    memcpy(body_end, "%5D", 3);
+    body_end += 3;
+
+    return(write_signed_tail(output, body_end, 0, timestamp_millis));
+}
@@ -0,0 +1,249 @@
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#include <wolfssl/options.h>
+#include <wolfssl/wolfcrypt/hmac.h>
+#include "order_request_builder.hpp"
+#include "latency_histogram.hpp"
+
+#define BENCH_DEFAULT_ORDERS        1000000
+#define BENCH_URL_LENGTH            512
+#define BENCH_REST_ENDPOINT         "https://api.binance.com/api/v3/"
+// The example key from the Binance API docs, so the urls can be checked against them
+#define BENCH_SECRET_KEY            "NhqPtmdSJYdKjVHjA7PZj4Mge3R5YNiP1e3UZjInClVN65XAbvqqM6A7H5fATj0j"
+
+struct bench_order {
+    bool is_buy;
+    double price;
+    double qty;
+    char client_order_id[32];
+    uint64_t timestamp_millis;
+};
+
+struct bench_result {
+    std::string name;
+    latency_histogram *order_latency;
+    latency_histogram *cancel_latency;
+};
+
+void print_options(){
+    std::cout << "Options for order_sign_bench:" << std::endl;
+    std::cout << "  [-n (--orders) <ORDERS>]                                = Orders and cancels to sign per run (default 1000000)" << std::endl;
+    std::cout << "  [-s (--symbol) <SYMBOL>]                                = Symbol in the requests (default BTCUSDT)" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+uint64_t get_monotonic_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// The way the trade adapter signed before the builder: a keyed HMAC per request
+// and the url put together in std::strings
+// -----------------------------------------------------------------------
+std::string legacy_hmac_hex(std::string &key, std::string &msg) {
+    Hmac hmac;
+    byte digest[SHA256_DIGEST_SIZE];
+    char buffer[HMAC_HEX_SIZE];
+    wc_HmacInit(&hmac, NULL, INVALID_DEVID);
+    wc_HmacSetKey(&hmac, WC_SHA256, (byte *) key.c_str(), key.length());
+    wc_HmacUpdate(&hmac, (byte *) msg.c_str(), msg.length());
+    wc_HmacFinal(&hmac, digest);
+    wc_HmacFree(&hmac);
+    for(int i = 0; i < SHA256_DIGEST_SIZE; i++){
+        buffer[2 * i] = "0123456789abcdef"[digest[i] >> 4];
+        buffer[(2 * i) + 1] = "0123456789abcdef"[digest[i] & 0x0f];
+    }
+    return(std::string(buffer, HMAC_HEX_SIZE));
+}
+
+int legacy_new_order(std::string &key, std::string &symbol, bench_order &order, char *output) {
+    char number[32];
+    std::string body = "symbol=" + symbol + (order.is_buy ? "&side=BUY" : "&side=SELL") + "&type=LIMIT&timeInForce=GTC&quantity=";
+    double_to_ascii(order.qty, number, 8);
+    body += number;
+    body += "&price=";
+    double_to_ascii(order.price, number, 8);
+    body += number;
+    body += "&newClientOrderId=" + std::string(order.client_order_id) + "&recvWindow=5000&timestamp=" + std::to_string(order.timestamp_millis);
+    std::string url = BENCH_REST_ENDPOINT "order?" + body + "&signature=" + legacy_hmac_hex(key, body);
+    strncpy(output, url.c_str(), BENCH_URL_LENGTH - 1);
+    return(url.length());
+}
+
+int legacy_cancel(std::string &key, std::string &symbol, bench_order &order, char *output) {
+    std::string body = "symbol=" + symbol + "&origClientOrderId=" + std::string(order.client_order_id) +
+                        "&recvWindow=5000&timestamp=" + std::to_string(order.timestamp_millis);
+    std::string url = BENCH_REST_ENDPOINT "order?" + body + "&signature=" + legacy_hmac_hex(key, body);
+    strncpy(output, url.c_str(), BENCH_URL_LENGTH - 1);
+    return(url.length());
+}
+
+// -----------------------------------------------------------------------
+// Orders the runs sign, made up front so only the signing is timed
+// -----------------------------------------------------------------------
+std::vector<bench_order> make_orders(uint64_t num_orders) {
+    std::vector<bench_order> orders(num_orders);
+    uint64_t timestamp_millis = 1700000000000;
+    for(uint64_t i = 0; i < num_orders; i++){
+        orders[i].is_buy = (i % 2) == 0;
+        orders[i].price = 30000.0 + ((i % 1000) * 0.01);
+        orders[i].qty = 0.001 * (1 + (i % 50));
+        snprintf(orders[i].client_order_id, sizeof(orders[i].client_order_id), "%lu", 1000000000000 + i);
+        orders[i].timestamp_millis = timestamp_millis + (i / 100);
+    }
+    return(orders);
+}
+
+// -----------------------------------------------------------------------
+// Signs every order and a cancel for it, each request timed on its own
+// -----------------------------------------------------------------------
+bench_result run_benchmark(std::string name, std::vector<bench_order> &orders,
+                            std::function<int(bench_order &, char *)> sign_order, std::function<int(bench_order &, char *)> sign_cancel) {
+    bench_result result;
+    result.name = name;
+    result.order_latency = new latency_histogram();
+    result.cancel_latency = new latency_histogram();
+    char url[BENCH_URL_LENGTH];
+    std::cout << "Running " << name << std::endl;
+
+    // What the clock itself costs, taken off every sample
+    uint64_t timer_overhead = UINT64_MAX;
+    for(int i = 0; i < 1000; i++){
+        uint64_t before = get_monotonic_ts();
+        timer_overhead = std::min(timer_overhead, get_monotonic_ts() - before);
+    }
+
+    for(auto &order: orders){
+        uint64_t before = get_monotonic_ts();
+        sign_order(order, url);
+        uint64_t after = get_monotonic_ts();
+        record_latency(result.order_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+
+        before = get_monotonic_ts();
+        sign_cancel(order, url);
+        after = get_monotonic_ts();
+        record_latency(result.cancel_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+    }
+    return(result);
+}
+
+// -----------------------------------------------------------------------
+// p50..max from a histogram, in ns
+// -----------------------------------------------------------------------
+std::string format_percentiles(latency_histogram *histogram) {
+    uint64_t count = histogram->count.load();
+    uint64_t buckets[LATENCY_BUCKETS];
+    for(int i = 0; i < LATENCY_BUCKETS; i++)
+        buckets[i] = histogram->buckets[i].load();
+    std::ostringstream line;
+    line << std::setw(10) << count;
+    line << std::setw(9) << ((count > 0) ? histogram->sum.load() / count : 0);
+    for(double percentile: {50.0, 90.0, 99.0, 99.9})
+        line << std::setw(9) << LatencyReader::get_percentile(buckets, count, percentile);
+    line << std::setw(11) << histogram->max.load();
+    return(line.str());
+}
+
+void print_results(std::vector<bench_result> &results) {
+    std::cout << std::endl << std::setw(12) << "signer" << std::setw(8) << " " << std::setw(10) << "count" << std::setw(9) << "avg_ns";
+    std::cout << std::setw(9) << "p50_ns" << std::setw(9) << "p90_ns" << std::setw(9) << "p99_ns" << std::setw(9) << "p99.9_ns" << std::setw(11) << "max_ns" << std::endl;
+    for(auto &result: results){
+        std::cout << std::setw(12) << result.name << std::setw(8) << "order" << format_percentiles(result.order_latency) << std::endl;
+        std::cout << std::setw(12) << result.name << std::setw(8) << "cancel" << format_percentiles(result.cancel_latency) << std::endl;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Both ways have to come up with the same url, or the timings don't mean anything
+// -----------------------------------------------------------------------
+uint64_t cross_check(std::vector<bench_order> &orders, std::function<int(bench_order &, char *)> legacy,
+                        std::function<int(bench_order &, char *)> precomputed, std::string request_name) {
+    char legacy_url[BENCH_URL_LENGTH];
+    char precomputed_url[BENCH_URL_LENGTH];
+    uint64_t num_mismatches = 0;
+    for(uint64_t i = 0; i < std::min((size_t) 1000, orders.size()); i++){
+        memset(legacy_url, 0, BENCH_URL_LENGTH);
+        memset(precomputed_url, 0, BENCH_URL_LENGTH);
+        legacy(orders[i], legacy_url);
+        precomputed(orders[i], precomputed_url);
+        if(strcmp(legacy_url, precomputed_url) != 0){
+            if(num_mismatches == 0){
+                std::cout << "Mismatch on " << request_name << " " << i << std::endl;
+                std::cout << "  legacy:      " << legacy_url << std::endl;
+                std::cout << "  precomputed: " << precomputed_url << std::endl;
+            }
+            num_mismatches++;
+        }
+    }
+    std::cout << request_name << " urls cross checked, " << num_mismatches << " mismatches" << std::endl;
+    return(num_mismatches);
+}
+
+int main(int argc, char* argv[]) {
+
+    uint64_t num_orders = BENCH_DEFAULT_ORDERS;
+    std::string symbol = "BTCUSDT";
+    std::string secret_key = BENCH_SECRET_KEY;
+
+    static struct option long_options[] = {
+        {"orders"           , optional_argument, NULL, 'n'},
+        {"symbol"           , optional_argument, NULL, 's'},
+        {"help"             , optional_argument, NULL,'h'}};
+
+    int cmd_option;
+    while((cmd_option = getopt_long(argc,argv,"n:s:h", long_options, NULL)) != -1) {
+        switch (cmd_option) {
+            case 'h':
+            print_options();
+            exit(0);
+            break;
+
+            case 'n':
+            num_orders = std::max(1L, atol(optarg));
+            break;
+
+            case 's':
+            symbol = optarg;
+            break;
+        }
+    }
+
+    std::vector<bench_order> orders = make_orders(num_orders);
+
+    OrderRequestBuilder *order_builder = new OrderRequestBuilder(secret_key);
+    order_template *order_tmpl = order_builder->add_template(1, BENCH_REST_ENDPOINT, symbol.c_str(), 8, 8, false);
+
+    std::function<int(bench_order &, char *)> legacy_order = [&](bench_order &order, char *url) {
+        return(legacy_new_order(secret_key, symbol, order, url));
+    };
+    std::function<int(bench_order &, char *)> legacy_cancel_order = [&](bench_order &order, char *url) {
+        return(legacy_cancel(secret_key, symbol, order, url));
+    };
+    std::function<int(bench_order &, char *)> precomputed_order = [&](bench_order &order, char *url) {
+        return(order_builder->build_new_order(order_tmpl, order.is_buy, order.price, order.qty, order.client_order_id, order.timestamp_millis, url));
+    };
+    std::function<int(bench_order &, char *)> precomputed_cancel = [&](bench_order &order, char *url) {
+        return(order_builder->build_cancel(order_tmpl, order.client_order_id, order.timestamp_millis, url));
+    };
+
+    uint64_t num_mismatches = cross_check(orders, legacy_order, precomputed_order, "order");
+    num_mismatches += cross_check(orders, legacy_cancel_order, precomputed_cancel, "cancel");
+
+    std::vector<bench_result> results;
+    results.push_back(run_benchmark("legacy", orders, legacy_order, legacy_cancel_order));
+    results.push_back(run_benchmark("precomputed", orders, precomputed_order, precomputed_cancel));
+
+    print_results(results);
+    std::cout << std::endl;
+    return((num_mismatches == 0) ? 0 : 1);
+}
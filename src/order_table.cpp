@@ -0,0 +1,338 @@
+#include "order_table.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - everything the table will ever use is allocated here. The indexes
+// and the history ring are masked, so both sizes are rounded up to powers of two.
+// -----------------------------------------------------------------------
+OrderTable::OrderTable(uint32_t _capacity, uint32_t _history_capacity) {
+    capacity = 1;
+    while(capacity < _capacity)
+        capacity <<= 1;
+    history_capacity = 1;
+    while(history_capacity < _history_capacity)
+        history_capacity <<= 1;
+    index_mask = (capacity * ORDER_TABLE_INDEX_FACTOR) - 1;
+
+    records = new order_record[capacity]();
+    internal_index = new uint32_t[index_mask + 1]();
+    external_index = new uint32_t[index_mask + 1]();
+    exchange_index = new uint32_t[index_mask + 1]();
+    history = new uint32_t[history_capacity]();
+
+    // Handed out from the back, so slot 0 goes first
+    free_slots = new uint32_t[capacity];
+    for(uint32_t i = 0; i < capacity; i++)
+        free_slots[i] = capacity - 1 - i;
+    num_free = capacity;
+
+    stats.capacity = capacity;
+    stats.history_capacity = history_capacity;
+}
+
+// -----------------------------------------------------------------------
+// Spreads the bits of an id over the whole word (splitmix64 finaliser)
+// -----------------------------------------------------------------------
+uint64_t OrderTable::mix_hash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9UL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebUL;
+    key ^= key >> 31;
+    return(key);
+}
+
+// -----------------------------------------------------------------------
+// FNV-1a over the id characters
+// -----------------------------------------------------------------------
+uint64_t OrderTable::external_hash(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325UL;
+    for(int i = 0; (i < MAX_EXTERNAL_ORDER_ID_LENGTH) && (key[i] != 0); i++){
+        hash ^= (uint8_t) key[i];
+        hash *= 0x100000001b3UL;
+    }
+    return(mix_hash(hash));
+}
+
+// -----------------------------------------------------------------------
+// Zero padded copy of the id, so keys can be compared with one memcmp
+// -----------------------------------------------------------------------
+void OrderTable::make_external_key(const char *external_order_id, char *key) {
+    memset(key, 0, MAX_EXTERNAL_ORDER_ID_LENGTH);
+    strncpy(key, external_order_id, MAX_EXTERNAL_ORDER_ID_LENGTH - 1);
+}
+
+uint64_t OrderTable::slot_hash(uint32_t slot, int key_type) {
+    switch(key_type) {
+        case ORDER_KEY_INTERNAL:    return(mix_hash(records[slot].order.internal_order_id));
+        case ORDER_KEY_EXTERNAL:    return(external_hash(records[slot].external_order_id));
+        default:                    return(mix_hash(records[slot].exchange_order_id));
+    }
+}
+
+// -----------------------------------------------------------------------
+// Slot of the order or ORDER_TABLE_NOT_FOUND
+// -----------------------------------------------------------------------
+uint32_t OrderTable::find_internal_slot(uint64_t internal_order_id) {
+    uint32_t position = mix_hash(internal_order_id) & index_mask;
+    while(internal_index[position] != ORDER_TABLE_EMPTY){
+        uint32_t slot = internal_index[position] - 1;
+        if(records[slot].order.internal_order_id == internal_order_id)
+            return(slot);
+        position = (position + 1) & index_mask;
+    }
+    return(ORDER_TABLE_NOT_FOUND);
+}
+
+uint32_t OrderTable::find_external_slot(const char *key) {
+    uint32_t position = external_hash(key) & index_mask;
+    while(external_index[position] != ORDER_TABLE_EMPTY){
+        uint32_t slot = external_index[position] - 1;
+        if(memcmp(records[slot].external_order_id, key, MAX_EXTERNAL_ORDER_ID_LENGTH) == 0)
+            return(slot);
+        position = (position + 1) & index_mask;
+    }
+    return(ORDER_TABLE_NOT_FOUND);
+}
+
+uint32_t OrderTable::find_exchange_slot(uint64_t exchange_order_id) {
+    uint32_t position = mix_hash(exchange_order_id) & index_mask;
+    while(exchange_index[position] != ORDER_TABLE_EMPTY){
+        uint32_t slot = exchange_index[position] - 1;
+        if(records[slot].exchange_order_id == exchange_order_id)
+            return(slot);
+        position = (position + 1) & index_mask;
+    }
+    return(ORDER_TABLE_NOT_FOUND);
+}
+
+// -----------------------------------------------------------------------
+// Puts the slot in the first empty position from its home
+// -----------------------------------------------------------------------
+void OrderTable::index_insert(uint32_t *index, uint64_t hash, uint32_t slot) {
+    uint32_t position = hash & index_mask;
+    uint32_t probe = 0;
+    while(index[position] != ORDER_TABLE_EMPTY){
+        position = (position + 1) & index_mask;
+        probe++;
+    }
+    index[position] = slot + 1;
+    if(probe > stats.max_probe)
+        stats.max_probe = probe;
+}
+
+// -----------------------------------------------------------------------
+// Takes the slot out of the index and shifts the entries after it back into the gap,
+// so probe sequences never run over deleted positions
+// -----------------------------------------------------------------------
+void OrderTable::index_remove(uint32_t *index, int key_type, uint32_t slot) {
+    uint32_t hole = slot_hash(slot, key_type) & index_mask;
+    while(index[hole] != (slot + 1)){
+        if(index[hole] == ORDER_TABLE_EMPTY)
+            return;
+        hole = (hole + 1) & index_mask;
+    }
+
+    uint32_t next = (hole + 1) & index_mask;
+    while(index[next] != ORDER_TABLE_EMPTY){
+        uint32_t home = slot_hash(index[next] - 1, key_type) & index_mask;
+        // Moves back if the hole is between its home and where it is now
+        if(((next - home) & index_mask) >= ((next - hole) & index_mask)){
+            index[hole] = index[next];
+            hole = next;
+        }
+        next = (next + 1) & index_mask;
+    }
+    index[hole] = ORDER_TABLE_EMPTY;
+}
+
+// -----------------------------------------------------------------------
+// Drops the oldest retired order for good and frees its slot
+// -----------------------------------------------------------------------
+void OrderTable::evict_oldest() {
+    uint32_t slot = history[history_head];
+    history_head = (history_head + 1) & (history_capacity - 1);
+    history_count--;
+
+    index_remove(internal_index, ORDER_KEY_INTERNAL, slot);
+    index_remove(external_index, ORDER_KEY_EXTERNAL, slot);
+    if(records[slot].exchange_order_id != 0)
+        index_remove(exchange_index, ORDER_KEY_EXCHANGE, slot);
+    records[slot].state = ORDER_RECORD_FREE;
+    free_slots[num_free++] = slot;
+    stats.num_closed--;
+    stats.num_evicted++;
+}
+
+// -----------------------------------------------------------------------
+// Moves an open order into the history
+// -----------------------------------------------------------------------
+bool OrderTable::retire_slot(uint32_t slot) {
+    if(records[slot].state != ORDER_RECORD_OPEN)
+        return(false);
+    if(history_count == history_capacity)
+        evict_oldest();
+    records[slot].state = ORDER_RECORD_CLOSED;
+    history[(history_head + history_count) & (history_capacity - 1)] = slot;
+    history_count++;
+    stats.num_open--;
+    stats.num_closed++;
+    stats.num_retired++;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Retired orders still get stamped, fills can come in after the order is done
+// -----------------------------------------------------------------------
+bool OrderTable::stamp_slot(uint32_t slot, int point, uint64_t ts, TraceContext *trace) {
+    if((slot == ORDER_TABLE_NOT_FOUND) || (records[slot].trace.magic != TRACE_CONTEXT_MAGIC))
+        return(false);
+    TraceContext *record_trace = &records[slot].trace;
+    if((record_trace->stamps[point] == 0) || (point == TRACE_POINT_FILL_RECEIVE))
+        record_trace->stamps[point] = ts;
+    if(trace != nullptr)
+        *trace = *record_trace;
+    return(true);
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// Adds a new order, the oldest retired order makes room if the slab is full
+// -----------------------------------------------------------------------
+bool OrderTable::insert(SendOrder *order, const char *external_order_id, uint64_t exchange_order_id, TraceContext *trace) {
+    MyGuard guard(table_lock);
+    if(num_free == 0){
+        if(history_count == 0){
+            stats.num_full++;
+            return(false);
+        }
+        evict_oldest();
+    }
+
+    uint32_t slot = free_slots[--num_free];
+    order_record *record = &records[slot];
+    record->order = *order;
+    make_external_key(external_order_id, record->external_order_id);
+    record->exchange_order_id = exchange_order_id;
+    record->state = ORDER_RECORD_OPEN;
+    if(trace != nullptr)
+        record->trace = *trace;
+    else
+        record->trace.magic = 0;
+
+    index_insert(internal_index, mix_hash(order->internal_order_id), slot);
+    index_insert(external_index, external_hash(record->external_order_id), slot);
+    if(exchange_order_id != 0)
+        index_insert(exchange_index, mix_hash(exchange_order_id), slot);
+
+    stats.num_open++;
+    stats.num_inserts++;
+    if(stats.num_open > stats.peak_open)
+        stats.peak_open = stats.num_open;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Makes the order findable on the id the exchange gave it
+// -----------------------------------------------------------------------
+bool OrderTable::link_exchange_order_id(const char *external_order_id, uint64_t exchange_order_id) {
+    char key[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    make_external_key(external_order_id, key);
+    MyGuard guard(table_lock);
+    uint32_t slot = find_external_slot(key);
+    if(slot == ORDER_TABLE_NOT_FOUND)
+        return(false);
+    if(records[slot].exchange_order_id == exchange_order_id)
+        return(true);
+    if(records[slot].exchange_order_id != 0)
+        index_remove(exchange_index, ORDER_KEY_EXCHANGE, slot);
+    records[slot].exchange_order_id = exchange_order_id;
+    index_insert(exchange_index, mix_hash(exchange_order_id), slot);
+    return(true);
+}
+
+bool OrderTable::find_by_internal(uint64_t internal_order_id, order_record *record) {
+    MyGuard guard(table_lock);
+    uint32_t slot = find_internal_slot(internal_order_id);
+    if(slot == ORDER_TABLE_NOT_FOUND)
+        return(false);
+    *record = records[slot];
+    return(true);
+}
+
+bool OrderTable::find_by_external(const char *external_order_id, order_record *record) {
+    char key[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    make_external_key(external_order_id, key);
+    MyGuard guard(table_lock);
+    uint32_t slot = find_external_slot(key);
+    if(slot == ORDER_TABLE_NOT_FOUND)
+        return(false);
+    *record = records[slot];
+    return(true);
+}
+
+bool OrderTable::find_by_exchange(uint64_t exchange_order_id, order_record *record) {
+    MyGuard guard(table_lock);
+    uint32_t slot = find_exchange_slot(exchange_order_id);
+    if(slot == ORDER_TABLE_NOT_FOUND)
+        return(false);
+    *record = records[slot];
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// true only for the call that closed the order, the record is copied out if asked for
+// -----------------------------------------------------------------------
+bool OrderTable::retire_by_external(const char *external_order_id, order_record *record) {
+    char key[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    make_external_key(external_order_id, key);
+    MyGuard guard(table_lock);
+    uint32_t slot = find_external_slot(key);
+    if((slot == ORDER_TABLE_NOT_FOUND) || ! retire_slot(slot))
+        return(false);
+    if(record != nullptr)
+        *record = records[slot];
+    return(true);
+}
+
+bool OrderTable::retire_by_exchange(uint64_t exchange_order_id, order_record *record) {
+    MyGuard guard(table_lock);
+    uint32_t slot = find_exchange_slot(exchange_order_id);
+    if((slot == ORDER_TABLE_NOT_FOUND) || ! retire_slot(slot))
+        return(false);
+    if(record != nullptr)
+        *record = records[slot];
+    return(true);
+}
+
+bool OrderTable::stamp_trace(uint64_t internal_order_id, int point, uint64_t ts, TraceContext *trace) {
+    MyGuard guard(table_lock);
+    return(stamp_slot(find_internal_slot(internal_order_id), point, ts, trace));
+}
+
+bool OrderTable::stamp_trace(const char *external_order_id, int point, uint64_t ts, TraceContext *trace) {
+    char key[MAX_EXTERNAL_ORDER_ID_LENGTH];
+    make_external_key(external_order_id, key);
+    MyGuard guard(table_lock);
+    return(stamp_slot(find_external_slot(key), point, ts, trace));
+}
+
+// -----------------------------------------------------------------------
+// Only holds the lock for the slots asked for, so the aeron thread is never held up for long
+// -----------------------------------------------------------------------
+uint32_t OrderTable::copy_open(uint32_t first_slot, uint32_t num_slots, order_record *output) {
+    MyGuard guard(table_lock);
+    uint32_t num_open = 0;
+    for(uint32_t slot = first_slot; (slot < capacity) && (slot < (first_slot + num_slots)); slot++){
+        if(records[slot].state == ORDER_RECORD_OPEN)
+            output[num_open++] = records[slot];
+    }
+    return(num_open);
+}
+
+order_table_stats OrderTable::get_stats() {
+    MyGuard guard(table_lock);
+    return(stats);
+}
@@ -0,0 +1,512 @@
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "sequence_binary_files.hpp"
+#include "binary_file.hpp"
+#include "merged_orderbook.hpp"
+#include "array_orderbook.hpp"
+#include "latency_histogram.hpp"
+
+#define BENCH_DEFAULT_DEPTH         10
+#define BENCH_DEFAULT_CHECK_EVERY   1000
+#define BENCH_SNAPSHOT_BUFFER_SIZE  16*1024*1024
+#define BENCH_MAX_MISMATCHES_SHOWN  10
+
+enum PerfCounter {
+    PERF_CYCLES         = 0,
+    PERF_INSTRUCTIONS   = 1,
+    PERF_CACHE_MISSES   = 2,
+    PERF_BRANCH_MISSES  = 3,
+    PERF_NUM_COUNTERS   = 4
+};
+
+// Replayed messages, back to back in one buffer so the replay itself does not miss the cache
+struct preloaded_messages {
+    std::vector<char> data;
+    std::vector<uint64_t> offsets;
+    uint64_t num_pl_updates = 0;
+    uint64_t num_tob_updates = 0;
+    uint64_t num_clears = 0;
+};
+
+// Top of the book of the instrument just updated, at one point of the replay
+struct book_checkpoint {
+    uint64_t message_number;
+    uint32_t instrument_id;
+    std::vector<PriceLevelDetails> bids;
+    std::vector<PriceLevelDetails> asks;
+};
+
+struct bench_result {
+    std::string name;
+    uint64_t num_updates;
+    uint64_t untimed_ns;
+    bool has_counters;
+    uint64_t counters[PERF_NUM_COUNTERS];
+    latency_histogram *update_latency;
+    latency_histogram *snapshot_latency;
+    std::vector<book_checkpoint> checkpoints;
+};
+
+bool file_exists(const std::string& name) {
+  struct stat buffer;
+  return (stat (name.c_str(), &buffer) == 0);
+}
+
+void print_options(){
+    std::cout << "Options for orderbook_bench:" << std::endl;
+    std::cout << "  -b (--binary_file) <binaryfilename>                     = Name of Binary File to read in (repeat for more files)" << std::endl;
+    std::cout << "  [-i (--instrument) <instrument-id>]                     = Only replay this instrument ID" << std::endl;
+    std::cout << "  [-I (--implementations) <merged,array>]                 = Books to run (default all)" << std::endl;
+    std::cout << "  [-d (--depth) <LEVELS>]                                 = Levels per side to cross check (default 10)" << std::endl;
+    std::cout << "  [-c (--check-every) <UPDATES>]                          = Snapshot and cross check every this many updates (default 1000)" << std::endl;
+    std::cout << "  [-k (--ticks) <TICKS>]                                  = Ticks per side for the array book (default 4096)" << std::endl;
+    std::cout << "  [-T (--no-tob)]                                         = Only replay depth updates, leave out top of book" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+uint64_t get_monotonic_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// cycles, instructions, cache misses and branch misses of this thread as one group
+// -----------------------------------------------------------------------
+class PerfCounters {
+    private:
+        int fds[PERF_NUM_COUNTERS];
+        bool available = true;
+
+        int open_counter(uint64_t config, int group_fd) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(struct perf_event_attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(struct perf_event_attr);
+            attr.config = config;
+            attr.disabled = (group_fd == -1) ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+        }
+
+    public:
+        PerfCounters() {
+            static const uint64_t configs[PERF_NUM_COUNTERS] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+            };
+            for(int i = 0; i < PERF_NUM_COUNTERS; i++){
+                fds[i] = open_counter(configs[i], (i == 0) ? -1 : fds[0]);
+                if(fds[i] < 0)
+                    available = false;
+            }
+            if(! available)
+                std::cout << "Hardware counters not available (check /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+        }
+
+        ~PerfCounters() {
+            for(int i = 0; i < PERF_NUM_COUNTERS; i++){
+                if(fds[i] >= 0)
+                    close(fds[i]);
+            }
+        }
+
+        bool is_available() {
+            return(available);
+        }
+
+        void start() {
+            if(! available)
+                return;
+            ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+
+        void stop(uint64_t *counters) {
+            if(! available)
+                return;
+            ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            // nr, time enabled, time running, then the counters
+            uint64_t values[3 + PERF_NUM_COUNTERS];
+            if(read(fds[0], values, sizeof(values)) != (ssize_t) sizeof(values))
+                return;
+            uint64_t time_enabled = values[1];
+            uint64_t time_running = values[2];
+            if(time_running == 0)
+                return;
+            // The group shared the PMU with others part of the time, scaled up to the whole pass
+            if(time_running < time_enabled)
+                std::cout << "Hardware counters ran " << (100 * time_running) / time_enabled << "% of the pass, scaled up" << std::endl;
+            for(int i = 0; i < PERF_NUM_COUNTERS; i++)
+                counters[i] = (uint64_t) (values[3 + i] * ((double) time_enabled / time_running));
+        }
+};
+
+// -----------------------------------------------------------------------
+// Reads all book messages from the binfiles into memory
+// -----------------------------------------------------------------------
+void preload(SequenceBinaryFiles *seq_bin_files, uint32_t instrument_id, bool include_tob, preloaded_messages &messages) {
+    char *msg_ptr;
+    while(seq_bin_files->get_next_message(&msg_ptr)) {
+        struct MessageHeader *msg = (struct MessageHeader *) msg_ptr;
+        uint32_t msg_instrument_id;
+        switch(msg->msgType){
+            case PL_UPDATE:
+                msg_instrument_id = ((PLUpdates *) msg_ptr)->instrument_id;
+                break;
+
+            case TOB_UPDATE:
+                if(! include_tob)
+                    continue;
+                msg_instrument_id = ((ToBUpdate *) msg_ptr)->instrument_id;
+                break;
+
+            case INSTRUMENT_CLEAR_BOOK:
+                msg_instrument_id = ((InstrumentClearBook *) msg_ptr)->instrument_id;
+                break;
+
+            default:
+                continue;
+        }
+        if((instrument_id != 0) && (msg_instrument_id != instrument_id))
+            continue;
+        messages.num_pl_updates += (msg->msgType == PL_UPDATE);
+        messages.num_tob_updates += (msg->msgType == TOB_UPDATE);
+        messages.num_clears += (msg->msgType == INSTRUMENT_CLEAR_BOOK);
+        messages.offsets.push_back(messages.data.size());
+        messages.data.insert(messages.data.end(), msg_ptr, msg_ptr + msg->msgLength);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Top depth levels per side out of a snapshot - every book can build one, so it is
+// the one view all implementations can be compared on
+// -----------------------------------------------------------------------
+void read_snapshot_levels(char *snap_buffer, int num_messages, int depth, book_checkpoint &checkpoint) {
+    char *msg_pointer = snap_buffer;
+    for(int i = 0; i < num_messages; i++){
+        PLUpdates *pl_updates = (PLUpdates *) msg_pointer;
+        PriceLevelDetails *pl_details = (PriceLevelDetails *) (msg_pointer + sizeof(PLUpdates));
+        for(int j = 0; j < pl_updates->num_of_pl_updates; j++){
+            if(pl_details[j].side == BUY_SIDE)
+                checkpoint.bids.push_back(pl_details[j]);
+            else
+                checkpoint.asks.push_back(pl_details[j]);
+        }
+        msg_pointer += pl_updates->msg_header.msgLength;
+    }
+    std::sort(checkpoint.bids.begin(), checkpoint.bids.end(), [](const PriceLevelDetails &a, const PriceLevelDetails &b) { return(a.price_level > b.price_level); });
+    std::sort(checkpoint.asks.begin(), checkpoint.asks.end(), [](const PriceLevelDetails &a, const PriceLevelDetails &b) { return(a.price_level < b.price_level); });
+    if(checkpoint.bids.size() > (size_t) depth)
+        checkpoint.bids.resize(depth);
+    if(checkpoint.asks.size() > (size_t) depth)
+        checkpoint.asks.resize(depth);
+}
+
+uint32_t get_message_instrument(char *msg_ptr) {
+    switch(((MessageHeader *) msg_ptr)->msgType){
+        case PL_UPDATE:     return(((PLUpdates *) msg_ptr)->instrument_id);
+        case TOB_UPDATE:    return(((ToBUpdate *) msg_ptr)->instrument_id);
+        default:            return(((InstrumentClearBook *) msg_ptr)->instrument_id);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Returns the book for the instrument, created the first time
+// -----------------------------------------------------------------------
+template <typename Book>
+Book *get_book(std::unordered_map<uint32_t, Book*> &books, std::function<Book*()> &new_book, uint32_t instrument_id) {
+    Book *book;
+    auto found = books.find(instrument_id);
+    if(found == books.end()){
+        book = new_book();
+        books[instrument_id] = book;
+    } else {
+        book = found->second;
+    }
+    return(book);
+}
+
+template <typename Book>
+inline void process_message(Book *book, char *msg_ptr) {
+    switch(((MessageHeader *) msg_ptr)->msgType){
+        case PL_UPDATE:     book->process_update((PLUpdates *) msg_ptr); break;
+        case TOB_UPDATE:    book->process_update((ToBUpdate *) msg_ptr); break;
+        default:            book->clear_orderbook(); break;
+    }
+}
+
+// -----------------------------------------------------------------------
+// Replays everything twice into fresh books: once untouched under the hardware counters,
+// once timing every update and snapshotting/cross checking every check_every updates
+// -----------------------------------------------------------------------
+template <typename Book>
+bench_result run_benchmark(std::string name, std::function<Book*()> new_book, preloaded_messages &messages,
+                           PerfCounters *perf_counters, uint64_t check_every, int depth, char *snap_buffer) {
+    bench_result result;
+    result.name = name;
+    result.num_updates = messages.offsets.size();
+    result.has_counters = perf_counters->is_available();
+    memset(result.counters, 0, sizeof(result.counters));
+    result.update_latency = new latency_histogram();
+    result.snapshot_latency = new latency_histogram();
+    std::cout << "Running " << name << std::endl;
+
+    // Books are created up front so the passes only measure the updates
+    std::unordered_map<uint32_t, Book*> books;
+    std::vector<Book*> message_books;
+    message_books.reserve(messages.offsets.size());
+    auto make_books = [&]() {
+        for(auto &[instrument_id, book]: books)
+            delete(book);
+        books.clear();
+        message_books.clear();
+        for(auto offset: messages.offsets)
+            message_books.push_back(get_book<Book>(books, new_book, get_message_instrument(&messages.data[offset])));
+    };
+    make_books();
+
+    uint64_t start_ts = get_monotonic_ts();
+    perf_counters->start();
+    for(uint64_t i = 0; i < messages.offsets.size(); i++)
+        process_message(message_books[i], &messages.data[messages.offsets[i]]);
+    perf_counters->stop(result.counters);
+    result.untimed_ns = get_monotonic_ts() - start_ts;
+
+    // New books, a cleared one could keep what the first pass grew or warmed
+    make_books();
+
+    // What the clock itself costs, taken off every sample
+    uint64_t timer_overhead = UINT64_MAX;
+    for(int i = 0; i < 1000; i++){
+        uint64_t before = get_monotonic_ts();
+        timer_overhead = std::min(timer_overhead, get_monotonic_ts() - before);
+    }
+
+    for(uint64_t i = 0; i < messages.offsets.size(); i++){
+        char *msg_ptr = &messages.data[messages.offsets[i]];
+        uint64_t before = get_monotonic_ts();
+        process_message(message_books[i], msg_ptr);
+        uint64_t after = get_monotonic_ts();
+        record_latency(result.update_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+
+        if(((i + 1) % check_every) != 0)
+            continue;
+        book_checkpoint checkpoint;
+        checkpoint.message_number = i;
+        checkpoint.instrument_id = get_message_instrument(msg_ptr);
+        before = get_monotonic_ts();
+        int num_messages = message_books[i]->build_snapshot_from_current_book(snap_buffer);
+        after = get_monotonic_ts();
+        record_latency(result.snapshot_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+        read_snapshot_levels(snap_buffer, num_messages, depth, checkpoint);
+        result.checkpoints.push_back(std::move(checkpoint));
+    }
+
+    for(auto &[instrument_id, book]: books)
+        delete(book);
+    return(result);
+}
+
+// -----------------------------------------------------------------------
+// p50..max from a histogram, in ns
+// -----------------------------------------------------------------------
+std::string format_percentiles(latency_histogram *histogram) {
+    uint64_t count = histogram->count.load();
+    uint64_t buckets[LATENCY_BUCKETS];
+    for(int i = 0; i < LATENCY_BUCKETS; i++)
+        buckets[i] = histogram->buckets[i].load();
+    std::ostringstream line;
+    line << std::setw(10) << count;
+    line << std::setw(9) << ((count > 0) ? histogram->sum.load() / count : 0);
+    for(double percentile: {50.0, 90.0, 99.0, 99.9})
+        line << std::setw(9) << LatencyReader::get_percentile(buckets, count, percentile);
+    line << std::setw(11) << histogram->max.load();
+    return(line.str());
+}
+
+void print_results(std::vector<bench_result> &results) {
+    std::cout << std::endl << std::setw(10) << "book" << std::setw(8) << " " << std::setw(10) << "count" << std::setw(9) << "avg_ns";
+    std::cout << std::setw(9) << "p50_ns" << std::setw(9) << "p90_ns" << std::setw(9) << "p99_ns" << std::setw(9) << "p99.9_ns" << std::setw(11) << "max_ns" << std::endl;
+    for(auto &result: results){
+        std::cout << std::setw(10) << result.name << std::setw(8) << "update" << format_percentiles(result.update_latency) << std::endl;
+        std::cout << std::setw(10) << result.name << std::setw(8) << "snap" << format_percentiles(result.snapshot_latency) << std::endl;
+    }
+
+    std::cout << std::endl << std::setw(10) << "book" << std::setw(14) << "untimed_ns/upd" << std::setw(12) << "cycles/upd";
+    std::cout << std::setw(10) << "IPC" << std::setw(16) << "cache_miss/upd" << std::setw(17) << "branch_miss/upd" << std::endl;
+    for(auto &result: results){
+        double num_updates = std::max((uint64_t) 1, result.num_updates);
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << std::setw(10) << result.name << std::setw(14) << result.untimed_ns / num_updates;
+        if(result.has_counters){
+            std::cout << std::setw(12) << result.counters[PERF_CYCLES] / num_updates;
+            std::cout << std::setw(10) << result.counters[PERF_INSTRUCTIONS] / (double) std::max((uint64_t) 1, result.counters[PERF_CYCLES]);
+            std::cout << std::setw(16) << result.counters[PERF_CACHE_MISSES] / num_updates;
+            std::cout << std::setw(17) << result.counters[PERF_BRANCH_MISSES] / num_updates;
+        } else {
+            std::cout << std::setw(12) << "n/a" << std::setw(10) << "n/a" << std::setw(16) << "n/a" << std::setw(17) << "n/a";
+        }
+        std::cout << std::endl;
+    }
+}
+
+std::string format_levels(std::vector<PriceLevelDetails> &levels) {
+    std::string line = "";
+    for(auto &level: levels)
+        line += std::to_string(level.price_level) + "@" + std::to_string(level.quantity) + " ";
+    return(line);
+}
+
+// -----------------------------------------------------------------------
+// Compares every checkpoint against the first implementation, returns the number of mismatches
+// -----------------------------------------------------------------------
+uint64_t cross_check(std::vector<bench_result> &results) {
+    uint64_t num_mismatches = 0;
+    if(results.size() < 2)
+        return(0);
+
+    auto same_levels = [](std::vector<PriceLevelDetails> &a, std::vector<PriceLevelDetails> &b) {
+        if(a.size() != b.size())
+            return(false);
+        for(size_t i = 0; i < a.size(); i++){
+            if((a[i].price_level != b[i].price_level) || (a[i].quantity != b[i].quantity))
+                return(false);
+        }
+        return(true);
+    };
+
+    bench_result &reference = results[0];
+    for(size_t r = 1; r < results.size(); r++){
+        uint64_t result_mismatches = 0;
+        for(size_t i = 0; i < reference.checkpoints.size(); i++){
+            book_checkpoint &expected = reference.checkpoints[i];
+            book_checkpoint &actual = results[r].checkpoints[i];
+            if(same_levels(expected.bids, actual.bids) && same_levels(expected.asks, actual.asks))
+                continue;
+            result_mismatches++;
+            if(result_mismatches <= BENCH_MAX_MISMATCHES_SHOWN){
+                std::cout << "Mismatch " << reference.name << "/" << results[r].name << " at message " << expected.message_number;
+                std::cout << " instrument " << expected.instrument_id << std::endl;
+                std::cout << "  " << reference.name << " bids: " << format_levels(expected.bids) << " asks: " << format_levels(expected.asks) << std::endl;
+                std::cout << "  " << results[r].name << " bids: " << format_levels(actual.bids) << " asks: " << format_levels(actual.asks) << std::endl;
+            }
+        }
+        std::cout << results[r].name << " vs " << reference.name << ": " << result_mismatches << " of " << reference.checkpoints.size() << " checkpoints differ" << std::endl;
+        num_mismatches += result_mismatches;
+    }
+    return(num_mismatches);
+}
+
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> binary_filenames;
+    SequenceBinaryFiles *seq_bin_files;
+    uint32_t instrument_id = 0;
+    std::string implementations = "merged,array";
+    int depth = BENCH_DEFAULT_DEPTH;
+    uint64_t check_every = BENCH_DEFAULT_CHECK_EVERY;
+    uint32_t array_ticks = ARRAY_BOOK_DEFAULT_TICKS;
+    bool include_tob = true;
+
+    static struct option long_options[] = {
+        {"binary_file"      , required_argument, NULL, 'b'},
+        {"instrument"       , optional_argument, NULL, 'i'},
+        {"implementations"  , optional_argument, NULL, 'I'},
+        {"depth"            , optional_argument, NULL, 'd'},
+        {"check-every"      , optional_argument, NULL, 'c'},
+        {"ticks"            , optional_argument, NULL, 'k'},
+        {"no-tob"           , optional_argument, NULL, 'T'},
+        {"help"             , optional_argument, NULL,'h'}};
+
+    int cmd_option;
+    while((cmd_option = getopt_long(argc,argv,"b:i:I:d:c:k:Th", long_options, NULL)) != -1) {
+        switch (cmd_option) {
+            case 'h':
+            print_options();
+            exit(0);
+            break;
+
+            case 'b':
+            binary_filenames.push_back(std::string(optarg));
+            break;
+
+            case 'i':
+            instrument_id = std::stoul(optarg);
+            break;
+
+            case 'I':
+            implementations = optarg;
+            break;
+
+            case 'd':
+            depth = atoi(optarg);
+            break;
+
+            case 'c':
+            check_every = std::max(1, atoi(optarg));
+            break;
+
+            case 'k':
+            array_ticks = atoi(optarg);
+            break;
+
+            case 'T':
+            include_tob = false;
+            break;
+        }
+    }
+
+    if(binary_filenames.size() == 0){
+        print_options();
+        exit(0);
+    }
+
+    seq_bin_files = new SequenceBinaryFiles();
+    for(auto const& bin_filename: binary_filenames) {
+        if(file_exists(bin_filename))
+            seq_bin_files->add_binary_file(bin_filename, 0);
+        else
+            std::cout << "Filename: " << bin_filename << " does not exist" << std::endl;
+    }
+
+    preloaded_messages messages;
+    uint64_t load_start = get_monotonic_ts();
+    preload(seq_bin_files, instrument_id, include_tob, messages);
+    std::cout << "Loaded " << messages.offsets.size() << " messages (" << messages.num_pl_updates << " depth, " << messages.num_tob_updates << " tob, ";
+    std::cout << messages.num_clears << " clears) " << messages.data.size() / (1024*1024) << "MB in " << (get_monotonic_ts() - load_start) / 1000000 << "ms" << std::endl;
+    if(messages.offsets.empty())
+        exit(0);
+
+    PerfCounters *perf_counters = new PerfCounters();
+    char *snap_buffer = (char *) malloc(BENCH_SNAPSHOT_BUFFER_SIZE);
+    std::vector<bench_result> results;
+
+    if(implementations.find("merged") != std::string::npos){
+        std::function<MergedOrderbook*()> new_book = []() { return(new MergedOrderbook()); };
+        results.push_back(run_benchmark<MergedOrderbook>("merged", new_book, messages, perf_counters, check_every, depth, snap_buffer));
+    }
+    if(implementations.find("array") != std::string::npos){
+        std::function<ArrayOrderbook*()> new_book = [array_ticks]() { return(new ArrayOrderbook(0.0, array_ticks)); };
+        results.push_back(run_benchmark<ArrayOrderbook>("array", new_book, messages, perf_counters, check_every, depth, snap_buffer));
+    }
+
+    print_results(results);
+    std::cout << std::endl;
+    uint64_t num_mismatches = cross_check(results);
+    return((num_mismatches == 0) ? 0 : 1);
+}
@@ -0,0 +1,238 @@
+#include "rate_limit_scheduler.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - budgets are added with add_limit before the first request
+// -----------------------------------------------------------------------
+RateLimitScheduler::RateLimitScheduler(uint8_t _exchange_id, std::function<void(RateLimitStatus *)> _status_callback) {
+    exchange_id = _exchange_id;
+    status_callback = _status_callback;
+}
+
+void RateLimitScheduler::add_limit(uint8_t limit_type, uint64_t interval_ns, uint32_t limit) {
+    MyGuard guard(scheduler_lock);
+    rate_limit_window *window = find_window(limit_type, interval_ns);
+    if(window != nullptr){
+        window->limit = limit;
+        return;
+    }
+    if((num_windows == RATE_LIMIT_MAX_WINDOWS) || (interval_ns == 0))
+        return;
+    windows[num_windows++] = {limit_type, interval_ns, limit, 0, 0};
+}
+
+void RateLimitScheduler::set_class_cost(int request_class, uint32_t weight, uint32_t orders) {
+    class_weight[request_class] = weight;
+    class_orders[request_class] = orders;
+}
+
+// -----------------------------------------------------------------------
+// Interval of an X-MBX-*-<number><unit> header or a rateLimits entry (SECOND, MINUTE..)
+// -----------------------------------------------------------------------
+uint64_t RateLimitScheduler::interval_from_unit(uint32_t number, char unit) {
+    switch(unit) {
+        case 's': case 'S':     return(number * 1000000000UL);
+        case 'm': case 'M':     return(number * 60000000000UL);
+        case 'h': case 'H':     return(number * 3600000000000UL);
+        case 'd': case 'D':     return(number * 86400000000000UL);
+        default:                return(0);
+    }
+}
+
+double RateLimitScheduler::class_fraction(int request_class) {
+    switch(request_class) {
+        case RATE_CLASS_CANCEL:         return(1.0);
+        case RATE_CLASS_REDUCE_ONLY:    return(RATE_LIMIT_REDUCE_ONLY_FRACTION);
+        default:                        return(RATE_LIMIT_NEW_ORDER_FRACTION);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Starts a new window when the wall clock has moved past the current one
+// -----------------------------------------------------------------------
+void RateLimitScheduler::roll_window(rate_limit_window *window, uint64_t current_ts) {
+    uint64_t window_start = current_ts - (current_ts % window->interval_ns);
+    if(window_start != window->window_start){
+        window->window_start = window_start;
+        window->used = 0;
+    }
+}
+
+rate_limit_window *RateLimitScheduler::find_window(uint8_t limit_type, uint64_t interval_ns) {
+    for(int i = 0; i < num_windows; i++){
+        if((windows[i].limit_type == limit_type) && (windows[i].interval_ns == interval_ns))
+            return(&windows[i]);
+    }
+    return(nullptr);
+}
+
+// -----------------------------------------------------------------------
+// Level from the budget closest to its limit, scheduler_lock has to be held
+// -----------------------------------------------------------------------
+uint8_t RateLimitScheduler::current_level(uint64_t current_ts, rate_limit_window **worst) {
+    double worst_ratio = -1.0;
+    for(int i = 0; i < num_windows; i++){
+        roll_window(&windows[i], current_ts);
+        double ratio = (windows[i].limit > 0) ? ((double) windows[i].used / windows[i].limit) : 0.0;
+        if(ratio > worst_ratio){
+            worst_ratio = ratio;
+            *worst = &windows[i];
+        }
+    }
+    if(blocked_until > current_ts)
+        return(RATE_LIMIT_LEVEL_BLOCKED);
+    if(worst_ratio >= RATE_LIMIT_NEW_ORDER_FRACTION)
+        return(RATE_LIMIT_LEVEL_THROTTLED);
+    if(worst_ratio >= RATE_LIMIT_WARNING_FRACTION)
+        return(RATE_LIMIT_LEVEL_WARNING);
+    return(RATE_LIMIT_LEVEL_NORMAL);
+}
+
+// -----------------------------------------------------------------------
+// Fills in the status when the level changed, scheduler_lock has to be held
+// -----------------------------------------------------------------------
+void RateLimitScheduler::update_level(uint64_t current_ts, RateLimitStatus *status, bool *changed) {
+    rate_limit_window *worst = nullptr;
+    uint8_t new_level = current_level(current_ts, &worst);
+    *changed = (new_level != level);
+    if(! *changed)
+        return;
+
+    level = new_level;
+    memset(status, 0, sizeof(RateLimitStatus));
+    status->msg_header = MessageHeaderT{sizeof(RateLimitStatus), RATE_LIMIT_STATUS, 0};
+    status->timestamp = current_ts;
+    status->retry_after = (level == RATE_LIMIT_LEVEL_BLOCKED) ? blocked_until : 0;
+    status->num_held = num_held;
+    status->exchange_id = exchange_id;
+    status->level = level;
+    if(worst != nullptr){
+        status->interval_ns = worst->interval_ns;
+        status->used = worst->used;
+        status->limit = worst->limit;
+        status->limit_type = worst->limit_type;
+    }
+    num_held = 0;
+}
+
+// -----------------------------------------------------------------------
+// The callback goes out without the lock held
+// -----------------------------------------------------------------------
+void RateLimitScheduler::publish(RateLimitStatus *status, bool changed) {
+    if(changed && status_callback)
+        status_callback(status);
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+bool RateLimitScheduler::try_acquire(int request_class, uint64_t current_ts) {
+    return(try_acquire(request_class, class_weight[request_class], class_orders[request_class], current_ts));
+}
+
+// -----------------------------------------------------------------------
+// Counts the request against every budget if there is room in all of them for its class
+// -----------------------------------------------------------------------
+bool RateLimitScheduler::try_acquire(int request_class, uint32_t weight, uint32_t orders, uint64_t current_ts) {
+    RateLimitStatus status;
+    bool changed;
+
+    scheduler_lock.acquire_lock();
+    bool allowed = (blocked_until <= current_ts);
+    double fraction = class_fraction(request_class);
+    for(int i = 0; allowed && (i < num_windows); i++){
+        rate_limit_window *window = &windows[i];
+        roll_window(window, current_ts);
+        uint32_t cost = (window->limit_type == RATE_LIMIT_WEIGHT) ? weight : orders;
+        if((cost > 0) && ((window->used + cost) > (window->limit * fraction)))
+            allowed = false;
+    }
+    if(allowed){
+        for(int i = 0; i < num_windows; i++)
+            windows[i].used += (windows[i].limit_type == RATE_LIMIT_WEIGHT) ? weight : orders;
+    } else {
+        num_held++;
+    }
+    update_level(current_ts, &status, &changed);
+    scheduler_lock.release_lock();
+
+    publish(&status, changed);
+    return(allowed);
+}
+
+// -----------------------------------------------------------------------
+// Takes the request off every budget again, a window that rolled in between keeps what it has
+// -----------------------------------------------------------------------
+void RateLimitScheduler::release(int request_class, uint64_t current_ts) {
+    RateLimitStatus status;
+    bool changed;
+
+    scheduler_lock.acquire_lock();
+    for(int i = 0; i < num_windows; i++){
+        rate_limit_window *window = &windows[i];
+        roll_window(window, current_ts);
+        uint32_t cost = (window->limit_type == RATE_LIMIT_WEIGHT) ? class_weight[request_class] : class_orders[request_class];
+        window->used -= std::min(cost, window->used);
+    }
+    update_level(current_ts, &status, &changed);
+    scheduler_lock.release_lock();
+
+    publish(&status, changed);
+}
+
+// -----------------------------------------------------------------------
+// Raises the local counts to what the exchange counted - only for the window the request went out in
+// -----------------------------------------------------------------------
+void RateLimitScheduler::on_usage(rate_limit_usage *usage, int num_usage, uint64_t sent_ts, uint64_t current_ts) {
+    RateLimitStatus status;
+    bool changed;
+
+    scheduler_lock.acquire_lock();
+    for(int i = 0; i < num_usage; i++){
+        if(usage[i].interval_ns == 0)
+            continue;
+        rate_limit_window *window = find_window(usage[i].limit_type, usage[i].interval_ns);
+        if((window == nullptr) && (usage[i].limit > 0) && (num_windows < RATE_LIMIT_MAX_WINDOWS)){
+            // A budget the config didn't know about
+            windows[num_windows] = {usage[i].limit_type, usage[i].interval_ns, usage[i].limit, 0, 0};
+            window = &windows[num_windows++];
+        }
+        if(window == nullptr)
+            continue;
+        if(usage[i].limit > 0)
+            window->limit = usage[i].limit;
+        roll_window(window, current_ts);
+        if((sent_ts >= window->window_start) && (usage[i].used > window->used))
+            window->used = usage[i].used;
+    }
+    update_level(current_ts, &status, &changed);
+    scheduler_lock.release_lock();
+
+    publish(&status, changed);
+}
+
+void RateLimitScheduler::on_rate_limited(bool banned, uint64_t retry_after_ns, uint64_t current_ts) {
+    RateLimitStatus status;
+    bool changed;
+
+    scheduler_lock.acquire_lock();
+    if(retry_after_ns == 0)
+        retry_after_ns = banned ? RATE_LIMIT_DEFAULT_BAN_NS : RATE_LIMIT_DEFAULT_BACKOFF_NS;
+    if((current_ts + retry_after_ns) > blocked_until)
+        blocked_until = current_ts + retry_after_ns;
+    update_level(current_ts, &status, &changed);
+    scheduler_lock.release_lock();
+
+    publish(&status, changed);
+}
+
+void RateLimitScheduler::refresh(uint64_t current_ts) {
+    RateLimitStatus status;
+    bool changed;
+
+    scheduler_lock.acquire_lock();
+    update_level(current_ts, &status, &changed);
+    scheduler_lock.release_lock();
+
+    publish(&status, changed);
+}
@@ -1,7 +1,12 @@
 #include "raw_file.hpp"
+#include <algorithm>
 
 
 RawFile::RawFile(std::string filename, unsigned char options) {
+    // Binary captures are read from their mapped segments instead of the stream
+    if((options & ReadOnly) && (open_compressed(filename) || open_capture(filename)))
+        return;
+
     // First thing - check if file exists..
     file_exists = check_file_exists(filename);
 
@@ -32,10 +37,220 @@ RawFile::RawFile(std::string filename, unsigned char options) {
 }
 
 RawFile::~RawFile() {
-    if(raw_file.is_open())
+    if(raw_file.is_open() || is_binary_capture)
         close();
 }
 
+// -----------------------------------------------------------------------
+// Checks if the file is a binary capture, either the base name (<base>.0000 exists)
+// or one of the segment files. Opens the first segment if so.
+// -----------------------------------------------------------------------
+bool RawFile::open_capture(std::string filename) {
+    if(check_file_exists(filename)){
+        char magic[sizeof(CAPTURE_MAGIC) - 1];
+        std::ifstream probe(filename, std::ios::in | std::ios::binary);
+        probe.read(magic, sizeof(magic));
+        if((probe.gcount() != sizeof(magic)) || (memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) != 0))
+            return(false);
+
+        // Given a segment - work out the base name so we can continue into the next segments
+        capture_base_filename = filename;
+        auto found = filename.find_last_of('.');
+        if((found != std::string::npos) && (filename.length() - found == 5) &&
+            std::all_of(filename.begin() + found + 1, filename.end(), ::isdigit)){
+            capture_base_filename = filename.substr(0, found);
+            segment_number = std::stoul(filename.substr(found + 1));
+        }
+    } 
+    else if(check_file_exists(capture_segment_filename(filename, 0))){
+        capture_base_filename = filename;
+        segment_number = 0;
+    } 
+    else {
+        return(false);
+    }
+
+    is_binary_capture = true;
+    if(! open_segment(capture_segment_filename(capture_base_filename, segment_number)))
+        throw(RawFileOpenException());
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Opens a compressed capture if there is a block index next to the file
+// -----------------------------------------------------------------------
+bool RawFile::open_compressed(std::string filename) {
+    std::string index_filename = filename + CAPTURE_INDEX_SUFFIX;
+    if(! check_file_exists(filename) || ! check_file_exists(index_filename))
+        return(false);
+
+    capz_fd = open(filename.c_str(), O_RDONLY);
+    if(capz_fd < 0)
+        throw(RawFileOpenException());
+
+    struct stat file_stat;
+    fstat(capz_fd, &file_stat);
+    std::ifstream index_file(index_filename, std::ios::in | std::ios::binary);
+    capture_block_index_entry entry;
+    while(index_file.read((char *) &entry, sizeof(entry))){
+        // A block written after the index was last appended to (or a torn write) is ignored
+        if((entry.file_offset + entry.compressed_length) > (uint64_t) file_stat.st_size)
+            break;
+        block_index.push_back(entry);
+    }
+
+    is_binary_capture = true;
+    is_compressed_capture = true;
+    block_number = 0;
+    while((block_number < block_index.size()) && ! load_block(block_number))
+        block_number++;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Reads and inflates one block of a compressed capture
+// -----------------------------------------------------------------------
+bool RawFile::load_block(uint64_t block_to_load) {
+    capture_block_index_entry &entry = block_index[block_to_load];
+    segment_base = nullptr;
+    if(compressed_buffer.size() < entry.compressed_length)
+        compressed_buffer.resize(entry.compressed_length);
+    if(block_buffer.size() < entry.uncompressed_length)
+        block_buffer.resize(entry.uncompressed_length);
+
+    uint64_t read_length = 0;
+    while(read_length < entry.compressed_length){
+        ssize_t bytes_read = pread(capz_fd, compressed_buffer.data() + read_length, entry.compressed_length - read_length, entry.file_offset + read_length);
+        if(bytes_read <= 0)
+            return(false);
+        read_length += bytes_read;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    inflateInit2(&stream, 15 + 16);
+    stream.next_in = (Bytef *) compressed_buffer.data();
+    stream.avail_in = entry.compressed_length;
+    stream.next_out = (Bytef *) block_buffer.data();
+    stream.avail_out = entry.uncompressed_length;
+    int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if(result != Z_STREAM_END){
+        std::cout << "Corrupt compressed capture block at offset: " << entry.file_offset << std::endl;
+        return(false);
+    }
+
+    segment_base = block_buffer.data();
+    segment_data_end = entry.uncompressed_length;
+    read_offset = 0;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Moves on to the next block or segment once the current one is read
+// -----------------------------------------------------------------------
+bool RawFile::next_capture_chunk() {
+    if(is_compressed_capture){
+        segment_base = nullptr;
+        while(++block_number < block_index.size()){
+            if(load_block(block_number))
+                return(true);
+        }
+        return(false);
+    }
+
+    close_segment();
+    std::string next_segment = capture_segment_filename(capture_base_filename, segment_number + 1);
+    if(! check_file_exists(next_segment) || ! open_segment(next_segment))
+        return(false);
+    segment_number++;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Maps a capture segment read only and positions on the first frame
+// -----------------------------------------------------------------------
+bool RawFile::open_segment(std::string segment_filename) {
+    struct stat file_stat;
+    segment_fd = open(segment_filename.c_str(), O_RDONLY);
+    if(segment_fd < 0)
+        return(false);
+    if((fstat(segment_fd, &file_stat) != 0) || (file_stat.st_size < (off_t) sizeof(capture_segment_header))){
+        ::close(segment_fd);
+        segment_fd = -1;
+        return(false);
+    }
+    segment_length = file_stat.st_size;
+    segment_base = (char *) mmap(NULL, segment_length, PROT_READ, MAP_PRIVATE, segment_fd, 0);
+    if(segment_base == MAP_FAILED){
+        ::close(segment_fd);
+        segment_fd = -1;
+        segment_base = nullptr;
+        return(false);
+    }
+    madvise(segment_base, segment_length, MADV_SEQUENTIAL);
+
+    capture_segment_header *header = (capture_segment_header *) segment_base;
+    segment_data_end = std::min(header->data_end, segment_length);
+    read_offset = header->header_size;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Unmaps the current segment
+// -----------------------------------------------------------------------
+void RawFile::close_segment() {
+    if(is_compressed_capture){
+        segment_base = nullptr;
+        return;
+    }
+    if(segment_base != nullptr)
+        munmap(segment_base, segment_length);
+    if(segment_fd >= 0)
+        ::close(segment_fd);
+    segment_base = nullptr;
+    segment_fd = -1;
+}
+
+// -----------------------------------------------------------------------
+// Returns the payload of the next frame, moving on to the next segment when needed
+// -----------------------------------------------------------------------
+std::string_view RawFile::read_binary_message() {
+    while(segment_base != nullptr){
+        if((read_offset + sizeof(capture_frame_header)) <= segment_data_end){
+            capture_frame_header *frame = (capture_frame_header *) (segment_base + read_offset);
+            uint64_t frame_size = capture_frame_size(frame->length);
+            if((frame->length != 0) && ((read_offset + frame_size) <= segment_data_end)){
+                current_frame = frame;
+                read_offset += frame_size;
+                return(std::string_view((char *) frame + sizeof(capture_frame_header), frame->length));
+            }
+        }
+
+        // End of this segment or block - try the next one
+        if(! next_capture_chunk())
+            break;
+    }
+    current_frame = nullptr;
+    return std::string_view();
+}
+
+bool RawFile::is_binary() {
+    return(is_binary_capture);
+}
+
+uint8_t RawFile::get_stream_kind_of_message() {
+    if(current_frame != nullptr)
+        return(current_frame->stream_kind);
+    return(CAPTURE_STREAM_UNKNOWN);
+}
+
+uint32_t RawFile::get_instrument_id_of_message() {
+    if(current_frame != nullptr)
+        return(current_frame->instrument_id);
+    return(0);
+}
+
 inline bool RawFile::check_file_exists (const std::string& name) {
   struct stat buffer;   
   return (stat (name.c_str(), &buffer) == 0); 
@@ -45,7 +260,64 @@ void RawFile::write_message(std::string_view dump_line, uint64_t recv_ts) {
     raw_file << recv_ts << ":" << dump_line << "\n";
 }
 
+// -----------------------------------------------------------------------
+// Returns the next message, or an empty view at the end of the file or window
+// -----------------------------------------------------------------------
 std::string_view RawFile::read_message() {
+    if(reached_end_time)
+        return std::string_view();
+
+    if(message_pending)
+        message_pending = false;
+    else if(is_binary_capture)
+        message_str_view = read_binary_message();
+    else
+        message_str_view = read_text_message();
+
+    if((end_time != 0) && (message_str_view.length() > 0) && (get_ts_of_message() > end_time)){
+        reached_end_time = true;
+        return std::string_view();
+    }
+    return(message_str_view);
+}
+
+// -----------------------------------------------------------------------
+// Positions the file so the next read_message returns the first message
+// received at or after start_ts. Compressed captures jump straight to the
+// right block using the index, other formats are read forward until then.
+// -----------------------------------------------------------------------
+bool RawFile::seek_to_time(uint64_t start_ts) {
+    message_pending = false;
+    if(is_compressed_capture){
+        auto found = std::lower_bound(block_index.begin(), block_index.end(), start_ts,
+            [](const capture_block_index_entry &entry, uint64_t ts) { return(entry.last_timestamp < ts); });
+        block_number = found - block_index.begin();
+        while((block_number < block_index.size()) && ! load_block(block_number))
+            block_number++;
+        if(block_number >= block_index.size())
+            return(false);
+    }
+
+    for(;;){
+        message_str_view = is_binary_capture ? read_binary_message() : read_text_message();
+        if(message_str_view.length() == 0)
+            return(false);
+        if(get_ts_of_message() >= start_ts){
+            message_pending = true;
+            return(true);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Messages received after end_ts are not returned (0 reads to the end)
+// -----------------------------------------------------------------------
+void RawFile::set_end_time(uint64_t end_ts) {
+    end_time = end_ts;
+    reached_end_time = false;
+}
+
+std::string_view RawFile::read_text_message() {
     if(raw_file.good()){
         raw_file.getline(line_buffer,1024*1024);
         line_str_view = std::string_view(line_buffer);
@@ -62,11 +334,22 @@ std::string_view RawFile::read_message() {
 }
 
 uint64_t RawFile::get_ts_of_message() {
+    if(is_binary_capture)
+        return((current_frame != nullptr) ? current_frame->receive_timestamp : 0);
 
     return(std::stoull(std::string(ts_str_view)));
 }
 
 bool RawFile::close() {
+    if(is_binary_capture){
+        close_segment();
+        if(capz_fd >= 0)
+            ::close(capz_fd);
+        capz_fd = -1;
+        is_binary_capture = false;
+        is_compressed_capture = false;
+        return(true);
+    }
     raw_file.close();
     return(true);
 }
@@ -0,0 +1,216 @@
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <getopt.h>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <time.h>
+
+#include "risk_engine.hpp"
+#include "latency_histogram.hpp"
+
+#define BENCH_DEFAULT_ORDERS        1000000
+#define BENCH_DEFAULT_STRATEGIES    32
+#define BENCH_DEFAULT_INSTRUMENTS   500
+#define BENCH_DEFAULT_BUDGET_NS     1000
+#define BENCH_COMPILES              1000
+// Time between orders of the synthetic flow, so the rate windows see something close to real traffic
+#define BENCH_ORDER_SPACING_NS      2000000
+
+void print_options(){
+    std::cout << "Options for risk_bench:" << std::endl;
+    std::cout << "  [-n (--orders) <ORDERS>]                                = Orders to check (default 1000000)" << std::endl;
+    std::cout << "  [-s (--strategies) <STRATEGIES>]                        = Strategies sending (default 32)" << std::endl;
+    std::cout << "  [-i (--instruments) <INSTRUMENTS>]                      = Instruments traded (default 500)" << std::endl;
+    std::cout << "  [-b (--budget) <NS>]                                    = p99 a check has to stay under, exits 1 if not (default 1000)" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+uint64_t get_monotonic_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Orders and touches made up front so only the engine is timed
+// -----------------------------------------------------------------------
+std::vector<SendOrder> make_orders(uint64_t num_orders, uint32_t num_strategies, uint32_t num_instruments, std::vector<double> &mid_prices) {
+    std::vector<SendOrder> orders(num_orders);
+    std::mt19937_64 generator(42);
+    std::uniform_int_distribution<uint32_t> strategy_dist(1, num_strategies);
+    std::uniform_int_distribution<uint32_t> instrument_dist(0, num_instruments - 1);
+    std::uniform_real_distribution<double> offset_dist(-0.03, 0.03);
+    for(uint64_t i = 0; i < num_orders; i++){
+        uint32_t instrument = instrument_dist(generator);
+        orders[i].msg_header = MessageHeaderT{sizeof(SendOrder), MSG_NEW_ORDER, 0};
+        orders[i].internal_order_id = i + 1;
+        orders[i].strategy_id = strategy_dist(generator);
+        orders[i].instrument_id = 1000 + instrument;
+        orders[i].exchange_id = 17;
+        orders[i].is_buy = (i % 2) == 0;
+        // Now and then one far through the touch, so the band check gets to reject
+        orders[i].price = mid_prices[instrument] * (1.0 + ((i % 97) == 0 ? (orders[i].is_buy ? 0.2 : -0.2) : offset_dist(generator)));
+        // Every third is over the 1200 max order value, inverse contracts are sent in contracts
+        if((instrument % 10) == 0)
+            orders[i].qty = 40.0 * (1 + (i % 3));
+        else
+            orders[i].qty = (500.0 / mid_prices[instrument]) * (1 + (i % 3));
+    }
+    return(orders);
+}
+
+// -----------------------------------------------------------------------
+// p50..max from a histogram, in ns
+// -----------------------------------------------------------------------
+std::string format_percentiles(latency_histogram *histogram) {
+    uint64_t count = histogram->count.load();
+    uint64_t buckets[LATENCY_BUCKETS];
+    for(int i = 0; i < LATENCY_BUCKETS; i++)
+        buckets[i] = histogram->buckets[i].load();
+    std::ostringstream line;
+    line << std::setw(10) << count;
+    line << std::setw(9) << ((count > 0) ? histogram->sum.load() / count : 0);
+    for(double percentile: {50.0, 90.0, 99.0, 99.9})
+        line << std::setw(9) << LatencyReader::get_percentile(buckets, count, percentile);
+    line << std::setw(11) << histogram->max.load();
+    return(line.str());
+}
+
+uint64_t get_p99(latency_histogram *histogram) {
+    uint64_t count = histogram->count.load();
+    uint64_t buckets[LATENCY_BUCKETS];
+    for(int i = 0; i < LATENCY_BUCKETS; i++)
+        buckets[i] = histogram->buckets[i].load();
+    return(LatencyReader::get_percentile(buckets, count, 99.0));
+}
+
+int main(int argc, char* argv[]) {
+
+    uint64_t num_orders = BENCH_DEFAULT_ORDERS;
+    uint32_t num_strategies = BENCH_DEFAULT_STRATEGIES;
+    uint32_t num_instruments = BENCH_DEFAULT_INSTRUMENTS;
+    uint64_t budget_ns = BENCH_DEFAULT_BUDGET_NS;
+
+    static struct option long_options[] = {
+        {"orders"           , optional_argument, NULL, 'n'},
+        {"strategies"       , optional_argument, NULL, 's'},
+        {"instruments"      , optional_argument, NULL, 'i'},
+        {"budget"           , optional_argument, NULL, 'b'},
+        {"help"             , optional_argument, NULL,'h'}};
+
+    int cmd_option;
+    while((cmd_option = getopt_long(argc,argv,"n:s:i:b:h", long_options, NULL)) != -1) {
+        switch (cmd_option) {
+            case 'h':
+            print_options();
+            exit(0);
+            break;
+
+            case 'n':
+            num_orders = std::max(1L, atol(optarg));
+            break;
+
+            case 's':
+            num_strategies = std::min(std::max(1L, atol(optarg)), (long) RISK_MAX_STRATEGY_SLOTS - 1);
+            break;
+
+            case 'i':
+            num_instruments = std::min(std::max(1L, atol(optarg)), (long) RISK_MAX_INSTRUMENTS);
+            break;
+
+            case 'b':
+            budget_ns = atol(optarg);
+            break;
+        }
+    }
+
+    // Limits set up the way the trade adapter does it - config, then strategy and instrument info
+    RiskEngine *risk_engine = new RiskEngine();
+    risk_config config;
+    config.max_position_value = 50000.0;
+    // The touches are set once up front and have to stay good for the whole run
+    config.touch_max_age_ns = 0;
+    risk_engine->set_config(config);
+
+    std::vector<double> mid_prices(num_instruments);
+    for(uint32_t i = 0; i < num_instruments; i++){
+        mid_prices[i] = 10.0 + (i * 7.5);
+        // Every tenth is an inverse contract, valued on contract size
+        risk_engine->set_instrument(1000 + i, ((i % 10) == 0) ? 10.0 : 0.0);
+        ToBUpdate tob = {};
+        tob.instrument_id = 1000 + i;
+        tob.bid_price = mid_prices[i] * 0.9995;
+        tob.ask_price = mid_prices[i] * 1.0005;
+        risk_engine->on_tob(&tob, 0);
+    }
+    for(uint32_t strategy_id = 1; strategy_id <= num_strategies; strategy_id++)
+        risk_engine->set_strategy(strategy_id, 1200.0);
+    risk_engine->compile();
+
+    std::vector<SendOrder> orders = make_orders(num_orders, num_strategies, num_instruments, mid_prices);
+
+    // What the clock itself costs, taken off every sample
+    uint64_t timer_overhead = UINT64_MAX;
+    for(int i = 0; i < 1000; i++){
+        uint64_t before = get_monotonic_ts();
+        timer_overhead = std::min(timer_overhead, get_monotonic_ts() - before);
+    }
+
+    std::cout << "Checking " << num_orders << " orders over " << num_strategies << " strategies and " << num_instruments << " instruments" << std::endl;
+    latency_histogram *check_latency = new latency_histogram();
+    uint64_t breaches[RISK_BREACH_NO_SLOT + 1] = {};
+    uint64_t order_ts = 1700000000000000000L;
+    for(uint64_t i = 0; i < num_orders; i++){
+        SendOrder *order = &orders[i];
+        order_ts += BENCH_ORDER_SPACING_NS;
+
+        uint64_t before = get_monotonic_ts();
+        uint8_t result = risk_engine->check(order, order_ts);
+        uint64_t after = get_monotonic_ts();
+        record_latency(check_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+        breaches[result]++;
+
+        // Passed orders go out and get filled or cancelled a little later
+        if(result == RISK_CHECK_OK){
+            risk_engine->on_order_accepted(order, order_ts);
+            if((i % 4) == 0)
+                risk_engine->on_fill(order->strategy_id, order->instrument_id, order->is_buy, order->qty);
+            risk_engine->on_order_closed(order->strategy_id);
+        }
+    }
+
+    // Recompiles happen on every strategy/instrument info update, they run on the same thread as the checks
+    latency_histogram *compile_latency = new latency_histogram();
+    for(int i = 0; i < BENCH_COMPILES; i++){
+        risk_engine->set_strategy(1 + (i % num_strategies), 1200.0 + i);
+        uint64_t before = get_monotonic_ts();
+        risk_engine->compile();
+        uint64_t after = get_monotonic_ts();
+        record_latency(compile_latency, (int64_t) (after - before) - (int64_t) timer_overhead);
+    }
+
+    std::cout << std::endl << std::setw(12) << " " << std::setw(10) << "count" << std::setw(9) << "avg_ns";
+    std::cout << std::setw(9) << "p50_ns" << std::setw(9) << "p90_ns" << std::setw(9) << "p99_ns" << std::setw(9) << "p99.9_ns" << std::setw(11) << "max_ns" << std::endl;
+    std::cout << std::setw(12) << "check" << format_percentiles(check_latency) << std::endl;
+    std::cout << std::setw(12) << "compile" << format_percentiles(compile_latency) << std::endl;
+
+    std::cout << std::endl << "passed:        " << breaches[RISK_CHECK_OK] << std::endl;
+    std::cout << "order value:   " << breaches[RISK_BREACH_ORDER_VALUE] << std::endl;
+    std::cout << "price band:    " << breaches[RISK_BREACH_PRICE_BAND] << std::endl;
+    std::cout << "position:      " << breaches[RISK_BREACH_POSITION] << std::endl;
+    std::cout << "open orders:   " << breaches[RISK_BREACH_OPEN_ORDERS] << std::endl;
+    std::cout << "short rate:    " << breaches[RISK_BREACH_SHORT_RATE] << std::endl;
+    std::cout << "long rate:     " << breaches[RISK_BREACH_LONG_RATE] << std::endl;
+    std::cout << "limits version " << risk_engine->get_limits_version() << std::endl;
+
+    uint64_t check_p99 = get_p99(check_latency);
+    if(check_p99 > budget_ns){
+        std::cout << std::endl << "p99 of " << check_p99 << "ns is over the budget of " << budget_ns << "ns" << std::endl;
+        return(1);
+    }
+    std::cout << std::endl << "p99 of " << check_p99 << "ns is within the budget of " << budget_ns << "ns" << std::endl;
+    return(0);
+}
@@ -0,0 +1,286 @@
+#include "risk_engine.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - all state is allocated up front, limits start out as the defaults
+// -----------------------------------------------------------------------
+RiskEngine::RiskEngine() {
+    for(int i = 0; i < 256; i++){
+        strategy_max_order_value[i] = RISK_DEFAULT_MAX_ORDER_VALUE;
+        strategy_slot[i].store(RISK_NO_SLOT, std::memory_order_relaxed);
+    }
+    for(int i = 0; i < RISK_INSTRUMENT_INDEX_SIZE; i++){
+        instrument_keys[i].store(0, std::memory_order_relaxed);
+        instrument_values[i] = RISK_NO_SLOT;
+    }
+
+    strategy_state = new risk_strategy_state[RISK_MAX_STRATEGY_SLOTS]();
+    positions = new std::atomic<double>[RISK_MAX_STRATEGY_SLOTS * RISK_MAX_INSTRUMENTS];
+    for(int i = 0; i < (RISK_MAX_STRATEGY_SLOTS * RISK_MAX_INSTRUMENTS); i++)
+        positions[i].store(0.0, std::memory_order_relaxed);
+    touches = new risk_touch[RISK_MAX_INSTRUMENTS]();
+
+    current_limits.store(nullptr, std::memory_order_relaxed);
+    compile();
+}
+
+uint32_t RiskEngine::instrument_hash(uint32_t instrument_id) {
+    return((instrument_id * 0x9e3779b1U) >> 7);
+}
+
+// -----------------------------------------------------------------------
+// Slot of the instrument or RISK_NO_SLOT - safe from any thread, slots are only ever added
+// -----------------------------------------------------------------------
+uint16_t RiskEngine::find_instrument_slot(uint32_t instrument_id) {
+    uint32_t position = instrument_hash(instrument_id) & (RISK_INSTRUMENT_INDEX_SIZE - 1);
+    while(1){
+        uint32_t key = instrument_keys[position].load(std::memory_order_acquire);
+        if(key == 0)
+            return(RISK_NO_SLOT);
+        if(key == (instrument_id + 1))
+            return(instrument_values[position]);
+        position = (position + 1) & (RISK_INSTRUMENT_INDEX_SIZE - 1);
+    }
+}
+
+uint16_t RiskEngine::add_instrument_slot(uint32_t instrument_id) {
+    uint16_t slot = find_instrument_slot(instrument_id);
+    if((slot != RISK_NO_SLOT) || (num_instrument_slots == RISK_MAX_INSTRUMENTS))
+        return(slot);
+
+    uint32_t position = instrument_hash(instrument_id) & (RISK_INSTRUMENT_INDEX_SIZE - 1);
+    while(instrument_keys[position].load(std::memory_order_relaxed) != 0)
+        position = (position + 1) & (RISK_INSTRUMENT_INDEX_SIZE - 1);
+    slot = num_instrument_slots++;
+    // Value first, the key publishes it
+    instrument_values[position] = slot;
+    instrument_keys[position].store(instrument_id + 1, std::memory_order_release);
+    return(slot);
+}
+
+// -----------------------------------------------------------------------
+// Slot of the strategy, handed out the first time it sends an order (aeron thread)
+// -----------------------------------------------------------------------
+uint16_t RiskEngine::get_strategy_slot(uint8_t strategy_id) {
+    uint16_t slot = strategy_slot[strategy_id].load(std::memory_order_relaxed);
+    if((slot == RISK_NO_SLOT) && (num_strategy_slots < RISK_MAX_STRATEGY_SLOTS)){
+        slot = num_strategy_slots++;
+        strategy_slot[strategy_id].store(slot, std::memory_order_release);
+    }
+    return(slot);
+}
+
+// ########################################################################
+// LIMITS - sources and compilation
+// ########################################################################
+
+void RiskEngine::set_config(risk_config &_config) {
+    config = _config;
+    if(config.short_window_orders > RISK_MAX_RATE_ORDERS)
+        config.short_window_orders = RISK_MAX_RATE_ORDERS;
+    if(config.long_window_orders > RISK_MAX_RATE_ORDERS)
+        config.long_window_orders = RISK_MAX_RATE_ORDERS;
+}
+
+void RiskEngine::set_strategy(uint8_t strategy_id, double max_order_value) {
+    strategy_max_order_value[strategy_id] = max_order_value;
+    get_strategy_slot(strategy_id);
+}
+
+void RiskEngine::set_instrument(uint32_t instrument_id, double contract_size) {
+    instrument_contract_size[instrument_id] = contract_size;
+    add_instrument_slot(instrument_id);
+}
+
+// -----------------------------------------------------------------------
+// Builds the flat limits from the sources and swaps them in
+// -----------------------------------------------------------------------
+void RiskEngine::compile() {
+    risk_limits *limits = new risk_limits();
+    limits->version = ++limits_version;
+    limits->short_window_ns = config.short_window_ns;
+    limits->long_window_ns = config.long_window_ns;
+    limits->touch_max_age_ns = config.touch_max_age_ns;
+    limits->default_strategy = {RISK_DEFAULT_MAX_ORDER_VALUE, config.max_open_orders, config.short_window_orders, config.long_window_orders};
+    limits->default_instrument = {0.0, config.max_position_value, config.price_band};
+
+    for(int strategy_id = 0; strategy_id < 256; strategy_id++){
+        uint16_t slot = strategy_slot[strategy_id].load(std::memory_order_relaxed);
+        if(slot == RISK_NO_SLOT)
+            continue;
+        limits->strategies[slot] = limits->default_strategy;
+        limits->strategies[slot].max_order_value = strategy_max_order_value[strategy_id];
+    }
+    limits->num_strategy_slots = num_strategy_slots;
+
+    for(uint32_t i = 0; i < num_instrument_slots; i++)
+        limits->instruments[i] = limits->default_instrument;
+    for(auto &[instrument_id, contract_size]: instrument_contract_size){
+        uint16_t slot = find_instrument_slot(instrument_id);
+        if(slot != RISK_NO_SLOT)
+            limits->instruments[slot].contract_size = contract_size;
+    }
+    limits->num_instrument_slots = num_instrument_slots;
+
+    // A check holds on to the limits for well under a microsecond and they change every few
+    // seconds at the most, so the set from two swaps ago is long out of use
+    risk_limits *previous = current_limits.exchange(limits, std::memory_order_acq_rel);
+    delete retired_limits;
+    retired_limits = previous;
+}
+
+uint64_t RiskEngine::get_limits_version() {
+    return(current_limits.load(std::memory_order_acquire)->version);
+}
+
+// ########################################################################
+// CHECKS - aeron thread
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// True if max_orders were already sent within the window
+// -----------------------------------------------------------------------
+bool RiskEngine::rate_breached(risk_strategy_state *state, uint32_t max_orders, uint64_t window_ns, uint64_t current_ts) {
+    if(max_orders == 0)
+        return(false);
+    uint64_t oldest = state->send_times[(state->rate_head - max_orders) & (RISK_MAX_RATE_ORDERS - 1)];
+    return((oldest != 0) && ((current_ts - oldest) < window_ns));
+}
+
+// -----------------------------------------------------------------------
+// Runs all checks on the order, RISK_CHECK_OK or the first breach
+// -----------------------------------------------------------------------
+uint8_t RiskEngine::check(SendOrder *order, uint64_t current_ts) {
+    risk_limits *limits = current_limits.load(std::memory_order_acquire);
+
+    uint16_t strategy = get_strategy_slot(order->strategy_id);
+    if(strategy == RISK_NO_SLOT)
+        return(RISK_BREACH_NO_SLOT);
+    risk_strategy_limits *strategy_limits = (strategy < limits->num_strategy_slots) ? &limits->strategies[strategy] : &limits->default_strategy;
+
+    uint16_t instrument = find_instrument_slot(order->instrument_id);
+    risk_instrument_limits *instrument_limits = (instrument < limits->num_instrument_slots) ? &limits->instruments[instrument] : &limits->default_instrument;
+
+    // Value of one unit of qty - contract size for the inverse contracts
+    double unit_value = (instrument_limits->contract_size > 0.000001) ? instrument_limits->contract_size : order->price;
+
+    if((order->qty * unit_value) > strategy_limits->max_order_value)
+        return(RISK_BREACH_ORDER_VALUE);
+
+    if(instrument != RISK_NO_SLOT){
+        // Buying too far through the offer or selling too far through the bid (no touch yet, or none
+        // for longer than touch_max_age_ns - no check, a stale touch would reject good prices)
+        risk_touch *touch = &touches[instrument];
+        bool touch_is_fresh = (limits->touch_max_age_ns == 0) || ((current_ts - touch->update_ts) < limits->touch_max_age_ns);
+        if((instrument_limits->price_band > 0.0) && touch_is_fresh){
+            if(order->is_buy){
+                if((touch->ask_price > 0.0) && (order->price > (touch->ask_price * (1.0 + instrument_limits->price_band))))
+                    return(RISK_BREACH_PRICE_BAND);
+            } else {
+                if((touch->bid_price > 0.0) && (order->price < (touch->bid_price * (1.0 - instrument_limits->price_band))))
+                    return(RISK_BREACH_PRICE_BAND);
+            }
+        }
+
+        // Orders that reduce the position always go through
+        if(instrument_limits->max_position_value > 0.0){
+            double position = positions[(strategy * RISK_MAX_INSTRUMENTS) + instrument].load(std::memory_order_relaxed);
+            double new_position = order->is_buy ? (position + order->qty) : (position - order->qty);
+            if((std::fabs(new_position) > std::fabs(position)) && ((std::fabs(new_position) * unit_value) > instrument_limits->max_position_value))
+                return(RISK_BREACH_POSITION);
+        }
+    }
+
+    risk_strategy_state *state = &strategy_state[strategy];
+    if((strategy_limits->max_open_orders > 0) && (state->open_orders.load(std::memory_order_relaxed) >= (int32_t) strategy_limits->max_open_orders))
+        return(RISK_BREACH_OPEN_ORDERS);
+    if(rate_breached(state, strategy_limits->short_window_orders, limits->short_window_ns, current_ts))
+        return(RISK_BREACH_SHORT_RATE);
+    if(rate_breached(state, strategy_limits->long_window_orders, limits->long_window_ns, current_ts))
+        return(RISK_BREACH_LONG_RATE);
+    return(RISK_CHECK_OK);
+}
+
+// -----------------------------------------------------------------------
+// Reject message for a breach - only built when an order is rejected
+// -----------------------------------------------------------------------
+std::string RiskEngine::describe_breach(uint8_t result, SendOrder *order) {
+    risk_limits *limits = current_limits.load(std::memory_order_acquire);
+    uint16_t strategy = strategy_slot[order->strategy_id].load(std::memory_order_relaxed);
+    risk_strategy_limits *strategy_limits = (strategy < limits->num_strategy_slots) ? &limits->strategies[strategy] : &limits->default_strategy;
+    uint16_t instrument = find_instrument_slot(order->instrument_id);
+
+    switch(result) {
+        case RISK_BREACH_ORDER_VALUE: {
+            double contract_size = (instrument < limits->num_instrument_slots) ? limits->instruments[instrument].contract_size : 0.0;
+            double order_value = order->qty * ((contract_size > 0.000001) ? contract_size : order->price);
+            return("BREACH MAX ORDER VALUE: " + std::to_string(order_value));
+        }
+        case RISK_BREACH_PRICE_BAND:
+            return("PRICE OUTSIDE BAND: " + std::to_string(order->price) + " (bid " + std::to_string(touches[instrument].bid_price) +
+                    ", ask " + std::to_string(touches[instrument].ask_price) + ")");
+        case RISK_BREACH_POSITION:
+            return("BREACH MAX POSITION: " + std::to_string(positions[(strategy * RISK_MAX_INSTRUMENTS) + instrument].load()));
+        case RISK_BREACH_OPEN_ORDERS:
+            return("BREACH MAX OPEN ORDERS: " + std::to_string(strategy_limits->max_open_orders));
+        case RISK_BREACH_SHORT_RATE:
+            return("BREACH ORDER RATE: " + std::to_string(strategy_limits->short_window_orders) + " IN " + std::to_string(limits->short_window_ns / 1000000) + "MS");
+        case RISK_BREACH_LONG_RATE:
+            return("BREACH ORDER RATE: " + std::to_string(strategy_limits->long_window_orders) + " IN " + std::to_string(limits->long_window_ns / 1000000) + "MS");
+        case RISK_BREACH_NO_SLOT:
+            return("NO RISK SLOT FOR STRATEGY: " + std::to_string(order->strategy_id));
+        default:
+            return("");
+    }
+}
+
+bool RiskEngine::reduces_position(SendOrder *order) {
+    uint16_t strategy = strategy_slot[order->strategy_id].load(std::memory_order_acquire);
+    uint16_t instrument = find_instrument_slot(order->instrument_id);
+    if((strategy == RISK_NO_SLOT) || (instrument == RISK_NO_SLOT))
+        return(false);
+    double position = positions[(strategy * RISK_MAX_INSTRUMENTS) + instrument].load(std::memory_order_relaxed);
+    if(order->is_buy)
+        return((position < 0.0) && (order->qty <= -position));
+    return((position > 0.0) && (order->qty <= position));
+}
+
+// -----------------------------------------------------------------------
+// Order passed and went out - counts towards open orders and the rate windows
+// -----------------------------------------------------------------------
+void RiskEngine::on_order_accepted(SendOrder *order, uint64_t current_ts) {
+    uint16_t strategy = get_strategy_slot(order->strategy_id);
+    if(strategy == RISK_NO_SLOT)
+        return;
+    risk_strategy_state *state = &strategy_state[strategy];
+    state->open_orders.fetch_add(1, std::memory_order_relaxed);
+    state->send_times[state->rate_head & (RISK_MAX_RATE_ORDERS - 1)] = current_ts;
+    state->rate_head++;
+}
+
+void RiskEngine::on_tob(ToBUpdate *tob, uint64_t current_ts) {
+    uint16_t instrument = find_instrument_slot(tob->instrument_id);
+    if(instrument == RISK_NO_SLOT)
+        return;
+    touches[instrument].bid_price = tob->bid_price;
+    touches[instrument].ask_price = tob->ask_price;
+    touches[instrument].update_ts = current_ts;
+}
+
+// ########################################################################
+// EXCHANGE UPDATES - any thread
+// ########################################################################
+
+void RiskEngine::on_order_closed(uint8_t strategy_id) {
+    uint16_t strategy = strategy_slot[strategy_id].load(std::memory_order_acquire);
+    if(strategy == RISK_NO_SLOT)
+        return;
+    strategy_state[strategy].open_orders.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void RiskEngine::on_fill(uint8_t strategy_id, uint32_t instrument_id, bool is_buy, double qty) {
+    uint16_t strategy = strategy_slot[strategy_id].load(std::memory_order_acquire);
+    uint16_t instrument = find_instrument_slot(instrument_id);
+    if((strategy == RISK_NO_SLOT) || (instrument == RISK_NO_SLOT))
+        return;
+    positions[(strategy * RISK_MAX_INSTRUMENTS) + instrument].fetch_add(is_buy ? qty : -qty, std::memory_order_relaxed);
+}
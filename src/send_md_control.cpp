@@ -0,0 +1,101 @@
+#include <unistd.h>
+#include <getopt.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include "to_aeron.hpp"
+#include "aeron_types.hpp"
+#include "aeron_types_ext.hpp"
+#include "capture_format.hpp"
+
+void print_options(){
+    std::cout << "Options for send_md_control:" << std::endl;
+    std::cout << "  -a (--action) <add|drop>                                = Add or drop the streams" << std::endl;
+    std::cout << "  -i (--instruments) <id,id,..>                           = Comma separated InstrumentIDs" << std::endl;
+    std::cout << "  -k (--streams) <depth,trade,bookticker,markprice,forceorder> = Streams to add/drop (default all)" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+// -----------------------------------------------------------------------
+// Turns a stream name into its bit in SubscriptionControl::stream_mask
+// -----------------------------------------------------------------------
+uint16_t get_stream_bit(std::string stream_name) {
+    if(stream_name == "depth")
+        return(1 << CAPTURE_STREAM_DEPTH);
+    if(stream_name == "trade")
+        return(1 << CAPTURE_STREAM_TRADE);
+    if(stream_name == "bookticker")
+        return(1 << CAPTURE_STREAM_BOOK_TICKER);
+    if(stream_name == "markprice")
+        return(1 << CAPTURE_STREAM_MARK_PRICE);
+    if(stream_name == "forceorder")
+        return(1 << CAPTURE_STREAM_FORCE_ORDER);
+    std::cout << "Unknown stream: " << stream_name << " - exiting.." << std::endl;
+    exit(1);
+}
+
+int main(int argc, char* argv[]) {
+    int ch;
+    SubscriptionControl control;
+    memset(&control, 0, sizeof(SubscriptionControl));
+
+    static struct option long_options[] = {
+        {"action"         , required_argument, NULL, 'a'},
+        {"instruments"    , required_argument, NULL, 'i'},
+        {"streams"        , optional_argument, NULL, 'k'},
+        {"help"           , optional_argument, NULL,'h'}};
+
+    while((ch = getopt_long(argc, argv, "a:i:k:h", long_options, NULL)) != -1) {
+        std::stringstream list_stream;
+        std::string cell;
+
+        switch (ch) {
+            case 'h':
+                print_options();
+                exit(0);
+
+            case 'a':
+            if(std::string(optarg) == "add"){
+                control.action = SUBSCRIPTION_ADD;
+            } else if(std::string(optarg) == "drop"){
+                control.action = SUBSCRIPTION_DROP;
+            } else {
+                std::cout << "Unknown action given - exiting.." << std::endl;
+                exit(1);
+            }
+            break;
+
+            case 'i':
+            list_stream << optarg;
+            while(std::getline(list_stream, cell, ',') && (control.num_instruments < MAX_SUBSCRIPTION_CONTROL_INSTRUMENTS))
+                control.instrument_ids[control.num_instruments++] = std::stoul(cell);
+            break;
+
+            case 'k':
+            list_stream << optarg;
+            while(std::getline(list_stream, cell, ','))
+                control.stream_mask |= get_stream_bit(cell);
+            break;
+
+            default:
+            break;
+        }
+    }
+
+    if((control.action == 0) || (control.num_instruments == 0)) {
+        print_options();
+        exit(1);
+    }
+
+    control.msg_header.msgType = SUBSCRIPTION_CONTROL;
+    control.msg_header.protoVersion = 1;
+    control.msg_header.msgLength = sizeof(SubscriptionControl) - ((MAX_SUBSCRIPTION_CONTROL_INSTRUMENTS - control.num_instruments) * sizeof(uint32_t));
+
+    to_aeron *to_aeron_mc = new to_aeron(AERON_MC);
+    to_aeron_mc->send_data((char *)&control, control.msg_header.msgLength);
+    std::cout << "Sent subscription control for " << std::to_string(control.num_instruments) << " instruments" << std::endl;
+    // Give the publication time to be picked up before we go away
+    sleep(1);
+    return(0);
+}
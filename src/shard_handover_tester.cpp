@@ -0,0 +1,237 @@
+#include <cstring>
+#include <iostream>
+#include <getopt.h>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "shard_publish_gate.hpp"
+
+#define TESTER_DEFAULT_MESSAGES     10000
+#define TESTER_DEFAULT_HANDOVER     4000
+#define TESTER_DEFAULT_DELAY        500
+#define TESTER_INSTRUMENT_ID        1001
+// Every third message is a trade, the rest depth updates
+#define TESTER_TRADE_EVERY          3
+
+void print_options(){
+    std::cout << "Options for shard_handover_tester:" << std::endl;
+    std::cout << "  [-n (--messages) <MESSAGES>]                            = Messages in the stream (default 10000)" << std::endl;
+    std::cout << "  [-k (--handover) <MESSAGE>]                             = Message the old owner releases at (default 4000)" << std::endl;
+    std::cout << "  [-d (--delay) <MESSAGES>]                               = Messages between the release and the takeover (default 500)" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+// What came out of both shards, in the order it was published
+struct published_stream {
+    std::vector<uint64_t> depth_seqs;
+    std::vector<uint64_t> trade_timestamps;
+    // Index into depth_seqs where a book went out, and the last depth update in it
+    std::vector<std::pair<size_t, uint64_t>> books;
+};
+
+struct stream_message {
+    union {
+        PLUpdates depth;
+        Trade trade;
+    };
+    bool is_trade;
+};
+
+std::vector<stream_message> make_stream(uint64_t num_messages) {
+    std::vector<stream_message> stream(num_messages);
+    uint64_t seq = 0;
+    for(uint64_t i = 0; i < num_messages; i++){
+        stream_message &msg = stream[i];
+        memset(&msg, 0, sizeof(stream_message));
+        msg.is_trade = (i % TESTER_TRADE_EVERY) == (TESTER_TRADE_EVERY - 1);
+        if(msg.is_trade){
+            msg.trade.msg_header = {sizeof(Trade), TRADE, 1};
+            msg.trade.instrument_id = TESTER_INSTRUMENT_ID;
+            msg.trade.exchange_timestamp = 1000 * (i + 1);
+        } else {
+            msg.depth.msg_header = {sizeof(PLUpdates), PL_UPDATE, 1};
+            msg.depth.instrument_id = TESTER_INSTRUMENT_ID;
+            msg.depth.start_seq_number = seq + 1;
+            msg.depth.end_seq_number = ++seq;
+            msg.depth.exchange_timestamp = 1000 * (i + 1);
+        }
+    }
+    return(stream);
+}
+
+void record(published_stream &published, char *msg) {
+    if(((MessageHeader *) msg)->msgType == TRADE)
+        published.trade_timestamps.push_back(((Trade *) msg)->exchange_timestamp);
+    else
+        published.depth_seqs.push_back(((PLUpdates *) msg)->end_seq_number);
+}
+
+// -----------------------------------------------------------------------
+// Both shards see the whole stream and keep the book, the old owner releases at handover_at and the
+// new one takes over delay messages later. resync_at (if not 0) resyncs the new owner's book while
+// it is on standby.
+// -----------------------------------------------------------------------
+published_stream run_handover(std::vector<stream_message> &stream, uint64_t handover_at, uint64_t delay, uint64_t max_replay_bytes, uint64_t resync_at) {
+    published_stream published;
+    ShardPublishGate old_owner;
+    ShardPublishGate new_owner(max_replay_bytes);
+    uint64_t new_owner_book_seq = 0;
+
+    old_owner.set_publisher([&](char *msg) { record(published, msg); }, [&](uint32_t) {}, [](std::string) {});
+    new_owner.set_publisher([&](char *msg) { record(published, msg); },
+                            [&](uint32_t) { published.books.push_back({published.depth_seqs.size(), new_owner_book_seq}); },
+                            [](std::string warning) { std::cout << "    warning: " << warning << std::endl; });
+    old_owner.add(TESTER_INSTRUMENT_ID, SHARD_INSTRUMENT_ACTIVE);
+    new_owner.add(TESTER_INSTRUMENT_ID, SHARD_INSTRUMENT_STANDBY);
+    new_owner.mark_ready(TESTER_INSTRUMENT_ID);
+
+    uint64_t last_end_seq_number = 0;
+    uint64_t last_exchange_timestamp = 0;
+    for(uint64_t i = 0; i < stream.size(); i++){
+        if(i == handover_at)
+            old_owner.release(TESTER_INSTRUMENT_ID, &last_end_seq_number, &last_exchange_timestamp);
+        if(i == handover_at + delay)
+            new_owner.take_over(TESTER_INSTRUMENT_ID, last_end_seq_number, last_exchange_timestamp);
+        if((resync_at != 0) && (i == resync_at)){
+            InstrumentClearBook clear_msg;
+            memset(&clear_msg, 0, sizeof(InstrumentClearBook));
+            clear_msg.msg_header = {sizeof(InstrumentClearBook), INSTRUMENT_CLEAR_BOOK, 1};
+            new_owner.should_publish(TESTER_INSTRUMENT_ID, (char *) &clear_msg, 0, 0);
+        }
+        // The feed thread loops round between websocket messages
+        if((i % 16) == 0)
+            new_owner.replay_handovers();
+
+        stream_message &msg = stream[i];
+        char *msg_pointer = msg.is_trade ? (char *) &msg.trade : (char *) &msg.depth;
+        uint64_t end_seq_number = msg.is_trade ? 0 : msg.depth.end_seq_number;
+        uint64_t exchange_timestamp = msg.is_trade ? msg.trade.exchange_timestamp : msg.depth.exchange_timestamp;
+        // Depth updates are in the book before they are published
+        if(! msg.is_trade)
+            new_owner_book_seq = end_seq_number;
+        if(old_owner.should_publish(TESTER_INSTRUMENT_ID, msg_pointer, end_seq_number, exchange_timestamp))
+            record(published, msg_pointer);
+        if(new_owner.should_publish(TESTER_INSTRUMENT_ID, msg_pointer, end_seq_number, exchange_timestamp))
+            record(published, msg_pointer);
+    }
+    new_owner.replay_handovers();
+    return(published);
+}
+
+// -----------------------------------------------------------------------
+// Depth updates have to follow on from each other, or from the last update in a book that was
+// published in between. No trade goes out twice, and unless the buffer wrapped none is missing.
+// -----------------------------------------------------------------------
+bool check_stream(std::string name, std::vector<stream_message> &stream, published_stream &published, bool expect_book, bool trades_complete) {
+    bool ok = true;
+    size_t next_book = 0;
+    uint64_t expected_seq = 1;
+    for(size_t i = 0; i < published.depth_seqs.size(); i++){
+        while((next_book < published.books.size()) && (published.books[next_book].first == i)){
+            expected_seq = published.books[next_book].second + 1;
+            next_book++;
+        }
+        if(published.depth_seqs[i] != expected_seq){
+            std::cout << "  " << name << ": depth update " << published.depth_seqs[i] << " published, expected " << expected_seq << std::endl;
+            ok = false;
+            break;
+        }
+        expected_seq++;
+    }
+    uint64_t last_seq = 0;
+    for(auto &msg: stream){
+        if(! msg.is_trade)
+            last_seq = msg.depth.end_seq_number;
+    }
+    if(ok && (expected_seq != last_seq + 1)){
+        std::cout << "  " << name << ": stream ends at depth update " << expected_seq - 1 << ", expected " << last_seq << std::endl;
+        ok = false;
+    }
+    if(expect_book != (published.books.size() > 0)){
+        std::cout << "  " << name << ": " << published.books.size() << " books published" << std::endl;
+        ok = false;
+    }
+
+    std::set<uint64_t> seen;
+    for(uint64_t exchange_timestamp: published.trade_timestamps){
+        if(! seen.insert(exchange_timestamp).second){
+            std::cout << "  " << name << ": trade at " << exchange_timestamp << " published twice" << std::endl;
+            ok = false;
+        }
+    }
+    uint64_t num_trades = 0;
+    for(auto &msg: stream)
+        num_trades += msg.is_trade ? 1 : 0;
+    if(trades_complete && (seen.size() != num_trades)){
+        std::cout << "  " << name << ": " << seen.size() << " of " << num_trades << " trades published" << std::endl;
+        ok = false;
+    }
+
+    std::cout << name << ": " << published.depth_seqs.size() << " depth updates, " << published.trade_timestamps.size() << " trades, "
+                << published.books.size() << " books - " << (ok ? "OK" : "FAILED") << std::endl;
+    return(ok);
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t num_messages = TESTER_DEFAULT_MESSAGES;
+    uint64_t handover_at = TESTER_DEFAULT_HANDOVER;
+    uint64_t delay = TESTER_DEFAULT_DELAY;
+
+    const char* const short_opts = "n:k:d:h";
+    const option long_opts[] = {
+        {"messages", required_argument, nullptr, 'n'},
+        {"handover", required_argument, nullptr, 'k'},
+        {"delay", required_argument, nullptr, 'd'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, no_argument, nullptr, 0}
+    };
+
+    while (true) {
+        const auto opt = getopt_long(argc, argv, short_opts, long_opts, nullptr);
+        if (-1 == opt)
+            break;
+
+        switch (opt) {
+            case 'n':
+                num_messages = std::stoull(optarg);
+                break;
+            case 'k':
+                handover_at = std::stoull(optarg);
+                break;
+            case 'd':
+                delay = std::stoull(optarg);
+                break;
+            case 'h':
+            case '?':
+            default:
+                print_options();
+                return(0);
+        }
+    }
+    if((handover_at == 0) || (handover_at + delay >= num_messages)){
+        std::cout << "The handover and takeover have to be inside the stream" << std::endl;
+        return(1);
+    }
+
+    std::vector<stream_message> stream = make_stream(num_messages);
+    bool ok = true;
+
+    // Buffer holds everything between the release and the takeover
+    published_stream published = run_handover(stream, handover_at, delay, SHARD_REPLAY_DEFAULT_BYTES, 0);
+    ok &= check_stream("replayed", stream, published, false, true);
+
+    // Takeover at the same message as the release
+    published = run_handover(stream, handover_at, 0, SHARD_REPLAY_DEFAULT_BYTES, 0);
+    ok &= check_stream("no delay", stream, published, false, true);
+
+    // Buffer of a few messages wraps past the cutoff, the book replaces the depth updates
+    published = run_handover(stream, handover_at, delay, 8 * sizeof(Trade), 0);
+    ok &= check_stream("buffer wrapped", stream, published, true, false);
+
+    // Book resynced while on standby, what was held from before doesn't line up anymore
+    published = run_handover(stream, handover_at, delay, SHARD_REPLAY_DEFAULT_BYTES, handover_at + (delay / 2));
+    ok &= check_stream("resynced on standby", stream, published, true, true);
+
+    return(ok ? 0 : 1);
+}
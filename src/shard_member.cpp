@@ -0,0 +1,223 @@
+#include "shard_member.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - subscribe_instrument subscribes all streams for an instrument
+// id and returns the number of streams it subscribed
+// -----------------------------------------------------------------------
+ShardMember::ShardMember(Logger *_logger, uint32_t _shard_id, WSock *_wsock, std::function<int(uint32_t)> _subscribe_instrument) {
+    logger = _logger;
+    shard_id = _shard_id;
+    wsock = _wsock;
+    subscribe_instrument = _subscribe_instrument;
+    start();
+}
+
+uint64_t ShardMember::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+void ShardMember::set_publisher(std::function<void(char *)> publish, std::function<void(uint32_t)> publish_book) {
+    gate.set_publisher(publish, publish_book, [this](std::string warning) { logger->msg(WARN, warning); });
+}
+
+// -----------------------------------------------------------------------
+// Feed thread: true if this shard publishes the message. end_seq_number is
+// 0 for anything but depth updates. Held while we are on standby.
+// -----------------------------------------------------------------------
+bool ShardMember::should_publish(uint32_t instrument_id, char *msg, uint64_t end_seq_number, uint64_t exchange_timestamp) {
+    return(gate.should_publish(instrument_id, msg, end_seq_number, exchange_timestamp));
+}
+
+// -----------------------------------------------------------------------
+// Feed thread: publishes what was held for the instruments taken over since the last call
+// -----------------------------------------------------------------------
+void ShardMember::replay_handovers() {
+    gate.replay_handovers();
+}
+
+// -----------------------------------------------------------------------
+// True if this shard is currently publishing the instrument
+// -----------------------------------------------------------------------
+bool ShardMember::is_active(uint32_t instrument_id) {
+    return(gate.is_active(instrument_id));
+}
+
+// -----------------------------------------------------------------------
+// Applies an assignment from the coordinator
+// -----------------------------------------------------------------------
+void ShardMember::process_assignment(ShardAssignment *assignment) {
+    for(int i = 0; (i < assignment->num_instruments) && (i < MAX_SHARD_ASSIGNMENT_INSTRUMENTS); i++){
+        uint32_t instrument_id = assignment->instrument_ids[i];
+        switch(assignment->action){
+            case SHARD_ASSIGN_STANDBY:
+            case SHARD_ASSIGN_ACTIVE: {
+                // An instrument we have on standby is made active when the previous owner went away - nothing to hand over
+                bool known = ! gate.add(instrument_id, (assignment->action == SHARD_ASSIGN_ACTIVE) ? SHARD_INSTRUMENT_ACTIVE : SHARD_INSTRUMENT_STANDBY);
+
+                if(! known){
+                    int num_streams = subscribe_instrument(instrument_id);
+                    logger->msg(INFO, "Assigned instrument: " + std::to_string(instrument_id) + ((assignment->action == SHARD_ASSIGN_ACTIVE) ? " (active), " : " (standby), ") + std::to_string(num_streams) + " streams");
+                    if(num_streams == 0)
+                        gate.remove(instrument_id);
+                }
+                break;
+            }
+
+            case SHARD_ASSIGN_RELEASE:
+                release_instrument(instrument_id, assignment->to_shard_id);
+                break;
+
+            case SHARD_ASSIGN_DROP:
+                logger->msg(INFO, "Dropping instrument: " + std::to_string(instrument_id));
+                gate.remove(instrument_id);
+                wsock->remove_subscriptions(instrument_id, 0xFFFF);
+                break;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Stops publishing, tells the new owner where we stopped and drops the streams
+// -----------------------------------------------------------------------
+void ShardMember::release_instrument(uint32_t instrument_id, uint32_t to_shard_id) {
+    ShardHandover handover;
+    memset(&handover, 0, sizeof(ShardHandover));
+    handover.msg_header = {sizeof(ShardHandover), SHARD_HANDOVER, 1};
+    handover.instrument_id = instrument_id;
+    handover.from_shard_id = shard_id;
+    handover.to_shard_id = to_shard_id;
+
+    // Nothing is published after this
+    if(! gate.release(instrument_id, &handover.last_end_seq_number, &handover.last_exchange_timestamp))
+        return;
+
+    to_aeron_mc->send_data((char *) &handover, sizeof(ShardHandover));
+    wsock->remove_subscriptions(instrument_id, 0xFFFF);
+    logger->msg(INFO, "Released instrument: " + std::to_string(instrument_id) + " to shard " + std::to_string(to_shard_id) +
+                        " at seq " + std::to_string(handover.last_end_seq_number));
+}
+
+// -----------------------------------------------------------------------
+// Previous owner stopped - start publishing from where it left off, including what
+// we held back since then
+// -----------------------------------------------------------------------
+void ShardMember::process_handover(ShardHandover *handover) {
+    if(! gate.take_over(handover->instrument_id, handover->last_end_seq_number, handover->last_exchange_timestamp))
+        return;
+    logger->msg(INFO, "Took over instrument: " + std::to_string(handover->instrument_id) + " from shard " + std::to_string(handover->from_shard_id) +
+                        " at seq " + std::to_string(handover->last_end_seq_number));
+}
+
+void ShardMember::send_register() {
+    ShardRegister register_msg;
+    memset(&register_msg, 0, sizeof(ShardRegister));
+    register_msg.msg_header = {sizeof(ShardRegister), SHARD_REGISTER, 1};
+    register_msg.shard_id = shard_id;
+    register_msg.pid = getpid();
+    register_msg.timestamp = get_current_ts();
+    to_aeron_mc->send_data((char *) &register_msg, sizeof(ShardRegister));
+}
+
+// -----------------------------------------------------------------------
+// Reports all our instruments with their state and message rate
+// -----------------------------------------------------------------------
+void ShardMember::send_status() {
+    wsock->get_instrument_stats(socket_stats);
+
+    std::vector<shard_instrument_status> entries;
+    gate.get_states(instrument_states);
+    for(auto &[instrument_id, state]: instrument_states){
+        shard_instrument_status entry;
+        memset(&entry, 0, sizeof(shard_instrument_status));
+        entry.instrument_id = instrument_id;
+        entry.state = state;
+        auto stats = socket_stats.find(instrument_id);
+        if(stats != socket_stats.end()){
+            entry.message_rate = stats->second.message_rate;
+            if((state == SHARD_INSTRUMENT_STANDBY) && stats->second.synced){
+                gate.mark_ready(instrument_id);
+                entry.state = SHARD_INSTRUMENT_READY;
+            }
+        }
+        entries.push_back(entry);
+    }
+
+    // Always at least one message, it is our heartbeat
+    uint16_t num_parts = (entries.size() + MAX_SHARD_STATUS_INSTRUMENTS - 1) / MAX_SHARD_STATUS_INSTRUMENTS;
+    if(num_parts == 0)
+        num_parts = 1;
+    for(uint16_t part = 0; part < num_parts; part++){
+        uint32_t first_entry = part * MAX_SHARD_STATUS_INSTRUMENTS;
+        uint16_t num_entries = std::min((size_t) MAX_SHARD_STATUS_INSTRUMENTS, entries.size() - std::min((size_t) first_entry, entries.size()));
+        status_msg.shard_id = shard_id;
+        status_msg.part = part;
+        status_msg.num_parts = num_parts;
+        status_msg.num_instruments = num_entries;
+        status_msg.timestamp = get_current_ts();
+        if(num_entries > 0)
+            memcpy(status_msg.instruments, &entries[first_entry], num_entries * sizeof(shard_instrument_status));
+        uint16_t msg_length = sizeof(ShardStatus) - ((MAX_SHARD_STATUS_INSTRUMENTS - num_entries) * sizeof(shard_instrument_status));
+        status_msg.msg_header = {msg_length, SHARD_STATUS, 1};
+        to_aeron_mc->send_data((char *) &status_msg, msg_length);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Shard thread, listens to the coordinator on AERON_MC and reports status
+// -----------------------------------------------------------------------
+void ShardMember::start() {
+    std::thread shard_thread([this]() {
+        std::vector<ShardAssignment> assignments;
+        std::vector<ShardHandover> handovers;
+
+        aeron::Context                      shard_context;
+        std::shared_ptr<Aeron>              shard_aeron = Aeron::connect(shard_context);
+        std::int64_t                        shard_channel_id = shard_aeron->addSubscription("aeron:ipc", AERON_MC);
+        std::shared_ptr<Subscription>       shard_subscription = shard_aeron->findSubscription(shard_channel_id);
+
+        to_aeron_mc = new to_aeron(AERON_MC);
+
+        while (!shard_subscription) {
+            shard_subscription = shard_aeron->findSubscription(shard_channel_id);
+        }
+
+        logger->msg(INFO, "Shard " + std::to_string(shard_id) + " started, registering with the coordinator");
+        send_register();
+
+        auto shard_fragment_lambda = [this, &assignments, &handovers](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+            struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
+            if((m->msgType == SHARD_ASSIGNMENT) && (((ShardAssignment *) m)->shard_id == shard_id)) {
+                ShardAssignment assignment;
+                memset(&assignment, 0, sizeof(ShardAssignment));
+                memcpy(&assignment, m, std::min((size_t) m->msgLength, sizeof(ShardAssignment)));
+                assignments.push_back(assignment);
+            }
+            else if((m->msgType == SHARD_HANDOVER) && (((ShardHandover *) m)->to_shard_id == shard_id)) {
+                handovers.push_back(*(ShardHandover *) m);
+            }
+        };
+
+        uint64_t last_status_time = 0;
+        while (1){
+            while(shard_subscription->poll(shard_fragment_lambda, 10) > 0);
+
+            // Work is done outside the poll, subscribing may take a while
+            for(auto &assignment: assignments)
+                process_assignment(&assignment);
+            assignments.clear();
+            for(auto &handover: handovers)
+                process_handover(&handover);
+            handovers.clear();
+
+            uint64_t current_ts = get_current_ts();
+            if((current_ts - last_status_time) > (SHARD_STATUS_INTERVAL_MS * 1000000L)){
+                last_status_time = current_ts;
+                send_status();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    shard_thread.detach();
+}
@@ -0,0 +1,387 @@
+#include "shard_publish_gate.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - records in the ring are 8 byte aligned, so is its size
+// -----------------------------------------------------------------------
+ShardPublishGate::ShardPublishGate(uint64_t _max_replay_bytes) {
+    max_replay_bytes = std::max(_max_replay_bytes & ~((uint64_t) 7), (uint64_t) sizeof(shard_ring_record));
+    for(auto &entry: instrument_table)
+        entry.store(nullptr, std::memory_order_relaxed);
+}
+
+ShardPublishGate::~ShardPublishGate() {
+    for(auto instrument: instrument_list){
+        delete[] instrument->replay_ring;
+        delete(instrument);
+    }
+}
+
+// -----------------------------------------------------------------------
+// publish sends one message as it is, publish_book the clear and snapshot of an instrument's book
+// -----------------------------------------------------------------------
+void ShardPublishGate::set_publisher(std::function<void(char *)> _publish, std::function<void(uint32_t)> _publish_book,
+                                        std::function<void(std::string)> _log_warning) {
+    publish = _publish;
+    publish_book = _publish_book;
+    log_warning = _log_warning;
+}
+
+// -----------------------------------------------------------------------
+// Open addressing on instrument_id, entries are only ever added. Any thread.
+// -----------------------------------------------------------------------
+shard_instrument *ShardPublishGate::find_instrument(uint32_t instrument_id) {
+    uint32_t index = (instrument_id * 2654435761u) & (SHARD_MAX_INSTRUMENTS - 1);
+    for(uint32_t probes = 0; probes < SHARD_MAX_INSTRUMENTS; probes++){
+        shard_instrument *instrument = instrument_table[index].load(std::memory_order_acquire);
+        if((instrument == nullptr) || (instrument->instrument_id == instrument_id))
+            return(instrument);
+        index = (index + 1) & (SHARD_MAX_INSTRUMENTS - 1);
+    }
+    return(nullptr);
+}
+
+// -----------------------------------------------------------------------
+// New entry in state NONE, nullptr if the table is full. gate_lock has to be held.
+// -----------------------------------------------------------------------
+shard_instrument *ShardPublishGate::insert_instrument(uint32_t instrument_id) {
+    uint32_t index = (instrument_id * 2654435761u) & (SHARD_MAX_INSTRUMENTS - 1);
+    for(uint32_t probes = 0; probes < SHARD_MAX_INSTRUMENTS; probes++){
+        if(instrument_table[index].load(std::memory_order_relaxed) == nullptr){
+            shard_instrument *instrument = new shard_instrument();
+            instrument->instrument_id = instrument_id;
+            instrument_list.push_back(instrument);
+            instrument_table[index].store(instrument, std::memory_order_release);
+            return(instrument);
+        }
+        index = (index + 1) & (SHARD_MAX_INSTRUMENTS - 1);
+    }
+    return(nullptr);
+}
+
+// -----------------------------------------------------------------------
+// Once this returns the feed thread is done with the old state and sees the new one for its next
+// message. Both sides are seq_cst - the feed thread either sees the new state or we see it deciding.
+// gate_lock has to be held.
+// -----------------------------------------------------------------------
+void ShardPublishGate::switch_state(shard_instrument *instrument, uint8_t state) {
+    instrument->state.store(state, std::memory_order_seq_cst);
+    while(instrument->in_feed.load(std::memory_order_seq_cst))
+        std::this_thread::yield();
+}
+
+// -----------------------------------------------------------------------
+// Empties the ring, frees it unless keep_ring. The feed thread must not be using it.
+// -----------------------------------------------------------------------
+void ShardPublishGate::reset_replay_ring(shard_instrument *instrument, bool keep_ring) {
+    if(! keep_ring){
+        delete[] instrument->replay_ring;
+        instrument->replay_ring = nullptr;
+    }
+    instrument->read_position = 0;
+    instrument->write_position = 0;
+    instrument->dropped_end_seq_number = 0;
+    instrument->dropped_exchange_timestamp = 0;
+    instrument->book_replaced = false;
+}
+
+// -----------------------------------------------------------------------
+// Record at position or the first after it, skipping the padding at the end of the ring.
+// position is moved to the record, nullptr if there are no more.
+// -----------------------------------------------------------------------
+shard_ring_record *ShardPublishGate::record_at(shard_instrument *instrument, uint64_t &position) {
+    while(position < instrument->write_position){
+        uint64_t offset = position % max_replay_bytes;
+        shard_ring_record *record = (shard_ring_record *) (instrument->replay_ring + offset);
+        // Padding is either too short for a record or marked with a 0 length
+        if(((max_replay_bytes - offset) < sizeof(shard_ring_record)) || (record->length == 0)){
+            position += max_replay_bytes - offset;
+            continue;
+        }
+        return(record);
+    }
+    return(nullptr);
+}
+
+uint64_t ShardPublishGate::record_size(uint32_t length) {
+    return((sizeof(shard_ring_record) + length + 7) & ~((uint64_t) 7));
+}
+
+void ShardPublishGate::drop_oldest(shard_instrument *instrument) {
+    shard_ring_record *oldest = record_at(instrument, instrument->read_position);
+    if(oldest == nullptr)
+        return;
+    // A resync already took care of the depth updates it discarded
+    if(! oldest->discarded && (oldest->end_seq_number > instrument->dropped_end_seq_number))
+        instrument->dropped_end_seq_number = oldest->end_seq_number;
+    if(oldest->exchange_timestamp > instrument->dropped_exchange_timestamp)
+        instrument->dropped_exchange_timestamp = oldest->exchange_timestamp;
+    instrument->read_position += record_size(oldest->length);
+}
+
+// -----------------------------------------------------------------------
+// Keeps the message, the oldest go when the ring is full. A record never wraps, what is left at the
+// end of the ring is skipped. Feed thread.
+// -----------------------------------------------------------------------
+void ShardPublishGate::buffer_message(shard_instrument *instrument, char *msg, uint64_t end_seq_number, uint64_t exchange_timestamp) {
+    uint16_t length = ((MessageHeader *) msg)->msgLength;
+    uint64_t size = record_size(length);
+    if((instrument->replay_ring == nullptr) || (size > max_replay_bytes)){
+        instrument->dropped_end_seq_number = std::max(instrument->dropped_end_seq_number, end_seq_number);
+        instrument->dropped_exchange_timestamp = std::max(instrument->dropped_exchange_timestamp, exchange_timestamp);
+        return;
+    }
+
+    uint64_t padding;
+    for(;;){
+        // Nothing held, start from the beginning of the ring
+        if(record_at(instrument, instrument->read_position) == nullptr){
+            instrument->read_position = 0;
+            instrument->write_position = 0;
+        }
+        uint64_t offset = instrument->write_position % max_replay_bytes;
+        padding = ((offset + size) > max_replay_bytes) ? (max_replay_bytes - offset) : 0;
+        if((instrument->write_position + padding + size - instrument->read_position) <= max_replay_bytes)
+            break;
+        drop_oldest(instrument);
+    }
+    if(padding >= sizeof(shard_ring_record))
+        ((shard_ring_record *) (instrument->replay_ring + (instrument->write_position % max_replay_bytes)))->length = 0;
+    instrument->write_position += padding;
+
+    shard_ring_record *record = (shard_ring_record *) (instrument->replay_ring + (instrument->write_position % max_replay_bytes));
+    record->end_seq_number = end_seq_number;
+    record->exchange_timestamp = exchange_timestamp;
+    record->length = length;
+    record->discarded = 0;
+    memcpy((char *) record + sizeof(shard_ring_record), msg, length);
+    instrument->write_position += size;
+}
+
+// -----------------------------------------------------------------------
+// Depth updates by sequence number, the rest by exchange time. Feed thread.
+// -----------------------------------------------------------------------
+bool ShardPublishGate::passes_cutoff(shard_instrument *instrument, uint64_t end_seq_number, uint64_t exchange_timestamp) {
+    if(end_seq_number != 0){
+        if(end_seq_number <= instrument->cutoff_end_seq_number)
+            return(false);
+        instrument->last_end_seq_number = end_seq_number;
+    }
+    else if(exchange_timestamp <= instrument->cutoff_exchange_timestamp) {
+        return(false);
+    }
+    if(exchange_timestamp > instrument->last_exchange_timestamp)
+        instrument->last_exchange_timestamp = exchange_timestamp;
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Publishes what was buffered after the previous owner stopped. in_book_end_seq_number is a depth
+// update that is in the book already but not published yet (0 if none). Feed thread.
+// -----------------------------------------------------------------------
+void ShardPublishGate::replay_instrument(shard_instrument *instrument, uint64_t in_book_end_seq_number) {
+    instrument->replay_pending.store(false, std::memory_order_relaxed);
+    num_pending_replays--;
+
+    if(instrument->book_replaced || (instrument->dropped_end_seq_number > instrument->cutoff_end_seq_number)){
+        // Depth updates the previous owner didn't publish are gone - the book replaces them, and
+        // everything in it already goes out with it
+        uint64_t book_end_seq_number = std::max(instrument->dropped_end_seq_number, in_book_end_seq_number);
+        shard_ring_record *record;
+        for(uint64_t position = instrument->read_position; (record = record_at(instrument, position)) != nullptr; position += record_size(record->length)){
+            if(! record->discarded)
+                book_end_seq_number = std::max(book_end_seq_number, record->end_seq_number);
+        }
+        if(publish_book)
+            publish_book(instrument->instrument_id);
+        instrument->cutoff_end_seq_number = book_end_seq_number;
+        instrument->last_end_seq_number = book_end_seq_number;
+        if(log_warning)
+            log_warning("Replay buffer of instrument " + std::to_string(instrument->instrument_id) + " did not reach back to the handover, republished the book");
+    }
+    if((instrument->dropped_exchange_timestamp > instrument->cutoff_exchange_timestamp) && log_warning)
+        log_warning("Replay buffer of instrument " + std::to_string(instrument->instrument_id) + " did not reach back to the handover, trades/tickers up to " +
+                        std::to_string(instrument->dropped_exchange_timestamp) + " were not published");
+
+    shard_ring_record *record;
+    for(uint64_t position = instrument->read_position; (record = record_at(instrument, position)) != nullptr; position += record_size(record->length)){
+        if(! record->discarded && passes_cutoff(instrument, record->end_seq_number, record->exchange_timestamp) && publish)
+            publish((char *) record + sizeof(shard_ring_record));
+    }
+    reset_replay_ring(instrument, true);
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// True if the instrument is new. An instrument we have on standby that is made active is switched
+// without a handover, the previous owner went away. The ring is allocated here for instruments
+// that start on standby, its pages are only backed once messages are held in them.
+// -----------------------------------------------------------------------
+bool ShardPublishGate::add(uint32_t instrument_id, uint8_t state) {
+    MyGuard guard(gate_lock);
+    shard_instrument *instrument = find_instrument(instrument_id);
+    if(instrument == nullptr)
+        instrument = insert_instrument(instrument_id);
+    if(instrument == nullptr){
+        if(log_warning)
+            log_warning("No room for instrument " + std::to_string(instrument_id) + ", " + std::to_string(SHARD_MAX_INSTRUMENTS) + " instruments assigned already");
+        return(false);
+    }
+
+    uint8_t current_state = instrument->state.load(std::memory_order_relaxed);
+    if(current_state == SHARD_INSTRUMENT_NONE){
+        // Feed thread leaves an instrument in state NONE alone
+        instrument->cutoff_end_seq_number = 0;
+        instrument->cutoff_exchange_timestamp = 0;
+        instrument->last_end_seq_number = 0;
+        instrument->last_exchange_timestamp = 0;
+        reset_replay_ring(instrument, false);
+        if(state != SHARD_INSTRUMENT_ACTIVE)
+            instrument->replay_ring = new char[max_replay_bytes];
+        instrument->state.store(state, std::memory_order_release);
+        return(true);
+    }
+    if((state == SHARD_INSTRUMENT_ACTIVE) && (current_state != SHARD_INSTRUMENT_ACTIVE)){
+        // Nothing to hand over and no cutoff, the buffer is history nobody asked for
+        switch_state(instrument, SHARD_INSTRUMENT_NONE);
+        reset_replay_ring(instrument, false);
+        instrument->state.store(SHARD_INSTRUMENT_ACTIVE, std::memory_order_release);
+    }
+    return(false);
+}
+
+// -----------------------------------------------------------------------
+// Standby instrument whose book is in sync, ready to take over
+// -----------------------------------------------------------------------
+void ShardPublishGate::mark_ready(uint32_t instrument_id) {
+    MyGuard guard(gate_lock);
+    shard_instrument *instrument = find_instrument(instrument_id);
+    if(instrument == nullptr)
+        return;
+    uint8_t expected = SHARD_INSTRUMENT_STANDBY;
+    instrument->state.compare_exchange_strong(expected, SHARD_INSTRUMENT_READY);
+}
+
+void ShardPublishGate::remove(uint32_t instrument_id) {
+    MyGuard guard(gate_lock);
+    shard_instrument *instrument = find_instrument(instrument_id);
+    if((instrument == nullptr) || (instrument->state.load(std::memory_order_relaxed) == SHARD_INSTRUMENT_NONE))
+        return;
+    switch_state(instrument, SHARD_INSTRUMENT_NONE);
+    if(instrument->replay_pending.exchange(false))
+        num_pending_replays--;
+    reset_replay_ring(instrument, false);
+}
+
+// -----------------------------------------------------------------------
+// Stops publishing and returns where we stopped. A message the feed thread is deciding on is
+// finished first, nothing is published after this.
+// -----------------------------------------------------------------------
+bool ShardPublishGate::release(uint32_t instrument_id, uint64_t *last_end_seq_number, uint64_t *last_exchange_timestamp) {
+    MyGuard guard(gate_lock);
+    shard_instrument *instrument = find_instrument(instrument_id);
+    if((instrument == nullptr) || (instrument->state.load(std::memory_order_relaxed) == SHARD_INSTRUMENT_NONE))
+        return(false);
+    switch_state(instrument, SHARD_INSTRUMENT_NONE);
+    *last_end_seq_number = instrument->last_end_seq_number;
+    *last_exchange_timestamp = instrument->last_exchange_timestamp;
+    if(instrument->replay_pending.exchange(false))
+        num_pending_replays--;
+    reset_replay_ring(instrument, false);
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Previous owner stopped at the cutoffs - what we buffered after them goes out on the feed thread
+// -----------------------------------------------------------------------
+bool ShardPublishGate::take_over(uint32_t instrument_id, uint64_t cutoff_end_seq_number, uint64_t cutoff_exchange_timestamp) {
+    MyGuard guard(gate_lock);
+    shard_instrument *instrument = find_instrument(instrument_id);
+    if((instrument == nullptr) || (instrument->state.load(std::memory_order_relaxed) == SHARD_INSTRUMENT_NONE))
+        return(false);
+    // Cutoffs are the feed thread's once the instrument is active, set them while it only buffers
+    uint8_t current_state = instrument->state.load(std::memory_order_relaxed);
+    if(current_state == SHARD_INSTRUMENT_ACTIVE)
+        switch_state(instrument, SHARD_INSTRUMENT_READY);
+    instrument->cutoff_end_seq_number = cutoff_end_seq_number;
+    instrument->cutoff_exchange_timestamp = cutoff_exchange_timestamp;
+    instrument->last_end_seq_number = cutoff_end_seq_number;
+    instrument->last_exchange_timestamp = cutoff_exchange_timestamp;
+    if(! instrument->replay_pending.exchange(true))
+        num_pending_replays++;
+    instrument->state.store(SHARD_INSTRUMENT_ACTIVE, std::memory_order_release);
+    return(true);
+}
+
+void ShardPublishGate::get_states(std::vector<std::pair<uint32_t, uint8_t>> &states) {
+    MyGuard guard(gate_lock);
+    states.clear();
+    for(auto instrument: instrument_list){
+        uint8_t state = instrument->state.load(std::memory_order_relaxed);
+        if(state != SHARD_INSTRUMENT_NONE)
+            states.push_back({instrument->instrument_id, state});
+    }
+}
+
+// -----------------------------------------------------------------------
+// True if this shard publishes the message. A takeover that hasn't been replayed yet is replayed
+// first so the messages go out in order.
+// -----------------------------------------------------------------------
+bool ShardPublishGate::should_publish(uint32_t instrument_id, char *msg, uint64_t end_seq_number, uint64_t exchange_timestamp) {
+    shard_instrument *instrument = find_instrument(instrument_id);
+    if(instrument == nullptr)
+        return(false);
+
+    bool publish_message = false;
+    bool is_clear = ((MessageHeader *) msg)->msgType == INSTRUMENT_CLEAR_BOOK;
+    instrument->in_feed.store(true, std::memory_order_seq_cst);
+    switch(instrument->state.load(std::memory_order_seq_cst)){
+        case SHARD_INSTRUMENT_STANDBY:
+        case SHARD_INSTRUMENT_READY:
+            if(is_clear){
+                // Resync, the depth updates we hold of the old book are no use anymore
+                shard_ring_record *record;
+                for(uint64_t position = instrument->read_position; (record = record_at(instrument, position)) != nullptr; position += record_size(record->length)){
+                    if(record->end_seq_number != 0)
+                        record->discarded = 1;
+                }
+                instrument->book_replaced = true;
+            } else {
+                buffer_message(instrument, msg, end_seq_number, exchange_timestamp);
+            }
+            break;
+        case SHARD_INSTRUMENT_ACTIVE:
+            if(instrument->replay_pending.load(std::memory_order_relaxed))
+                replay_instrument(instrument, end_seq_number);
+            publish_message = is_clear || passes_cutoff(instrument, end_seq_number, exchange_timestamp);
+            break;
+        default:
+            break;
+    }
+    instrument->in_feed.store(false, std::memory_order_release);
+    return(publish_message);
+}
+
+// -----------------------------------------------------------------------
+// Replays the takeovers since the last call, so they go out even if nothing else comes in
+// -----------------------------------------------------------------------
+void ShardPublishGate::replay_handovers() {
+    if(num_pending_replays.load(std::memory_order_relaxed) == 0)
+        return;
+    for(auto &entry: instrument_table){
+        shard_instrument *instrument = entry.load(std::memory_order_acquire);
+        if((instrument == nullptr) || ! instrument->replay_pending.load(std::memory_order_relaxed))
+            continue;
+        instrument->in_feed.store(true, std::memory_order_seq_cst);
+        if(instrument->state.load(std::memory_order_seq_cst) == SHARD_INSTRUMENT_ACTIVE && instrument->replay_pending.load(std::memory_order_relaxed))
+            replay_instrument(instrument, 0);
+        instrument->in_feed.store(false, std::memory_order_release);
+    }
+}
+
+bool ShardPublishGate::is_active(uint32_t instrument_id) {
+    shard_instrument *instrument = find_instrument(instrument_id);
+    return((instrument != nullptr) && (instrument->state.load(std::memory_order_acquire) == SHARD_INSTRUMENT_ACTIVE));
+}
@@ -0,0 +1,372 @@
+#include "sim_matching_engine.hpp"
+
+SimMatchingEngine::SimMatchingEngine(std::function<void(sim_execution *)> _execution_callback) {
+    execution_callback = _execution_callback;
+}
+
+uint64_t SimMatchingEngine::get_current_ms() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000L)+(t.tv_nsec/1000000L));
+}
+
+void SimMatchingEngine::add_instrument(std::string symbol, uint32_t instrument_id) {
+    MyGuard guard(engine_lock);
+    sim_book *book = get_book(symbol);
+    book->instrument_id = instrument_id;
+    books_by_instrument[instrument_id] = book;
+}
+
+// -----------------------------------------------------------------------
+// Book of a symbol, created on its first order - engine_lock has to be held
+// -----------------------------------------------------------------------
+sim_book *SimMatchingEngine::get_book(const std::string &symbol) {
+    auto found = books.find(symbol);
+    if(found != books.end())
+        return(found->second);
+    sim_book *book = new sim_book();
+    book->symbol = symbol;
+    book->instrument_id = 0;
+    book->touch = {};
+    books[symbol] = book;
+    return(book);
+}
+
+void SimMatchingEngine::report(sim_order *order, uint8_t exec_type, double last_qty, double last_price, bool is_maker, const char *cancel_client_order_id) {
+    sim_execution execution;
+    execution.order = *order;
+    execution.exec_type = exec_type;
+    execution.is_maker = is_maker;
+    execution.last_qty = last_qty;
+    execution.last_price = last_price;
+    execution.trade_id = (exec_type == SIM_EXEC_TRADE) ? next_trade_id++ : 0;
+    execution.event_time = order->update_time;
+    strncpy(execution.cancel_client_order_id, cancel_client_order_id, SIM_MAX_CLIENT_ORDER_ID - 1);
+    execution.cancel_client_order_id[SIM_MAX_CLIENT_ORDER_ID - 1] = 0;
+    if(execution_callback)
+        execution_callback(&execution);
+}
+
+void SimMatchingEngine::fill(sim_order *order, double qty, double price, bool is_maker) {
+    order->executed_qty += qty;
+    order->cum_quote += qty * price;
+    order->status = ((order->orig_qty - order->executed_qty) <= SIM_QTY_EPSILON) ? SIM_STATUS_FILLED : SIM_STATUS_PARTIALLY_FILLED;
+    order->update_time = get_current_ms();
+    stats.num_fills++;
+    report(order, SIM_EXEC_TRADE, qty, price, is_maker);
+}
+
+// -----------------------------------------------------------------------
+// Order is done, it has to be out of the book already
+// -----------------------------------------------------------------------
+void SimMatchingEngine::close_order(sim_order *order) {
+    orders_by_client_id.erase(std::string(order->symbol) + ":" + order->client_order_id);
+    orders.erase(order->order_id);
+    delete(order);
+}
+
+void SimMatchingEngine::add_resting(sim_book *book, sim_order *order) {
+    if(order->is_buy)
+        book->bids[order->price].push_back(order);
+    else
+        book->asks[order->price].push_back(order);
+}
+
+void SimMatchingEngine::remove_resting(sim_book *book, sim_order *order) {
+    if(order->is_buy){
+        auto level = book->bids.find(order->price);
+        if(level == book->bids.end())
+            return;
+        level->second.remove(order);
+        if(level->second.empty())
+            book->bids.erase(level);
+    } else {
+        auto level = book->asks.find(order->price);
+        if(level == book->asks.end())
+            return;
+        level->second.remove(order);
+        if(level->second.empty())
+            book->asks.erase(level);
+    }
+}
+
+bool SimMatchingEngine::crosses(sim_order *order, double price) {
+    if(order->order_type == SIM_TYPE_MARKET)
+        return(true);
+    return(order->is_buy ? (price <= order->price) : (price >= order->price));
+}
+
+// -----------------------------------------------------------------------
+// Quantity an incoming order could trade right now, for FOK and post only
+// -----------------------------------------------------------------------
+double SimMatchingEngine::available_to(sim_book *book, sim_order *order) {
+    double available = 0.0;
+    if(order->is_buy){
+        for(auto &level: book->asks){
+            if(! crosses(order, level.first))
+                break;
+            for(sim_order *resting: level.second)
+                available += resting->orig_qty - resting->executed_qty;
+        }
+        if((book->touch.ask_price > 0.0) && crosses(order, book->touch.ask_price))
+            available += std::max(0.0, book->touch.ask_qty - book->touch.ask_taken);
+    } else {
+        for(auto &level: book->bids){
+            if(! crosses(order, level.first))
+                break;
+            for(sim_order *resting: level.second)
+                available += resting->orig_qty - resting->executed_qty;
+        }
+        if((book->touch.bid_price > 0.0) && crosses(order, book->touch.bid_price))
+            available += std::max(0.0, book->touch.bid_qty - book->touch.bid_taken);
+    }
+    return(available);
+}
+
+// -----------------------------------------------------------------------
+// Trades an incoming order with the better of the best resting order and what is left of the touch
+// -----------------------------------------------------------------------
+void SimMatchingEngine::match_incoming(sim_book *book, sim_order *order) {
+    while((order->orig_qty - order->executed_qty) > SIM_QTY_EPSILON){
+        double remaining = order->orig_qty - order->executed_qty;
+
+        sim_order *resting = nullptr;
+        double resting_price = 0.0;
+        if(order->is_buy && ! book->asks.empty()){
+            resting_price = book->asks.begin()->first;
+            resting = book->asks.begin()->second.front();
+        } else if(! order->is_buy && ! book->bids.empty()){
+            resting_price = book->bids.begin()->first;
+            resting = book->bids.begin()->second.front();
+        }
+        double touch_price = order->is_buy ? book->touch.ask_price : book->touch.bid_price;
+        double *touch_taken = order->is_buy ? &book->touch.ask_taken : &book->touch.bid_taken;
+        double touch_qty = (order->is_buy ? book->touch.ask_qty : book->touch.bid_qty) - *touch_taken;
+
+        bool resting_ok = (resting != nullptr) && crosses(order, resting_price);
+        bool touch_ok = (touch_price > 0.0) && (touch_qty > SIM_QTY_EPSILON) && crosses(order, touch_price);
+        if(! resting_ok && ! touch_ok)
+            break;
+
+        bool resting_first = resting_ok && (! touch_ok || (order->is_buy ? (resting_price <= touch_price) : (resting_price >= touch_price)));
+        if(resting_first){
+            double qty = std::min(remaining, resting->orig_qty - resting->executed_qty);
+            fill(resting, qty, resting_price, true);
+            fill(order, qty, resting_price, false);
+            if(resting->status == SIM_STATUS_FILLED){
+                remove_resting(book, resting);
+                close_order(resting);
+            }
+        } else {
+            double qty = std::min(remaining, touch_qty);
+            *touch_taken += qty;
+            fill(order, qty, touch_price, false);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Fills the resting orders of one side the market went through. Orders at price (and better ones
+// unless better_fill_all) share qty in price-time order, better ones fill in full when better_fill_all.
+// Returns how much of qty was used.
+// -----------------------------------------------------------------------
+template<typename LEVELS>
+double SimMatchingEngine::fill_through(LEVELS &levels, bool is_buy, double price, double qty, bool better_fill_all) {
+    double used = 0.0;
+    auto level = levels.begin();
+    while(level != levels.end()){
+        double level_price = level->first;
+        bool better = is_buy ? (level_price > price) : (level_price < price);
+        if(! better && (level_price != price))
+            break;
+        bool fill_all = better && better_fill_all;
+
+        auto &queue = level->second;
+        while(! queue.empty()){
+            sim_order *order = queue.front();
+            double fill_qty = order->orig_qty - order->executed_qty;
+            if(! fill_all)
+                fill_qty = std::min(fill_qty, qty - used);
+            if(fill_qty <= SIM_QTY_EPSILON)
+                return(used);
+            fill(order, fill_qty, level_price, true);
+            if(! fill_all)
+                used += fill_qty;
+            if(order->status != SIM_STATUS_FILLED)
+                return(used);
+            queue.pop_front();
+            close_order(order);
+        }
+        level = levels.erase(level);
+    }
+    return(used);
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+int SimMatchingEngine::new_order(sim_order_request &request, sim_order *result, std::string &error_message) {
+    if(request.symbol.empty() || (request.symbol.length() >= SIM_MAX_SYMBOL)){
+        error_message = "Mandatory parameter 'symbol' was not sent, was empty/null, or malformed.";
+        return(SIM_ERROR_MANDATORY_PARAM);
+    }
+    if(request.qty <= 0.0){
+        error_message = "Mandatory parameter 'quantity' was not sent, was empty/null, or malformed.";
+        return(SIM_ERROR_MANDATORY_PARAM);
+    }
+    if((request.order_type != SIM_TYPE_MARKET) && (request.price <= 0.0)){
+        error_message = "Mandatory parameter 'price' was not sent, was empty/null, or malformed.";
+        return(SIM_ERROR_MANDATORY_PARAM);
+    }
+    if(request.client_order_id.length() >= SIM_MAX_CLIENT_ORDER_ID){
+        error_message = "Illegal characters found in parameter 'newClientOrderId'; legal range is '^[\\.A-Z\\:/a-z0-9_-]{1,36}$'.";
+        return(SIM_ERROR_BAD_PARAM);
+    }
+
+    MyGuard guard(engine_lock);
+    uint64_t order_id = next_order_id++;
+    std::string client_order_id = request.client_order_id.empty() ? ("sim_" + std::to_string(order_id)) : request.client_order_id;
+    std::string client_key = request.symbol + ":" + client_order_id;
+    if(orders_by_client_id.count(client_key)){
+        stats.num_rejects++;
+        error_message = "Duplicate order sent.";
+        return(SIM_ERROR_NEW_ORDER_REJECTED);
+    }
+
+    sim_book *book = get_book(request.symbol);
+    sim_order *order = new sim_order();
+    order->order_id = order_id;
+    strcpy(order->client_order_id, client_order_id.c_str());
+    strcpy(order->symbol, request.symbol.c_str());
+    order->is_buy = request.is_buy;
+    order->reduce_only = request.reduce_only;
+    order->order_type = request.order_type;
+    order->time_in_force = request.time_in_force;
+    order->status = SIM_STATUS_NEW;
+    order->price = (request.order_type == SIM_TYPE_MARKET) ? 0.0 : request.price;
+    order->orig_qty = request.qty;
+    order->executed_qty = 0.0;
+    order->cum_quote = 0.0;
+    order->order_time = get_current_ms();
+    order->update_time = order->order_time;
+
+    // Spot post only orders are rejected when they would take, futures ones are accepted and expire
+    bool would_take = ((order->order_type == SIM_TYPE_LIMIT_MAKER) || (order->time_in_force == SIM_TIF_GTX)) &&
+                        (available_to(book, order) > SIM_QTY_EPSILON);
+    if(would_take && (order->order_type == SIM_TYPE_LIMIT_MAKER)){
+        delete(order);
+        stats.num_rejects++;
+        error_message = "Order would immediately match and take.";
+        return(SIM_ERROR_NEW_ORDER_REJECTED);
+    }
+
+    orders[order_id] = order;
+    orders_by_client_id[client_key] = order;
+    stats.num_orders++;
+    report(order, SIM_EXEC_NEW, 0.0, 0.0, false);
+
+    bool can_fill = ! would_take &&
+                    ((order->time_in_force != SIM_TIF_FOK) || ((available_to(book, order) + SIM_QTY_EPSILON) >= order->orig_qty));
+    if(can_fill)
+        match_incoming(book, order);
+
+    bool rests = (order->order_type != SIM_TYPE_MARKET) && ((order->time_in_force == SIM_TIF_GTC) || (order->time_in_force == SIM_TIF_GTX));
+    if(order->status == SIM_STATUS_FILLED){
+        *result = *order;
+        close_order(order);
+    } else if(! can_fill || ! rests){
+        order->status = SIM_STATUS_EXPIRED;
+        order->update_time = get_current_ms();
+        report(order, SIM_EXEC_EXPIRED, 0.0, 0.0, false);
+        *result = *order;
+        close_order(order);
+    } else {
+        add_resting(book, order);
+        *result = *order;
+    }
+    return(SIM_OK);
+}
+
+int SimMatchingEngine::cancel_order(std::string &symbol, uint64_t order_id, std::string &orig_client_order_id, std::string &cancel_client_order_id,
+                                    sim_order *result, std::string &error_message) {
+    if(symbol.empty()){
+        error_message = "Mandatory parameter 'symbol' was not sent, was empty/null, or malformed.";
+        return(SIM_ERROR_MANDATORY_PARAM);
+    }
+    if((order_id == 0) && orig_client_order_id.empty()){
+        error_message = "Param 'origClientOrderId' or 'orderId' must be sent, but both were empty/null!";
+        return(SIM_ERROR_MANDATORY_PARAM);
+    }
+
+    MyGuard guard(engine_lock);
+    sim_order *order = nullptr;
+    if(order_id != 0){
+        auto found = orders.find(order_id);
+        if(found != orders.end())
+            order = found->second;
+    } else {
+        auto found = orders_by_client_id.find(symbol + ":" + orig_client_order_id);
+        if(found != orders_by_client_id.end())
+            order = found->second;
+    }
+    if((order == nullptr) || (symbol != order->symbol)){
+        stats.num_rejects++;
+        error_message = "Unknown order sent.";
+        return(SIM_ERROR_CANCEL_REJECTED);
+    }
+
+    remove_resting(get_book(symbol), order);
+    order->status = SIM_STATUS_CANCELED;
+    order->update_time = get_current_ms();
+    stats.num_cancels++;
+    report(order, SIM_EXEC_CANCELED, 0.0, 0.0, false, cancel_client_order_id.c_str());
+    *result = *order;
+    close_order(order);
+    return(SIM_OK);
+}
+
+std::vector<sim_order> SimMatchingEngine::get_open_orders(std::string &symbol) {
+    std::vector<sim_order> open_orders;
+    MyGuard guard(engine_lock);
+    for(auto &order: orders){
+        if(symbol.empty() || (symbol == order.second->symbol))
+            open_orders.push_back(*order.second);
+    }
+    std::sort(open_orders.begin(), open_orders.end(), [](const sim_order &a, const sim_order &b) { return(a.order_id < b.order_id); });
+    return(open_orders);
+}
+
+// -----------------------------------------------------------------------
+// New touch - resting orders it crossed are filled out of it, the rest is there for incoming orders
+// -----------------------------------------------------------------------
+void SimMatchingEngine::on_tob(ToBUpdate *tob) {
+    MyGuard guard(engine_lock);
+    stats.num_market_updates++;
+    auto found = books_by_instrument.find(tob->instrument_id);
+    if(found == books_by_instrument.end())
+        return;
+    sim_book *book = found->second;
+    book->touch = {tob->bid_price, tob->bid_qty, tob->ask_price, tob->ask_qty, 0.0, 0.0};
+    if(tob->ask_price > 0.0)
+        book->touch.ask_taken = fill_through(book->bids, true, tob->ask_price, tob->ask_qty, false);
+    if(tob->bid_price > 0.0)
+        book->touch.bid_taken = fill_through(book->asks, false, tob->bid_price, tob->bid_qty, false);
+}
+
+void SimMatchingEngine::on_trade(Trade *trade) {
+    MyGuard guard(engine_lock);
+    stats.num_market_updates++;
+    auto found = books_by_instrument.find(trade->instrument_id);
+    if(found == books_by_instrument.end())
+        return;
+    sim_book *book = found->second;
+    fill_through(book->bids, true, trade->price, trade->qty, true);
+    fill_through(book->asks, false, trade->price, trade->qty, true);
+}
+
+sim_engine_stats SimMatchingEngine::get_stats() {
+    MyGuard guard(engine_lock);
+    stats.num_open = orders.size();
+    return(stats);
+}
@@ -0,0 +1,1032 @@
+#include "sim_server.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - nothing is listening until start is called
+// -----------------------------------------------------------------------
+SimServer::SimServer(sim_config _config) {
+    config = _config;
+}
+
+void SimServer::set_engine(SimMatchingEngine *_engine) {
+    engine = _engine;
+}
+
+uint64_t SimServer::get_current_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+double SimServer::random_fraction() {
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    return(distribution(generator));
+}
+
+std::string SimServer::url_decode(const std::string &value) {
+    std::string decoded;
+    for(size_t i = 0; i < value.length(); i++){
+        if((value[i] == '%') && ((i + 2) < value.length())){
+            decoded += (char) strtol(value.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        } else if(value[i] == '+') {
+            decoded += ' ';
+        } else {
+            decoded += value[i];
+        }
+    }
+    return(decoded);
+}
+
+void SimServer::parse_params(const std::string &query, std::unordered_map<std::string, std::string> &params) {
+    size_t start = 0;
+    while(start < query.length()){
+        size_t end = query.find('&', start);
+        if(end == std::string::npos)
+            end = query.length();
+        size_t equals = query.find('=', start);
+        if((equals != std::string::npos) && (equals < end))
+            params[url_decode(query.substr(start, equals - start))] = url_decode(query.substr(equals + 1, end - equals - 1));
+        start = end + 1;
+    }
+}
+
+std::string SimServer::get_param(sim_http_request &request, const char *name) {
+    auto found = request.params.find(name);
+    return((found != request.params.end()) ? found->second : "");
+}
+
+// -----------------------------------------------------------------------
+// JSON string or bare value at pos (spaces skipped) into value, returns the position after it or
+// npos if there is none. Escapes are taken as the character escaped.
+// -----------------------------------------------------------------------
+size_t SimServer::read_json_value(const std::string &json, size_t pos, std::string &value) {
+    value.clear();
+    pos = json.find_first_not_of(" \t\r\n", pos);
+    if(pos == std::string::npos)
+        return(std::string::npos);
+    if(json[pos] != '"'){
+        size_t end = json.find_first_of(",]} \t\r\n", pos);
+        if((end == std::string::npos) || (end == pos))
+            return(std::string::npos);
+        value = json.substr(pos, end - pos);
+        return(end);
+    }
+    for(pos++; pos < json.length(); pos++){
+        if(json[pos] == '"')
+            return(pos + 1);
+        if((json[pos] == '\\') && (pos + 1 < json.length()))
+            pos++;
+        value += json[pos];
+    }
+    return(std::string::npos);
+}
+
+// -----------------------------------------------------------------------
+// [{"name":"value",..},..] of batchOrders, or ["value",..] of the id lists of a batch cancel
+// (objects empty then). False if it is neither.
+// -----------------------------------------------------------------------
+bool SimServer::parse_json_list(const std::string &json, std::vector<std::unordered_map<std::string, std::string>> &objects,
+                                    std::vector<std::string> &values) {
+    objects.clear();
+    values.clear();
+    size_t pos = json.find_first_not_of(" \t\r\n");
+    if((pos == std::string::npos) || (json[pos] != '['))
+        return(false);
+    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    if((pos != std::string::npos) && (json[pos] == ']'))
+        return(true);
+    while(pos != std::string::npos){
+        if(json[pos] == '{'){
+            std::unordered_map<std::string, std::string> object;
+            pos = json.find_first_not_of(" \t\r\n", pos + 1);
+            while((pos != std::string::npos) && (json[pos] != '}')){
+                std::string name, value;
+                pos = read_json_value(json, pos, name);
+                if((pos == std::string::npos) || ((pos = json.find_first_not_of(" \t\r\n", pos)) == std::string::npos) || (json[pos] != ':'))
+                    return(false);
+                if((pos = read_json_value(json, pos + 1, value)) == std::string::npos)
+                    return(false);
+                object[name] = value;
+                pos = json.find_first_not_of(" \t\r\n", pos);
+                if((pos != std::string::npos) && (json[pos] == ','))
+                    pos = json.find_first_not_of(" \t\r\n", pos + 1);
+            }
+            if(pos == std::string::npos)
+                return(false);
+            objects.push_back(object);
+            pos++;
+        } else {
+            std::string value;
+            if((pos = read_json_value(json, pos, value)) == std::string::npos)
+                return(false);
+            values.push_back(value);
+        }
+        pos = json.find_first_not_of(" \t\r\n", pos);
+        if(pos == std::string::npos)
+            return(false);
+        if(json[pos] == ']')
+            return(true);
+        if(json[pos] != ',')
+            return(false);
+        pos = json.find_first_not_of(" \t\r\n", pos + 1);
+    }
+    return(false);
+}
+
+std::string SimServer::format_decimal(double value) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.8f", value);
+    return(std::string(buffer));
+}
+
+// -----------------------------------------------------------------------
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key - base64 of the SHA1 of key + guid
+// -----------------------------------------------------------------------
+std::string SimServer::websocket_accept(const std::string &key) {
+    static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string input = key + SIM_WEBSOCKET_GUID;
+    byte digest[WC_SHA_DIGEST_SIZE];
+    wc_ShaHash((const byte *) input.c_str(), input.length(), digest);
+
+    std::string encoded;
+    for(int i = 0; i < WC_SHA_DIGEST_SIZE; i += 3){
+        uint32_t chunk = digest[i] << 16;
+        if((i + 1) < WC_SHA_DIGEST_SIZE)
+            chunk |= digest[i + 1] << 8;
+        if((i + 2) < WC_SHA_DIGEST_SIZE)
+            chunk |= digest[i + 2];
+        encoded += base64_chars[(chunk >> 18) & 63];
+        encoded += base64_chars[(chunk >> 12) & 63];
+        encoded += ((i + 1) < WC_SHA_DIGEST_SIZE) ? base64_chars[(chunk >> 6) & 63] : '=';
+        encoded += ((i + 2) < WC_SHA_DIGEST_SIZE) ? base64_chars[chunk & 63] : '=';
+    }
+    return(encoded);
+}
+
+std::string SimServer::make_listen_key() {
+    static const char key_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+    std::string listen_key;
+    for(int i = 0; i < SIM_LISTEN_KEY_LENGTH; i++)
+        listen_key += key_chars[(int) (random_fraction() * 62) % 62];
+    return(listen_key);
+}
+
+// -----------------------------------------------------------------------
+// What the network would have added, before the exchange sees the request
+// -----------------------------------------------------------------------
+void SimServer::request_delay() {
+    uint64_t delay = config.request_latency_ns;
+    if(config.request_jitter_ns > 0)
+        delay += (uint64_t) (random_fraction() * config.request_jitter_ns);
+    if(delay > 0)
+        std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+}
+
+// ########################################################################
+// CONNECTIONS
+// ########################################################################
+
+void SimServer::accept_loop() {
+    while(true){
+        int fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0)
+            continue;
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        num_connections++;
+        std::thread(&SimServer::connection_thread, this, fd).detach();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Serves REST requests on the connection until it closes, or turns it into a user stream session
+// -----------------------------------------------------------------------
+void SimServer::connection_thread(int fd) {
+    WOLFSSL *ssl = wolfSSL_new(ctx);
+    if(ssl == NULL){
+        close(fd);
+        return;
+    }
+    wolfSSL_set_fd(ssl, fd);
+    if(wolfSSL_accept(ssl) != SSL_SUCCESS){
+        std::cout << "TLS handshake failed: " << wolfSSL_get_error(ssl, 0) << std::endl;
+        wolfSSL_free(ssl);
+        close(fd);
+        return;
+    }
+
+    std::string buffer;
+    sim_http_request request;
+    while(read_request(ssl, buffer, request)){
+        if((request.method == "GET") && (request.headers["upgrade"] == "websocket")){
+            if((request.path.find("/ws-api/") != std::string::npos) || (request.path.find("/ws-fapi/") != std::string::npos))
+                run_ws_api_session(ssl, request);
+            else
+                run_stream_session(ssl, fd, request);
+            break;
+        }
+
+        request_delay();
+
+        num_requests++;
+        std::string body;
+        int status = 404;
+        uint32_t weight = 1;
+        uint32_t num_orders = 0;
+        std::string endpoint = request.path.substr(request.path.rfind('/') + 1);
+        if(endpoint == "order"){
+            num_orders = (request.method == "POST") ? 1 : 0;
+            if(request.method == "POST")
+                status = handle_new_order(request, body);
+            else if(request.method == "DELETE")
+                status = handle_cancel(request, body);
+            else
+                body = error_body(-1100, "Only new orders and cancels are simulated.");
+        } else if((endpoint == "batchOrders") && config.futures){
+            // Weight 5 for new orders, each of them counts as an order
+            if(request.method == "POST"){
+                weight = 5;
+                status = handle_batch_orders(request, body, &num_orders);
+            } else if(request.method == "DELETE")
+                status = handle_batch_cancel(request, body);
+            else
+                body = error_body(-1100, "Only new orders and cancels are simulated.");
+        } else if(endpoint == "openOrders"){
+            weight = (get_param(request, "symbol") == "") ? 40 : 3;
+            status = handle_open_orders(request, body);
+        } else if((endpoint == "userDataStream") || (endpoint == "listenKey")){
+            status = handle_listen_key(request, body);
+        } else if(endpoint == "ping"){
+            status = 200;
+            body = "{}";
+        } else if(endpoint == "time"){
+            status = 200;
+            body = "{\"serverTime\":" + std::to_string(get_current_ts() / 1000000) + "}";
+        } else {
+            body = error_body(-1000, "Not simulated: " + request.path);
+        }
+
+        if(! write_response(ssl, status, body, usage_headers(count_usage(weight, num_orders))) || (request.headers["connection"] == "close"))
+            break;
+    }
+    wolfSSL_shutdown(ssl);
+    wolfSSL_free(ssl);
+    close(fd);
+}
+
+// -----------------------------------------------------------------------
+// Next request off the connection, buffer keeps what was read past it
+// -----------------------------------------------------------------------
+bool SimServer::read_request(WOLFSSL *ssl, std::string &buffer, sim_http_request &request) {
+    char read_buffer[SIM_READ_BUFFER_SIZE];
+    size_t header_end;
+    size_t separator_length;
+    while(true){
+        // Clients are not all strict about \r\n
+        size_t crlf = buffer.find("\r\n\r\n");
+        size_t lf = buffer.find("\n\n");
+        header_end = std::min(crlf, lf);
+        separator_length = (header_end == crlf) ? 4 : 2;
+        if(header_end != std::string::npos)
+            break;
+        if(buffer.length() > SIM_MAX_REQUEST_SIZE)
+            return(false);
+        int read_length = wolfSSL_read(ssl, read_buffer, sizeof(read_buffer));
+        if(read_length <= 0)
+            return(false);
+        buffer.append(read_buffer, read_length);
+    }
+
+    request.headers.clear();
+    request.params.clear();
+    size_t line_start = 0;
+    bool first_line = true;
+    while(line_start < header_end){
+        size_t line_end = buffer.find('\n', line_start);
+        if((line_end == std::string::npos) || (line_end > header_end))
+            line_end = header_end;
+        std::string line = buffer.substr(line_start, line_end - line_start);
+        if(! line.empty() && (line.back() == '\r'))
+            line.pop_back();
+        line_start = line_end + 1;
+
+        if(first_line){
+            // METHOD target HTTP/1.1
+            first_line = false;
+            size_t method_end = line.find(' ');
+            size_t target_end = line.rfind(' ');
+            if((method_end == std::string::npos) || (target_end <= method_end))
+                return(false);
+            request.method = line.substr(0, method_end);
+            std::string target = line.substr(method_end + 1, target_end - method_end - 1);
+            size_t query_start = target.find('?');
+            request.path = target.substr(0, query_start);
+            if(query_start != std::string::npos)
+                parse_params(target.substr(query_start + 1), request.params);
+            continue;
+        }
+        size_t colon = line.find(':');
+        if(colon == std::string::npos)
+            continue;
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        size_t value_start = line.find_first_not_of(' ', colon + 1);
+        request.headers[name] = (value_start == std::string::npos) ? "" : line.substr(value_start);
+    }
+
+    size_t body_length = 0;
+    if(request.headers.count("content-length"))
+        body_length = strtoul(request.headers["content-length"].c_str(), nullptr, 10);
+    if(body_length > SIM_MAX_REQUEST_SIZE)
+        return(false);
+    size_t body_start = header_end + separator_length;
+    while(buffer.length() < (body_start + body_length)){
+        int read_length = wolfSSL_read(ssl, read_buffer, sizeof(read_buffer));
+        if(read_length <= 0)
+            return(false);
+        buffer.append(read_buffer, read_length);
+    }
+    // Binance takes the params in the body as well as in the query string
+    if(body_length > 0)
+        parse_params(buffer.substr(body_start, body_length), request.params);
+    std::transform(request.headers["upgrade"].begin(), request.headers["upgrade"].end(), request.headers["upgrade"].begin(), ::tolower);
+    std::transform(request.headers["connection"].begin(), request.headers["connection"].end(), request.headers["connection"].begin(), ::tolower);
+    buffer.erase(0, body_start + body_length);
+    return(true);
+}
+
+bool SimServer::write_all(WOLFSSL *ssl, const char *data, int length) {
+    while(length > 0){
+        int written = wolfSSL_write(ssl, data, length);
+        if(written <= 0)
+            return(false);
+        data += written;
+        length -= written;
+    }
+    return(true);
+}
+
+bool SimServer::write_response(WOLFSSL *ssl, int status, std::string &body, std::string usage_headers) {
+    const char *status_text = (status == 200) ? "OK" : ((status == 400) ? "Bad Request" : "Not Found");
+    std::string response = "HTTP/1.1 " + std::to_string(status) + " " + status_text + "\r\n";
+    response += "Content-Type: application/json;charset=UTF-8\r\n";
+    response += "Content-Length: " + std::to_string(body.length()) + "\r\n";
+    response += usage_headers;
+    response += "\r\n";
+    response += body;
+    return(write_all(ssl, response.c_str(), response.length()));
+}
+
+// -----------------------------------------------------------------------
+// Counts the request, what it comes to goes back in the X-MBX-* headers or the rateLimits
+// -----------------------------------------------------------------------
+sim_usage SimServer::count_usage(uint32_t weight, uint32_t num_orders) {
+    uint64_t current_ts = get_current_ts();
+    uint64_t long_interval = config.futures ? 60000000000L : 86400000000000L;
+    MyGuard guard(usage_lock);
+    if((current_ts / 60000000000L) != weight_window){
+        weight_window = current_ts / 60000000000L;
+        weight_used = 0;
+    }
+    if((current_ts / 10000000000L) != order_window){
+        order_window = current_ts / 10000000000L;
+        orders_used = 0;
+    }
+    if((current_ts / long_interval) != long_order_window){
+        long_order_window = current_ts / long_interval;
+        long_orders_used = 0;
+    }
+    weight_used += weight;
+    orders_used += num_orders;
+    long_orders_used += num_orders;
+    return(sim_usage{weight_used, orders_used, long_orders_used, num_orders > 0});
+}
+
+std::string SimServer::usage_headers(sim_usage usage) {
+    std::string headers = "X-MBX-USED-WEIGHT-1M: " + std::to_string(usage.weight_used) + "\r\n";
+    if(usage.is_order){
+        headers += "X-MBX-ORDER-COUNT-10S: " + std::to_string(usage.orders_used) + "\r\n";
+        headers += std::string(config.futures ? "X-MBX-ORDER-COUNT-1M: " : "X-MBX-ORDER-COUNT-1D: ") + std::to_string(usage.long_orders_used) + "\r\n";
+    }
+    return(headers);
+}
+
+// -----------------------------------------------------------------------
+// The rateLimits array of a websocket API response, with the documented limits
+// -----------------------------------------------------------------------
+std::string SimServer::usage_rate_limits(sim_usage usage) {
+    std::string rate_limits = "[{\"rateLimitType\":\"REQUEST_WEIGHT\",\"interval\":\"MINUTE\",\"intervalNum\":1,\"limit\":" +
+                                std::string(config.futures ? "2400" : "6000") + ",\"count\":" + std::to_string(usage.weight_used) + "}";
+    if(usage.is_order){
+        rate_limits += ",{\"rateLimitType\":\"ORDERS\",\"interval\":\"SECOND\",\"intervalNum\":10,\"limit\":" +
+                        std::string(config.futures ? "300" : "100") + ",\"count\":" + std::to_string(usage.orders_used) + "}";
+        rate_limits += ",{\"rateLimitType\":\"ORDERS\",\"interval\":\"" + std::string(config.futures ? "MINUTE" : "DAY") + "\",\"intervalNum\":1,\"limit\":" +
+                        std::string(config.futures ? "1200" : "200000") + ",\"count\":" + std::to_string(usage.long_orders_used) + "}";
+    }
+    return(rate_limits + "]");
+}
+
+std::string SimServer::error_body(int code, std::string message) {
+    std::string escaped;
+    for(char c: message){
+        if((c == '"') || (c == '\\'))
+            escaped += '\\';
+        escaped += c;
+    }
+    return("{\"code\":" + std::to_string(code) + ",\"msg\":\"" + escaped + "\"}");
+}
+
+// ########################################################################
+// REST ENDPOINTS
+// ########################################################################
+
+int SimServer::handle_new_order(sim_http_request &request, std::string &body) {
+    if((config.order_reject_rate > 0.0) && (random_fraction() < config.order_reject_rate)){
+        num_injected_rejects++;
+        body = error_body(SIM_ERROR_NEW_ORDER_REJECTED, "Account has insufficient balance for requested action.");
+        return(400);
+    }
+
+    sim_order_request order_request;
+    order_request.symbol = get_param(request, "symbol");
+    order_request.client_order_id = get_param(request, "newClientOrderId");
+    order_request.is_buy = (get_param(request, "side") == "BUY");
+    order_request.reduce_only = (get_param(request, "reduceOnly") == "true");
+    order_request.price = strtod(get_param(request, "price").c_str(), nullptr);
+    order_request.qty = strtod(get_param(request, "quantity").c_str(), nullptr);
+
+    std::string side = get_param(request, "side");
+    std::string type = get_param(request, "type");
+    std::string time_in_force = get_param(request, "timeInForce");
+    if((side != "BUY") && (side != "SELL")){
+        body = error_body(SIM_ERROR_MANDATORY_PARAM, "Mandatory parameter 'side' was not sent, was empty/null, or malformed.");
+        return(400);
+    }
+    if(type == "LIMIT")
+        order_request.order_type = SIM_TYPE_LIMIT;
+    else if(type == "MARKET")
+        order_request.order_type = SIM_TYPE_MARKET;
+    else if((type == "LIMIT_MAKER") && ! config.futures)
+        order_request.order_type = SIM_TYPE_LIMIT_MAKER;
+    else {
+        body = error_body(SIM_ERROR_BAD_PARAM, "Invalid orderType.");
+        return(400);
+    }
+    if(time_in_force == "IOC")
+        order_request.time_in_force = SIM_TIF_IOC;
+    else if(time_in_force == "FOK")
+        order_request.time_in_force = SIM_TIF_FOK;
+    else if((time_in_force == "GTX") && config.futures)
+        order_request.time_in_force = SIM_TIF_GTX;
+    else if((time_in_force == "GTC") || (order_request.order_type != SIM_TYPE_LIMIT))
+        order_request.time_in_force = SIM_TIF_GTC;
+    else {
+        body = error_body(SIM_ERROR_MANDATORY_PARAM, "Mandatory parameter 'timeInForce' was not sent, was empty/null, or malformed.");
+        return(400);
+    }
+
+    sim_order order;
+    std::string error_message;
+    int result = engine->new_order(order_request, &order, error_message);
+    if(result != SIM_OK){
+        body = error_body(result, error_message);
+        return(400);
+    }
+    body = format_order(&order, "");
+    return(200);
+}
+
+int SimServer::handle_cancel(sim_http_request &request, std::string &body) {
+    if((config.cancel_reject_rate > 0.0) && (random_fraction() < config.cancel_reject_rate)){
+        num_injected_rejects++;
+        body = error_body(SIM_ERROR_CANCEL_REJECTED, "Unknown order sent.");
+        return(400);
+    }
+
+    std::string symbol = get_param(request, "symbol");
+    uint64_t order_id = strtoull(get_param(request, "orderId").c_str(), nullptr, 10);
+    std::string orig_client_order_id = get_param(request, "origClientOrderId");
+    std::string cancel_client_order_id = get_param(request, "newClientOrderId");
+    if(cancel_client_order_id.empty()){
+        MyGuard guard(session_lock);
+        cancel_client_order_id = "sim_cancel_" + std::to_string(next_cancel_id++);
+    }
+
+    sim_order order;
+    std::string error_message;
+    int result = engine->cancel_order(symbol, order_id, orig_client_order_id, cancel_client_order_id, &order, error_message);
+    if(result != SIM_OK){
+        body = error_body(result, error_message);
+        return(400);
+    }
+    body = format_order(&order, cancel_client_order_id.c_str());
+    return(200);
+}
+
+// -----------------------------------------------------------------------
+// Futures batchOrders - every order on its own, the response has the order or its error for each
+// in the order they were sent. num_orders is set to how many orders it counts as.
+// -----------------------------------------------------------------------
+int SimServer::handle_batch_orders(sim_http_request &request, std::string &body, uint32_t *num_orders) {
+    std::vector<std::unordered_map<std::string, std::string>> items;
+    std::vector<std::string> values;
+    if(! parse_json_list(get_param(request, "batchOrders"), items, values) || items.empty() || ! values.empty()){
+        body = error_body(SIM_ERROR_MANDATORY_PARAM, "Mandatory parameter 'batchOrders' was not sent, was empty/null, or malformed.");
+        return(400);
+    }
+    if(items.size() > SIM_MAX_BATCH_ORDERS){
+        body = error_body(SIM_ERROR_BAD_PARAM, "Param 'batchOrders' has more than " + std::to_string(SIM_MAX_BATCH_ORDERS) + " orders.");
+        return(400);
+    }
+
+    *num_orders = items.size();
+    body = "[";
+    for(size_t i = 0; i < items.size(); i++){
+        sim_http_request item_request;
+        item_request.params = items[i];
+        std::string item_body;
+        handle_new_order(item_request, item_body);
+        body += ((i > 0) ? "," : "") + item_body;
+    }
+    body += "]";
+    return(200);
+}
+
+// -----------------------------------------------------------------------
+// Futures batch cancel of orderIdList or origClientOrderIdList, one result per id like batchOrders
+// -----------------------------------------------------------------------
+int SimServer::handle_batch_cancel(sim_http_request &request, std::string &body) {
+    std::vector<std::unordered_map<std::string, std::string>> objects;
+    std::vector<std::string> order_ids;
+    std::vector<std::string> client_order_ids;
+    bool by_order_id = (get_param(request, "orderIdList") != "");
+    bool parsed = by_order_id ? parse_json_list(get_param(request, "orderIdList"), objects, order_ids) :
+                                parse_json_list(get_param(request, "origClientOrderIdList"), objects, client_order_ids);
+    std::vector<std::string> &ids = by_order_id ? order_ids : client_order_ids;
+    if(! parsed || ! objects.empty() || ids.empty()){
+        body = error_body(SIM_ERROR_MANDATORY_PARAM, "Mandatory parameter 'orderIdList' or 'origClientOrderIdList' was not sent, was empty/null, or malformed.");
+        return(400);
+    }
+    if(ids.size() > SIM_MAX_BATCH_CANCELS){
+        body = error_body(SIM_ERROR_BAD_PARAM, "Param 'orderIdList' or 'origClientOrderIdList' has more than " + std::to_string(SIM_MAX_BATCH_CANCELS) + " ids.");
+        return(400);
+    }
+
+    body = "[";
+    for(size_t i = 0; i < ids.size(); i++){
+        sim_http_request item_request;
+        item_request.params["symbol"] = get_param(request, "symbol");
+        item_request.params[by_order_id ? "orderId" : "origClientOrderId"] = ids[i];
+        std::string item_body;
+        handle_cancel(item_request, item_body);
+        body += ((i > 0) ? "," : "") + item_body;
+    }
+    body += "]";
+    return(200);
+}
+
+int SimServer::handle_open_orders(sim_http_request &request, std::string &body) {
+    std::string symbol = get_param(request, "symbol");
+    std::vector<sim_order> open_orders = engine->get_open_orders(symbol);
+    body = "[";
+    for(size_t i = 0; i < open_orders.size(); i++){
+        if(i > 0)
+            body += ",";
+        body += format_order(&open_orders[i], "");
+    }
+    body += "]";
+    return(200);
+}
+
+// -----------------------------------------------------------------------
+// POST hands out a key, PUT keeps it alive, DELETE drops it
+// -----------------------------------------------------------------------
+int SimServer::handle_listen_key(sim_http_request &request, std::string &body) {
+    MyGuard guard(session_lock);
+    if(request.method == "POST"){
+        std::string listen_key = make_listen_key();
+        listen_keys[listen_key] = true;
+        body = "{\"listenKey\":\"" + listen_key + "\"}";
+        return(200);
+    }
+    if(request.method == "DELETE")
+        listen_keys.erase(get_param(request, "listenKey"));
+    body = "{}";
+    return(200);
+}
+
+// -----------------------------------------------------------------------
+// Order the way the REST endpoints return it, a cancel_client_order_id makes it a spot cancel response
+// -----------------------------------------------------------------------
+std::string SimServer::format_order(sim_order *order, const char *cancel_client_order_id) {
+    static const char *status_names[] = {"NEW", "PARTIALLY_FILLED", "FILLED", "CANCELED", "EXPIRED"};
+    static const char *type_names[] = {"LIMIT", "MARKET", "LIMIT_MAKER"};
+    static const char *time_in_force_names[] = {"GTC", "IOC", "FOK", "GTX"};
+
+    std::string json = "{\"symbol\":\"" + std::string(order->symbol) + "\",\"orderId\":" + std::to_string(order->order_id);
+    if(! config.futures && (cancel_client_order_id[0] != 0))
+        json += ",\"origClientOrderId\":\"" + std::string(order->client_order_id) + "\",\"clientOrderId\":\"" + cancel_client_order_id + "\"";
+    else
+        json += ",\"clientOrderId\":\"" + std::string(order->client_order_id) + "\"";
+    json += ",\"price\":\"" + format_decimal(order->price) + "\"";
+    json += ",\"origQty\":\"" + format_decimal(order->orig_qty) + "\"";
+    json += ",\"executedQty\":\"" + format_decimal(order->executed_qty) + "\"";
+    if(config.futures){
+        json += ",\"cumQty\":\"" + format_decimal(order->executed_qty) + "\"";
+        json += ",\"cumQuote\":\"" + format_decimal(order->cum_quote) + "\"";
+        json += ",\"avgPrice\":\"" + format_decimal((order->executed_qty > 0.0) ? order->cum_quote / order->executed_qty : 0.0) + "\"";
+        json += ",\"reduceOnly\":" + std::string(order->reduce_only ? "true" : "false") + ",\"positionSide\":\"BOTH\"";
+    } else {
+        json += ",\"orderListId\":-1,\"cummulativeQuoteQty\":\"" + format_decimal(order->cum_quote) + "\"";
+    }
+    json += ",\"status\":\"" + std::string(status_names[order->status]) + "\"";
+    json += ",\"timeInForce\":\"" + std::string(time_in_force_names[order->time_in_force]) + "\"";
+    json += ",\"type\":\"" + std::string(type_names[order->order_type]) + "\"";
+    json += ",\"side\":\"" + std::string(order->is_buy ? "BUY" : "SELL") + "\"";
+    json += ",\"time\":" + std::to_string(order->order_time) + ",\"updateTime\":" + std::to_string(order->update_time) + "}";
+    return(json);
+}
+
+// ########################################################################
+// USER DATA STREAM
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// executionReport (spot) or ORDER_TRADE_UPDATE (futures) - the fields the trade adapter reads and
+// the ones around them, commission is always 0
+// -----------------------------------------------------------------------
+std::string SimServer::format_execution(sim_execution *execution) {
+    static const char *status_names[] = {"NEW", "PARTIALLY_FILLED", "FILLED", "CANCELED", "EXPIRED"};
+    static const char *exec_names[] = {"NEW", "TRADE", "CANCELED", "EXPIRED"};
+    static const char *type_names[] = {"LIMIT", "MARKET", "LIMIT_MAKER"};
+    static const char *time_in_force_names[] = {"GTC", "IOC", "FOK", "GTX"};
+    sim_order *order = &execution->order;
+    bool is_trade = (execution->exec_type == SIM_EXEC_TRADE);
+    bool spot_cancel = ! config.futures && (execution->exec_type == SIM_EXEC_CANCELED);
+
+    std::string fields = "\"s\":\"" + std::string(order->symbol) + "\"";
+    fields += ",\"c\":\"" + std::string(spot_cancel ? execution->cancel_client_order_id : order->client_order_id) + "\"";
+    fields += ",\"S\":\"" + std::string(order->is_buy ? "BUY" : "SELL") + "\"";
+    fields += ",\"o\":\"" + std::string(type_names[order->order_type]) + "\"";
+    fields += ",\"f\":\"" + std::string(time_in_force_names[order->time_in_force]) + "\"";
+    fields += ",\"q\":\"" + format_decimal(order->orig_qty) + "\"";
+    fields += ",\"p\":\"" + format_decimal(order->price) + "\"";
+    fields += ",\"x\":\"" + std::string(exec_names[execution->exec_type]) + "\"";
+    fields += ",\"X\":\"" + std::string(status_names[order->status]) + "\"";
+    fields += ",\"i\":" + std::to_string(order->order_id);
+    fields += ",\"l\":\"" + format_decimal(execution->last_qty) + "\"";
+    fields += ",\"z\":\"" + format_decimal(order->executed_qty) + "\"";
+    fields += ",\"L\":\"" + format_decimal(execution->last_price) + "\"";
+    fields += ",\"n\":\"0\",\"N\":" + std::string(is_trade ? "\"USDT\"" : "null");
+    fields += ",\"T\":" + std::to_string(execution->event_time);
+    fields += ",\"t\":" + (is_trade ? std::to_string(execution->trade_id) : std::string("-1"));
+    fields += ",\"m\":" + std::string(execution->is_maker ? "true" : "false");
+
+    if(config.futures){
+        fields += ",\"ap\":\"" + format_decimal((order->executed_qty > 0.0) ? order->cum_quote / order->executed_qty : 0.0) + "\"";
+        fields += ",\"R\":" + std::string(order->reduce_only ? "true" : "false") + ",\"ps\":\"BOTH\",\"ot\":\"" + type_names[order->order_type] + "\"";
+        return("{\"e\":\"ORDER_TRADE_UPDATE\",\"E\":" + std::to_string(execution->event_time) + ",\"T\":" + std::to_string(execution->event_time) +
+                ",\"o\":{" + fields + "}}");
+    }
+    fields += ",\"C\":\"" + std::string(spot_cancel ? order->client_order_id : "") + "\"";
+    fields += ",\"r\":\"NONE\",\"w\":" + std::string(((order->status == SIM_STATUS_NEW) || (order->status == SIM_STATUS_PARTIALLY_FILLED)) ? "true" : "false");
+    fields += ",\"O\":" + std::to_string(order->order_time) + ",\"Z\":\"" + format_decimal(order->cum_quote) + "\"";
+    return("{\"e\":\"executionReport\",\"E\":" + std::to_string(execution->event_time) + "," + fields + "}");
+}
+
+bool SimServer::write_frame(WOLFSSL *ssl, uint8_t op_code, const char *payload, uint64_t length) {
+    char header[10];
+    int header_length = 2;
+    header[0] = 0x80 | op_code;
+    if(length < 126){
+        header[1] = length;
+    } else if(length < 65536){
+        header[1] = 126;
+        header[2] = (length >> 8) & 0xFF;
+        header[3] = length & 0xFF;
+        header_length = 4;
+    } else {
+        header[1] = 127;
+        for(int i = 0; i < 8; i++)
+            header[2 + i] = (length >> (56 - (8 * i))) & 0xFF;
+        header_length = 10;
+    }
+    // One write per frame so it goes out in a single TLS record
+    std::string frame(header, header_length);
+    frame.append(payload, length);
+    return(write_all(ssl, frame.c_str(), frame.length()));
+}
+
+bool SimServer::accept_websocket(WOLFSSL *ssl, sim_http_request &request) {
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n";
+    response += "Sec-WebSocket-Accept: " + websocket_accept(request.headers["sec-websocket-key"]) + "\r\n\r\n";
+    return(write_all(ssl, response.c_str(), response.length()));
+}
+
+// -----------------------------------------------------------------------
+// Upgrades the connection and writes the events as they come due. What the client sends is only
+// looked at for a close - its keepalive pongs aren't always well formed masked frames.
+// -----------------------------------------------------------------------
+void SimServer::run_stream_session(WOLFSSL *ssl, int fd, sim_http_request &request) {
+    std::string listen_key = request.path.substr(request.path.rfind('/') + 1);
+    session_lock.acquire_lock();
+    bool known_key = listen_keys.count(listen_key) > 0;
+    session_lock.release_lock();
+    if(! known_key){
+        std::string body = error_body(-1125, "This listenKey does not exist.");
+        write_response(ssl, 400, body, "");
+        return;
+    }
+
+    if(! accept_websocket(ssl, request))
+        return;
+
+    sim_stream_session *session = new sim_stream_session();
+    session->listen_key = listen_key;
+    session->wake_fd = eventfd(0, EFD_NONBLOCK);
+    session_lock.acquire_lock();
+    sessions.push_back(session);
+    session_lock.release_lock();
+    std::cout << "User stream connected for listenKey: " << listen_key << std::endl;
+
+    char read_buffer[SIM_READ_BUFFER_SIZE];
+    std::vector<std::string> due;
+    bool connected = true;
+    while(connected){
+        uint64_t current_ts = get_current_ts();
+        uint64_t next_due = current_ts + SIM_STREAM_IDLE_NS;
+        session->queue_lock.acquire_lock();
+        while(! session->queue.empty() && (session->queue.front().due_ts <= current_ts)){
+            due.push_back(std::move(session->queue.front().payload));
+            session->queue.pop_front();
+        }
+        if(! session->queue.empty())
+            next_due = session->queue.front().due_ts;
+        session->queue_lock.release_lock();
+
+        for(auto &payload: due){
+            if(! write_frame(ssl, 0x1, payload.c_str(), payload.length())){
+                connected = false;
+                break;
+            }
+        }
+        due.clear();
+        if(! connected)
+            break;
+
+        uint64_t wait_ns = (next_due > current_ts) ? (next_due - current_ts) : 0;
+        struct timespec timeout = {(time_t) (wait_ns / 1000000000L), (long) (wait_ns % 1000000000L)};
+        struct pollfd poll_fds[2] = {{fd, POLLIN, 0}, {session->wake_fd, POLLIN, 0}};
+        if((wolfSSL_pending(ssl) == 0) && (ppoll(poll_fds, 2, &timeout, NULL) <= 0))
+            continue;
+        if(poll_fds[1].revents & POLLIN){
+            uint64_t wakeups;
+            if(read(session->wake_fd, &wakeups, sizeof(wakeups)) < 0)
+                wakeups = 0;
+        }
+        if((wolfSSL_pending(ssl) > 0) || (poll_fds[0].revents & (POLLIN | POLLHUP | POLLERR))){
+            int read_length = wolfSSL_read(ssl, read_buffer, sizeof(read_buffer));
+            if((read_length <= 0) || ((read_buffer[0] & 0x0F) == 0x8)){
+                write_frame(ssl, 0x8, "", 0);
+                connected = false;
+            }
+        }
+    }
+
+    session_lock.acquire_lock();
+    sessions.erase(std::find(sessions.begin(), sessions.end(), session));
+    session_lock.release_lock();
+    close(session->wake_fd);
+    delete(session);
+    std::cout << "User stream disconnected for listenKey: " << listen_key << std::endl;
+}
+
+// ########################################################################
+// WEBSOCKET API
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// Next frame from the client, buffer keeps what was read past it. Client frames are masked.
+// -----------------------------------------------------------------------
+bool SimServer::read_frame(WOLFSSL *ssl, std::string &buffer, uint8_t *op_code, std::string &payload) {
+    char read_buffer[SIM_READ_BUFFER_SIZE];
+    while(true){
+        if(buffer.length() >= 2){
+            const unsigned char *data = (const unsigned char *) buffer.data();
+            bool masked = data[1] & 0x80;
+            uint64_t length = data[1] & 0x7F;
+            size_t header_length = 2;
+            if(length == 126){
+                if(buffer.length() >= 4)
+                    length = (data[2] << 8) | data[3];
+                header_length = 4;
+            } else if(length == 127) {
+                if(buffer.length() >= 10){
+                    length = 0;
+                    for(int i = 0; i < 8; i++)
+                        length = (length << 8) | data[2 + i];
+                }
+                header_length = 10;
+            }
+            if(length > SIM_MAX_REQUEST_SIZE)
+                return(false);
+            size_t mask_offset = header_length;
+            if(masked)
+                header_length += 4;
+            if(buffer.length() >= (header_length + length)){
+                *op_code = data[0] & 0x0F;
+                payload = buffer.substr(header_length, length);
+                if(masked){
+                    for(size_t i = 0; i < length; i++)
+                        payload[i] ^= data[mask_offset + (i % 4)];
+                }
+                buffer.erase(0, header_length + length);
+                return(true);
+            }
+        }
+        int read_length = wolfSSL_read(ssl, read_buffer, sizeof(read_buffer));
+        if(read_length <= 0)
+            return(false);
+        buffer.append(read_buffer, read_length);
+    }
+}
+
+// -----------------------------------------------------------------------
+// id, method and the params of {"id":..,"method":"..","params":{..}} - params are flat strings
+// and numbers, which is all order.place and order.cancel take
+// -----------------------------------------------------------------------
+bool SimServer::parse_ws_api_request(const std::string &message, std::string &id, std::string &method, sim_http_request &request) {
+    // Bare value or "quoted" from position, position is left after it
+    auto parse_value = [&message](size_t &position) -> std::string {
+        position = message.find_first_not_of(" \t\r\n", position);
+        if(position == std::string::npos)
+            return("");
+        if(message[position] == '"'){
+            size_t end = message.find('"', position + 1);
+            if(end == std::string::npos){
+                position = std::string::npos;
+                return("");
+            }
+            std::string value = message.substr(position + 1, end - position - 1);
+            position = end + 1;
+            return(value);
+        }
+        size_t end = message.find_first_of(",} \t\r\n", position);
+        if(end == std::string::npos)
+            end = message.length();
+        std::string value = message.substr(position, end - position);
+        position = end;
+        return(value);
+    };
+
+    size_t position = message.find("\"id\"");
+    if((position == std::string::npos) || ((position = message.find(':', position)) == std::string::npos))
+        return(false);
+    position = message.find_first_not_of(" \t\r\n", position + 1);
+    // The id goes back as it came, quoted or not
+    bool quoted_id = (position != std::string::npos) && (message[position] == '"');
+    id = parse_value(position);
+    if(id.empty() || (position == std::string::npos))
+        return(false);
+    if(quoted_id)
+        id = "\"" + id + "\"";
+
+    position = message.find("\"method\"");
+    if((position == std::string::npos) || ((position = message.find(':', position)) == std::string::npos))
+        return(false);
+    position++;
+    method = parse_value(position);
+
+    request.params.clear();
+    position = message.find("\"params\"");
+    if((position == std::string::npos) || ((position = message.find('{', position)) == std::string::npos))
+        return(true);
+    position++;
+    while(true){
+        position = message.find_first_not_of(" \t\r\n,", position);
+        if((position == std::string::npos) || (message[position] != '"'))
+            break;
+        std::string name = parse_value(position);
+        if((position == std::string::npos) || ((position = message.find(':', position)) == std::string::npos))
+            return(false);
+        position++;
+        request.params[name] = parse_value(position);
+        if(position == std::string::npos)
+            return(false);
+    }
+    return(true);
+}
+
+// -----------------------------------------------------------------------
+// Upgrades the connection and answers order.place/order.cancel requests in the order they come,
+// with the same engine, rejects and latency as REST. Fills go out on the user stream.
+// -----------------------------------------------------------------------
+void SimServer::run_ws_api_session(WOLFSSL *ssl, sim_http_request &request) {
+    if(! accept_websocket(ssl, request))
+        return;
+    std::cout << "Websocket API connected on: " << request.path << std::endl;
+
+    std::string buffer;
+    std::string message;
+    uint8_t op_code;
+    sim_http_request api_request;
+    while(read_frame(ssl, buffer, &op_code, message)){
+        if(op_code == 0x8){
+            write_frame(ssl, 0x8, "", 0);
+            break;
+        }
+        if(op_code == 0x9){
+            if(! write_frame(ssl, 0xA, message.c_str(), message.length()))
+                break;
+            continue;
+        }
+        if(op_code != 0x1)
+            continue;
+
+        std::string id;
+        std::string method;
+        if(! parse_ws_api_request(message, id, method, api_request)){
+            std::string error = error_body(-1000, "Malformed request.");
+            std::string response = "{\"id\":null,\"status\":400,\"error\":" + error + "}";
+            if(! write_frame(ssl, 0x1, response.c_str(), response.length()))
+                break;
+            continue;
+        }
+
+        request_delay();
+        num_requests++;
+        std::string body;
+        int status = 400;
+        bool is_order = false;
+        if(method == "order.place"){
+            is_order = true;
+            status = handle_new_order(api_request, body);
+        } else if(method == "order.cancel") {
+            status = handle_cancel(api_request, body);
+        } else {
+            body = error_body(-1000, "Not simulated: " + method);
+        }
+
+        std::string response = "{\"id\":" + id + ",\"status\":" + std::to_string(status) + "," +
+                                ((status == 200) ? "\"result\":" : "\"error\":") + body +
+                                ",\"rateLimits\":" + usage_rate_limits(count_usage(1, is_order ? 1 : 0)) + "}";
+        if(! write_frame(ssl, 0x1, response.c_str(), response.length()))
+            break;
+    }
+    std::cout << "Websocket API disconnected on: " << request.path << std::endl;
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+bool SimServer::start() {
+    wolfSSL_Init();
+    if((ctx = wolfSSL_CTX_new(wolfSSLv23_server_method())) == NULL){
+        std::cout << "Failed to create the TLS context" << std::endl;
+        return(false);
+    }
+    if(wolfSSL_CTX_use_certificate_file(ctx, config.cert_file.c_str(), SSL_FILETYPE_PEM) != SSL_SUCCESS){
+        std::cout << "Failed to load the certificate: " << config.cert_file << std::endl;
+        return(false);
+    }
+    if(wolfSSL_CTX_use_PrivateKey_file(ctx, config.key_file.c_str(), SSL_FILETYPE_PEM) != SSL_SUCCESS){
+        std::cout << "Failed to load the private key: " << config.key_file << std::endl;
+        return(false);
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int flag = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(config.port);
+    if((bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0) || (listen(listen_fd, 1024) != 0)){
+        std::cout << "Failed to listen on port: " << config.port << std::endl;
+        close(listen_fd);
+        return(false);
+    }
+    std::thread(&SimServer::accept_loop, this).detach();
+    return(true);
+}
+
+void SimServer::on_execution(sim_execution *execution) {
+    sim_stream_event event = {get_current_ts() + config.stream_latency_ns, format_execution(execution)};
+    uint64_t wakeup = 1;
+    MyGuard guard(session_lock);
+    for(sim_stream_session *session: sessions){
+        session->queue_lock.acquire_lock();
+        session->queue.push_back(event);
+        session->queue_lock.release_lock();
+        if(write(session->wake_fd, &wakeup, sizeof(wakeup)) < 0)
+            continue;
+    }
+    num_stream_events++;
+}
+
+sim_server_stats SimServer::get_stats() {
+    MyGuard guard(session_lock);
+    return(sim_server_stats{num_connections.load(), num_requests.load(), num_injected_rejects.load(), num_stream_events.load(), (uint32_t) sessions.size()});
+}
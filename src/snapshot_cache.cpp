@@ -0,0 +1,77 @@
+#include "snapshot_cache.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor
+// -----------------------------------------------------------------------
+SnapshotCache::SnapshotCache(WSock *_wsocket, uint64_t freshness_millis) {
+    wsocket = _wsocket;
+    freshness_ns = freshness_millis * 1000000L;
+    build_buffer = (char*) malloc(sizeof(char) * SNAPSHOT_CACHE_BUILD_BUFFER_SIZE);
+}
+
+// -----------------------------------------------------------------------
+// Returns current time in nanoseconds
+// -----------------------------------------------------------------------
+uint64_t SnapshotCache::get_current_ts_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Returns the serialised snapshot for the instrument, only rebuilding it from
+// the book if it is older than the freshness window and the book has changed.
+// Returns nullptr if there is no book for the instrument.
+// -----------------------------------------------------------------------
+cached_snapshot *SnapshotCache::get_snapshot(uint32_t instrument_id) {
+    uint64_t current_ts = get_current_ts_ns();
+    cached_snapshot *snapshot;
+
+    auto it = snapshots.find(instrument_id);
+    if(it != snapshots.end()){
+        snapshot = it->second;
+        if((current_ts - snapshot->built_time) < freshness_ns){
+            num_fresh_hits++;
+            return(snapshot);
+        }
+        if(wsocket->get_book_version(instrument_id) == snapshot->book_version){
+            snapshot->built_time = current_ts;
+            num_version_hits++;
+            return(snapshot);
+        }
+    } else {
+        snapshot = new cached_snapshot();
+        snapshot->length = 0;
+        snapshot->num_messages = 0;
+        snapshot->book_version = 0;
+        snapshots[instrument_id] = snapshot;
+    }
+
+    uint64_t book_version = 0;
+    int num_messages = wsocket->get_snapshot(build_buffer, instrument_id, &book_version);
+    if(num_messages == 0)
+        return(nullptr);
+
+    uint32_t length = 0;
+    for(int i = 0; i < num_messages; i++){
+        length += ((MessageHeader *) (build_buffer + length))->msgLength;
+    }
+    if(snapshot->data.size() < length)
+        snapshot->data.resize(length);
+    memcpy(snapshot->data.data(), build_buffer, length);
+    snapshot->length = length;
+    snapshot->num_messages = num_messages;
+    snapshot->book_version = book_version;
+    snapshot->built_time = current_ts;
+    num_rebuilds++;
+    return(snapshot);
+}
+
+// -----------------------------------------------------------------------
+// Summary of the counters for logging
+// -----------------------------------------------------------------------
+std::string SnapshotCache::get_stats() {
+    return("fresh hits: " + std::to_string(num_fresh_hits) +
+            ", version hits: " + std::to_string(num_version_hits) +
+            ", rebuilds: " + std::to_string(num_rebuilds));
+}
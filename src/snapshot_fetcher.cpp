@@ -0,0 +1,346 @@
+#include "snapshot_fetcher.hpp"
+
+// -----------------------------------------------------------------------
+// Constructor - preallocates buffers/handles and starts the fetcher thread
+// -----------------------------------------------------------------------
+SnapshotFetcher::SnapshotFetcher(Logger *_logger, int _max_in_flight) {
+    logger = _logger;
+    max_in_flight = _max_in_flight;
+    if(max_in_flight < 1)
+        max_in_flight = 1;
+    if(max_in_flight > SNAPSHOT_MAX_IN_FLIGHT)
+        max_in_flight = SNAPSHOT_MAX_IN_FLIGHT;
+
+    // Request weight for depth limit=1000 and the per minute weight limit for each endpoint
+    // These are only starting points, the actual used weight is picked up from the response headers
+    endpoints[0] = {"https://api.binance.com/api/v3/depth?symbol=", 50, 6000, 0, 0, 0};
+    endpoints[1] = {"https://fapi.binance.com/fapi/v1/depth?symbol=", 20, 2400, 0, 0, 0};
+    endpoints[2] = {"https://dapi.binance.com/dapi/v1/depth?symbol=", 20, 2400, 0, 0, 0};
+
+    // Slots are held both by in-flight requests and by snapshots waiting for the feed thread
+    num_slots = max_in_flight * 4;
+    for(int i = 0; i < num_slots; i++){
+        slot_buffers.push_back((char*) malloc(sizeof(char) * SNAPSHOT_BUFFER_SIZE));
+        free_slots.push_back(i);
+    }
+
+    multi_handle = curl_multi_init();
+    curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_in_flight);
+
+    for(int i = 0; i < max_in_flight; i++){
+        fetch_context *context = new fetch_context();
+        context->easy = curl_easy_init();
+        context->fetcher = this;
+        context->in_use = false;
+        curl_easy_setopt(context->easy, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(context->easy, CURLOPT_WRITEDATA, context);
+        curl_easy_setopt(context->easy, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(context->easy, CURLOPT_HEADERDATA, context);
+        curl_easy_setopt(context->easy, CURLOPT_PRIVATE, context);
+        curl_easy_setopt(context->easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(context->easy, CURLOPT_TIMEOUT_MS, 10000L);
+        contexts.push_back(context);
+    }
+
+    std::thread fetcher_thread([this]() {
+        fetcher_loop();
+    });
+    fetcher_thread.detach();
+}
+
+// -----------------------------------------------------------------------
+// Returns current time in nanoseconds
+// -----------------------------------------------------------------------
+uint64_t SnapshotFetcher::get_current_ts_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Maps exchange_id to the REST endpoint used for its snapshots
+// -----------------------------------------------------------------------
+int SnapshotFetcher::get_endpoint(uint8_t ex_id) {
+    if(ex_id == 16)
+        return(0);
+    else if(ex_id == 18)
+        return(1);
+    return(2);
+}
+
+// -----------------------------------------------------------------------
+// Writes response body straight into the preallocated slot buffer
+// -----------------------------------------------------------------------
+size_t SnapshotFetcher::write_callback(char *buffer, size_t size, size_t nmemb, void *data) {
+    fetch_context *context = (fetch_context *) data;
+    size_t data_size = size * nmemb;
+    // Always leave room for the terminating zero
+    if((context->length + data_size + 1) > SNAPSHOT_BUFFER_SIZE){
+        context->overflow = true;
+        return(0);
+    }
+    memcpy(context->fetcher->slot_buffers[context->slot] + context->length, buffer, data_size);
+    context->length += data_size;
+    return(data_size);
+}
+
+// -----------------------------------------------------------------------
+// Picks out the used weight and retry-after headers from the response
+// -----------------------------------------------------------------------
+size_t SnapshotFetcher::header_callback(char *buffer, size_t size, size_t nmemb, void *data) {
+    fetch_context *context = (fetch_context *) data;
+    size_t data_size = size * nmemb;
+    static const char weight_header[] = "x-mbx-used-weight-1m:";
+    static const char retry_header[] = "retry-after:";
+
+    if((data_size > sizeof(weight_header)) && (strncasecmp(buffer, weight_header, sizeof(weight_header) - 1) == 0)){
+        context->header_used_weight = strtoul(buffer + sizeof(weight_header) - 1, nullptr, 10);
+    }
+    else if((data_size > sizeof(retry_header)) && (strncasecmp(buffer, retry_header, sizeof(retry_header) - 1) == 0)){
+        context->header_retry_after = strtoul(buffer + sizeof(retry_header) - 1, nullptr, 10);
+    }
+    return(data_size);
+}
+
+// -----------------------------------------------------------------------
+// Resets the local weight estimate when we move into a new minute
+// -----------------------------------------------------------------------
+void SnapshotFetcher::reset_weight_windows(uint64_t current_ts) {
+    uint64_t window_start = current_ts - (current_ts % SNAPSHOT_WEIGHT_WINDOW_NS);
+    for(auto &endpoint: endpoints){
+        if(endpoint.window_start != window_start){
+            endpoint.window_start = window_start;
+            endpoint.used_weight = 0;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+// Moves new requests from the feed thread into the pending map (deduped per instrument)
+// -----------------------------------------------------------------------
+void SnapshotFetcher::drain_requests() {
+    snapshot_info *snap_info;
+    while(request_ring.GetPopPtr(&snap_info)){
+        auto it = pending_requests.find(snap_info->instrument_id);
+        if(it == pending_requests.end()){
+            pending_requests.emplace(snap_info->instrument_id, std::move(*snap_info));
+        } else {
+            it->second.activity = snap_info->activity;
+        }
+        request_ring.incrTail();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Takes back slots that the feed thread has finished with
+// -----------------------------------------------------------------------
+void SnapshotFetcher::drain_released_slots() {
+    int *slot;
+    while(release_ring.GetPopPtr(&slot)){
+        free_slots.push_back(*slot);
+        release_ring.incrTail();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Puts a failed request back in the pending map unless a newer one already is there
+// -----------------------------------------------------------------------
+void SnapshotFetcher::requeue(snapshot_info &info) {
+    num_retried++;
+    if(pending_requests.count(info.instrument_id) == 0)
+        pending_requests.emplace(info.instrument_id, std::move(info));
+}
+
+// -----------------------------------------------------------------------
+// Starts as many of the most active pending requests as handles, slots and weight allow
+// -----------------------------------------------------------------------
+void SnapshotFetcher::launch_requests(uint64_t current_ts) {
+    while((num_in_flight < max_in_flight) && (! free_slots.empty()) && (! pending_requests.empty())){
+        // Find the most active instrument whose endpoint still has weight to spare
+        auto best = pending_requests.end();
+        for(auto it = pending_requests.begin(); it != pending_requests.end(); ++it){
+            endpoint_weight &endpoint = endpoints[get_endpoint(it->second.ex_id)];
+            if(endpoint.banned_until > current_ts)
+                continue;
+            if((endpoint.used_weight + endpoint.request_weight) > (endpoint.weight_limit * SNAPSHOT_WEIGHT_HEADROOM))
+                continue;
+            if((best == pending_requests.end()) || (it->second.activity > best->second.activity))
+                best = it;
+        }
+        if(best == pending_requests.end())
+            return;
+
+        fetch_context *context = nullptr;
+        for(auto ctx: contexts){
+            if(! ctx->in_use){
+                context = ctx;
+                break;
+            }
+        }
+
+        context->info = std::move(best->second);
+        pending_requests.erase(best);
+        context->endpoint = get_endpoint(context->info.ex_id);
+        context->slot = free_slots.back();
+        free_slots.pop_back();
+        context->length = 0;
+        context->overflow = false;
+        context->header_used_weight = 0;
+        context->header_retry_after = 0;
+        context->start_time = current_ts;
+        context->in_use = true;
+        context->url = endpoints[context->endpoint].base_url + context->info.instrument_name + "&limit=1000";
+
+        // Account for the request locally until the response tells us the real number
+        endpoints[context->endpoint].used_weight += endpoints[context->endpoint].request_weight;
+
+        curl_easy_setopt(context->easy, CURLOPT_URL, context->url.c_str());
+        curl_multi_add_handle(multi_handle, context->easy);
+        num_in_flight++;
+        logger->msg(INFO, "Processing snapshot for: " + context->info.instrument_name + " - Using URL: " + context->url);
+    }
+}
+
+// -----------------------------------------------------------------------
+// Handles a finished transfer, either hands it to the feed thread or requeues it
+// -----------------------------------------------------------------------
+void SnapshotFetcher::complete_request(fetch_context *context, CURLcode result) {
+    long response_code = 0;
+    uint64_t current_ts = get_current_ts_ns();
+    endpoint_weight &endpoint = endpoints[context->endpoint];
+
+    curl_easy_getinfo(context->easy, CURLINFO_RESPONSE_CODE, &response_code);
+    curl_multi_remove_handle(multi_handle, context->easy);
+    context->in_use = false;
+    num_in_flight--;
+
+    // The exchange knows better than our estimate
+    if(context->header_used_weight > endpoint.used_weight)
+        endpoint.used_weight = context->header_used_weight;
+
+    if((response_code == 429) || (response_code == 418)){
+        uint64_t backoff = context->header_retry_after ? context->header_retry_after : SNAPSHOT_DEFAULT_BACKOFF_SECONDS;
+        endpoint.banned_until = current_ts + (backoff * 1000000000L);
+        logger->msg(WARN, "Rate limited (" + std::to_string(response_code) + ") on " + endpoint.base_url + " backing off " + std::to_string(backoff) + "s");
+        free_slots.push_back(context->slot);
+        requeue(context->info);
+        return;
+    }
+
+    if((result != CURLE_OK) || (response_code != 200) || context->overflow){
+        logger->msg(WARN, "Snapshot request failed for: " + context->info.instrument_name + " (" + std::string(curl_easy_strerror(result)) + ", http " + std::to_string(response_code) + ") - requeueing");
+        free_slots.push_back(context->slot);
+        requeue(context->info);
+        return;
+    }
+
+    char *snapshot_data = slot_buffers[context->slot];
+    snapshot_data[context->length] = 0;
+
+    // for capture to_file true
+    if(context->info.to_file){
+        std::string file_name = "/datacollection/binance/" + context->info.current_date + "_";
+        file_name += context->info.instrument_name + "_" + std::to_string(context->info.instrument_id) + "_ss.txt";
+        FileWriter *file_writer = new FileWriter(file_name);
+        file_writer->write_to_file(std::string_view(snapshot_data, context->length), current_ts);
+        delete(file_writer);
+    }
+
+    snapshot_result completed = {context->info.instrument_id, context->info.ex_id, context->slot, snapshot_data, context->length, current_ts};
+    while(!result_ring.tryEnqueue(std::move(completed)));
+
+    num_fetched++;
+    logger->msg(INFO, "Snapshot for: " + context->info.instrument_name + " fetched in " + std::to_string((current_ts - context->start_time) / 1000000) + "ms (used weight: " + std::to_string(endpoint.used_weight) + ", fetched: " + std::to_string(num_fetched) + ", retried: " + std::to_string(num_retried) + ")");
+}
+
+// -----------------------------------------------------------------------
+// The fetcher thread - drives the multi handle and keeps it topped up
+// -----------------------------------------------------------------------
+void SnapshotFetcher::fetcher_loop() {
+    int running_handles;
+    int msgs_in_queue;
+    CURLMsg *curl_msg;
+
+    logger->msg(INFO, "Snapshot fetcher started with " + std::to_string(max_in_flight) + " requests in flight");
+
+    while(1){
+        uint64_t current_ts = get_current_ts_ns();
+        reset_weight_windows(current_ts);
+        drain_requests();
+        drain_released_slots();
+        launch_requests(current_ts);
+
+        curl_multi_perform(multi_handle, &running_handles);
+        while((curl_msg = curl_multi_info_read(multi_handle, &msgs_in_queue))){
+            if(curl_msg->msg == CURLMSG_DONE){
+                fetch_context *context;
+                curl_easy_getinfo(curl_msg->easy_handle, CURLINFO_PRIVATE, (char **) &context);
+                complete_request(context, curl_msg->data.result);
+            }
+        }
+
+        // Sleeps until there is socket activity, or at most 10ms so we pick up new requests
+        curl_multi_poll(multi_handle, NULL, 0, 10, NULL);
+    }
+}
+
+// ########################################################################
+// PUBLIC METHODS - all of these are only to be called from the feed thread
+// ########################################################################
+
+// -----------------------------------------------------------------------
+// Queue a snapshot request to the fetcher thread
+// -----------------------------------------------------------------------
+void SnapshotFetcher::request_snapshot(snapshot_info &&info) {
+    while(!request_ring.tryEnqueue(std::move(info)));
+}
+
+// -----------------------------------------------------------------------
+// Moves finished snapshots into the local lookup, replacing any stale one
+// -----------------------------------------------------------------------
+void SnapshotFetcher::process_completed_snapshots() {
+    snapshot_result *completed;
+    while(result_ring.GetPopPtr(&completed)){
+        // Nobody claimed these (socket went away or state moved on) - give the slots back
+        for(auto it = ready_snapshots.begin(); it != ready_snapshots.end();){
+            if((completed->completed_time - it->second.completed_time) > SNAPSHOT_READY_TIMEOUT_NS){
+                int old_slot = it->second.slot;
+                while(!release_ring.tryEnqueue(std::move(old_slot)));
+                it = ready_snapshots.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        auto it = ready_snapshots.find(completed->instrument_id);
+        if(it != ready_snapshots.end()){
+            int old_slot = it->second.slot;
+            while(!release_ring.tryEnqueue(std::move(old_slot)));
+            it->second = *completed;
+        } else {
+            ready_snapshots.emplace(completed->instrument_id, *completed);
+        }
+        result_ring.incrTail();
+    }
+}
+
+// -----------------------------------------------------------------------
+// Returns the snapshot for the instrument or nullptr if there is none yet
+// -----------------------------------------------------------------------
+const char *SnapshotFetcher::get_snapshot(uint32_t instrument_id) {
+    auto it = ready_snapshots.find(instrument_id);
+    if(it == ready_snapshots.end())
+        return(nullptr);
+    return(it->second.data);
+}
+
+// -----------------------------------------------------------------------
+// Hands the buffer of a processed snapshot back to the fetcher thread
+// -----------------------------------------------------------------------
+void SnapshotFetcher::release_snapshot(uint32_t instrument_id) {
+    auto it = ready_snapshots.find(instrument_id);
+    if(it == ready_snapshots.end())
+        return;
+    int slot = it->second.slot;
+    while(!release_ring.tryEnqueue(std::move(slot)));
+    ready_snapshots.erase(it);
+}
@@ -8,7 +8,8 @@
 #include <getopt.h>
 #include <chrono>
 #include <thread>
-#include <curl/curl.h>
+#include <functional>
+#include <vector>
 #include "wsock.hpp"
 #include "refdb.hpp"
 #include "logger.hpp"
@@ -16,7 +17,15 @@
 #include "aeron_types.hpp"
 #include "heartbeat_service.hpp"
 #include "binance_md_process.hpp"
-#include "MyRingBuffer.hpp"
+#include "snapshot_fetcher.hpp"
+#include "diff_replay_buffer.hpp"
+#include "snapshot_cache.hpp"
+#include "latency_histogram.hpp"
+#include "trace_context.hpp"
+#include "shard_member.hpp"
+#include "book_shm.hpp"
+#include "microstructure_signals.hpp"
+#include "aeron_types_ext.hpp"
 #include "to_aeron.hpp"
 
 bool all_instruments = false;
@@ -24,18 +33,6 @@ char start_letter;
 char end_letter;
 bool range_given = false;
 
-struct snapshot_info {
-    uint8_t ex_id;
-    uint32_t instrument_id;
-    std::string instrument_name;
-    std::string current_date;
-    bool to_file;
-};
-typedef MyRingBuffer<snapshot_info, 1024> SnapshotRingT;
-
-SnapshotRingT snapshot_ring;
-std::map<uint32_t, char *> symbol_to_snapshotmessage;
-
 void print_options(){
   std::cout << "Options for svc_md_binance:" << std::endl;
   std::cout << "  -E (--environment) <PROD|UAT>                           = Sets to Prod or UAT config (need one of them)" << std::endl;
@@ -45,6 +42,14 @@ void print_options(){
   std::cout << "  -o (--offset-day)                                       = This is used when starting next days capture early" << std::endl;
   std::cout << "  -a (--all-instruments)                                  = Do all instruments - not just live" << std::endl;
   std::cout << "  -s (--stdout-only)                                      = Only log to stdout instead of influx" << std::endl;
+  std::cout << "  -n (--snapshots-in-flight) <NUM>                        = Max concurrent REST depth snapshots (default 4)" << std::endl;
+  std::cout << "  -b (--binary-capture) <SEGMENT_MB>                      = Collect into memory mapped binary capture segments of this size" << std::endl;
+  std::cout << "  -z (--compressed-capture)                               = Collect into compressed binary capture files with a block index" << std::endl;
+  std::cout << "  -S (--shard) <SHARD_ID>                                 = Run as a shard, instruments are assigned by svc_md_coordinator" << std::endl;
+  std::cout << "  -f (--snapshot-freshness) <MILLIS>                      = Serve cached AERON_SS snapshots younger than this (default 50)" << std::endl;
+  std::cout << "  -B (--book-shm) <LEVELS>                                = Publish the top LEVELS of every book in shared memory (read with book_reader)" << std::endl;
+  std::cout << "  -G (--signals) <MILLIS>                                 = Publish order book signals as SignalBlock, at most every MILLIS per instrument" << std::endl;
+  std::cout << "  -T (--trace)                                            = Start a tick to trade trace on every Signal published (TraceContext trailer)" << std::endl;
   std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
 }
 
@@ -60,12 +65,6 @@ std::string get_current_date_as_string(int offset) {
     return(outputstring);
 }
 
-static size_t curl_writemethod(char *buffer, size_t size, size_t nmemb, void *data) {
-  std::string *s = (std::string *)data;
-  s->append(buffer, size*nmemb);
-  return size*nmemb;
-}
-
 uint64_t get_current_ts() {
   struct timespec t;
   clock_gettime(CLOCK_REALTIME, &t);
@@ -74,65 +73,16 @@ uint64_t get_current_ts() {
 
 
 // -----------------------------------------------------------------------
-// This thread processes all snapshot requests given to it in the ringbuffer
+// This thread listens to snapshot requests and publishes the (cached) snapshots
+// All requests read in one poll are coalesced so each instrument is published once
 // -----------------------------------------------------------------------
-void process_snapshot_requests(Logger *snapshot_logger) {
-    std::thread snapshot_thread([snapshot_logger]() {
-        std::string request_url = "";
-        CURL * curl;
-        curl = curl_easy_init();
-        struct snapshot_info *snap_info;
-
-        while (1){
-            if (snapshot_ring.GetPopPtr(&snap_info)) {
-                // Process the snapshot request
-                if (snap_info->ex_id == 16) {
-                    request_url = "https://api.binance.com/api/v3/depth?symbol=" + snap_info->instrument_name + "&limit=1000";
-                } else if (snap_info->ex_id == 18) {
-                    request_url = "https://fapi.binance.com/fapi/v1/depth?symbol=" + snap_info->instrument_name + "&limit=1000";
-                } else {
-                    request_url = "https://dapi.binance.com/dapi/v1/depth?symbol=" + snap_info->instrument_name + "&limit=1000";
-                }
-                snapshot_logger->msg(INFO, "Processing snapshot for: " + snap_info->instrument_name + " - Using URL: " + request_url);
-                
-                uint64_t timestamp;
-                std::string response;
-                curl_easy_setopt(curl, CURLOPT_URL, request_url.c_str());
-                curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_writemethod);
-                curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-                curl_easy_perform(curl);
-
-                // for capture to_file true
-                if(snap_info->to_file){
-                    std::string file_name = "/datacollection/binance/" + snap_info->current_date + "_";
-                    file_name += snap_info->instrument_name + "_" + std::to_string(snap_info->instrument_id) + "_ss.txt";
-                    FileWriter *file_writer = new FileWriter(file_name);
-
-                    timestamp = get_current_ts();
-                    file_writer->write_to_file(response, timestamp);
-                    delete(file_writer);
-                } 
-                // Here we handle the writing of the output to a symbol map so the realtime thread can easily check if something is there
-                char *snapshot_buffer = (char*) malloc(sizeof(char) * (1024*1024));
-                memcpy(snapshot_buffer, response.c_str(), response.length() + 1);
-                symbol_to_snapshotmessage[snap_info->instrument_id] = snapshot_buffer;
-
-                snapshot_ring.incrTail();
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1500));
-        }
-    });
-    snapshot_thread.detach();
-}
-
-// -----------------------------------------------------------------------
-// This thread listens to snapshot requests and then generates and publishes the snapshot
-// -----------------------------------------------------------------------
-void snapshot_publisher(Logger *snapshot_logger, WSock *wsocket, char *snapshot_buffer) {
-    std::thread snapshot_publisher_thread([snapshot_logger, wsocket, snapshot_buffer]() {
+void snapshot_publisher(Logger *snapshot_logger, SnapshotCache *snapshot_cache, ShardMember *shard_member) {
+    std::thread snapshot_publisher_thread([snapshot_logger, snapshot_cache, shard_member]() {
         to_aeron *to_aeron_ss;
-        int num_messages = 0;
-        uint32_t snap_request_instrument_id = 0;
+        std::vector<uint32_t> requested_instruments;
+        uint64_t num_requests = 0;
+        uint64_t num_published = 0;
+        int idle_count = 0;
 
         aeron::Context                      snap_context;
         std::shared_ptr<Aeron>              snap_aeron = Aeron::connect(snap_context);
@@ -147,39 +97,139 @@ void snapshot_publisher(Logger *snapshot_logger, WSock *wsocket, char *snapshot_
 
         snapshot_logger->msg(INFO, "Snapshot Publisher thread started");
 
+        auto add_request = [&requested_instruments, &num_requests](uint32_t instrument_id) {
+            num_requests++;
+            if(std::find(requested_instruments.begin(), requested_instruments.end(), instrument_id) == requested_instruments.end())
+                requested_instruments.push_back(instrument_id);
+        };
+
         // Fragment handler lambda, putting it here so I can easily pass extra variables..:)
-        auto snap_fragment_lambda = [&snap_request_instrument_id](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+        auto snap_fragment_lambda = [&add_request](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
             struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
             if(m->msgType == DEPTH_SNAPSHOT_REQUEST) {
                 struct DepthSnapshotRequest *depth_request = (struct DepthSnapshotRequest*)m;
-                snap_request_instrument_id = depth_request->instrument_id;
+                add_request(depth_request->instrument_id);
+            }
+            else if(m->msgType == DEPTH_SNAPSHOT_REQUEST_MULTI) {
+                struct DepthSnapshotRequestMulti *depth_request = (struct DepthSnapshotRequestMulti*)m;
+                for(int i = 0; (i < depth_request->num_instruments) && (i < MAX_SNAPSHOT_REQUEST_INSTRUMENTS); i++)
+                    add_request(depth_request->instrument_ids[i]);
             }
         };
 
         
         // Infinite loop that iterates over all items over and over
         while (1){
-            // Check if any requests on the bus
-            const int fragmentsRead = snap_subscription->poll(snap_fragment_lambda, 10);
-
-            if(snap_request_instrument_id != 0){
-                // Build and publish snapshot response
+            // Drain everything that is on the bus before publishing anything
+            int fragments_read = 0;
+            int fragments;
+            while((fragments = snap_subscription->poll(snap_fragment_lambda, 10)) > 0)
+                fragments_read += fragments;
+
+            for(auto instrument_id: requested_instruments){
+                // Only the shard publishing the instrument answers for it
+                if((shard_member != nullptr) && ! shard_member->is_active(instrument_id))
+                    continue;
+                cached_snapshot *snapshot = snapshot_cache->get_snapshot(instrument_id);
+                if(snapshot == nullptr)
+                    continue;
                 int bin_snapshot_message_offset = 0;
                 char *snapshot_msg_pointer;
-                num_messages = wsocket->get_snapshot(snapshot_buffer, snap_request_instrument_id);
-                for(int i = 0; i < num_messages; i++){
-                    snapshot_msg_pointer = snapshot_buffer + bin_snapshot_message_offset;
+                for(int i = 0; i < snapshot->num_messages; i++){
+                    snapshot_msg_pointer = snapshot->data.data() + bin_snapshot_message_offset;
                     to_aeron_ss->send_data(snapshot_msg_pointer, ((MessageHeader *) snapshot_msg_pointer)->msgLength);
                     bin_snapshot_message_offset += ((MessageHeader *) snapshot_msg_pointer)->msgLength;
                 }
+                num_published++;
+                if((num_published % 1000) == 0)
+                    snapshot_logger->msg(INFO, "Snapshot requests: " + std::to_string(num_requests) + ", published: " + std::to_string(num_published) + " - " + snapshot_cache->get_stats());
             }
-            snap_request_instrument_id = 0;
-            usleep(100);
+
+            // Back off gradually when there is nothing to do, stay responsive while requests keep coming
+            if(fragments_read == 0){
+                if(idle_count < 100)
+                    idle_count++;
+                if(idle_count < 10)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(idle_count * 10));
+            } else {
+                idle_count = 0;
+            }
+            requested_instruments.clear();
         }
     });
     snapshot_publisher_thread.detach();
 }
 
+// -----------------------------------------------------------------------
+// Returns the websocket URIs for all the streams we take for an instrument
+// -----------------------------------------------------------------------
+std::vector<std::string> get_stream_uris(std::string exch_name, std::string instrument_name) {
+    if(exch_name == "Binance"){
+        return {"wss://stream.binance.com:9443/ws/" + instrument_name + "@depth@100ms",
+                "wss://stream.binance.com:9443/ws/" + instrument_name + "@trade",
+                "wss://stream.binance.com:9443/ws/" + instrument_name + "@bookTicker"};
+    }
+    else if (exch_name == "Binance Futures"){
+        return {"wss://fstream.binance.com/ws/" + instrument_name + "@depth@0ms",
+                "wss://fstream.binance.com/ws/" + instrument_name + "@trade",
+                "wss://fstream.binance.com/ws/" + instrument_name + "@bookTicker",
+                "wss://fstream.binance.com/ws/" + instrument_name + "@markPrice@1s",
+                "wss://fstream.binance.com/ws/" + instrument_name + "@forceOrder"};
+    }
+    else if (exch_name == "BinanceDEX"){
+        return {"wss://dstream.binance.com/ws/" + instrument_name + "@depth@0ms",
+                "wss://dstream.binance.com/ws/" + instrument_name + "@trade",
+                "wss://dstream.binance.com/ws/" + instrument_name + "@bookTicker",
+                "wss://dstream.binance.com/ws/" + instrument_name + "@markPrice@1s",
+                "wss://fstream.binance.com/ws/" + instrument_name + "@forceOrder"};
+    }
+    return {};
+}
+
+// -----------------------------------------------------------------------
+// This thread listens to subscription control messages on AERON_MC and hands
+// everything read in one poll to apply_controls as a batch
+// -----------------------------------------------------------------------
+void subscription_controller(Logger *control_logger, std::function<void(std::vector<SubscriptionControl> &)> apply_controls) {
+    std::thread subscription_controller_thread([control_logger, apply_controls]() {
+        std::vector<SubscriptionControl> controls;
+
+        aeron::Context                      control_context;
+        std::shared_ptr<Aeron>              control_aeron = Aeron::connect(control_context);
+        std::int64_t                        control_channel_id = control_aeron->addSubscription("aeron:ipc", AERON_MC);
+        std::shared_ptr<Subscription>       control_subscription = control_aeron->findSubscription(control_channel_id);
+
+        while (!control_subscription) {
+            control_subscription = control_aeron->findSubscription(control_channel_id);
+        }
+
+        control_logger->msg(INFO, "Subscription control thread started");
+
+        auto control_fragment_lambda = [&controls](const AtomicBuffer &buffer, util::index_t offset, util::index_t length, const Header &header) {
+            struct MessageHeader *m = (MessageHeader*)(reinterpret_cast<const char *>(buffer.buffer()) + offset);
+            if(m->msgType == SUBSCRIPTION_CONTROL) {
+                SubscriptionControl control;
+                memset(&control, 0, sizeof(SubscriptionControl));
+                memcpy(&control, m, std::min((size_t) m->msgLength, sizeof(SubscriptionControl)));
+                controls.push_back(control);
+            }
+        };
+
+        while (1){
+            while(control_subscription->poll(control_fragment_lambda, 10) > 0);
+
+            if(controls.size() > 0){
+                apply_controls(controls);
+                controls.clear();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+    subscription_controller_thread.detach();
+}
+
 // -----------------------------------------------------------------------
 // Main thread for SVC_MD_BINANCE
 // -----------------------------------------------------------------------
@@ -192,7 +242,20 @@ int main(int argc, char** argv) {
     Logger              *logger;
     Logger              *subscription_logger;
     to_aeron            *to_aeron_io;
-    char snapshot_buffer[1024*1024];
+    SnapshotFetcher     *snapshot_fetcher;
+    int snapshots_in_flight = SNAPSHOT_DEFAULT_IN_FLIGHT;
+    int snapshot_freshness_ms = SNAPSHOT_CACHE_DEFAULT_FRESHNESS_MS;
+    bool binary_capture = false;
+    bool compressed_capture = false;
+    uint32_t shard_id = 0;
+    ShardMember *shard_member = nullptr;
+    uint32_t book_shm_depth = 0;
+    BookShmWriter *book_shm = nullptr;
+    int signals_interval_ms = -1;
+    MicrostructureSignals *signals = nullptr;
+    bool trace_signals = false;
+    uint64_t trace_sequence = 0;
+    uint64_t capture_segment_mb = CAPTURE_DEFAULT_SEGMENT_MB;
 
 
     current_date = get_current_date_as_string(0);
@@ -211,10 +274,18 @@ int main(int argc, char** argv) {
         {"all-instruments"  , optional_argument, NULL, 'a'},
         {"range"            , optional_argument, NULL, 'r'},
         {"collect"          , optional_argument, NULL, 'c'},
+        {"snapshots-in-flight", optional_argument, NULL, 'n'},
+        {"snapshot-freshness", optional_argument, NULL, 'f'},
+        {"binary-capture"   , optional_argument, NULL, 'b'},
+        {"compressed-capture", optional_argument, NULL, 'z'},
+        {"shard"            , optional_argument, NULL, 'S'},
+        {"book-shm"         , optional_argument, NULL, 'B'},
+        {"signals"          , optional_argument, NULL, 'G'},
+        {"trace"            , optional_argument, NULL, 'T'},
         {"help"             , optional_argument, NULL, 'h'}};
 
     int cmd_option;
-    while((cmd_option = getopt_long(argc, argv, "E:shcmoar:", long_options, NULL)) != -1) {
+    while((cmd_option = getopt_long(argc, argv, "E:shcmoar:n:f:b:zS:B:G:T", long_options, NULL)) != -1) {
         switch (cmd_option) {
             case 'E':
                 environment_given = true;
@@ -253,6 +324,39 @@ int main(int argc, char** argv) {
             case 'o':
                 current_date = get_current_date_as_string(1);
             break;
+
+            case 'n':
+                snapshots_in_flight = atoi(optarg);
+            break;
+
+            case 'f':
+                snapshot_freshness_ms = atoi(optarg);
+            break;
+
+            case 'b':
+                binary_capture = true;
+                capture_segment_mb = atoi(optarg);
+            break;
+
+            case 'z':
+                compressed_capture = true;
+            break;
+
+            case 'S':
+                shard_id = atoi(optarg);
+            break;
+
+            case 'B':
+                book_shm_depth = atoi(optarg);
+            break;
+
+            case 'G':
+                signals_interval_ms = atoi(optarg);
+            break;
+
+            case 'T':
+                trace_signals = true;
+            break;
             
             case 'h':
                 print_options();
@@ -287,69 +391,137 @@ int main(int argc, char** argv) {
 
     wsocket = new WSock(logger, subscription_logger, 1800, 50);
 
-    // Start heartbeating
-    if(do_collect){
-        start_heartbeat(1, CAPTURE_SERVICE);
-    } else {
-        snapshot_publisher(log_worker->get_new_logger("snapshotpublisher_thread"), wsocket, snapshot_buffer);
-        start_heartbeat(1, MARKETDATA_SERVICE);
-    }
+    // One file writer per instrument, shared by all of its streams and kept across drop/add
+    std::unordered_map<uint32_t, FileWriter*> file_writers;
+    auto get_file_writer = [&](auto instrument) -> FileWriter* {
+        if(! do_collect)
+            return(nullptr);
+        if(file_writers.count(instrument->instrument_id))
+            return(file_writers[instrument->instrument_id]);
+
+        std::string file_name = "/datacollection/binance/" + current_date + "_" + std::string(instrument->instrument_name);
+        file_name += "_" + std::to_string(instrument->instrument_id) + "_all";
+
+        FileWriter *file_writer;
+        if(compressed_capture) {
+            file_writer = new FileWriter(file_name + ".capz", instrument->instrument_id, CompressedCaptureFormat);
+        } else if(binary_capture) {
+            file_writer = new FileWriter(file_name + ".cap", instrument->instrument_id, BinaryCaptureFormat, capture_segment_mb);
+        } else {
+            file_writer = new FileWriter(file_name + ".txt");
+        }
+        file_writers[instrument->instrument_id] = file_writer;
+        return(file_writer);
+    };
+
+    // Subscribes the wanted streams (stream_mask 0 is all) of an instrument that are not already subscribed
+    auto subscribe_instrument = [&](auto instrument, std::string exch_name, uint8_t ex_id, uint16_t stream_mask) -> int {
+        int num_subscribed = 0;
+        std::string instrument_name = std::string(instrument->instrument_name);
+        std::string cap_instrument_name = instrument_name;
+        std::transform(instrument_name.begin(), instrument_name.end(), instrument_name.begin(), 
+            [](unsigned char c){ return std::tolower(c); });
+
+        uint16_t already_subscribed = wsocket->get_subscribed_streams(instrument->instrument_id);
+        for(auto const& stream_uri: get_stream_uris(exch_name, instrument_name)) {
+            uint16_t stream_bit = 1 << capture_stream_kind_from_uri(stream_uri);
+            if(((stream_mask != 0) && ! (stream_mask & stream_bit)) || (already_subscribed & stream_bit))
+                continue;
+            wsocket->add_subscription_request(stream_uri, get_file_writer(instrument), cap_instrument_name, instrument->instrument_id, ex_id);
+            num_subscribed++;
+        }
+        return(num_subscribed);
+    };
+
+    auto in_range = [&](std::string instrument_name) -> bool {
+        if(range_given)
+            return((instrument_name.front() >= start_letter) && (instrument_name.front() <= end_letter));
+        return(true);
+    };
 
-     // Add subscriptions for all three Binance exchanges
+     // Add subscriptions for all three Binance exchanges - a shard waits for the coordinator instead
     std::list<std::string> exchange_list {"Binance", "Binance Futures", "BinanceDEX"};
     for (auto exch_name : exchange_list) {
+        if(shard_id != 0)
+            break;
         uint8_t ex_id = refdb->get_exchange_id(exch_name);
         auto instruments = refdb->get_all_symbols_for_exchange(ex_id);
 
         for(auto const& instrument: instruments) {
             if(instrument->is_live < 2){
-                std::string instrument_name = std::string(instrument->instrument_name);
-                if(range_given){
-                    if ((instrument_name.front() < start_letter) || (instrument_name.front() > end_letter))
-                        continue;
-                }
-                std::string cap_instrument_name = instrument_name;
-                std::transform(instrument_name.begin(), instrument_name.end(), instrument_name.begin(), 
-                    [](unsigned char c){ return std::tolower(c); });
-                logger->msg(INFO, "Adding all subscriptions for Instrument: " + instrument_name);
-
-                std::string file_name = "/datacollection/binance/" + current_date + "_" + std::string(instrument->instrument_name);
-                file_name += "_" + std::to_string(instrument->instrument_id) + "_all.txt";
-
-                FileWriter *file_writer;
-                if(do_collect) {
-                    file_writer = new FileWriter(file_name);
-                } else{
-                    file_writer = nullptr;
-                }
+                if(! in_range(std::string(instrument->instrument_name)))
+                    continue;
+                logger->msg(INFO, "Adding all subscriptions for Instrument: " + std::string(instrument->instrument_name));
+                subscribe_instrument(instrument, exch_name, ex_id, 0);
+            }
+        }
+    }
 
-                if(exch_name == "Binance"){
-                    wsocket->add_subscription_request("wss://stream.binance.com:9443/ws/" + instrument_name + "@depth@100ms",file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://stream.binance.com:9443/ws/" + instrument_name + "@trade", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://stream.binance.com:9443/ws/" + instrument_name + "@bookTicker", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                }
+    // As a shard the coordinator decides what we subscribe to and what we publish. From here on
+    // refdb and the file writers are only used by the shard thread.
+    if(shard_id != 0){
+        shard_member = new ShardMember(log_worker->get_new_logger("shard"), shard_id, wsocket, [&](uint32_t instrument_id) -> int {
+            auto instrument = refdb->get_symbol_from_id(instrument_id);
+            if(instrument == nullptr){
+                // Listed after we started
+                refdb->get_all_instrument_from_db();
+                instrument = refdb->get_symbol_from_id(instrument_id);
+            }
+            if(instrument == nullptr)
+                return(0);
+            std::string exch_name = refdb->get_exchange_name_from_symbol_id(instrument_id);
+            if(std::find(exchange_list.begin(), exchange_list.end(), exch_name) == exchange_list.end())
+                return(0);
+            return(subscribe_instrument(instrument, exch_name, refdb->get_exchange_id(exch_name), 0));
+        });
+    }
 
-                else if (exch_name == "Binance Futures"){
-                    wsocket->add_subscription_request("wss://fstream.binance.com/ws/" + instrument_name + "@depth@0ms", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://fstream.binance.com/ws/" + instrument_name + "@trade", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://fstream.binance.com/ws/" + instrument_name + "@bookTicker", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://fstream.binance.com/ws/" + instrument_name + "@markPrice@1s", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://fstream.binance.com/ws/" + instrument_name + "@forceOrder", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);                    
-                }
+    // Start heartbeating
+    if(do_collect){
+        start_heartbeat(1, CAPTURE_SERVICE);
+    } else {
+        snapshot_publisher(log_worker->get_new_logger("snapshotpublisher_thread"), new SnapshotCache(wsocket, snapshot_freshness_ms), shard_member);
+        start_heartbeat(1, MARKETDATA_SERVICE);
+    }
 
-                else if (exch_name == "BinanceDEX"){
-                    wsocket->add_subscription_request("wss://dstream.binance.com/ws/" + instrument_name + "@depth@0ms", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://dstream.binance.com/ws/" + instrument_name + "@trade", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://dstream.binance.com/ws/" + instrument_name + "@bookTicker", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://dstream.binance.com/ws/" + instrument_name + "@markPrice@1s", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                    wsocket->add_subscription_request("wss://fstream.binance.com/ws/" + instrument_name + "@forceOrder", file_writer, cap_instrument_name, instrument->instrument_id, ex_id);
-                }            
+    // Instruments and streams can be added and dropped at runtime on AERON_MC, from here on
+    // refdb and the file writers are only used by the control thread
+    if(shard_id == 0){
+        Logger *control_logger = log_worker->get_new_logger("subscription_control");
+        subscription_controller(control_logger, [&, control_logger](std::vector<SubscriptionControl> &controls) {
+            // RefDB only loads in bulk - refresh once for the batch and only touch the instruments in it
+            bool has_adds = std::any_of(controls.begin(), controls.end(), [](SubscriptionControl &control) { return(control.action == SUBSCRIPTION_ADD); });
+            if(has_adds)
+                refdb->get_all_instrument_from_db();
+
+            for(auto &control: controls){
+                for(int i = 0; (i < control.num_instruments) && (i < MAX_SUBSCRIPTION_CONTROL_INSTRUMENTS); i++){
+                    uint32_t instrument_id = control.instrument_ids[i];
+                    if(control.action == SUBSCRIPTION_DROP){
+                        if(wsocket->get_subscribed_streams(instrument_id) == 0)
+                            continue;
+                        control_logger->msg(INFO, "Dropping streams for instrument: " + std::to_string(instrument_id));
+                        wsocket->remove_subscriptions(instrument_id, (control.stream_mask == 0) ? 0xFFFF : control.stream_mask);
+                    }
+                    else if(control.action == SUBSCRIPTION_ADD){
+                        auto instrument = refdb->get_symbol_from_id(instrument_id);
+                        if(instrument == nullptr){
+                            control_logger->msg(WARN, "Unknown instrument in subscription request: " + std::to_string(instrument_id));
+                            continue;
+                        }
+                        // Not ours - another exchange or another instance's range
+                        std::string exch_name = refdb->get_exchange_name_from_symbol_id(instrument_id);
+                        if((std::find(exchange_list.begin(), exchange_list.end(), exch_name) == exchange_list.end()) || ! in_range(std::string(instrument->instrument_name)))
+                            continue;
+                        int num_subscribed = subscribe_instrument(instrument, exch_name, refdb->get_exchange_id(exch_name), control.stream_mask);
+                        control_logger->msg(INFO, "Added " + std::to_string(num_subscribed) + " streams for instrument: " + std::string(instrument->instrument_name));
+                    }
+                }
             }
-        }
+        });
     }
 
     std::string_view        message_to_print;
-    struct snapshot_info    snap_info;
     DecodeResponse          decode_response;
     DecodeResponse          decode_snapshot_response;
     char                    bin_message_buffer[1024*1024];
@@ -357,13 +529,116 @@ int main(int argc, char** argv) {
     auto binance_processor  = new BinanceMDProcessor(bin_message_buffer, bin_snapshot_buffer, &decode_response, &decode_snapshot_response);
     to_aeron_io             = new to_aeron(AERON_IO);
 
-    // This thread processes snapshot requests and writes them to a binary file (collection)
-    process_snapshot_requests(log_worker->get_new_logger("snapshot_thread"));
+    // Fetches REST snapshots concurrently in its own thread and hands them back to us (also writes them out when collecting)
+    Logger *snapshot_logger = log_worker->get_new_logger("snapshot_thread");
+    snapshot_fetcher        = new SnapshotFetcher(snapshot_logger, snapshots_in_flight);
+    auto diff_replay        = new DiffReplayBuffer(snapshot_logger);
+
+    // Queues a snapshot request for the instrument of the current socket
+    auto request_snapshot = [&]() {
+        struct snapshot_info snap_info;
+        snap_info.current_date = current_date;
+        snap_info.ex_id = wsocket->get_exchange_id();
+        snap_info.instrument_id = wsocket->get_instrument_id();
+        snap_info.instrument_name = wsocket->get_instrument_name();
+        snap_info.activity = wsocket->get_message_rate();
+        snap_info.to_file = do_collect;
+        snapshot_fetcher->request_snapshot(std::move(snap_info));
+    };
 
 
     int bin_message_offset;
     char *msg_pointer;
-    
+
+    // As a shard we keep the books of standby instruments in sync but only publish what we own,
+    // depth updates are cut off by sequence number and the rest by exchange time at a handover.
+    // What comes in on standby is held by the shard member and published when we take over.
+    auto shard_allows = [&](char *msg) -> bool {
+        if(shard_member == nullptr)
+            return(true);
+        uint32_t instrument_id = wsocket->get_instrument_id();
+        switch(((MessageHeader *) msg)->msgType){
+            case PL_UPDATE:
+                return(shard_member->should_publish(instrument_id, msg, ((PLUpdates *) msg)->end_seq_number, ((PLUpdates *) msg)->exchange_timestamp));
+            case TOB_UPDATE:
+                return(shard_member->should_publish(instrument_id, msg, 0, ((ToBUpdate *) msg)->exchange_timestamp));
+            case TRADE:
+                return(shard_member->should_publish(instrument_id, msg, 0, ((Trade *) msg)->exchange_timestamp));
+            case SIGNAL:
+                return(shard_member->should_publish(instrument_id, msg, 0, ((Signal *) msg)->exchange_timestamp));
+            case INSTRUMENT_CLEAR_BOOK:
+                return(shard_member->should_publish(instrument_id, msg, 0, 0));
+            default:
+                return(shard_member->is_active(instrument_id));
+        }
+    };
+
+    if(shard_member != nullptr){
+        char *shard_book_buffer = (char *) malloc(SNAPSHOT_CACHE_BUILD_BUFFER_SIZE);
+        shard_member->set_publisher([&](char *msg) {
+            // Held since we were on standby, stamped when it actually goes out
+            switch(((MessageHeader *) msg)->msgType){
+                case PL_UPDATE:
+                    ((PLUpdates *) msg)->sending_timestamp = get_current_ts();
+                    break;
+                case TOB_UPDATE:
+                    ((ToBUpdate *) msg)->sending_timestamp = get_current_ts();
+                    break;
+                case TRADE:
+                    ((Trade *) msg)->sending_timestamp = get_current_ts();
+                    break;
+                case SIGNAL:
+                    ((Signal *) msg)->sending_timestamp = get_current_ts();
+                    break;
+            }
+            to_aeron_io->send_data(msg, ((MessageHeader *) msg)->msgLength);
+        }, [&, shard_book_buffer](uint32_t instrument_id) {
+            int num_messages = wsocket->get_snapshot(shard_book_buffer, instrument_id);
+            if(num_messages == 0)
+                return;
+            InstrumentClearBook clear_msg;
+            clear_msg.msg_header = {sizeof(InstrumentClearBook), INSTRUMENT_CLEAR_BOOK, 1};
+            clear_msg.instrument_id = instrument_id;
+            clear_msg.exchange_id = ((PLUpdates *) shard_book_buffer)->exchange_id;
+            clear_msg.book_type_to_clear = PL_BOOK_TYPE;
+            clear_msg.clear_reason = EXCHANGE_SNAP;
+            clear_msg.sending_timestamp = get_current_ts();
+            to_aeron_io->send_data((char *) &clear_msg, sizeof(InstrumentClearBook));
+            int offset = 0;
+            for(int i = 0; i < num_messages; i++){
+                char *snapshot_msg_pointer = shard_book_buffer + offset;
+                ((PLUpdates *) snapshot_msg_pointer)->sending_timestamp = get_current_ts();
+                to_aeron_io->send_data(snapshot_msg_pointer, ((MessageHeader *) snapshot_msg_pointer)->msgLength);
+                offset += ((MessageHeader *) snapshot_msg_pointer)->msgLength;
+            }
+        });
+    }
+
+    // Per instrument/stream latency histograms, scraped from shared memory with latency_reader
+    auto latency_recorder = new LatencyRecorder("svc_md_binance");
+    logger->msg(INFO, "Publishing latency histograms in shared memory: " + latency_recorder->get_shm_name());
+    uint64_t decoded_ts;
+    uint64_t exchange_ts;
+
+    // Top of the books in shared memory for local consumers, see book_reader
+    if((book_shm_depth > 0) && ! do_collect){
+        book_shm = new BookShmWriter((shard_id != 0) ? "svc_md_binance_shard" + std::to_string(shard_id) : "svc_md_binance", book_shm_depth);
+        logger->msg(INFO, "Publishing order books in shared memory: " + book_shm->get_shm_name());
+        // Levels come from the socket's book, the update is applied there first
+        book_shm->set_level_source([&](uint8_t side, int depth, PriceLevelDetails *levels) {
+            return(wsocket->get_plbook_levels(side, depth, levels));
+        });
+    }
+
+    // Microprice, imbalance and depth signals from the books, computed once here for all strategies
+    if((signals_interval_ms >= 0) && ! do_collect){
+        signals = new MicrostructureSignals([&](char *msg, uint32_t length) {
+            if((shard_member == nullptr) || shard_member->is_active(((SignalBlock *) msg)->instrument_id))
+                to_aeron_io->send_data(msg, length);
+        }, signals_interval_ms);
+        logger->msg(INFO, "Publishing order book signals, at most every " + std::to_string(signals_interval_ms) + "ms per instrument");
+    }
+
 
     for(;;) {
         bin_message_offset = 0;
@@ -373,14 +648,22 @@ int main(int argc, char** argv) {
 
         // Capture process is part of the same pipeline as aeron publisher, enables seq checking..
         if(do_collect){
-            wsocket->get_filewriter()->write_to_file(message_to_print, wsocket->get_message_receive_time());
+            wsocket->get_filewriter()->write_to_file(message_to_print, wsocket->get_message_receive_time(), wsocket->get_stream_kind());
         }
 
+        // Pick up any snapshots the fetcher thread has completed
+        snapshot_fetcher->process_completed_snapshots();
+
+        // Instruments we took over go out from where the previous owner stopped, even if quiet
+        if(shard_member != nullptr)
+            shard_member->replay_handovers();
+
         if(wsocket->in_snapshot_state()){
-            if(symbol_to_snapshotmessage.count(wsocket->get_instrument_id())){
+            const char *snapshot_data = snapshot_fetcher->get_snapshot(wsocket->get_instrument_id());
+            if(snapshot_data != nullptr){
                 // We have received a snapshotupdate lets process it
                 binance_processor->process_message( 
-                                std::string_view(symbol_to_snapshotmessage[wsocket->get_instrument_id()]),
+                                std::string_view(snapshot_data),
                                 wsocket->get_message_receive_time(), 
                                 wsocket->get_instrument_id(), 
                                 wsocket->get_exchange_id(), 
@@ -388,43 +671,81 @@ int main(int argc, char** argv) {
                                 wsocket->get_ask_price(),
                                 true);                
 
-                int bin_snapshot_message_offset = 0;
-                char *snapshot_msg_pointer;
-                snapshot_msg_pointer = bin_snapshot_buffer + bin_snapshot_message_offset;
-                if(! do_collect){
-                    // Send instrument clear message
-                    InstrumentClearBook clear_msg;
-                    clear_msg.msg_header = {sizeof(InstrumentClearBook), INSTRUMENT_CLEAR_BOOK, 1};
-                    clear_msg.instrument_id = wsocket->get_instrument_id();
-                    clear_msg.exchange_id = wsocket->get_exchange_id();
-                    clear_msg.book_type_to_clear = PL_BOOK_TYPE;
-                    clear_msg.clear_reason = EXCHANGE_SNAP;
-                    clear_msg.sending_timestamp = get_current_ts();
-                    wsocket->clear_plbook();
-                    to_aeron_io->send_data((char *) &clear_msg, sizeof(InstrumentClearBook));
-
-                    // Loop over the multiple messages that the snapshot will return
-                    for(int i = 0; i < decode_snapshot_response.num_messages; i++){
-                        snapshot_msg_pointer = bin_snapshot_buffer + bin_snapshot_message_offset;
-                        // Send the snapshot to aeron
-                        ((PLUpdates *) snapshot_msg_pointer)->sending_timestamp = get_current_ts();
-                        wsocket->process_plbook_update((PLUpdates *) snapshot_msg_pointer);
-                        to_aeron_io->send_data(snapshot_msg_pointer, ((MessageHeader *) snapshot_msg_pointer)->msgLength);
-
-                        // Update the offset to point to the next one
-                        bin_snapshot_message_offset += ((MessageHeader *) snapshot_msg_pointer)->msgLength;
-                    }
-                }
+                // Hand the buffer back to the fetcher, everything we need is decoded now
+                snapshot_fetcher->release_snapshot(wsocket->get_instrument_id());
 
-                // Set the last sequence number of the socket to that of the snapshot
-                wsocket->set_last_sequence_number(((PLUpdates *) snapshot_msg_pointer)->end_seq_number);
+                uint64_t last_update_id = ((PLUpdates *) bin_snapshot_buffer)->end_seq_number;
 
-                // Delete the snapshotupdate from map (first dealloc memory)
-                free(symbol_to_snapshotmessage[wsocket->get_instrument_id()]);
-                symbol_to_snapshotmessage.erase(wsocket->get_instrument_id());
+                // Check the snapshot against the diffs we buffered while waiting for it
+                if(decode_snapshot_response.num_messages == 0 || ! diff_replay->can_bridge(wsocket->get_instrument_id(), last_update_id)){
+                    // Snapshot is older than the first buffered diff - keep buffering and ask for a new one
+                    request_snapshot();
+                } else {
+                    int bin_snapshot_message_offset = 0;
+                    char *snapshot_msg_pointer;
+                    if(! do_collect){
+                        // Send instrument clear message
+                        InstrumentClearBook clear_msg;
+                        clear_msg.msg_header = {sizeof(InstrumentClearBook), INSTRUMENT_CLEAR_BOOK, 1};
+                        clear_msg.instrument_id = wsocket->get_instrument_id();
+                        clear_msg.exchange_id = wsocket->get_exchange_id();
+                        clear_msg.book_type_to_clear = PL_BOOK_TYPE;
+                        clear_msg.clear_reason = EXCHANGE_SNAP;
+                        clear_msg.sending_timestamp = get_current_ts();
+                        wsocket->clear_plbook();
+                        if(book_shm != nullptr)
+                            book_shm->clear_book(wsocket->get_instrument_id(), wsocket->get_exchange_id());
+                        if(signals != nullptr)
+                            signals->clear_book(wsocket->get_instrument_id(), wsocket->get_exchange_id());
+                        // A resync replaces the whole book, it goes out as long as we own the instrument
+                        bool publish_snapshot = shard_allows((char *) &clear_msg);
+                        if(publish_snapshot)
+                            to_aeron_io->send_data((char *) &clear_msg, sizeof(InstrumentClearBook));
+
+                        // Loop over the multiple messages that the snapshot will return
+                        for(int i = 0; i < decode_snapshot_response.num_messages; i++){
+                            snapshot_msg_pointer = bin_snapshot_buffer + bin_snapshot_message_offset;
+                            // Send the snapshot to aeron
+                            ((PLUpdates *) snapshot_msg_pointer)->sending_timestamp = get_current_ts();
+                            wsocket->process_plbook_update((PLUpdates *) snapshot_msg_pointer);
+                            if(book_shm != nullptr)
+                                book_shm->process_update((PLUpdates *) snapshot_msg_pointer);
+                            if(signals != nullptr)
+                                signals->process_update((PLUpdates *) snapshot_msg_pointer);
+                            if(publish_snapshot)
+                                to_aeron_io->send_data(snapshot_msg_pointer, ((MessageHeader *) snapshot_msg_pointer)->msgLength);
+
+                            // Update the offset to point to the next one
+                            bin_snapshot_message_offset += ((MessageHeader *) snapshot_msg_pointer)->msgLength;
+                        }
+                    }
 
-                // Reset the snapshot state
-                wsocket->set_snapshot_state(false);
+                    // Set the last sequence number of the socket to that of the snapshot
+                    wsocket->set_last_sequence_number(last_update_id);
+
+                    // Replay the diffs that arrived after the snapshot was taken
+                    bool replayed = diff_replay->replay(wsocket->get_instrument_id(), last_update_id, [&](PLUpdates *pl_update) {
+                        wsocket->set_last_sequence_number(pl_update->end_seq_number);
+                        if(! do_collect){
+                            pl_update->sending_timestamp = get_current_ts();
+                            wsocket->process_plbook_update(pl_update);
+                            if(book_shm != nullptr)
+                                book_shm->process_update(pl_update);
+                            if(signals != nullptr)
+                                signals->process_update(pl_update);
+                            if(shard_allows((char *) pl_update))
+                                to_aeron_io->send_data((char *) pl_update, pl_update->msg_header.msgLength);
+                        }
+                    });
+
+                    if(replayed){
+                        // Reset the snapshot state
+                        wsocket->set_snapshot_state(false);
+                    } else {
+                        request_snapshot();
+                    }
+                    snapshot_logger->msg(INFO, "Resynced " + wsocket->get_instrument_name() + " - " + diff_replay->get_stats());
+                }
             }
         }
 
@@ -436,13 +757,16 @@ int main(int argc, char** argv) {
                                 wsocket->get_exchange_id(), 
                                 wsocket->get_bid_price(), 
                                 wsocket->get_ask_price());
+        decoded_ts = get_current_ts();
+        exchange_ts = 0;
 
 
         for(int i = 0; i < decode_response.num_messages; i++){
             msg_pointer = bin_message_buffer + bin_message_offset;
             switch(((MessageHeader *) msg_pointer)->msgType){
                 case TOB_UPDATE:
-                    if(! do_collect){
+                    exchange_ts = ((ToBUpdate *) msg_pointer)->exchange_timestamp;
+                    if(! do_collect && shard_allows(msg_pointer)){
                         ((ToBUpdate *) msg_pointer)->sending_timestamp = get_current_ts();
                         to_aeron_io->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
                     }
@@ -452,6 +776,12 @@ int main(int argc, char** argv) {
                     break;
 
                 case PL_UPDATE:
+                    exchange_ts = ((PLUpdates *) msg_pointer)->exchange_timestamp;
+                    if(wsocket->in_snapshot_state()){
+                        // Waiting for the snapshot - hold on to the diff so it can be replayed on top of it
+                        diff_replay->add_update(wsocket->get_instrument_id(), (PLUpdates *) msg_pointer, decode_response.previous_end_seq_no);
+                        break;
+                    }
                     if(wsocket->get_last_sequence_number() != decode_response.previous_end_seq_no){
                         if(decode_response.previous_end_seq_no < wsocket->get_last_sequence_number()){
                             std::cout << "Update is older than current seq no. dropping (most likely because of snapshot)" << std::endl;
@@ -462,20 +792,12 @@ int main(int argc, char** argv) {
                             // lets confirm that this one is a depth feed, if so - lets do a snapshot
                             auto connection = wsocket->get_connection_string();
                             if(connection.find("depth") != connection.npos){
-                                // now - enque the snapshot request to the snapshot thread
-                                if(! wsocket->in_snapshot_state()){
-                                    snap_info.current_date = current_date;
-                                    snap_info.ex_id = wsocket->get_exchange_id();
-                                    snap_info.instrument_id = wsocket->get_instrument_id();
-                                    snap_info.instrument_name = wsocket->get_instrument_name();
-                                    if(do_collect){
-                                        snap_info.to_file = true;
-                                    } else {
-                                        snap_info.to_file = false;
-                                    }
-                                    while(!snapshot_ring.tryEnqueue(std::move(snap_info)));
-                                    wsocket->set_snapshot_state(true);
-                                }
+                                // now - enque the snapshot request to the snapshot thread and start buffering
+                                diff_replay->clear(wsocket->get_instrument_id());
+                                request_snapshot();
+                                wsocket->set_snapshot_state(true);
+                                diff_replay->add_update(wsocket->get_instrument_id(), (PLUpdates *) msg_pointer, decode_response.previous_end_seq_no);
+                                break;
                             }
                         }
                     }
@@ -484,20 +806,37 @@ int main(int argc, char** argv) {
                         // This is  true most of the time - that we want to write the message..
                         ((PLUpdates *) msg_pointer)->sending_timestamp = get_current_ts();
                         wsocket->process_plbook_update((PLUpdates *) msg_pointer);
-                        to_aeron_io->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
+                        if(book_shm != nullptr)
+                            book_shm->process_update((PLUpdates *) msg_pointer);
+                        if(shard_allows(msg_pointer))
+                            to_aeron_io->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
+                        if(signals != nullptr)
+                            signals->process_update((PLUpdates *) msg_pointer);
                     }
                     break;
 
                 case TRADE:
-                    if(! do_collect){
+                    exchange_ts = ((Trade *) msg_pointer)->exchange_timestamp;
+                    if(! do_collect && shard_allows(msg_pointer)){
                         ((Trade *) msg_pointer)->sending_timestamp = get_current_ts();
                         to_aeron_io->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
                     }
                     break;
 
                 case SIGNAL:
-                    if(! do_collect){
-                        to_aeron_io->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
+                    if(! do_collect && shard_allows(msg_pointer)){
+                        if(trace_signals){
+                            // Trace starts at the websocket frame the signal was decoded from
+                            traced_message<Signal> traced;
+                            traced.message = *((Signal *) msg_pointer);
+                            traced.message.sending_timestamp = get_current_ts();
+                            trace_start(&traced.trace, make_trace_id(++trace_sequence), traced.message.instrument_id, wsocket->get_message_receive_time());
+                            trace_stamp(&traced.trace, TRACE_POINT_DECODE_PUBLISH, traced.message.sending_timestamp);
+                            traced.message.msg_header.msgLength = sizeof(traced);
+                            to_aeron_io->send_data((char *) &traced, sizeof(traced));
+                        } else {
+                            to_aeron_io->send_data(msg_pointer, ((MessageHeader *) msg_pointer)->msgLength);
+                        }
                     }
                     break;
             }
@@ -505,7 +844,22 @@ int main(int argc, char** argv) {
             bin_message_offset += ((MessageHeader *) msg_pointer)->msgLength;
         }
 
+        // One sample per websocket message and hop, counters are only ever touched from this thread
+        if(decode_response.num_messages > 0){
+            latency_slot *slot = latency_recorder->get_slot(wsocket->get_instrument_id(), wsocket->get_stream_kind());
+            if(slot != nullptr){
+                uint64_t receive_ts = wsocket->get_message_receive_time();
+                if(exchange_ts != 0)
+                    record_latency(&slot->hops[LATENCY_HOP_EXCHANGE_TO_RECEIVE], (int64_t) (receive_ts - exchange_ts));
+                record_latency(&slot->hops[LATENCY_HOP_RECEIVE_TO_DECODE], (int64_t) (decoded_ts - receive_ts));
+                if(! do_collect)
+                    record_latency(&slot->hops[LATENCY_HOP_DECODE_TO_PUBLISH], (int64_t) (get_current_ts() - decoded_ts));
+            }
+        }
 
+        // Rate limited signal blocks whose interval has passed since they changed
+        if(signals != nullptr)
+            signals->publish_due();
     }
 
     delete(wsocket);
@@ -0,0 +1,68 @@
+#include <getopt.h>
+#include "md_conflator.hpp"
+
+
+void print_options(){
+    std::cout << "Options for svc_md_conflator:" << std::endl;
+    std::cout << "  -E (--environment) <PROD|UAT>                           = Sets to Prod or UAT config (need one of them)" << std::endl;
+    std::cout << "  -i (--interval) <MILLIS>                                = Conflation interval (default 100)" << std::endl;
+    std::cout << "  -s (--stdout-only)                                      = Only log to stdout instead of influx" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int option;
+  std::string environment_name = "";
+  uint64_t interval_millis = CONFLATOR_DEFAULT_INTERVAL_MS;
+  bool stdout_only = false;
+
+  static struct option long_options[] = {
+    {"environment"  , optional_argument, NULL, 'E'},
+    {"interval"     , optional_argument, NULL, 'i'},
+    {"stdout-only"  , optional_argument, NULL, 's'},
+    {"help"         , optional_argument, NULL,'h'}};
+
+  while((option = getopt_long(argc, argv, "E:i:sh", long_options, NULL)) != -1) {
+    switch (option) {
+      case 'h':
+        print_options();
+        exit(0);
+
+      case 'E':
+        environment_name = optarg;
+        break;
+
+      case 'i':
+        interval_millis = atoi(optarg);
+        break;
+
+      case 's':
+        stdout_only = true;
+        break;
+
+      default:
+          // Do nothing - we don't accept anything else
+        break;
+    }
+  }
+
+  if  ((environment_name != "UAT") && (environment_name != "PROD")) {
+    print_options();
+    exit(1);
+  }
+
+  if(interval_millis == 0) {
+    std::cout << "Interval has to be at least 1ms.. exiting" << std::endl;
+    exit(1);
+  }
+
+  LogWorker *log_worker = new LogWorker("svc_md_conflator", "All_Exchanges", environment_name, stdout_only);
+  MDConflator *conflator = new MDConflator(log_worker->get_new_logger("conflator"), interval_millis);
+
+  while(1){
+      sleep(500);
+  }
+
+  delete(conflator);
+  return(0);
+}
@@ -0,0 +1,97 @@
+#include <getopt.h>
+#include <list>
+#include "md_consolidator.hpp"
+#include "refdb.hpp"
+
+#define INSTRUMENT_REFRESH_SECONDS 300
+
+
+void print_options(){
+    std::cout << "Options for svc_md_consolidator:" << std::endl;
+    std::cout << "  -E (--environment) <PROD|UAT>                           = Sets to Prod or UAT config (need one of them)" << std::endl;
+    std::cout << "  -t (--stale) <MILLIS>                                   = Take a venue out when it has not updated for this long (default off)" << std::endl;
+    std::cout << "  -s (--stdout-only)                                      = Only log to stdout instead of influx" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+// -----------------------------------------------------------------------
+// Adds the live instruments of all venues, returns how many were new
+// -----------------------------------------------------------------------
+int load_instruments(RefDB *refdb, MDConsolidator *consolidator) {
+    int num_added = 0;
+    std::list<std::string> exchange_list {"Binance", "BinanceDEX", "Binance Futures", "Kraken"};
+    refdb->get_all_instrument_from_db();
+    for (auto exch_name : exchange_list) {
+        uint8_t ex_id = refdb->get_exchange_id(exch_name);
+        for (auto instrument : refdb->get_all_symbols_for_exchange(ex_id)) {
+            if(instrument->is_live >= 2)
+                continue;
+            if(consolidator->add_instrument(instrument->instrument_id, ex_id, instrument->base_asset_id, instrument->quote_asset_id))
+                num_added++;
+        }
+    }
+    return(num_added);
+}
+
+int main(int argc, char* argv[]) {
+  int option;
+  std::string environment_name = "";
+  uint64_t stale_millis = CONSOLIDATOR_DEFAULT_STALE_MS;
+  bool stdout_only = false;
+
+  static struct option long_options[] = {
+    {"environment"  , optional_argument, NULL, 'E'},
+    {"stale"        , optional_argument, NULL, 't'},
+    {"stdout-only"  , optional_argument, NULL, 's'},
+    {"help"         , optional_argument, NULL,'h'}};
+
+  while((option = getopt_long(argc, argv, "E:t:sh", long_options, NULL)) != -1) {
+    switch (option) {
+      case 'h':
+        print_options();
+        exit(0);
+
+      case 'E':
+        environment_name = optarg;
+        break;
+
+      case 't':
+        stale_millis = atoi(optarg);
+        break;
+
+      case 's':
+        stdout_only = true;
+        break;
+
+      default:
+          // Do nothing - we don't accept anything else
+        break;
+    }
+  }
+
+  if  ((environment_name != "UAT") && (environment_name != "PROD")) {
+    print_options();
+    exit(1);
+  }
+
+  LogWorker *log_worker = new LogWorker("svc_md_consolidator", "All_Exchanges", environment_name, stdout_only);
+  Logger *logger = log_worker->get_new_logger("main");
+  RefDB *refdb = new RefDB(environment_name, logger);
+  refdb->get_all_exchanges_from_db();
+
+  MDConsolidator *consolidator = new MDConsolidator(log_worker->get_new_logger("consolidator"), stale_millis);
+  int num_added = load_instruments(refdb, consolidator);
+  logger->msg(INFO, "Consolidating " + std::to_string(num_added) + " instruments in " + std::to_string(consolidator->get_num_pairs()) + " asset pairs");
+  consolidator->start();
+
+  // Newly listed instruments are picked up on every refresh
+  while(1){
+      sleep(INSTRUMENT_REFRESH_SECONDS);
+      num_added = load_instruments(refdb, consolidator);
+      if(num_added > 0)
+          logger->msg(INFO, "Added " + std::to_string(num_added) + " newly listed instruments");
+  }
+
+  delete(consolidator);
+  return(0);
+}
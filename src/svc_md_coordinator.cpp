@@ -0,0 +1,110 @@
+#include <getopt.h>
+#include <list>
+#include "md_coordinator.hpp"
+#include "refdb.hpp"
+
+#define UNIVERSE_REFRESH_SECONDS 300
+
+
+void print_options(){
+    std::cout << "Options for svc_md_coordinator:" << std::endl;
+    std::cout << "  -E (--environment) <PROD|UAT>                           = Sets to Prod or UAT config (need one of them)" << std::endl;
+    std::cout << "  -i (--interval) <SECONDS>                               = Rebalance interval (default 30)" << std::endl;
+    std::cout << "  -t (--threshold) <RATIO>                                = Rebalance when the busiest shard is this much above average (default 1.25)" << std::endl;
+    std::cout << "  -m (--max-migrations) <NUM>                             = Instruments moved per rebalance (default 8)" << std::endl;
+    std::cout << "  -s (--stdout-only)                                      = Only log to stdout instead of influx" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+// -----------------------------------------------------------------------
+// All live instruments on the exchanges svc_md_binance handles
+// -----------------------------------------------------------------------
+std::vector<uint32_t> load_universe(RefDB *refdb) {
+    std::vector<uint32_t> instrument_ids;
+    std::list<std::string> exchange_list {"Binance", "Binance Futures", "BinanceDEX"};
+    refdb->get_all_instrument_from_db();
+    for (auto exch_name : exchange_list) {
+        uint8_t ex_id = refdb->get_exchange_id(exch_name);
+        for (auto instrument : refdb->get_all_symbols_for_exchange(ex_id)) {
+            if(instrument->is_live < 2)
+                instrument_ids.push_back(instrument->instrument_id);
+        }
+    }
+    return(instrument_ids);
+}
+
+int main(int argc, char* argv[]) {
+  int option;
+  std::string environment_name = "";
+  uint64_t interval_seconds = COORDINATOR_DEFAULT_INTERVAL_S;
+  double threshold = COORDINATOR_DEFAULT_THRESHOLD;
+  uint32_t max_migrations = COORDINATOR_DEFAULT_MAX_MIGRATIONS;
+  bool stdout_only = false;
+
+  static struct option long_options[] = {
+    {"environment"    , optional_argument, NULL, 'E'},
+    {"interval"       , optional_argument, NULL, 'i'},
+    {"threshold"      , optional_argument, NULL, 't'},
+    {"max-migrations" , optional_argument, NULL, 'm'},
+    {"stdout-only"    , optional_argument, NULL, 's'},
+    {"help"           , optional_argument, NULL,'h'}};
+
+  while((option = getopt_long(argc, argv, "E:i:t:m:sh", long_options, NULL)) != -1) {
+    switch (option) {
+      case 'h':
+        print_options();
+        exit(0);
+
+      case 'E':
+        environment_name = optarg;
+        break;
+
+      case 'i':
+        interval_seconds = atoi(optarg);
+        break;
+
+      case 't':
+        threshold = atof(optarg);
+        break;
+
+      case 'm':
+        max_migrations = atoi(optarg);
+        break;
+
+      case 's':
+        stdout_only = true;
+        break;
+
+      default:
+          // Do nothing - we don't accept anything else
+        break;
+    }
+  }
+
+  if  ((environment_name != "UAT") && (environment_name != "PROD")) {
+    print_options();
+    exit(1);
+  }
+
+  if(threshold < 1.0) {
+    std::cout << "Threshold has to be at least 1.0.. exiting" << std::endl;
+    exit(1);
+  }
+
+  LogWorker *log_worker = new LogWorker("svc_md_coordinator", "All_Binance_Exchanges", environment_name, stdout_only);
+  Logger *logger = log_worker->get_new_logger("main");
+  RefDB *refdb = new RefDB(environment_name, logger);
+  refdb->get_all_exchanges_from_db();
+
+  MDCoordinator *coordinator = new MDCoordinator(log_worker->get_new_logger("coordinator"), interval_seconds, threshold, max_migrations);
+
+  // Newly listed instruments are picked up and delisted ones dropped on every refresh
+  while(1){
+      std::vector<uint32_t> instrument_ids = load_universe(refdb);
+      coordinator->set_universe(instrument_ids);
+      sleep(UNIVERSE_REFRESH_SECONDS);
+  }
+
+  delete(coordinator);
+  return(0);
+}
@@ -0,0 +1,213 @@
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "sequence_binary_files.hpp"
+#include "binary_file.hpp"
+#include "sim_matching_engine.hpp"
+#include "sim_server.hpp"
+
+#define SIM_DEFAULT_PORT            8443
+#define SIM_STATS_INTERVAL_MS       1000
+
+bool file_exists(const std::string& name) {
+  struct stat buffer;
+  return (stat (name.c_str(), &buffer) == 0);
+}
+
+void print_options(){
+    std::cout << "Options for svc_sim_binance:" << std::endl;
+    std::cout << "  -c (--cert) <PEM file>                                  = Server certificate (the adapter's tls_ca_file)" << std::endl;
+    std::cout << "  -k (--key) <PEM file>                                   = Private key of the certificate" << std::endl;
+    std::cout << "  [-p (--port) <PORT>]                                    = Port to listen on (default 8443)" << std::endl;
+    std::cout << "  [-F (--futures)]                                        = Simulate Binance futures (fapi), spot is the default" << std::endl;
+    std::cout << "  [-b (--binary_file) <binaryfilename>]                   = Binary File to replay (repeat for more files)" << std::endl;
+    std::cout << "  [-I (--instrument) <SYMBOL=INSTRUMENT_ID>]              = Symbol of a replayed instrument (repeat for more)" << std::endl;
+    std::cout << "  [-x (--speed) <MULTIPLIER>]                             = Replay speed, 0 replays as fast as it can (default 1)" << std::endl;
+    std::cout << "  [-l (--latency) <MICROS>]                               = Added to every REST and WS API request (default 0)" << std::endl;
+    std::cout << "  [-j (--jitter) <MICROS>]                                = Uniform jitter on top of the request latency (default 0)" << std::endl;
+    std::cout << "  [-w (--stream-latency) <MICROS>]                        = Delay of the user stream events (default 0)" << std::endl;
+    std::cout << "  [-r (--reject-rate) <0-1>]                              = Share of new orders to reject (default 0)" << std::endl;
+    std::cout << "  [-R (--cancel-reject-rate) <0-1>]                       = Share of cancels to reject (default 0)" << std::endl;
+    std::cout << "  [-h (--help)]                                           = Prints this message" << std::endl;
+}
+
+uint64_t get_monotonic_ts() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return((t.tv_sec*1000000000L)+t.tv_nsec);
+}
+
+// -----------------------------------------------------------------------
+// Feeds the top of book and trades of the binfiles to the engine, spaced out the way they were received
+// -----------------------------------------------------------------------
+void replay_market_data(SequenceBinaryFiles *seq_bin_files, SimMatchingEngine *engine, double speed) {
+    char *msg_ptr;
+    uint64_t first_receive_ts = 0;
+    uint64_t replay_start = get_monotonic_ts();
+    uint64_t num_messages = 0;
+    while(seq_bin_files->get_next_message(&msg_ptr)) {
+        struct MessageHeader *msg = (struct MessageHeader *) msg_ptr;
+        uint64_t receive_ts;
+        if(msg->msgType == TOB_UPDATE)
+            receive_ts = ((ToBUpdate *) msg_ptr)->receive_timestamp;
+        else if(msg->msgType == TRADE)
+            receive_ts = ((Trade *) msg_ptr)->receive_timestamp;
+        else
+            continue;
+
+        if(speed > 0.0){
+            if(first_receive_ts == 0)
+                first_receive_ts = receive_ts;
+            uint64_t due_ts = replay_start + (uint64_t) ((receive_ts - first_receive_ts) / speed);
+            uint64_t current_ts = get_monotonic_ts();
+            if(due_ts > current_ts)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due_ts - current_ts));
+        }
+        if(msg->msgType == TOB_UPDATE)
+            engine->on_tob((ToBUpdate *) msg_ptr);
+        else
+            engine->on_trade((Trade *) msg_ptr);
+        num_messages++;
+    }
+    std::cout << "Replay done after " << num_messages << " messages, the book stays as it was left" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+
+    std::vector<std::string> binary_filenames;
+    std::vector<std::string> instruments;
+    sim_config config = {SIM_DEFAULT_PORT, "", "", false, 0, 0, 0, 0.0, 0.0};
+    double speed = 1.0;
+
+    static struct option long_options[] = {
+        {"cert"                 , required_argument, NULL, 'c'},
+        {"key"                  , required_argument, NULL, 'k'},
+        {"port"                 , optional_argument, NULL, 'p'},
+        {"futures"              , optional_argument, NULL, 'F'},
+        {"binary_file"          , optional_argument, NULL, 'b'},
+        {"instrument"           , optional_argument, NULL, 'I'},
+        {"speed"                , optional_argument, NULL, 'x'},
+        {"latency"              , optional_argument, NULL, 'l'},
+        {"jitter"               , optional_argument, NULL, 'j'},
+        {"stream-latency"       , optional_argument, NULL, 'w'},
+        {"reject-rate"          , optional_argument, NULL, 'r'},
+        {"cancel-reject-rate"   , optional_argument, NULL, 'R'},
+        {"help"                 , optional_argument, NULL,'h'}};
+
+    int cmd_option;
+    while((cmd_option = getopt_long(argc,argv,"c:k:p:Fb:I:x:l:j:w:r:R:h", long_options, NULL)) != -1) {
+        switch (cmd_option) {
+            case 'h':
+            print_options();
+            exit(0);
+            break;
+
+            case 'c':
+            config.cert_file = optarg;
+            break;
+
+            case 'k':
+            config.key_file = optarg;
+            break;
+
+            case 'p':
+            config.port = atoi(optarg);
+            break;
+
+            case 'F':
+            config.futures = true;
+            break;
+
+            case 'b':
+            binary_filenames.push_back(std::string(optarg));
+            break;
+
+            case 'I':
+            instruments.push_back(std::string(optarg));
+            break;
+
+            case 'x':
+            speed = atof(optarg);
+            break;
+
+            case 'l':
+            config.request_latency_ns = std::stoull(optarg) * 1000;
+            break;
+
+            case 'j':
+            config.request_jitter_ns = std::stoull(optarg) * 1000;
+            break;
+
+            case 'w':
+            config.stream_latency_ns = std::stoull(optarg) * 1000;
+            break;
+
+            case 'r':
+            config.order_reject_rate = atof(optarg);
+            break;
+
+            case 'R':
+            config.cancel_reject_rate = atof(optarg);
+            break;
+        }
+    }
+
+    if(config.cert_file.empty() || config.key_file.empty()){
+        print_options();
+        exit(0);
+    }
+
+    SimServer *server = new SimServer(config);
+    SimMatchingEngine *engine = new SimMatchingEngine([server](sim_execution *execution) { server->on_execution(execution); });
+    server->set_engine(engine);
+
+    for(auto const& instrument: instruments) {
+        size_t equals = instrument.find('=');
+        if(equals == std::string::npos){
+            std::cout << "Instrument should be SYMBOL=INSTRUMENT_ID: " << instrument << std::endl;
+            exit(1);
+        }
+        engine->add_instrument(instrument.substr(0, equals), std::stoul(instrument.substr(equals + 1)));
+    }
+
+    if(! server->start())
+        exit(1);
+    std::cout << "Simulating Binance " << (config.futures ? "futures" : "spot") << " on port " << config.port << std::endl;
+
+    if(binary_filenames.size() > 0){
+        SequenceBinaryFiles *seq_bin_files = new SequenceBinaryFiles();
+        for(auto const& bin_filename: binary_filenames) {
+            if(file_exists(bin_filename))
+                seq_bin_files->add_binary_file(bin_filename, 0);
+            else
+                std::cout << "Filename: " << bin_filename << " does not exist" << std::endl;
+        }
+        std::thread(replay_market_data, seq_bin_files, engine, speed).detach();
+    }
+
+    sim_engine_stats last_engine_stats = {};
+    sim_server_stats last_server_stats = {};
+    while(true){
+        std::this_thread::sleep_for(std::chrono::milliseconds(SIM_STATS_INTERVAL_MS));
+        sim_engine_stats engine_stats = engine->get_stats();
+        sim_server_stats server_stats = server->get_stats();
+        std::cout << "requests/s: " << std::setw(6) << server_stats.num_requests - last_server_stats.num_requests;
+        std::cout << "  orders/s: " << std::setw(6) << engine_stats.num_orders - last_engine_stats.num_orders;
+        std::cout << "  cancels/s: " << std::setw(6) << engine_stats.num_cancels - last_engine_stats.num_cancels;
+        std::cout << "  fills/s: " << std::setw(6) << engine_stats.num_fills - last_engine_stats.num_fills;
+        std::cout << "  rejects/s: " << std::setw(4) << (engine_stats.num_rejects - last_engine_stats.num_rejects) +
+                                                        (server_stats.num_injected_rejects - last_server_stats.num_injected_rejects);
+        std::cout << "  market/s: " << std::setw(6) << engine_stats.num_market_updates - last_engine_stats.num_market_updates;
+        std::cout << "  open: " << engine_stats.num_open << "  streams: " << server_stats.num_sessions << std::endl;
+        last_engine_stats = engine_stats;
+        last_server_stats = server_stats;
+    }
+    return(0);
+}
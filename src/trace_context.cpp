@@ -0,0 +1,53 @@
+#include "trace_context.hpp"
+
+TraceRecorder::TraceRecorder(std::string process_name) {
+    latency_recorder = new LatencyRecorder(process_name);
+}
+
+std::string TraceRecorder::get_shm_name() {
+    return(latency_recorder->get_shm_name());
+}
+
+latency_slot *TraceRecorder::get_slot(uint32_t instrument_id, uint8_t stream_kind) {
+    MyGuard guard(recorder_lock);
+    return(latency_recorder->get_slot(instrument_id, stream_kind));
+}
+
+// -----------------------------------------------------------------------
+// Only when the trace got to both points
+// -----------------------------------------------------------------------
+void TraceRecorder::record_hop(latency_histogram *histogram, uint64_t from_ts, uint64_t to_ts) {
+    if((from_ts == 0) || (to_ts == 0))
+        return;
+    record_latency(histogram, (int64_t) (to_ts - from_ts));
+}
+
+// ########################################################################
+// PUBLIC METHODS
+// ########################################################################
+
+void TraceRecorder::record_ack(uint32_t instrument_id, TraceContext *trace) {
+    uint64_t *stamps = trace->stamps;
+    latency_slot *slot = get_slot(instrument_id, TRACE_STREAM_DECISION);
+    if(slot != nullptr){
+        record_hop(&slot->hops[0], trace->origin_receive_timestamp, stamps[TRACE_POINT_DECODE_PUBLISH]);
+        record_hop(&slot->hops[1], stamps[TRACE_POINT_DECODE_PUBLISH], stamps[TRACE_POINT_STRATEGY_SEND]);
+        record_hop(&slot->hops[2], stamps[TRACE_POINT_STRATEGY_SEND], stamps[TRACE_POINT_ADAPTER_RECEIVE]);
+    }
+    slot = get_slot(instrument_id, TRACE_STREAM_ORDER);
+    if(slot != nullptr){
+        record_hop(&slot->hops[0], stamps[TRACE_POINT_ADAPTER_RECEIVE], stamps[TRACE_POINT_ADAPTER_SEND]);
+        record_hop(&slot->hops[1], stamps[TRACE_POINT_ADAPTER_SEND], stamps[TRACE_POINT_EXCHANGE_ACK]);
+        record_hop(&slot->hops[2], trace->origin_receive_timestamp, stamps[TRACE_POINT_EXCHANGE_ACK]);
+    }
+}
+
+void TraceRecorder::record_fill(uint32_t instrument_id, TraceContext *trace) {
+    uint64_t *stamps = trace->stamps;
+    latency_slot *slot = get_slot(instrument_id, TRACE_STREAM_FILL);
+    if(slot != nullptr){
+        record_hop(&slot->hops[0], stamps[TRACE_POINT_ADAPTER_SEND], stamps[TRACE_POINT_FILL_RECEIVE]);
+        record_hop(&slot->hops[1], stamps[TRACE_POINT_EXCHANGE_ACK], stamps[TRACE_POINT_FILL_RECEIVE]);
+        record_hop(&slot->hops[2], trace->origin_receive_timestamp, stamps[TRACE_POINT_FILL_RECEIVE]);
+    }
+}
@@ -229,7 +229,10 @@ struct fd_info* WSock::connect_to_websocket(std::string websocket_URI, FileWrite
     connection_info->last_read_time = get_current_ts_ns();
     connection_info->last_epoll_time = get_current_ts_ns();
     connection_info->last_keepalive = get_current_ts_ns();
+    connection_info->connect_time = connection_info->last_read_time;
     memcpy(connection_info->connection_string, websocket_URI.c_str(), websocket_URI.length());
+    connection_info->is_depth = (websocket_URI.find("depth") != websocket_URI.npos);
+    connection_info->stream_kind = capture_stream_kind_from_uri(websocket_URI);
     connection_info->file_writer = _file_writer;
     connection_info->instrument_id = _instrument_id;
     connection_info->exchange_id = _exchange_id;
@@ -316,7 +319,7 @@ void WSock::process_subscription_requests() {
             auto current_ts = get_current_ts_ns();
             for (auto& it: socket_to_fd_info) {
                 long long int diff = current_ts - it.second->last_read_time;
-                if(std::abs(diff) > ((uint64_t) refresh_timeout * 1000000000L))
+                if((std::abs(diff) > ((uint64_t) refresh_timeout * 1000000000L)) && (! it.second->delete_me))
                 {
                     // We should really reconnect and ignore this one
                     std::string event_msg = "Reached max limit of no data - " + std::to_string(refresh_timeout) + " seconds - reconnecting to: " + std::string(it.second->connection_string);
@@ -362,8 +365,15 @@ void WSock::process_subscription_requests() {
 
             struct subscription_info *sub_info;
             if (subscription_ring.GetPopPtr(&sub_info)) {
-                // Process the subscription request
+                // Dropped again before we got to it - nothing to connect
+                uint16_t stream_bit = 1 << capture_stream_kind_from_uri(sub_info->websocket_URI);
+                if((sub_info->instrument_id != 0) && ! (get_subscribed_streams(sub_info->instrument_id) & stream_bit)){
+                    subscription_logger->msg(INFO, "Skipping dropped subscription: " + sub_info->websocket_URI);
+                    subscription_ring.incrTail();
+                    continue;
+                }
 
+                // Process the subscription request
                 subscription_logger->msg(INFO, "Subscribing to: " + sub_info->websocket_URI);
                 auto fd_info = connect_to_websocket(sub_info->websocket_URI, sub_info->_file_writer, sub_info->instrument_id, sub_info->exchange_id);
                 fd_info->pl_book = new MergedOrderbook();
@@ -498,6 +508,7 @@ int WSock::read() {
 bool WSock::send_pong(char *msg_ptr, int msg_len) {
     msg_ptr[0] = 128 + 10; // fin bit set and 10 = pong op_code
     msg_ptr[1] |= 1UL << 7;
+    MyGuard guard(current_fd_info->write_lock);
     write_ssl(msg_ptr, msg_len, current_fd_info);
     return(true);
 }
@@ -509,6 +520,7 @@ void WSock::send_keepalive_pong(fd_info *socket_info) {
     char pong_response[2];
     pong_response[0] = 128 + 10; // fin bit set and 10 = pong op_code
     pong_response[1] = 128;
+    MyGuard guard(socket_info->write_lock);
     write_ssl(pong_response, 2, socket_info);
 }
 
@@ -581,6 +593,7 @@ int WSock::ws_read() {
                 // We only send this to the parser if it is text and it is the final segment in the message
                 ws_messages[num_messages++] = std::string_view(message_char_ptr + offset, payload_length);
                 current_fd_info->last_read_time = message_receive_time;
+                current_fd_info->num_messages_received++;
             }
             else if (op_code == 2){
                 logger->msg(INFO, "Received binary data on: " + std::string(current_fd_info->connection_string));
@@ -637,7 +650,9 @@ void WSock::add_subscription_request(std::string websocket_URI, FileWriter *_fil
     struct subscription_info new_request;
     new_request.shared_sym_det = nullptr;
 
+    MyGuard guard(subscription_lock);
     if(instrument_id != 0){
+        subscribed_streams[instrument_id] |= 1 << capture_stream_kind_from_uri(websocket_URI);
         if(shared_sym_map.count(instrument_id) == 0) {
             auto new_sym_det = new shared_symbol_details();
             new_sym_det->current_ask_price = 0.0;
@@ -658,6 +673,37 @@ void WSock::add_subscription_request(std::string websocket_URI, FileWriter *_fil
     while(!subscription_ring.tryEnqueue(std::move(new_request)));
 }
 
+// -----------------------------------------------------------------------
+// Drops the given stream kinds (bit per CaptureStreamKind) for an instrument,
+// the sockets are closed by the subscription thread like any other delete
+// -----------------------------------------------------------------------
+void WSock::remove_subscriptions(uint32_t instrument_id, uint16_t stream_mask) {
+    subscription_lock.acquire_lock();
+    if(subscribed_streams.count(instrument_id))
+        subscribed_streams[instrument_id] &= ~stream_mask;
+    subscription_lock.release_lock();
+
+    fd_map_lock.acquire_lock();
+    for (auto const& [key, val] : socket_to_fd_info){
+        if((val->instrument_id == instrument_id) && (stream_mask & (1 << val->stream_kind)) && (! val->delete_me)){
+            subscription_logger->msg(INFO, "Dropping subscription: " + std::string(val->connection_string));
+            val->delete_me = true;
+        }
+    }
+    fd_map_lock.release_lock();
+}
+
+// -----------------------------------------------------------------------
+// Returns the stream kinds (bit per CaptureStreamKind) wanted for an instrument
+// -----------------------------------------------------------------------
+uint16_t WSock::get_subscribed_streams(uint32_t instrument_id) {
+    MyGuard guard(subscription_lock);
+    auto found = subscribed_streams.find(instrument_id);
+    if(found == subscribed_streams.end())
+        return(0);
+    return(found->second);
+}
+
 // -----------------------------------------------------------------------
 // Returns the receive time for the current message
 // -----------------------------------------------------------------------
@@ -694,6 +740,43 @@ std::string WSock::get_connection_string() {
     return(connection_string);
 }
 
+// -----------------------------------------------------------------------
+// Returns the stream kind (depth, trade etc) of the current socket
+// -----------------------------------------------------------------------
+uint8_t WSock::get_stream_kind() {
+    return(current_fd_info->stream_kind);
+}
+
+// -----------------------------------------------------------------------
+// Returns messages per second received on the socket since it connected
+// -----------------------------------------------------------------------
+double WSock::get_message_rate() {
+    uint64_t connected_ns = current_fd_info->last_read_time - current_fd_info->connect_time;
+    if(connected_ns < 1000000000L)
+        return((double) current_fd_info->num_messages_received);
+    return((double) current_fd_info->num_messages_received / ((double) connected_ns / 1000000000.0));
+}
+
+// -----------------------------------------------------------------------
+// Fills in message rate and depth sync state per instrument, one pass over all sockets
+// -----------------------------------------------------------------------
+void WSock::get_instrument_stats(std::unordered_map<uint32_t, instrument_socket_stats> &stats) {
+    uint64_t current_ts = get_current_ts_ns();
+    stats.clear();
+    fd_map_lock.acquire_lock();
+    for (auto const& [key, val] : socket_to_fd_info){
+        if(val->delete_me || (val->instrument_id == 0))
+            continue;
+        instrument_socket_stats &instrument_stats = stats[val->instrument_id];
+        uint64_t connected_ns = current_ts - val->connect_time;
+        if(connected_ns >= 1000000000L)
+            instrument_stats.message_rate += (double) val->num_messages_received / ((double) connected_ns / 1000000000.0);
+        if(val->is_depth && ! val->in_shapshot_state && (val->last_end_sequence_number != 0))
+            instrument_stats.synced = true;
+    }
+    fd_map_lock.release_lock();
+}
+
 // -----------------------------------------------------------------------
 // Sets the current sequence number of the active socket
 // -----------------------------------------------------------------------
@@ -796,6 +879,7 @@ void WSock::release_plbook_lock() {
 void WSock::process_plbook_update(PLUpdates *pl_update){
     aquire_plbook_lock();
     current_fd_info->pl_book->process_update(pl_update);
+    current_fd_info->pl_book_version = ++book_version_counter;
     release_plbook_lock();
 }
 
@@ -805,7 +889,35 @@ void WSock::process_plbook_update(PLUpdates *pl_update){
 void WSock::clear_plbook(){
     aquire_plbook_lock();
     current_fd_info->pl_book->clear_orderbook();
+    current_fd_info->pl_book_version = ++book_version_counter;
+    release_plbook_lock();
+}
+
+// -----------------------------------------------------------------------
+// Copies the best x levels of one side of the current PL Orderbook, best
+// first. Returns the number of levels copied.
+// -----------------------------------------------------------------------
+int WSock::get_plbook_levels(uint8_t side, int x, PriceLevelDetails *levels){
+    int num_levels = 0;
+    level_map.clear();
+    aquire_plbook_lock();
+    current_fd_info->pl_book->get_x_price_levels(side, x, &level_map);
+    auto copy_level = [&](double price, PLInfo *info) {
+        levels[num_levels].price_level = price;
+        levels[num_levels].quantity = info->qty;
+        levels[num_levels].side = side;
+        num_levels++;
+    };
+    // Map is ordered by price, the best bid is at the end
+    if(side == BUY_SIDE){
+        for(auto it = level_map.rbegin(); (it != level_map.rend()) && (num_levels < x); it++)
+            copy_level(it->first, it->second);
+    } else {
+        for(auto it = level_map.begin(); (it != level_map.end()) && (num_levels < x); it++)
+            copy_level(it->first, it->second);
+    }
     release_plbook_lock();
+    return(num_levels);
 }
 
 // -----------------------------------------------------------------------
@@ -815,26 +927,106 @@ int WSock::num_sockets() {
     return(socket_to_fd_info.size());
 }
 
+// -----------------------------------------------------------------------
+// Finds the depth socket for the instrument, fd_map_lock has to be held by the caller
+// -----------------------------------------------------------------------
+struct fd_info* WSock::find_depth_socket(uint32_t instrument_id){
+    for (auto const& [key, val] : socket_to_fd_info){
+        if((val->instrument_id == instrument_id) && val->is_depth && (! val->delete_me))
+            return(val);
+    }
+    return(nullptr);
+}
+
+// -----------------------------------------------------------------------
+// Finds the live socket added for the exchange, fd_map_lock has to be held by the caller
+// -----------------------------------------------------------------------
+struct fd_info* WSock::find_exchange_socket(uint8_t exchange_id){
+    for (auto const& [key, val] : socket_to_fd_info){
+        if((val->exchange_id == exchange_id) && (! val->delete_me))
+            return(val);
+    }
+    return(nullptr);
+}
+
+// -----------------------------------------------------------------------
+// Sends a text frame on the exchange socket, false if it isn't connected
+// Client frames have to be masked - the key is all zeros so the payload goes out as it is
+// -----------------------------------------------------------------------
+bool WSock::send_text_message(uint8_t exchange_id, const char *payload, uint32_t length){
+    char frame[MAX_SEND_FRAME_SIZE];
+    int header_length = 2;
+
+    if((length + 8) > MAX_SEND_FRAME_SIZE){
+        logger->msg(ERROR, "Message too large for a websocket frame: " + std::to_string(length));
+        return(false);
+    }
+
+    frame[0] = 128 + 1; // fin bit set and 1 = text op_code
+    if(length < 126){
+        frame[1] = 128 + length;
+    } else {
+        frame[1] = 128 + 126;
+        *((uint16_t *) (frame + 2)) = htobe16(length);
+        header_length += 2;
+    }
+    memset(frame + header_length, 0, 4);
+    header_length += 4;
+    memcpy(frame + header_length, payload, length);
+
+    bool sent = false;
+    fd_map_lock.acquire_lock();
+    struct fd_info *socket_info = find_exchange_socket(exchange_id);
+    if(socket_info != nullptr){
+        MyGuard guard(socket_info->write_lock);
+        sent = (write_ssl(frame, header_length + length, socket_info) == (int) (header_length + length));
+    }
+    fd_map_lock.release_lock();
+    return(sent);
+}
+
+// -----------------------------------------------------------------------
+// True if there is a socket for the exchange that isn't being torn down
+// -----------------------------------------------------------------------
+bool WSock::is_connected(uint8_t exchange_id){
+    MyGuard guard(fd_map_lock);
+    return(find_exchange_socket(exchange_id) != nullptr);
+}
+
 // -----------------------------------------------------------------------
 // Iterate over items in fdsocket into and generate snapshot into given snapshot buffer
 // This is used by the snapshot thread from the publisher.
-// Returns the number of messages in the snapshot
+// Returns the number of messages in the snapshot, book_version (if given) is set to
+// the version of the book the snapshot was built from
 // -----------------------------------------------------------------------
-int WSock::get_snapshot(char *snap_buffer, uint32_t instrument_id){
+int WSock::get_snapshot(char *snap_buffer, uint32_t instrument_id, uint64_t *book_version){
     int num_messages = 0;
-    std::unordered_map<int, struct fd_info*>::iterator it;
     fd_map_lock.acquire_lock();
-    for (it = socket_to_fd_info.begin(); it != socket_to_fd_info.end(); it++) {
-        if((it->second->instrument_id == instrument_id)){
-            auto connection = std::string(it->second->connection_string);
-            if(connection.find("depth") != connection.npos) {
-                it->second->pl_lock.acquire_lock();
-                num_messages = it->second->pl_book->build_snapshot_from_current_book(snap_buffer);
-                it->second->pl_lock.release_lock();
-                break;
-            }            
-        }
+    struct fd_info *depth_info = find_depth_socket(instrument_id);
+    if(depth_info != nullptr){
+        depth_info->pl_lock.acquire_lock();
+        num_messages = depth_info->pl_book->build_snapshot_from_current_book(snap_buffer);
+        if(book_version != nullptr)
+            *book_version = depth_info->pl_book_version;
+        depth_info->pl_lock.release_lock();
     }
     fd_map_lock.release_lock();
     return(num_messages);
-}
\ No newline at end of file
+}
+
+// -----------------------------------------------------------------------
+// Returns the number of updates applied to the instrument book so far (0 if no book)
+// Cheap way for the snapshot thread to tell if a cached snapshot is still valid
+// -----------------------------------------------------------------------
+uint64_t WSock::get_book_version(uint32_t instrument_id){
+    uint64_t book_version = 0;
+    fd_map_lock.acquire_lock();
+    struct fd_info *depth_info = find_depth_socket(instrument_id);
+    if(depth_info != nullptr){
+        depth_info->pl_lock.acquire_lock();
+        book_version = depth_info->pl_book_version;
+        depth_info->pl_lock.release_lock();
+    }
+    fd_map_lock.release_lock();
+    return(book_version);
+}